@@ -6,6 +6,7 @@
 #include "SoLKalTrackSystem.h"
 #include "SoLKalTrackSite.h"
 #include "SoLKalTrackState.h"
+#include "SoLKalTrackArena.h"
 #define MAXHITGEM 1500
 #define MAXSEED 10000
 PVDISKalTrackFinder::PVDISKalTrackFinder(bool isMC)
@@ -16,8 +17,7 @@ PVDISKalTrackFinder::PVDISKalTrackFinder(bool isMC)
   fTargetCenter  =  0.1;
   fTargetLength  =  0.4;
   fGEMTracker.clear();
-  fWindowHits.clear();
-  fWindowHits.reserve(MAXWINDOWHIT);
+  fNHitsCovWindow = 2; //the hit window follows the prediction from the second hit on
 }
 //_____________________________________________________________________________
 PVDISKalTrackFinder::~PVDISKalTrackFinder()
@@ -33,6 +33,7 @@ void PVDISKalTrackFinder::Clear( Option_t* opt )
   fCoarseTracks->Delete();
 
   fCoarseTracks->Clear(opt);
+  fArena->Reset();
 
   fCaloHits = nullptr;
   fNSeeds = 0;
@@ -229,13 +230,13 @@ void PVDISKalTrackFinder::MergeSeed()
             thisSystem->Add(&initSite);
 
             //remember finding tracks always go backward
-            SoLKalTrackSite& backSite = *new SoLKalTrackSite(fSeedPool[kMidBack].at(i).hitb, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+            SoLKalTrackSite& backSite = *fArena->NewSite(fSeedPool[kMidBack].at(i).hitb, kMdim*fChi2PerNDFCut);
             if (!(thisSystem->AddAndFilter(backSite))) thisSystem->SetTrackStatus(false);
 
-            SoLKalTrackSite& midSite = *new SoLKalTrackSite(fSeedPool[kMidBack].at(i).hita, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+            SoLKalTrackSite& midSite = *fArena->NewSite(fSeedPool[kMidBack].at(i).hita, kMdim*fChi2PerNDFCut);
             if (!(thisSystem->AddAndFilter(midSite))) thisSystem->SetTrackStatus(false);
 
-            SoLKalTrackSite& frontSite = *new SoLKalTrackSite(fSeedPool[kFrontBack].at(k).hita, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+            SoLKalTrackSite& frontSite = *fArena->NewSite(fSeedPool[kFrontBack].at(k).hita, kMdim*fChi2PerNDFCut);
             if (!(thisSystem->AddAndFilter(frontSite))) thisSystem->SetTrackStatus(false);
           }
         }
@@ -263,10 +264,10 @@ void PVDISKalTrackFinder::MergeSeed()
       //of a triplet seed and thus be set as inactived already)
       thisSystem->AddMissingHits();
 
-      SoLKalTrackSite& backSite = *new SoLKalTrackSite(thisVector.at(i).hitb, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+      SoLKalTrackSite& backSite = *fArena->NewSite(thisVector.at(i).hitb, kMdim*fChi2PerNDFCut);
       if (!(thisSystem->AddAndFilter(backSite))) thisSystem->SetTrackStatus(false);
 
-      SoLKalTrackSite& midSite = *new SoLKalTrackSite(thisVector.at(i).hita, kMdim, kSdim,  kMdim*fChi2PerNDFCut);
+      SoLKalTrackSite& midSite = *fArena->NewSite(thisVector.at(i).hita, kMdim*fChi2PerNDFCut);
       if (!(thisSystem->AddAndFilter(midSite))) thisSystem->SetTrackStatus(false);
     }
   }
@@ -274,71 +275,13 @@ void PVDISKalTrackFinder::MergeSeed()
 //______________________________________________________________________________
 void PVDISKalTrackFinder::TrackFollow()
 {
-    //this function is responsible for propagating the seed track toward the next tracker, find suitable hits
+  //this function is responsible for propagating the seed track toward the next tracker, find suitable hits
   //the process stop until the track reach the first tracker upstream (track searching always go backward)
+  FollowTracks();
 
-  for (Int_t i=0; i<fCoarseTracks->GetLast()+1; i++){
+  for (Int_t i=0; i<(Int_t)fFollowStart.size(); i++){
+    if (fFollowStart[i] < 0) continue;
     SoLKalTrackSystem* thisSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(i));
-    thisSystem->CheckTrackStatus();
-    if (!thisSystem->GetTrackStatus()) continue; //skip the bad tracks
-
-    thisSystem->SetCurInstancePtr(thisSystem);
-    Int_t currentTracker = ((thisSystem->GetCurSite()).GetHit())->GetTrackerID();
-
-    //seed from type kMidBack will skip the front seed plane. We assume for this type of seed, the hit on the
-    //front seed plane is missing, (otherwise the seed should be absorbed into the triplet seed)
-    if (thisSystem->GetSeedType() == kMidBack) currentTracker--;
-
-    while (currentTracker > 0){
-      currentTracker--;
-
-      thisSystem->CheckTrackStatus();
-      if (!thisSystem->GetTrackStatus()) break; //skip the bad tracks
-
-      SoLKalTrackState currentState = (thisSystem->GetCurSite()).GetCurState();
-      currentState.InitPredictSV();
-      SoLKalTrackState *predictState = currentState.PredictSVatNextZ(fGEMTracker[currentTracker]->GetZ());
-
-      bool flag = (thisSystem->GetNHits() >= 2);
-
-      int size = GetHitsInWindow(currentTracker, (*predictState)(kIdxX0, 0), (predictState->GetCovMat())(kIdxX0, kIdxX0),
-                                (*predictState)(kIdxY0, 0), (predictState->GetCovMat())(kIdxY0, kIdxY0), flag);
-
-
-      if (size <= 0){
-
-        thisSystem->AddMissingHits();
-
-      }
-      else if (size == 1){
-        SoLKalTrackSite &newSite = *new SoLKalTrackSite(fWindowHits.at(0), kMdim, kSdim, kMdim*fChi2PerNDFCut);
-        newSite.Add(predictState);
-        if (newSite.Filter()){
-          thisSystem->Add(&newSite);
-          thisSystem->IncreaseChi2(newSite.GetDeltaChi2());
-          currentState.ClearAttemptSV();
-        }
-        else{
-          thisSystem->AddMissingHits();
-        }
-
-      }
-      else{
-        //find the cloest one for now, should use concurrent tracking in the future
-        SoLKalTrackSite &newSite = *new SoLKalTrackSite(FindCloestHitInWindow((*predictState)(kIdxX0, 0),
-                                    (*predictState)(kIdxY0, 0)), kMdim, kSdim,  kMdim*fChi2PerNDFCut);
-        newSite.Add(predictState);
-        if (newSite.Filter()){
-          thisSystem->Add(&newSite);
-          thisSystem->IncreaseChi2(newSite.GetDeltaChi2());
-          currentState.ClearAttemptSV();
-        }
-        else{
-          thisSystem->AddMissingHits();
-        }
-
-      }
-    }
 
     //now that we have all the hits selected, we can look at the chi2 per ndf and charge asymmetry to
     //get rid of some potential bad tracks, before doing other things
@@ -362,6 +305,8 @@ void PVDISKalTrackFinder::TrackFollow()
     //---------------------------------------------------//
 #endif
   }
+  //the branches cut here no longer hold the sites of the others
+  if (fMaxBranches > 1) ReleaseBadTracks();
 }
 //______________________________________________________________________________
 void PVDISKalTrackFinder::FindandAddVertex()
@@ -376,6 +321,8 @@ void PVDISKalTrackFinder::FindandAddVertex()
       SoLKalTrackState currentState = (thisSystem->GetCurSite()).GetCurState();
       currentState.InitPredictSV();
 
+      //full prediction, the one at the vertex continues from this state and
+      //needs its propagator and process noise
       SoLKalTrackState *predictState = currentState.PredictSVatNextZ(fTargetCenter);
       Double_t vertexz = FindVertexZ(predictState);
 
@@ -390,7 +337,7 @@ void PVDISKalTrackFinder::FindandAddVertex()
       predictState = currentState.PredictSVatNextZ(vertexz);
 
       //make a site at the interaction vertex to add to the fitting
-      SoLKalTrackSite &vertexSite = *new SoLKalTrackSite(kMdim, kSdim,  kGiga);
+      SoLKalTrackSite &vertexSite = *fArena->NewSite(kGiga);
       vertexSite.SetMeasurement(fBPMX, fBPMY);
       vertexSite.SetHitResolution(3e-4, 3e-4);
       vertexSite.Add(predictState);
@@ -414,7 +361,6 @@ void PVDISKalTrackFinder::FindandAddVertex()
         thisSystem->SetPhi(atan2(vertex_vdir.Y(), vertex_vdir.X()));
       }
       currentState.ClearAttemptSV();
-      delete &vertexSite;
    }
 }
 //______________________________________________________________________________
@@ -522,29 +468,16 @@ inline SoLKalTrackSite & PVDISKalTrackFinder::SiteInitWithSeed(DoubletSeed* this
   C(kIdxTY, kIdxTY) = 0.001;
   C(kIdxQP, kIdxQP) = 0.0025;
 
-  SoLKalTrackSite& initSite = *new SoLKalTrackSite(thisSeed->hitb, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+  SoLKalTrackSite& initSite = *fArena->NewSite(thisSeed->hitb, kMdim*fChi2PerNDFCut);
 
-  initSite.Add(new SoLKalTrackState(svd, C, initSite, SoLKalTrackSite::kPredicted));
-  initSite.Add(new SoLKalTrackState(svd, C, initSite, SoLKalTrackSite::kFiltered));
+  initSite.Add(fArena->NewState(svd, C, initSite, SoLKalTrackSite::kPredicted));
+  initSite.Add(fArena->NewState(svd, C, initSite, SoLKalTrackSite::kFiltered));
   initSite.SetHitResolution(kGiga, kGiga); //give it a very large resolution (100m) since it is a virtual site
 
   return initSite;
 }
 //______________________________________________________________________________________
-inline SoLIDGEMHit* PVDISKalTrackFinder::FindCloestHitInWindow(double &x, double &y){
-  double minD = kGiga;
-  SoLIDGEMHit *minHit = nullptr;
-  for (unsigned int i=0; i<fWindowHits.size(); i++){
-    double r = sqrt(pow(x - fWindowHits.at(i)->GetX(), 2) + pow(y - fWindowHits.at(i)->GetY(), 2));
-     if (r < minD) {
-       minHit = fWindowHits.at(i);
-       minD = r;
-     }
-   }
-   return minHit;
-}
-//______________________________________________________________________________________
-inline int PVDISKalTrackFinder::GetHitsInWindow(int plane, double x, double wx, double y, double wy, bool flag)
+int PVDISKalTrackFinder::GetHitsInWindow(int plane, double x, double wx, double y, double wy, bool flag)
 {
   assert(plane >= 0);
   fWindowHits.clear();
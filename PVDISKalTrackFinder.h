@@ -56,7 +56,6 @@ protected:
   Double_t   StraightLinePredict(const Double_t& x1, const Double_t& z1, const Double_t& x2, 
                                  const Double_t& z2, const Double_t& targetZ);
   int GetHitsInWindow(int plane, double x, double wx, double y, double wy, bool flag = false);
-  SoLIDGEMHit* FindCloestHitInWindow(double &x, double &y);
   Bool_t CheckChargeAsy(SoLKalTrackSystem* theSystem);
   Double_t FindVertexZ(SoLKalTrackState* thisState);
   void CopyTrack(SoLIDTrack* soltrack, SoLKalTrackSystem* kaltrack);  
@@ -68,7 +67,6 @@ protected:
   Double_t fRefPhi;
   Double_t fRefSin;
   Double_t fRefCos;
-  vector<SoLIDGEMHit*> fWindowHits;
   map< Int_t, vector<SoLIDGEMHit*> > fGoodHits;
   Int_t fNGoodTrack;
 };
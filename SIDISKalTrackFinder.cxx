@@ -7,6 +7,7 @@
 #include "SoLKalTrackSystem.h"
 #include "SoLKalTrackSite.h"
 #include "SoLKalTrackState.h"
+#include "SoLKalTrackArena.h"
 
 //these should definitely need to go to the database
 #define MAXNTRACKS_FAEC 1000
@@ -19,8 +20,6 @@ SIDISKalTrackFinder::SIDISKalTrackFinder(bool isMC)
 {
   fGEMTracker.clear();
   
-  fWindowHits.clear();
-  fWindowHits.reserve(MAXWINDOWHIT);
   fTargetPlaneZ = -3.2;
   fTargetCenter = -3.5;
   fTargetLength =  0.4;
@@ -45,6 +44,7 @@ void SIDISKalTrackFinder::Clear( Option_t* opt )
    fCoarseTracks->Delete();
   
   fCoarseTracks->Clear(opt);
+  fArena->Reset();
   
   fCaloHits = nullptr;
   fNSeeds = 0;
@@ -105,6 +105,7 @@ void SIDISKalTrackFinder::FindDoubletSeed(Int_t planej, Int_t planek, ECType typ
   double dphi, dr;
   SeedType seedType = kMidBack;
   int countSeed = 0;
+  fSeedCandidates.clear();
   
   double charge = 0;
   if (type == kFAEC){
@@ -211,76 +212,104 @@ void SIDISKalTrackFinder::FindDoubletSeed(Int_t planej, Int_t planek, ECType typ
           if (initMom > 12. || initMom < 0.8) continue;
           
           
-          TVector3 initDir(cos(initPhi), sin(initPhi), 1./tan(initTheta));
-          initDir = initDir.Unit();
-		      TVector3 initMomentum = initMom*initDir;
-		      TVector3 initPosition(hitk->GetX(), hitk->GetY(), hitk->GetZ());
-		      TVector3 finalMomentum;
-          TVector3 finalPosition;
-          Double_t stepSize = 1.;
-          
-          Bool_t isSeed = false;
-          Double_t toZ = fECal->GetECZ(type);
-		      if (type == kFAEC){
-        
-            fFieldStepper->PropagationClassicalRK4(initMomentum, initPosition, toZ, 
-                                               charge, stepSize, finalMomentum, finalPosition);
-            for (UInt_t ec_count=0; ec_count<fCaloHits->size(); ec_count++){
-	            if (fCaloHits->at(ec_count).fECID != kFAEC) continue; //not FAEC hit
-	            if (sqrt( pow(finalPosition.X() - fCaloHits->at(ec_count).fXPos, 2) +  
-	                  pow(finalPosition.Y() - fCaloHits->at(ec_count).fYPos, 2) ) < 0.2 ) isSeed = true;
-	          } 
-		      }
-		      else if (type == kLAEC){
-            fFieldStepper->PropagationClassicalRK4(initMomentum, initPosition, toZ, 
-                                               charge, stepSize, finalMomentum, finalPosition);
-            for (UInt_t ec_count=0; ec_count<fCaloHits->size(); ec_count++){
-	            if (fCaloHits->at(ec_count).fECID != kLAEC) continue; //not FAEC hit
-	            if (sqrt( pow(finalPosition.X() - fCaloHits->at(ec_count).fXPos, 2) +  
-	                  pow(finalPosition.Y() - fCaloHits->at(ec_count).fYPos, 2) ) < 0.06 ) isSeed = true;
-	          } 
-		      }
-		      if (type == kFAEC && !isSeed) continue;
-          
-          
-          fFieldStepper->PropagationClassicalRK4(initMomentum, initPosition, 
-                                             fTargetCenter, charge, stepSize, finalMomentum, finalPosition);
-      
-          double tx = finalMomentum.X()/finalMomentum.Z();
-          double ty = finalMomentum.Y()/finalMomentum.Z();
-		      double ReconZ = fTargetCenter + (1./(pow(tx,2) + pow(ty,2)))*
-                       (tx*(fBPMX-finalPosition.X()) + ty*(fBPMY-finalPosition.Y()) );
+          //the pair is a candidate, the propagations to the ECal and to the
+          //target are done for a batch of candidates together
+          fSeedCandidates.push_back(DoubletSeed(seedType, hitj, hitk, initMom, initTheta, initPhi, charge, type));
+          if (fSeedCandidates.size() >= SEEDBATCHSIZE && !PropagateSeedCandidates(countSeed, type)) return;
+        }
+      }
       
-          if (type == kFAEC && (ReconZ > fTargetCenter + 0.5 || ReconZ < fTargetCenter - 0.5) ) continue;
-          if (type == kLAEC && (ReconZ > fTargetCenter + 0.4 || ReconZ < fTargetCenter - 0.4) ) continue;
-          
-          
-          //so the hit pairs has passed all the cuts, now we can save it into a container and waiting for merge
-          countSeed++;
-          map< SeedType, vector<DoubletSeed> >::iterator it = fSeedPool.find(seedType);
+    }
+  }
+  PropagateSeedCandidates(countSeed, type);
+}
+//___________________________________________________________________________________________________________________
+Bool_t SIDISKalTrackFinder::PropagateSeedCandidates(Int_t &countSeed, ECType type)
+{
+  //the candidates of FindDoubletSeed go to the ECal, those that match an ECal
+  //hit then to the target. The cuts and the seed limit are applied in the
+  //order the candidates were found, returns kFALSE once the limit is reached
+  Double_t toZ = fECal->GetECZ(type);
+  fECalBatch.Clear();
+  for (UInt_t i=0; i<fSeedCandidates.size(); i++){
+    DoubletSeed & seed = fSeedCandidates[i];
+    TVector3 initDir(cos(seed.initPhi), sin(seed.initPhi), 1./tan(seed.initTheta));
+    initDir = initDir.Unit();
+    TVector3 initMomentum = seed.initMom*initDir;
+    TVector3 initPosition(seed.hitb->GetX(), seed.hitb->GetY(), seed.hitb->GetZ());
+    fECalBatch.Add(initPosition, initMomentum, seed.charge);
+  }
+  fFieldStepper->ExtrapolateSeeds(fECalBatch, toZ);
+
+  TVector3 initMomentum, initPosition, finalMomentum, finalPosition;
+  fTargetBatch.Clear();
+  fTargetCandidates.clear();
+  for (Int_t i=0; i<fECalBatch.GetN(); i++){
+    fECalBatch.GetFinal(i, finalPosition, finalMomentum);
+    Bool_t isSeed = false;
+    if (type == kFAEC){
+      for (UInt_t ec_count=0; ec_count<fCaloHits->size(); ec_count++){
+        if (fCaloHits->at(ec_count).fECID != kFAEC) continue; //not FAEC hit
+        if (sqrt( pow(finalPosition.X() - fCaloHits->at(ec_count).fXPos, 2) +  
+              pow(finalPosition.Y() - fCaloHits->at(ec_count).fYPos, 2) ) < 0.2 ) isSeed = true;
+      } 
+    }
+    else if (type == kLAEC){
+      for (UInt_t ec_count=0; ec_count<fCaloHits->size(); ec_count++){
+        if (fCaloHits->at(ec_count).fECID != kLAEC) continue; //not FAEC hit
+        if (sqrt( pow(finalPosition.X() - fCaloHits->at(ec_count).fXPos, 2) +  
+              pow(finalPosition.Y() - fCaloHits->at(ec_count).fYPos, 2) ) < 0.06 ) isSeed = true;
+      } 
+    }
+    if (type == kFAEC && !isSeed) continue;
+
+    fECalBatch.GetStart(i, initPosition, initMomentum);
+    fTargetBatch.Add(initPosition, initMomentum, fECalBatch.fCharge[i]);
+    fTargetCandidates.push_back(i);
+  }
+  fFieldStepper->ExtrapolateSeeds(fTargetBatch, fTargetCenter);
+
+  Bool_t belowLimit = kTRUE;
+  for (Int_t j=0; j<fTargetBatch.GetN(); j++){
+    //if the number seeds already exceed the limit, terminate the seed finding process
+    if (countSeed > MAXNSEEDS){
+      belowLimit = kFALSE;
+      break;
+    }
+    DoubletSeed & seed = fSeedCandidates[fTargetCandidates[j]];
+    fTargetBatch.GetFinal(j, finalPosition, finalMomentum);
     
-          if (it != fSeedPool.end()){
-            (it->second).push_back(DoubletSeed(seedType, hitj, hitk, initMom, initTheta, initPhi, charge, type));
-          }
-          else{
-            cout<<"should never happen, fSeedPool should be init in constructor"<<endl;
-            vector<DoubletSeed> thisVector;
-            thisVector.push_back(DoubletSeed(seedType, hitj, hitk, initMom, initTheta, initPhi, charge, type));
-            fSeedPool.insert(std::pair< SeedType, vector<DoubletSeed> >(seedType, thisVector));
-          }
+    double tx = finalMomentum.X()/finalMomentum.Z();
+    double ty = finalMomentum.Y()/finalMomentum.Z();
+    double ReconZ = fTargetCenter + (1./(pow(tx,2) + pow(ty,2)))*
+                    (tx*(fBPMX-finalPosition.X()) + ty*(fBPMY-finalPosition.Y()) );
+    
+    if (type == kFAEC && (ReconZ > fTargetCenter + 0.5 || ReconZ < fTargetCenter - 0.5) ) continue;
+    if (type == kLAEC && (ReconZ > fTargetCenter + 0.4 || ReconZ < fTargetCenter - 0.4) ) continue;
+    
+    //so the hit pairs has passed all the cuts, now we can save it into a container and waiting for merge
+    countSeed++;
+    map< SeedType, vector<DoubletSeed> >::iterator it = fSeedPool.find(seed.type);
+    
+    if (it != fSeedPool.end()){
+      (it->second).push_back(seed);
+    }
+    else{
+      cout<<"should never happen, fSeedPool should be init in constructor"<<endl;
+      vector<DoubletSeed> thisVector;
+      thisVector.push_back(seed);
+      fSeedPool.insert(std::pair< SeedType, vector<DoubletSeed> >(seed.type, thisVector));
+    }
 #ifdef MCDATA
-          if (dynamic_cast<SoLIDMCGEMHit*>(hitj)->IsSignalHit() == 1 && dynamic_cast<SoLIDMCGEMHit*>(hitk)->IsSignalHit() == 1)
-          fSeedEfficiency[0] = true;
+    if (dynamic_cast<SoLIDMCGEMHit*>(seed.hita)->IsSignalHit() == 1 && dynamic_cast<SoLIDMCGEMHit*>(seed.hitb)->IsSignalHit() == 1)
+    fSeedEfficiency[0] = true;
 
-          if (dynamic_cast<SoLIDMCGEMHit*>(hitj)->IsSignalHit() == 2 && dynamic_cast<SoLIDMCGEMHit*>(hitk)->IsSignalHit() == 2)
-          fSeedEfficiency[1] = true;
+    if (dynamic_cast<SoLIDMCGEMHit*>(seed.hita)->IsSignalHit() == 2 && dynamic_cast<SoLIDMCGEMHit*>(seed.hitb)->IsSignalHit() == 2)
+    fSeedEfficiency[1] = true;
 #endif
-        }
-      }
-      
-    }
   }
-  
+  fSeedCandidates.clear();
+  return belowLimit;
 }
 //___________________________________________________________________________________________________________________
 void SIDISKalTrackFinder::MergeSeed()
@@ -312,13 +341,13 @@ void SIDISKalTrackFinder::MergeSeed()
             thisSystem->Add(&initSite);
       
             //remember finding tracks always go backward
-            SoLKalTrackSite& backSite = *new SoLKalTrackSite(fSeedPool[kMidBack].at(i).hitb, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+            SoLKalTrackSite& backSite = *fArena->NewSite(fSeedPool[kMidBack].at(i).hitb, kMdim*fChi2PerNDFCut);
             if (!(thisSystem->AddAndFilter(backSite))) thisSystem->SetTrackStatus(false);
       
-            SoLKalTrackSite& midSite = *new SoLKalTrackSite(fSeedPool[kMidBack].at(i).hita, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+            SoLKalTrackSite& midSite = *fArena->NewSite(fSeedPool[kMidBack].at(i).hita, kMdim*fChi2PerNDFCut);
             if (!(thisSystem->AddAndFilter(midSite))) thisSystem->SetTrackStatus(false);
       
-            SoLKalTrackSite& frontSite = *new SoLKalTrackSite(fSeedPool[kFrontBack].at(k).hita, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+            SoLKalTrackSite& frontSite = *fArena->NewSite(fSeedPool[kFrontBack].at(k).hita, kMdim*fChi2PerNDFCut);
             if (!(thisSystem->AddAndFilter(frontSite))) thisSystem->SetTrackStatus(false);
 		         
           }
@@ -346,10 +375,10 @@ void SIDISKalTrackFinder::MergeSeed()
       //of a triplet seed and thus be set as inactived already)
       thisSystem->AddMissingHits();
     
-      SoLKalTrackSite& backSite = *new SoLKalTrackSite(thisVector.at(i).hitb, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+      SoLKalTrackSite& backSite = *fArena->NewSite(thisVector.at(i).hitb, kMdim*fChi2PerNDFCut);
       if (!(thisSystem->AddAndFilter(backSite))) thisSystem->SetTrackStatus(false);
       
-      SoLKalTrackSite& midSite = *new SoLKalTrackSite(thisVector.at(i).hita, kMdim, kSdim,  kMdim*fChi2PerNDFCut);
+      SoLKalTrackSite& midSite = *fArena->NewSite(thisVector.at(i).hita, kMdim*fChi2PerNDFCut);
       if (!(thisSystem->AddAndFilter(midSite))) thisSystem->SetTrackStatus(false);
     }
     
@@ -361,91 +390,11 @@ void SIDISKalTrackFinder::TrackFollow()
 {
   //this function is responsible for propagating the seed track toward the next tracker, find suitable hits
   //the process stop until the track reach the first tracker upstream (track searching always go backward)
+  FollowTracks();
   
-  for (Int_t i=0; i<fCoarseTracks->GetLast()+1; i++){
+  for (Int_t i=0; i<(Int_t)fFollowStart.size(); i++){
+    if (fFollowStart[i] < 0) continue;
     SoLKalTrackSystem* thisSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(i));
-    thisSystem->CheckTrackStatus();
-    if (!thisSystem->GetTrackStatus()) continue; //skip the bad tracks
-    //--------------------for test----------------------//
-      /*SoLKalTrackSystem *newSystem = (SoLKalTrackSystem*)thisSystem->Clone();
-      cout<<"chi2: "<<newSystem->GetChi2()<<" "<<thisSystem->GetChi2()<<endl;
-      cout<<"mass: "<<newSystem->GetMass()<<" "<<thisSystem->GetMass()<<endl;
-      cout<<"state x: "<<(newSystem->GetCurSite()).GetCurState()(0, 0)<<" "<<(thisSystem->GetCurSite()).GetCurState()(0, 0)<<endl;
-      cout<<"state x: "<<(newSystem->GetCurSite()).GetCurState()(1, 0)<<" "<<(thisSystem->GetCurSite()).GetCurState()(1, 0)<<endl;
-      cout<<"state x: "<<(newSystem->GetCurSite()).GetCurState().GetZ0()<<" "<<(thisSystem->GetCurSite()).GetCurState().GetZ0()<<endl;*/
-    //--------------------------------------------------//
-    
-    thisSystem->SetCurInstancePtr(thisSystem);
-    Int_t currentTracker = ((thisSystem->GetCurSite()).GetHit())->GetTrackerID();
-    
-    Int_t lastTracker = 0;
-    
-    //seed from type kMidBack will skip the front seed plane. We assume for this type of seed, the hit on the
-    //front seed plane is missing, (otherwise the seed should be absorbed into the triplet seed)
-    
-    if (thisSystem->GetSeedType() == kMidBack) currentTracker--;
-    
-    while (currentTracker > lastTracker){
-      currentTracker--;
-      
-      thisSystem->CheckTrackStatus();    
-      if (!thisSystem->GetTrackStatus()) break; //skip the bad tracks
-      
-      SoLKalTrackState currentState = (thisSystem->GetCurSite()).GetCurState();
-      currentState.InitPredictSV();
-      SoLKalTrackState *predictState = currentState.PredictSVatNextZ(fGEMTracker[currentTracker]->GetZ());
-      
-      bool flag = (thisSystem->GetNHits() >= 3);
-      
-      int size = GetHitsInWindow(currentTracker, (*predictState)(kIdxX0, 0), (predictState->GetCovMat())(kIdxX0, kIdxX0),
-                                (*predictState)(kIdxY0, 0), (predictState->GetCovMat())(kIdxY0, kIdxY0), flag); 
-                                
-      
-      if (size <= 0){
-        //when there are too many hits in a small window (usually should not happen), or
-        //when there is no hit found in the window, if the track has not missed a hit so far
-        //we will keep the track, otherwise it is a bad track (miss too many hits)
-        
-        //the only exception will be the 0th tracker for a forward angle track, for which it 
-        //is not necessary to have a hit, and in that case, we don't count missing hit
-        if (thisSystem->GetAngleFlag() == kFAEC && currentTracker == 0) continue;
-        
-        thisSystem->AddMissingHits();
-        
-        /*if (thisSystem->GetNMissingHits() > 1 ){
-          thisSystem->SetTrackStatus(kFALSE);
-        }*/
-      }
-      else if (size == 1){
-        SoLKalTrackSite &newSite = *new SoLKalTrackSite(fWindowHits.at(0), kMdim, kSdim, kMdim*fChi2PerNDFCut);
-        newSite.Add(predictState);
-        if (newSite.Filter()){
-          thisSystem->Add(&newSite);
-          thisSystem->IncreaseChi2(newSite.GetDeltaChi2());
-          currentState.ClearAttemptSV();
-        }
-        else{
-          thisSystem->AddMissingHits();
-        }
-          
-      }
-      else{
-        //find the cloest one for now, should use concurrent tracking in the future
-        SoLKalTrackSite &newSite = *new SoLKalTrackSite(FindCloestHitInWindow((*predictState)(kIdxX0, 0), 
-                                    (*predictState)(kIdxY0, 0)), kMdim, kSdim,  kMdim*fChi2PerNDFCut);
-        newSite.Add(predictState);
-        if (newSite.Filter()){
-          thisSystem->Add(&newSite);
-          thisSystem->IncreaseChi2(newSite.GetDeltaChi2());
-          currentState.ClearAttemptSV();
-        }
-        else{
-          thisSystem->AddMissingHits();
-        }
-         
-      }
-     
-    } 
     
     //now that we have all the hits selected, we can look at the chi2 per ndf and charge asymmetry to 
     //get rid of some potential bad tracks, before doing other things
@@ -470,6 +419,8 @@ void SIDISKalTrackFinder::TrackFollow()
     if (allMC[1]) fMcTrackEfficiency[1] = true;
     //---------------------------------------------------//
   }
+  //the branches cut here no longer hold the sites of the others
+  if (fMaxBranches > 1) ReleaseBadTracks();
 }
 //___________________________________________________________________________________________________________________
 void SIDISKalTrackFinder::FindandAddVertex()
@@ -484,6 +435,8 @@ void SIDISKalTrackFinder::FindandAddVertex()
       SoLKalTrackState currentState = (thisSystem->GetCurSite()).GetCurState();
       currentState.InitPredictSV();
       
+      //full prediction, the one at the vertex continues from this state and
+      //needs its propagator and process noise
       SoLKalTrackState *predictState = currentState.PredictSVatNextZ(fTargetCenter);
       Double_t vertexz = FindVertexZ(predictState);
       
@@ -502,7 +455,7 @@ void SIDISKalTrackFinder::FindandAddVertex()
       predictState = currentState.PredictSVatNextZ(vertexz);
       
       //make a site at the interaction vertex to add to the fitting
-      SoLKalTrackSite &vertexSite = *new SoLKalTrackSite(kMdim, kSdim,  10.*fChi2PerNDFCut);
+      SoLKalTrackSite &vertexSite = *fArena->NewSite(10.*fChi2PerNDFCut);
       vertexSite.SetMeasurement(fBPMX, fBPMY);
       vertexSite.SetHitResolution(3e-4, 3e-4);
       vertexSite.Add(predictState);
@@ -530,7 +483,6 @@ void SIDISKalTrackFinder::FindandAddVertex()
       }
       
       currentState.ClearAttemptSV();
-      delete &vertexSite;
    }
 }
 //___________________________________________________________________________________________________________________
@@ -603,7 +555,8 @@ void SIDISKalTrackFinder::ECalFinalMatch()
     SoLKalTrackState currentState = (thisSystem->GetCurSite()).GetCurState();
     currentState.InitPredictSV();
     
-    SoLKalTrackState *predictState = currentState.PredictSVatNextZ(ecalZ);
+    //only the position and momentum are matched to the calorimeter
+    SoLKalTrackState *predictState = currentState.PredictSVatNextZ(ecalZ, 0, kPropState);
     
     thisSystem->SetTrackStatus(kFALSE);
     for (UInt_t ec_count=0; ec_count<fCaloHits->size(); ec_count++){
@@ -667,10 +620,10 @@ inline SoLKalTrackSite & SIDISKalTrackFinder::SiteInitWithSeed(DoubletSeed* this
   C(kIdxTY, kIdxTY) = 0.001;
   C(kIdxQP, kIdxQP) = 0.01;
       
-  SoLKalTrackSite& initSite = *new SoLKalTrackSite(thisSeed->hitb, kMdim, kSdim, kMdim*fChi2PerNDFCut);
+  SoLKalTrackSite& initSite = *fArena->NewSite(thisSeed->hitb, kMdim*fChi2PerNDFCut);
       
-  initSite.Add(new SoLKalTrackState(svd, C, initSite, SoLKalTrackSite::kPredicted));
-  initSite.Add(new SoLKalTrackState(svd, C, initSite, SoLKalTrackSite::kFiltered));
+  initSite.Add(fArena->NewState(svd, C, initSite, SoLKalTrackSite::kPredicted));
+  initSite.Add(fArena->NewState(svd, C, initSite, SoLKalTrackSite::kFiltered));
   initSite.SetHitResolution(kGiga, kGiga); //give it a very large resolution (100m) since it is a virtual site
   
   return initSite;
@@ -712,20 +665,7 @@ inline Bool_t SIDISKalTrackFinder::TriggerCheck(SoLIDGEMHit *theHit, ECType type
   return kFALSE;
 }
 //___________________________________________________________________________________________________________________
-inline SoLIDGEMHit* SIDISKalTrackFinder::FindCloestHitInWindow(double &x, double &y){
-  double minD = kGiga;
-  SoLIDGEMHit *minHit = nullptr;
-  for (unsigned int i=0; i<fWindowHits.size(); i++){
-    double r = sqrt(pow(x - fWindowHits.at(i)->GetX(), 2) + pow(y - fWindowHits.at(i)->GetY(), 2));
-    if (r < minD) {
-      minHit = fWindowHits.at(i);
-      minD = r;
-    }
-  }
-  return minHit;
-}
-//___________________________________________________________________________________________________________________
-inline int SIDISKalTrackFinder::GetHitsInWindow(int plane, double x, double wx, double y, double wy, bool flag)
+int SIDISKalTrackFinder::GetHitsInWindow(int plane, double x, double wx, double y, double wy, bool flag)
 {
   assert(plane >= 0);
   fWindowHits.clear();
@@ -759,6 +699,12 @@ inline int SIDISKalTrackFinder::GetHitsInWindow(int plane, double x, double wx,
   
   return fWindowHits.size();
 }
+//___________________________________________________________________________________________________________________
+Bool_t SIDISKalTrackFinder::IsHitRequired(SoLKalTrackSystem* theSystem, Int_t tracker) const
+{
+  //a forward angle track does not need a hit on the 0th tracker, it is not counted missing there
+  return !(theSystem->GetAngleFlag() == kFAEC && tracker == 0);
+}
 //____________________________________________________________________________________________________________________
 inline Double_t SIDISKalTrackFinder::FindVertexZ(SoLKalTrackState* thisState)
 {
@@ -48,6 +48,7 @@ class SIDISKalTrackFinder : public SoLKalTrackFinder
   
   //Main analysis functions
   void FindDoubletSeed(Int_t planej, Int_t planek, ECType type = kFAEC);
+  Bool_t PropagateSeedCandidates(Int_t &countSeed, ECType type);
   void MergeSeed();
   void TrackFollow();
   void CoarseCheckVertex();
@@ -62,9 +63,9 @@ class SIDISKalTrackFinder : public SoLKalTrackFinder
   double CalDeltaR(const double & r1, const double & r2);
   SoLKalTrackSite & SiteInitWithSeed(DoubletSeed* thisSeed);
   Bool_t TriggerCheck(SoLIDGEMHit* theHit, ECType type);
-  SoLIDGEMHit* FindCloestHitInWindow(double &x, double &y);
   double PredictR(Int_t &plane, SoLIDGEMHit* hit1, SoLIDGEMHit* hit2);
   int GetHitsInWindow(int plane, double x, double wx, double y, double wy, bool flag = false);
+  Bool_t IsHitRequired(SoLKalTrackSystem* theSystem, Int_t tracker) const;
   Double_t FindVertexZ(SoLKalTrackState* thisState);
   Bool_t CheckChargeAsy(SoLKalTrackSystem* theSystem);
   void GetHitChamberList(vector<Int_t> &theList, Int_t thisChamber, Int_t size);
@@ -76,9 +77,14 @@ class SIDISKalTrackFinder : public SoLKalTrackFinder
   bool fIsMC;
   bool fSeedEfficiency[2];
   bool fMcTrackEfficiency[2];
-  vector<SoLIDGEMHit*> fWindowHits;
   map< Int_t, vector<SoLIDGEMHit*> > fGoodHits;
   Int_t fNGoodTrack;
+  //hit pairs of FindDoubletSeed waiting for the propagation, and the batches
+  //propagated to the ECal and to the target (with the candidate of each lane)
+  vector<DoubletSeed> fSeedCandidates;
+  SoLKalSeedBatch fECalBatch;
+  SoLKalSeedBatch fTargetBatch;
+  vector<Int_t> fTargetCandidates;
 };
 
 #endif
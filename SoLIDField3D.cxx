@@ -0,0 +1,344 @@
+//c++
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+//unix
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//ROOT
+#include "TMath.h"
+//SoLIDTracking
+#include "SoLIDField3D.h"
+#include "SoLIDFieldMap.h"
+
+using namespace std;
+
+//__________________________________________________________________
+SoLIDField3D::SoLIDField3D()
+: fMapAddr(NULL), fMapSize(0), fTiles(NULL), fTileStride(0), fSymmetry(0), fNSector(1),
+  fSector(TMath::TwoPi())
+{
+  for (Int_t a=0; a<3; a++){
+    fN[a]       = 0;
+    fNTile[a]   = 0;
+    fMin[a]     = 0.;
+    fStep[a]    = 1.;
+    fInvStep[a] = 1.;
+  }
+}
+//__________________________________________________________________
+SoLIDField3D::~SoLIDField3D()
+{
+  if (fMapAddr != NULL) munmap(fMapAddr, fMapSize);
+}
+//__________________________________________________________________
+Bool_t SoLIDField3D::Load(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return kFALSE;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SoLIDField3DHeader)){
+    close(fd);
+    return kFALSE;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return kFALSE;
+
+  const SoLIDField3DHeader* header = static_cast<const SoLIDField3DHeader*>(addr);
+  if (strncmp(header->fMagic, "SOLFMAP3", 8) != 0){
+    munmap(addr, st.st_size);
+    return kFALSE;
+  }
+
+  Bool_t ok = header->fEndianTag == SoLIDFieldMap::kEndianTag &&
+              header->fVersion == SoLIDFieldMap::kVersion &&
+              header->fTileCells == (UInt_t)kTileCells &&
+              header->fTileStride >= sizeof(SoLIDField3DTile);
+  size_t nTiles = 1;
+  for (Int_t a=0; a<3 && ok; a++){
+    ok = header->fN[a] >= 2 && header->fStep[a] > 0 &&
+         header->fNTile[a] == (header->fN[a] - 2)/kTileCells + 1;
+    nTiles *= header->fNTile[a];
+  }
+  if (!ok || header->fTileOffset + nTiles*header->fTileStride > (size_t)st.st_size){
+    cout<<"SoLIDField3D: "<<filename<<" has a bad header or is truncated"<<endl;
+    munmap(addr, st.st_size);
+    return kFALSE;
+  }
+
+  fMapAddr    = addr;
+  fMapSize    = st.st_size;
+  fTiles      = static_cast<const char*>(addr) + header->fTileOffset;
+  fTileStride = header->fTileStride;
+  for (Int_t a=0; a<3; a++){
+    fN[a]       = header->fN[a];
+    fNTile[a]   = header->fNTile[a];
+    fMin[a]     = header->fMin[a];
+    fStep[a]    = header->fStep[a];
+    fInvStep[a] = 1./header->fStep[a];
+  }
+  fSymmetry = header->fSymmetry;
+  fNSector  = (header->fNSector > 1) ? header->fNSector : 1;
+  fSector   = TMath::TwoPi()/fNSector;
+  fCosSector.resize(fNSector);
+  fSinSector.resize(fNSector);
+  for (Int_t i=0; i<fNSector; i++){
+    fCosSector[i] = cos(i*fSector);
+    fSinSector[i] = sin(i*fSector);
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+Double_t SoLIDField3D::GetRMax() const
+{
+  //largest circle around the axis inside the stored part of the x-y plane,
+  //or inside its images
+  Double_t r = TMath::Min(GetMax(0), GetMax(1));
+  if (fNSector > 1) return r;
+  if (!(fSymmetry & kMirrorX)) r = TMath::Min(r, -fMin[0]);
+  if (!(fSymmetry & kMirrorY)) r = TMath::Min(r, -fMin[1]);
+  return r > 0 ? r : 0.;
+}
+//__________________________________________________________________
+Double_t SoLIDField3D::GetZMin() const
+{
+  return (fSymmetry & kMirrorZ) ? -GetMax(2) : fMin[2];
+}
+//__________________________________________________________________
+Bool_t SoLIDField3D::LookUp(double x, double y, double z, double* b) const
+{
+  //grid coordinates, in units of the steps from the first node
+  double u = (x - fMin[0])*fInvStep[0];
+  double v = (y - fMin[1])*fInvStep[1];
+  double w = (z - fMin[2])*fInvStep[2];
+  if (!(u >= 0 && u < fN[0] - 1 && v >= 0 && v < fN[1] - 1 && w >= 0 && w < fN[2] - 1))
+    return kFALSE;
+
+  int i = (int)u, j = (int)v, k = (int)w;
+  double du = u - i, dv = v - j, dw = w - k;
+
+  const Int_t nt = kTileNodes;
+  size_t tile = ((size_t)(k/kTileCells)*fNTile[1] + j/kTileCells)*fNTile[0] + i/kTileCells;
+  const SoLIDField3DTile* t = reinterpret_cast<const SoLIDField3DTile*>(fTiles + tile*fTileStride);
+  const Short_t (*q)[3] = t->fNode + ((k%kTileCells)*nt + j%kTileCells)*nt + i%kTileCells;
+
+  //trilinear interpolation of the stored integers, then one scale per component
+  for (Int_t c=0; c<3; c++){
+    double q00 = q[0][c]         + du*(q[1][c]           - q[0][c]);
+    double q10 = q[nt][c]        + du*(q[nt + 1][c]      - q[nt][c]);
+    double q01 = q[nt*nt][c]     + du*(q[nt*nt + 1][c]   - q[nt*nt][c]);
+    double q11 = q[nt*nt + nt][c] + du*(q[nt*nt + nt + 1][c] - q[nt*nt + nt][c]);
+    double q0 = q00 + dv*(q10 - q00);
+    double q1 = q01 + dv*(q11 - q01);
+    b[c] = t->fOffset[c] + t->fScale[c]*(q0 + dw*(q1 - q0));
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+void SoLIDField3D::GetBField(double x, double y, double z, double* b) const
+{
+  //here use cm, other place use m
+  x = 100*x;
+  y = 100*y;
+  z = 100*z;
+
+  //rotate into the first sector, the field is rotated back at the end
+  double cosa = 1., sina = 0.;
+  if (fNSector > 1){
+    double phi = atan2(y, x);
+    if (phi < 0) phi += TMath::TwoPi();
+    int sector = (int)(phi/fSector);
+    if (sector >= fNSector) sector = fNSector - 1;
+    if (sector > 0){
+      cosa = fCosSector[sector];
+      sina = fSinSector[sector];
+      double xr =  cosa*x + sina*y;
+      double yr = -sina*x + cosa*y;
+      x = xr;
+      y = yr;
+    }
+  }
+
+  //mirror into the stored part
+  double sx = 1., sy = 1., sz = 1.;
+  if ((fSymmetry & kMirrorX) && x < 0){ x = -x; sx = -1.; }
+  if ((fSymmetry & kMirrorY) && y < 0){ y = -y; sy = -1.; }
+  if ((fSymmetry & kMirrorZ) && z < 0){ z = -z; sz = -1.; }
+
+  if (!LookUp(x, y, z, b)){
+    b[0] = 0.; b[1] = 0.; b[2] = 0.;
+    return;
+  }
+
+  double bx = b[0]*sx*sz;
+  double by = b[1]*sy*sz;
+  b[0] = cosa*bx - sina*by;
+  b[1] = sina*bx + cosa*by;
+}
+//__________________________________________________________________
+Bool_t SoLIDField3D::ParseSymmetry(const char* symmetry, UInt_t& flags, UInt_t& nSector)
+{
+  flags = 0;
+  nSector = 1;
+  if (strcmp(symmetry, "none") == 0) return kTRUE;
+  for (const char* c = symmetry; *c; c++){
+    if (*c == 'x') flags |= kMirrorX;
+    else if (*c == 'y') flags |= kMirrorY;
+    else if (*c == 'z') flags |= kMirrorZ;
+    else if (*c == 's'){
+      char* end;
+      nSector = strtoul(c + 1, &end, 10);
+      if (end == c + 1 || nSector < 2) return kFALSE;
+      c = end - 1;
+    }else{
+      return kFALSE;
+    }
+  }
+  //the sector folding is a rotation, x-y mirrors on top of it are not supported
+  return !(nSector > 1 && (flags & (kMirrorX | kMirrorY)));
+}
+//__________________________________________________________________
+Int_t SoLIDField3D::ConvertTextToBinary(const char* textfile, const char* binfile,
+                                       const char* symmetry)
+{
+  UInt_t flags, nSector;
+  if (!ParseSymmetry(symmetry, flags, nSector)){
+    cerr<<"SoLIDField3D: bad symmetry "<<symmetry<<", use mirror planes x, y, z and/or s<N>"<<endl;
+    return 1;
+  }
+
+  ifstream infile(textfile);
+  if (!infile.is_open()){
+    cerr<<"SoLIDField3D: cannot open field map file "<<textfile<<endl;
+    return 1;
+  }
+  vector<Double_t> data;
+  double input[6];
+  while (infile>>input[0]>>input[1]>>input[2]>>input[3]>>input[4]>>input[5]){
+    data.insert(data.end(), input, input + 6);
+  }
+  infile.close();
+
+  //grid from the coordinates found in the file
+  size_t nPoints = data.size()/6;
+  Int_t n[3];
+  Double_t vmin[3], step[3];
+  const char axis[3] = { 'x', 'y', 'z' };
+  for (Int_t a=0; a<3; a++){
+    vector<Double_t> v(nPoints);
+    for (size_t i=0; i<nPoints; i++) v[i] = data[6*i + a];
+    if (nPoints < 8 || !SoLIDFieldMap::FindGridAxis(v, vmin[a], step[a], n[a]) || n[a] < 2){
+      cerr<<"SoLIDField3D: "<<textfile<<" is not a field map on an (x, y, z) grid"<<endl;
+      return 1;
+    }
+    if ((flags & (1 << a)) && fabs(vmin[a]) > 1e-6*step[a]){
+      cerr<<"SoLIDField3D: mirror plane "<<axis[a]<<" = 0, but the grid starts at "
+          <<vmin[a]<<" cm"<<endl;
+      return 1;
+    }
+  }
+  size_t nNodes = (size_t)n[0]*n[1]*n[2];
+  if (nPoints < nNodes){
+    cout<<"SoLIDField3D: "<<textfile<<" has "<<nPoints<<" of the "<<nNodes
+        <<" grid points, the missing ones are set to zero"<<endl;
+  }
+  vector<Double_t> table(3*nNodes, 0.);
+  for (size_t i=0; i<nPoints; i++){
+    size_t idx[3];
+    for (Int_t a=0; a<3; a++) idx[a] = (size_t)floor((data[6*i + a] - vmin[a])/step[a] + 0.5);
+    size_t node = (idx[2]*n[1] + idx[1])*n[0] + idx[0];
+    for (Int_t c=0; c<3; c++) table[3*node + c] = data[6*i + 3 + c]/1000.;//convert from gauss to kgauss
+  }
+  vector<Double_t>().swap(data);
+
+  //header, tiles start on a page boundary and on 64 byte lines
+  const ULong64_t page = 4096;
+  SoLIDField3DHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.fMagic, "SOLFMAP3", 8);
+  header.fEndianTag  = SoLIDFieldMap::kEndianTag;
+  header.fVersion    = SoLIDFieldMap::kVersion;
+  header.fTileCells  = kTileCells;
+  header.fSymmetry   = flags;
+  header.fNSector    = nSector;
+  header.fTileStride = (sizeof(SoLIDField3DTile) + 63)/64*64;
+  header.fTileOffset = page;
+  size_t nTiles = 1;
+  for (Int_t a=0; a<3; a++){
+    header.fN[a]     = n[a];
+    header.fNTile[a] = (n[a] - 2)/kTileCells + 1;
+    header.fMin[a]   = vmin[a];
+    header.fStep[a]  = step[a];
+    nTiles *= header.fNTile[a];
+  }
+
+  FILE* out = fopen(binfile, "wb");
+  if (out == NULL){
+    cerr<<"SoLIDField3D: cannot create "<<binfile<<endl;
+    return 1;
+  }
+  vector<char> buffer(page, 0);
+  memcpy(&buffer[0], &header, sizeof(header));
+  Bool_t ok = fwrite(&buffer[0], 1, page, out) == page;
+
+  //quantize every tile, nodes past the end of the grid repeat the last one
+  const Int_t nt = kTileNodes;
+  buffer.assign(header.fTileStride, 0);
+  SoLIDField3DTile* tile = reinterpret_cast<SoLIDField3DTile*>(&buffer[0]);
+  Double_t maxErr = 0.;
+  vector<size_t> nodes(nt*nt*nt);
+  for (UInt_t tk=0; tk<header.fNTile[2] && ok; tk++){
+    for (UInt_t tj=0; tj<header.fNTile[1]; tj++){
+      for (UInt_t ti=0; ti<header.fNTile[0]; ti++){
+        for (Int_t lk=0; lk<nt; lk++){
+          size_t k = TMath::Min(tk*kTileCells + lk, (UInt_t)n[2] - 1);
+          for (Int_t lj=0; lj<nt; lj++){
+            size_t j = TMath::Min(tj*kTileCells + lj, (UInt_t)n[1] - 1);
+            for (Int_t li=0; li<nt; li++){
+              size_t i = TMath::Min(ti*kTileCells + li, (UInt_t)n[0] - 1);
+              nodes[(lk*nt + lj)*nt + li] = (k*n[1] + j)*n[0] + i;
+            }
+          }
+        }
+        for (Int_t c=0; c<3; c++){
+          Double_t lo = table[3*nodes[0] + c], hi = lo;
+          for (size_t m=1; m<nodes.size(); m++){
+            Double_t val = table[3*nodes[m] + c];
+            if (val < lo) lo = val;
+            if (val > hi) hi = val;
+          }
+          tile->fScale[c]  = (Float_t)((hi - lo)/65534.);
+          tile->fOffset[c] = (Float_t)(lo + 32767.*tile->fScale[c]);
+          for (size_t m=0; m<nodes.size(); m++){
+            Double_t val = table[3*nodes[m] + c];
+            Double_t qv = (tile->fScale[c] > 0) ? floor((val - tile->fOffset[c])/tile->fScale[c] + 0.5) : 0.;
+            if (qv >  32767.) qv =  32767.;
+            if (qv < -32767.) qv = -32767.;
+            tile->fNode[m][c] = (Short_t)qv;
+            Double_t err = fabs(tile->fOffset[c] + tile->fScale[c]*qv - val);
+            if (err > maxErr) maxErr = err;
+          }
+        }
+        ok = ok && fwrite(&buffer[0], 1, header.fTileStride, out) == header.fTileStride;
+      }
+    }
+  }
+  ok = (fclose(out) == 0) && ok;
+  if (!ok){
+    cerr<<"SoLIDField3D: error writing "<<binfile<<endl;
+    return 1;
+  }
+  cout<<"SoLIDField3D: wrote "<<binfile<<", "<<n[0]<<" x "<<n[1]<<" x "<<n[2]<<" points in "
+      <<nTiles<<" tiles ("<<nTiles*header.fTileStride/1048576.<<" MB), symmetry "<<symmetry
+      <<", max quantization error "<<maxErr<<" kG"<<endl;
+  return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef ROOT_SoLID_Field_3D
+#define ROOT_SoLID_Field_3D
+//c++
+#include <cstddef>
+#include <vector>
+//ROOT
+#include "Rtypes.h"
+
+using namespace std;
+
+//header of the binary 3D field map file, the tiles follow at fTileOffset
+struct SoLIDField3DHeader {
+  char      fMagic[8];   // "SOLFMAP3"
+  UInt_t    fEndianTag;  // SoLIDFieldMap::kEndianTag as written by the converter
+  UInt_t    fVersion;
+  UInt_t    fN[3];       // grid points in x, y, z
+  UInt_t    fNTile[3];   // tiles in x, y, z
+  UInt_t    fTileCells;  // cells per tile edge, kTileCells
+  UInt_t    fSymmetry;   // SoLIDField3D::ESymmetry bits
+  UInt_t    fNSector;    // rotational symmetry order around z, 0 or 1 if none
+  UInt_t    fTileStride; // bytes per tile in the file
+  Double_t  fMin[3];     // first grid point (cm)
+  Double_t  fStep[3];    // grid steps (cm)
+  ULong64_t fTileOffset; // byte offset of the first tile
+};
+
+//Cartesian 3D field map with trilinear interpolation, for magnet models that
+//are not axisymmetric (yoke, endcap). Only a part of the space is stored and
+//the rest is obtained by symmetry: mirror planes x = 0, y = 0, z = 0 and/or
+//an N-fold rotational symmetry around the z axis.
+//The grid is cut into tiles of kTileCells^3 cells. A tile keeps its
+//(kTileCells+1)^3 nodes, so that a lookup never leaves the tile, as 16 bit
+//integers with a scale and offset per tile and component: one lookup reads
+//a few cache lines of one 4.4 kB tile
+class SoLIDField3D
+{
+  public:
+  SoLIDField3D();
+  ~SoLIDField3D();
+
+  //symmetry of the field. Mirror in x: Bx odd, By and Bz even in x, same
+  //for y. Mirror in z: Bx and By odd, Bz even in z (solenoid like)
+  enum ESymmetry { kMirrorX = 1, kMirrorY = 2, kMirrorZ = 4 };
+
+  //position in m, field (Bx, By, Bz) in kG written to b[3], zero outside
+  void   GetBField(double x, double y, double z, double* b) const;
+
+  //maps a binary 3D map file, returns kFALSE (silently if it is not a 3D map)
+  Bool_t Load(const char* filename);
+
+  //text map with columns x, y, z (cm), Bx, By, Bz (gauss) on a regular grid
+  //covering the stored part of space. symmetry is a list of mirror planes
+  //("x", "y", "z") and/or "s<N>" for N sectors, e.g. "xy", "s6z" or "none"
+  static Int_t ConvertTextToBinary(const char* textfile, const char* binfile,
+                                   const char* symmetry);
+
+  inline UInt_t   GetSymmetry() const { return fSymmetry; }
+  inline Int_t    GetNSector() const { return fNSector; }
+  inline Int_t    GetN(Int_t axis) const { return fN[axis]; }
+  inline Double_t GetMin(Int_t axis) const { return fMin[axis]; }
+  inline Double_t GetStep(Int_t axis) const { return fStep[axis]; }
+  Double_t GetMax(Int_t axis) const { return fMin[axis] + (fN[axis] - 1)*fStep[axis]; }
+  //radius (cm) up to which the field is known at every azimuth
+  Double_t GetRMax() const;
+  Double_t GetZMin() const;
+  Double_t GetZMax() const { return GetMax(2); }
+
+  static const Int_t kTileCells = 8;
+  static const Int_t kTileNodes = kTileCells + 1;
+
+  protected:
+  static Bool_t ParseSymmetry(const char* symmetry, UInt_t& flags, UInt_t& nSector);
+  Bool_t LookUp(double x, double y, double z, double* b) const;
+
+  void*     fMapAddr;    // mapped file, NULL if not loaded
+  size_t    fMapSize;
+  const char* fTiles;    // first tile
+  size_t    fTileStride;
+  Int_t     fN[3];
+  Int_t     fNTile[3];
+  Double_t  fMin[3];     // cm
+  Double_t  fStep[3];    // cm
+  Double_t  fInvStep[3];
+  UInt_t    fSymmetry;
+  Int_t     fNSector;
+  Double_t  fSector;     // sector angle (rad)
+  vector<Double_t> fCosSector; // rotation of every sector
+  vector<Double_t> fSinSector;
+};
+
+//one tile as stored in the file: B = fOffset + fScale*q for every component
+struct SoLIDField3DTile {
+  Float_t fOffset[3];
+  Float_t fScale[3];
+  Short_t fNode[SoLIDField3D::kTileNodes*SoLIDField3D::kTileNodes*SoLIDField3D::kTileNodes][3]; // [z][y][x]
+};
+
+#endif
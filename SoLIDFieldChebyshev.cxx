@@ -0,0 +1,281 @@
+//c++
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+//ROOT
+#include "TMath.h"
+//SoLIDTracking
+#include "SoLIDFieldChebyshev.h"
+#include "SoLIDFieldMap.h"
+
+using namespace std;
+
+const char* const SoLIDFieldChebyshev::kCoefFile = "solenoid_CLEOv8.cheb";
+
+#define CHEB_MAX_DEG 15
+
+//__________________________________________________________________
+SoLIDFieldChebyshev::SoLIDFieldChebyshev()
+: fNRegR(0), fNRegZ(0), fDeg(0), fRMin(0), fRMax(0), fZMin(0), fZMax(0),
+  fRegR(1), fRegZ(1), fMapNZ(0), fMapNR(0), fMapZShift(0), fMapZStep(0), fMapRStep(0)
+{
+}
+//__________________________________________________________________
+SoLIDFieldChebyshev::~SoLIDFieldChebyshev()
+{
+}
+//__________________________________________________________________
+void SoLIDFieldChebyshev::SetRegions(Int_t nRegR, Int_t nRegZ, Int_t deg,
+                                     Double_t rMin, Double_t rMax, Double_t zMin, Double_t zMax)
+{
+  if (deg > CHEB_MAX_DEG) {
+    cout<<"SoLIDFieldChebyshev: degree "<<deg<<" too large, using "<<CHEB_MAX_DEG<<endl;
+    deg = CHEB_MAX_DEG;
+  }
+  fNRegR = nRegR;
+  fNRegZ = nRegZ;
+  fDeg   = deg;
+  fRMin  = rMin;
+  fRMax  = rMax;
+  fZMin  = zMin;
+  fZMax  = zMax;
+  fRegR  = (rMax - rMin)/nRegR;
+  fRegZ  = (zMax - zMin)/nRegZ;
+  fCoef.assign(nRegR*nRegZ*2*(deg + 1)*(deg + 1), 0.);
+}
+//__________________________________________________________________
+void SoLIDFieldChebyshev::Clenshaw2D(const Double_t* c, Int_t n, Double_t u, Double_t v,
+                                     Double_t& bz, Double_t& br)
+{
+  //sum_ij c[i][j] T_i(u) T_j(v) for both components. The inner recurrences
+  //in v of all 2n rows (Bz rows, then Br rows) are independent and advance
+  //together, so they pipeline instead of forming one long dependency chain
+  Double_t b1[2*CHEB_MAX_DEG + 2], b2[2*CHEB_MAX_DEG + 2];
+  const Int_t nrow = 2*n;
+  Double_t v2 = 2*v;
+  for (Int_t m=0; m<nrow; m++){
+    b1[m] = 0.;
+    b2[m] = 0.;
+  }
+  for (Int_t j=n-1; j>0; j--){
+    for (Int_t m=0; m<nrow; m++){
+      Double_t b0 = c[m*n + j] + v2*b1[m] - b2[m];
+      b2[m] = b1[m];
+      b1[m] = b0;
+    }
+  }
+  //g = row sums at v, reuse b2 for them
+  for (Int_t m=0; m<nrow; m++) b2[m] = c[m*n] + v*b1[m] - b2[m];
+  const Double_t* gz = b2;
+  const Double_t* gr = b2 + n;
+
+  //outer recurrences in u
+  Double_t u2 = 2*u;
+  Double_t z1 = 0., z2 = 0., r1 = 0., r2 = 0.;
+  for (Int_t i=n-1; i>0; i--){
+    Double_t z0 = gz[i] + u2*z1 - z2;
+    Double_t r0 = gr[i] + u2*r1 - r2;
+    z2 = z1;
+    z1 = z0;
+    r2 = r1;
+    r1 = r0;
+  }
+  bz = gz[0] + u*z1 - z2;
+  br = gr[0] + u*r1 - r2;
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldChebyshev::EvalRZ(double r, double z, double& br, double& bz) const
+{
+  if (r < fRMin || r >= fRMax || z < fZMin || z >= fZMax){
+    br = 0.;
+    bz = 0.;
+    return kFALSE;
+  }
+
+  Int_t ir = (Int_t)((r - fRMin)/fRegR);
+  Int_t iz = (Int_t)((z - fZMin)/fRegZ);
+  if (ir >= fNRegR) ir = fNRegR - 1;
+  if (iz >= fNRegZ) iz = fNRegZ - 1;
+
+  //local coordinates in [-1, 1]
+  Double_t u = 2.*(r - fRMin - ir*fRegR)/fRegR - 1.;
+  Double_t v = 2.*(z - fZMin - iz*fRegZ)/fRegZ - 1.;
+
+  Int_t n = fDeg + 1;
+  const Double_t* c = &fCoef[(iz*fNRegR + ir)*2*n*n];
+  Clenshaw2D(c, n, u, v, bz, br);
+  return kTRUE;
+}
+//__________________________________________________________________
+void SoLIDFieldChebyshev::GetBField(double x, double y, double z, double* b) const
+{
+  //here use cm, other place use m
+  x = 100*x;
+  y = 100*y;
+  z = 100*z;
+  double r = sqrt(x*x + y*y);
+  double br, bz;
+  if (!EvalRZ(r, z, br, bz)){
+    b[0] = 0.; b[1] = 0.; b[2] = 0.;
+    return;
+  }
+  double cosphi = r > 0 ? x/r : 0.;
+  double sinphi = r > 0 ? y/r : 0.;
+  b[0] = br*cosphi;
+  b[1] = br*sinphi;
+  b[2] = bz;
+}
+//__________________________________________________________________
+void SoLIDFieldChebyshev::Fit(const SoLIDFieldMap& map, Int_t nRegR, Int_t nRegZ, Int_t deg,
+                              Double_t rMin, Double_t rMax, Double_t zMin, Double_t zMax)
+{
+  SetRegions(nRegR, nRegZ, deg, rMin, rMax, zMin, zMax);
+  fMapName   = map.GetFileName();
+  fMapNZ     = map.GetNZ();
+  fMapNR     = map.GetNR();
+  fMapZShift = map.GetZShift();
+  fMapZStep  = map.GetZStep();
+  fMapRStep  = map.GetRStep();
+  Int_t n = fDeg + 1;
+
+  //Chebyshev nodes of the first kind and the polynomials evaluated on them
+  vector<Double_t> node(n), T(n*n);
+  for (Int_t k=0; k<n; k++){
+    node[k] = cos(TMath::Pi()*(k + 0.5)/n);
+    for (Int_t i=0; i<n; i++) T[i*n + k] = cos(i*TMath::Pi()*(k + 0.5)/n);
+  }
+
+  vector<Double_t> fz(n*n), fr(n*n);
+  Double_t b[3];
+  for (Int_t iz=0; iz<fNRegZ; iz++){
+    for (Int_t ir=0; ir<fNRegR; ir++){
+      //sample the map at the nodes of this region, field map in m
+      for (Int_t k=0; k<n; k++){
+        Double_t r = fRMin + (ir + 0.5*(node[k] + 1.))*fRegR;
+        for (Int_t l=0; l<n; l++){
+          Double_t z = fZMin + (iz + 0.5*(node[l] + 1.))*fRegZ;
+          map.GetBField(r/100., 0., z/100., b);
+          fz[k*n + l] = b[2];
+          fr[k*n + l] = b[0];
+        }
+      }
+
+      //discrete Chebyshev transform, exact interpolation on the nodes
+      Double_t* c = &fCoef[(iz*fNRegR + ir)*2*n*n];
+      for (Int_t i=0; i<n; i++){
+        for (Int_t j=0; j<n; j++){
+          Double_t sz = 0., sr = 0.;
+          for (Int_t k=0; k<n; k++){
+            for (Int_t l=0; l<n; l++){
+              Double_t w = T[i*n + k]*T[j*n + l];
+              sz += w*fz[k*n + l];
+              sr += w*fr[k*n + l];
+            }
+          }
+          Double_t norm = (i == 0 ? 1. : 2.)*(j == 0 ? 1. : 2.)/(n*n);
+          c[i*n + j]       = norm*sz;
+          c[n*n + i*n + j] = norm*sr;
+        }
+      }
+    }
+  }
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldChebyshev::ReadCoefficients(const char* filename, const SoLIDFieldMap* map)
+{
+  ifstream infile(filename);
+  if (!infile.is_open()) return kFALSE;
+
+  string magic, mapName;
+  Int_t nRegR, nRegZ, deg, mapNZ, mapNR;
+  Double_t rMin, rMax, zMin, zMax, mapZShift, mapZStep, mapRStep;
+  infile>>magic;
+  if (magic == "SOLCHEB1"){
+    cout<<"SoLIDFieldChebyshev: "<<filename<<" does not record its field map, run fieldchebfit again"<<endl;
+    return kFALSE;
+  }
+  infile>>nRegR>>nRegZ>>deg>>rMin>>rMax>>zMin>>zMax;
+  infile>>mapNZ>>mapNR>>mapZShift>>mapZStep>>mapRStep>>ws;
+  getline(infile, mapName);
+  if (!infile || magic != "SOLCHEB2" || nRegR <= 0 || nRegZ <= 0 || deg < 0 || deg > CHEB_MAX_DEG){
+    cout<<"SoLIDFieldChebyshev: "<<filename<<" is not a coefficient file"<<endl;
+    return kFALSE;
+  }
+
+  SetRegions(nRegR, nRegZ, deg, rMin, rMax, zMin, zMax);
+  fMapName   = mapName;
+  fMapNZ     = mapNZ;
+  fMapNR     = mapNR;
+  fMapZShift = mapZShift;
+  fMapZStep  = mapZStep;
+  fMapRStep  = mapRStep;
+  if (map != NULL && !MatchesFieldMap(filename, *map)){
+    fCoef.clear();
+    return kFALSE;
+  }
+  for (size_t i=0; i<fCoef.size(); i++) infile>>fCoef[i];
+  if (!infile){
+    cout<<"SoLIDFieldChebyshev: "<<filename<<" is truncated"<<endl;
+    fCoef.clear();
+    return kFALSE;
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldChebyshev::MatchesFieldMap(const char* filename, const SoLIDFieldMap& map) const
+{
+  //the file names are compared without their directories, the grids exactly
+  //up to the precision of the text header. The scale is applied by the map
+  string fitted = fMapName.substr(fMapName.find_last_of('/') + 1);
+  string name = map.GetFileName();
+  name = name.substr(name.find_last_of('/') + 1);
+  Bool_t sameGrid = fMapNZ == map.GetNZ() && fMapNR == map.GetNR() &&
+                    fabs(fMapZShift - map.GetZShift()) < 1.e-9*(1. + fabs(fMapZShift)) &&
+                    fabs(fMapZStep - map.GetZStep()) < 1.e-9*fMapZStep &&
+                    fabs(fMapRStep - map.GetRStep()) < 1.e-9*fMapRStep;
+  if (map.Is3D() || fitted != name || !sameGrid){
+    cout<<"SoLIDFieldChebyshev: "<<filename<<" was fitted to "<<fMapName<<" ("<<fMapNZ<<" x "
+        <<fMapNR<<" points, z from "<<-fMapZShift<<" cm in steps of "<<fMapZStep<<" cm, r in steps of "
+        <<fMapRStep<<" cm), not to "<<map.GetFileName();
+    if (!map.Is3D())
+      cout<<" ("<<map.GetNZ()<<" x "<<map.GetNR()<<" points, z from "<<-map.GetZShift()
+          <<" cm in steps of "<<map.GetZStep()<<" cm, r in steps of "<<map.GetRStep()<<" cm)";
+    cout<<endl;
+    return kFALSE;
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+string SoLIDFieldChebyshev::MakeCoefFileName(const char* mapfile)
+{
+  string name = mapfile;
+  size_t dot = name.find_last_of('.');
+  size_t slash = name.find_last_of('/');
+  if (dot != string::npos && (slash == string::npos || dot > slash)) name.erase(dot);
+  return name + ".cheb";
+}
+//__________________________________________________________________
+Int_t SoLIDFieldChebyshev::WriteCoefficients(const char* filename) const
+{
+  ofstream outfile(filename);
+  if (!outfile.is_open()){
+    cerr<<"SoLIDFieldChebyshev: cannot create "<<filename<<endl;
+    return 1;
+  }
+
+  //header with the regions, then the grid and file name of the fitted map,
+  //then one line per region and component (Bz first)
+  outfile<<setprecision(17);
+  outfile<<"SOLCHEB2 "<<fNRegR<<" "<<fNRegZ<<" "<<fDeg<<" "
+         <<fRMin<<" "<<fRMax<<" "<<fZMin<<" "<<fZMax<<endl;
+  outfile<<fMapNZ<<" "<<fMapNR<<" "<<fMapZShift<<" "<<fMapZStep<<" "<<fMapRStep<<" "
+         <<fMapName<<endl;
+  Int_t n = fDeg + 1;
+  for (size_t i=0; i<fCoef.size(); i++){
+    outfile<<fCoef[i]<<(((i + 1)%(n*n) == 0) ? "\n" : " ");
+  }
+  outfile.close();
+  return outfile.fail() ? 1 : 0;
+}
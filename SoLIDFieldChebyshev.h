@@ -0,0 +1,83 @@
+#ifndef ROOT_SoLID_Field_Chebyshev
+#define ROOT_SoLID_Field_Chebyshev
+//c++
+#include <vector>
+#include <string>
+//ROOT
+#include "Rtypes.h"
+
+using namespace std;
+
+class SoLIDFieldMap;
+
+//analytic parameterization of the solenoid field: the (r, z) plane is cut
+//into a regular grid of rectangular regions and Br, Bz are each expanded in
+//a tensor product of Chebyshev polynomials of degree fDeg inside a region.
+//Evaluation is two nested Clenshaw recurrences on a few kB of coefficients,
+//without any access to the field map tables
+class SoLIDFieldChebyshev
+{
+  public:
+  SoLIDFieldChebyshev();
+  ~SoLIDFieldChebyshev();
+
+  //position in m, field (Bx, By, Bz) in kG written to b[3], zero outside
+  void   GetBField(double x, double y, double z, double* b) const;
+  //r, z in cm, Br and Bz in kG. Returns kFALSE outside the fitted range
+  Bool_t EvalRZ(double r, double z, double& br, double& bz) const;
+
+  //fit by Chebyshev interpolation of the given field map at the Chebyshev
+  //nodes of every region. Ranges in cm. The file name and (r, z) grid of the
+  //map are kept and written with the coefficients
+  void   Fit(const SoLIDFieldMap& map, Int_t nRegR, Int_t nRegZ, Int_t deg,
+             Double_t rMin, Double_t rMax, Double_t zMin, Double_t zMax);
+
+  //with a map, the file must have been fitted to a map of the same file name
+  //and (r, z) grid, otherwise it is refused
+  Bool_t ReadCoefficients(const char* filename, const SoLIDFieldMap* map = NULL);
+  Int_t  WriteCoefficients(const char* filename) const;
+
+  inline Bool_t IsValid() const { return !fCoef.empty(); }
+  inline Int_t  GetNRegionR() const { return fNRegR; }
+  inline Int_t  GetNRegionZ() const { return fNRegZ; }
+  inline Int_t  GetDegree() const { return fDeg; }
+  inline Double_t GetRMin() const { return fRMin; }
+  inline Double_t GetRMax() const { return fRMax; }
+  inline Double_t GetZMin() const { return fZMin; }
+  inline Double_t GetZMax() const { return fZMax; }
+  //field map the coefficients were fitted to
+  inline const char* GetFieldMapName() const { return fMapName.c_str(); }
+
+  //coefficient file of a field map file: its name with the extension
+  //replaced by .cheb, kCoefFile for the default map
+  static string MakeCoefFileName(const char* mapfile);
+  static const char* const kCoefFile;
+
+  protected:
+  void   SetRegions(Int_t nRegR, Int_t nRegZ, Int_t deg,
+                    Double_t rMin, Double_t rMax, Double_t zMin, Double_t zMax);
+  Bool_t MatchesFieldMap(const char* filename, const SoLIDFieldMap& map) const;
+  static void Clenshaw2D(const Double_t* c, Int_t n, Double_t u, Double_t v,
+                         Double_t& bz, Double_t& br);
+
+  Int_t    fNRegR;    // number of regions in r
+  Int_t    fNRegZ;    // number of regions in z
+  Int_t    fDeg;      // polynomial degree in r and in z
+  Double_t fRMin;     // cm
+  Double_t fRMax;     // cm
+  Double_t fZMin;     // cm
+  Double_t fZMax;     // cm
+  Double_t fRegR;     // region size in r (cm)
+  Double_t fRegZ;     // region size in z (cm)
+  string   fMapName;  // file name of the fitted field map
+  Int_t    fMapNZ;    // and its grid, see SoLIDFieldMap
+  Int_t    fMapNR;
+  Double_t fMapZShift;
+  Double_t fMapZStep;
+  Double_t fMapRStep;
+  //coefficients c[region][component][i][j], component 0 Bz, 1 Br, i the order
+  //in r and j the order in z, (fDeg+1)^2 per component
+  vector<Double_t> fCoef;
+};
+
+#endif
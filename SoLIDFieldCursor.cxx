@@ -0,0 +1,110 @@
+//c++
+#include <cmath>
+//SoLIDTracking
+#include "SoLIDFieldCursor.h"
+#include "SoLIDFieldMap.h"
+
+using namespace std;
+
+//__________________________________________________________________
+SoLIDFieldCursor::SoLIDFieldCursor(const SoLIDFieldMap* map)
+: fMap(map), fRMin(-1), fZMin(-1), fFloat(kFALSE), fNHit(0), fNMiss(0), fNPass(0)
+{
+  for (Int_t i=0; i<4; i++){
+    fBz[i] = 0.;
+    fBr[i] = 0.;
+  }
+}
+//__________________________________________________________________
+SoLIDFieldCursor::~SoLIDFieldCursor()
+{
+}
+//__________________________________________________________________
+Double_t SoLIDFieldCursor::GetHitRate() const
+{
+  ULong64_t n = fNHit + fNMiss;
+  return n > 0 ? (Double_t)fNHit/n : 0.;
+}
+//__________________________________________________________________
+void SoLIDFieldCursor::LoadCell(Int_t r_min, Int_t z_min)
+{
+  fRMin  = r_min;
+  fZMin  = z_min;
+  fFloat = (fMap->fStorage == SoLIDFieldMap::kInterleavedFloat);
+  if (fFloat){
+    const SoLIDFieldNode* lo = &fMap->fNode[z_min*fMap->fNRPadded + r_min];
+    const SoLIDFieldNode* hi = lo + fMap->fNRPadded;
+    fBz[0] = lo[0].fBz; fBz[1] = lo[1].fBz; fBz[2] = hi[0].fBz; fBz[3] = hi[1].fBz;
+    fBr[0] = lo[0].fBr; fBr[1] = lo[1].fBr; fBr[2] = hi[0].fBr; fBr[3] = hi[1].fBr;
+  }else{
+    const Int_t nr = fMap->fNR;
+    const Double_t* bz = fMap->Bz + z_min*nr + r_min;
+    const Double_t* br = fMap->Br + z_min*nr + r_min;
+    fBz[0] = bz[0]; fBz[1] = bz[1]; fBz[2] = bz[nr]; fBz[3] = bz[nr + 1];
+    fBr[0] = br[0]; fBr[1] = br[1]; fBr[2] = br[nr]; fBr[3] = br[nr + 1];
+  }
+}
+//__________________________________________________________________
+void SoLIDFieldCursor::GetBField(double x, double y, double z, double* b)
+{
+  if (fMap->fInterpolation != SoLIDFieldMap::kBilinear || fMap->fField3D != NULL){
+    fNPass++;
+    fMap->GetBField(x, y, z, b);
+    return;
+  }
+
+  //grid coordinates as in SoLIDFieldMap::GetBFieldSplit
+  x = 100*x;
+  y = 100*y;
+  double rho = sqrt(x*x + y*y);
+  double r = rho/fMap->fRStep;
+  z = (100*z + fMap->fZShift)/fMap->fZStep;
+  if (r >= fMap->fNR - 1 || z <= 0 || z >= fMap->fNZ - 1){
+    fNMiss++;
+    b[0] = 0.; b[1] = 0.; b[2] = 0.;
+    return;
+  }
+
+  //the cell is reloaded if it changed, or if the storage of the map changed
+  int r_min = (int)r;
+  int z_min = (int)z;
+  Bool_t isFloat = (fMap->fStorage == SoLIDFieldMap::kInterleavedFloat);
+  if (r_min == fRMin && z_min == fZMin && isFloat == fFloat){
+    fNHit++;
+  }else{
+    fNMiss++;
+    LoadCell(r_min, z_min);
+  }
+
+  //same arithmetic as the map, so that the result is identical
+  double Bzi, Bri;
+  if (fFloat){
+    double dr = r - r_min;
+    double dz = z - z_min;
+    Bzi = (1. - dz)*((1. - dr)*fBz[0] + dr*fBz[1]) + dz*((1. - dr)*fBz[2] + dr*fBz[3]);
+    Bri = (1. - dz)*((1. - dr)*fBr[0] + dr*fBr[1]) + dz*((1. - dr)*fBr[2] + dr*fBr[3]);
+  }else{
+    int r_max = r_min + 1;
+    int z_max = z_min + 1;
+    Bzi = (1./((r_max - r_min)*(z_max - z_min)))*(fBz[0]*( z_max - z )*( r_max - r ) +
+                                                  fBz[2]*( z - z_min )*( r_max - r ) +
+                                                  fBz[1]*( z_max - z )*( r - r_min ) +
+                                                  fBz[3]*( z - z_min )*( r - r_min ) );
+    Bri = (1./((r_max - r_min)*(z_max - z_min)))*(fBr[0]*( z_max - z )*( r_max - r ) +
+                                                  fBr[2]*( z - z_min )*( r_max - r ) +
+                                                  fBr[1]*( z_max - z )*( r - r_min ) +
+                                                  fBr[3]*( z - z_min )*( r - r_min ) );
+  }
+
+  double cosphi = rho > 0 ? x/rho : 0.;
+  double sinphi = rho > 0 ? y/rho : 0.;
+  double scale = fMap->fScale;
+  b[0] = Bri*cosphi;
+  b[1] = Bri*sinphi;
+  b[2] = Bzi;
+  if (scale != 1.){
+    b[0] *= scale;
+    b[1] *= scale;
+    b[2] *= scale;
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef ROOT_SoLID_Field_Cursor
+#define ROOT_SoLID_Field_Cursor
+//ROOT
+#include "Rtypes.h"
+
+class SoLIDFieldMap;
+
+//per-caller cache of the last field map cell. Consecutive lookups along a
+//trajectory, e.g. the stages of one Runge-Kutta step, mostly fall into the
+//same grid cell; those reuse the four corner values kept here instead of
+//redoing the index computation and the table loads. Gives the same result
+//as SoLIDFieldMap::GetBField. Only the bilinear interpolation of (r, z) maps
+//is cached, other interpolations and 3D maps are passed through to the map.
+//Not shared between threads: every caller owns its cursor
+class SoLIDFieldCursor
+{
+  public:
+  SoLIDFieldCursor(const SoLIDFieldMap* map = NULL);
+  ~SoLIDFieldCursor();
+
+  //position in m, field (Bx, By, Bz) in kG written to b[3]
+  void   GetBField(double x, double y, double z, double* b);
+
+  void   SetFieldMap(const SoLIDFieldMap* map) { fMap = map; Reset(); }
+  inline const SoLIDFieldMap* GetFieldMap() const { return fMap; }
+  //forget the cached cell
+  inline void Reset() { fRMin = -1; fZMin = -1; }
+
+  //lookups served from the cached cell, lookups that loaded a new cell (or
+  //were outside the map), and lookups passed through to the map
+  inline ULong64_t GetNHit()  const { return fNHit;  }
+  inline ULong64_t GetNMiss() const { return fNMiss; }
+  inline ULong64_t GetNPass() const { return fNPass; }
+  Double_t GetHitRate() const;
+  void   ResetCounters() { fNHit = 0; fNMiss = 0; fNPass = 0; }
+
+  protected:
+  void   LoadCell(Int_t r_min, Int_t z_min);
+
+  const SoLIDFieldMap* fMap;
+  Int_t     fRMin;       // cached cell, lower grid indices, -1 if none
+  Int_t     fZMin;
+  Bool_t    fFloat;      // corners taken from the interleaved float table
+  Double_t  fBz[4];      // corners (r_min, z_min), (r_max, z_min), (r_min, z_max), (r_max, z_max)
+  Double_t  fBr[4];
+  ULong64_t fNHit;
+  ULong64_t fNMiss;
+  ULong64_t fNPass;
+};
+
+#endif
@@ -1,101 +1,661 @@
+//c++
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+//unix
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 //SoLIDTracking
 #include "SoLIDFieldMap.h"
+#include "SoLIDFieldChebyshev.h"
+#include "SoLIDField3D.h"
 
-SoLIDFieldMap * SoLIDFieldMap::fInstance = NULL;
+map<string, SoLIDFieldMap*> SoLIDFieldMap::fInstances;
+UInt_t SoLIDFieldMap::fgNSettings = 0;
+const char* const SoLIDFieldMap::kTextFile   = "solenoid_CLEOv8.dat";
+const char* const SoLIDFieldMap::kBinaryFile = "solenoid_CLEOv8.bin";
 
 //__________________________________________________________________
-SoLIDFieldMap::SoLIDFieldMap()
+SoLIDFieldMap::SoLIDFieldMap(const char* name, const char* filename, Double_t scale)
+: fName(name), fFileName(filename), fScale(scale), fNZ(0), fNR(0), fNRPadded(0),
+  fZShift(0), fZStep(1), fRStep(1), Bz(NULL), Br(NULL), fMapAddr(NULL), fMapSize(0),
+  fStorage(kSplitDouble), fNode(NULL), fInterpolation(kBilinear), fHermite(NULL), fChebyshev(NULL),
+  fField3D(NULL), fChebyshevFile(SoLIDFieldChebyshev::MakeCoefFileName(filename)),
+  fSettingsId(++fgNSettings)
 {
-  for (int i=0; i<ZSIZE; i++){
-    for (int j=0; j<RSIZE; j++) { 
-      Bz[i][j] = 0;
-      Br[i][j] = 0;
-    }
-  }
   fField.SetXYZ(0.,0.,0.);
-  
-  LoadFieldMap();
 }
 //__________________________________________________________________
-void SoLIDFieldMap::LoadFieldMap()
+SoLIDFieldMap::~SoLIDFieldMap()
 {
-  cout<<"loading SoLID field map"<<endl;
-  ifstream infile;
-  infile.open("solenoid_CLEOv8.dat");
-  if (!infile.is_open()){
+  map<string, SoLIDFieldMap*>::iterator it = fInstances.find(fName);
+  if (it != fInstances.end() && it->second == this) fInstances.erase(it);
+  if (fMapAddr != NULL) munmap(fMapAddr, fMapSize);
+  delete fChebyshev;
+  delete fField3D;
+}
+//__________________________________________________________________
+SoLIDFieldMap * SoLIDFieldMap::GetInstance()
+{
+  SoLIDFieldMap* map = GetInstance(kTextFile, 1.);
+  if (map == NULL){
     cout<<"cannot open field map file"<<endl;
     exit(0);
   }
+  return map;
+}
+//__________________________________________________________________
+SoLIDFieldMap * SoLIDFieldMap::GetInstance(const char* filename, Double_t scale)
+{
+  string name = MakeName(filename, scale);
+  SoLIDFieldMap* map = FindInstance(name.c_str());
+  if (map != NULL) return map;
+
+  map = new SoLIDFieldMap(name.c_str(), filename, scale);
+  if (!map->LoadFieldMap()){
+    delete map;
+    return NULL;
+  }
+  fInstances[name] = map;
+  return map;
+}
+//__________________________________________________________________
+SoLIDFieldMap * SoLIDFieldMap::FindInstance(const char* name)
+{
+  map<string, SoLIDFieldMap*>::iterator it = fInstances.find(name);
+  return (it != fInstances.end()) ? it->second : NULL;
+}
+//__________________________________________________________________
+string SoLIDFieldMap::MakeName(const char* filename, Double_t scale)
+{
+  ostringstream name;
+  name<<filename<<"@"<<setprecision(10)<<scale;
+  return name.str();
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldMap::LoadFieldMap()
+{
+  cout<<"loading SoLID field map "<<fFileName<<" scaled by "<<fScale<<endl;
+  //the binary map is mapped read-only and shared, so every analysis process
+  //on the node uses the same physical pages. The text map is only a fallback
+  if (LoadBinaryFieldMap(fFileName.c_str())) return kTRUE;
+
+  //or a binary 3D map, which then replaces the (r, z) tables
+  fField3D = new SoLIDField3D();
+  if (fField3D->Load(fFileName.c_str())) return kTRUE;
+  delete fField3D;
+  fField3D = NULL;
+
+  //a text map is looked for in binary form next to it, with the .bin extension
+  string binfile = fFileName;
+  size_t n = binfile.size();
+  if (n > 4 && binfile.compare(n - 4, 4, ".dat") == 0){
+    binfile.replace(n - 4, 4, ".bin");
+    if (LoadBinaryFieldMap(binfile.c_str())) return kTRUE;
+    cout<<"binary field map "<<binfile<<" not usable, reading "<<fFileName
+        <<" (run fieldmapconvert once to speed up start-up)"<<endl;
+  }
+
+  if (!LoadTextFieldMap(fFileName.c_str())){
+    cout<<"cannot open field map file "<<fFileName<<endl;
+    return kFALSE;
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+void SoLIDFieldMap::SetGrid(Int_t nz, Int_t nr, Double_t zShift, Double_t zStep, Double_t rStep)
+{
+  fNZ     = nz;
+  fNR     = nr;
+  fZShift = zShift;
+  fZStep  = zStep;
+  fRStep  = rStep;
+  const Int_t lineNodes = 64/sizeof(SoLIDFieldNode);
+  fNRPadded = (nr + lineNodes - 1)/lineNodes*lineNodes;
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldMap::LoadBinaryFieldMap(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return kFALSE;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SoLIDFieldMapHeader)){
+    close(fd);
+    return kFALSE;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); //the mapping stays valid after the descriptor is closed
+  if (addr == MAP_FAILED) return kFALSE;
+
+  //not a binary map at all, e.g. the text map itself
+  const SoLIDFieldMapHeader* header = static_cast<const SoLIDFieldMapHeader*>(addr);
+  if (strncmp(header->fMagic, "SOLFMAP1", 8) != 0){
+    munmap(addr, st.st_size);
+    return kFALSE;
+  }
+
+  size_t tableSize = sizeof(Double_t)*header->fNZ*header->fNR;
+  if (header->fEndianTag != kEndianTag || header->fVersion != kVersion ||
+      header->fNZ < 2 || header->fNR < 2 || !(header->fZStep > 0) || !(header->fRStep > 0) ||
+      header->fBzOffset + tableSize > (size_t)st.st_size ||
+      header->fBrOffset + tableSize > (size_t)st.st_size){
+    cout<<"SoLIDFieldMap: "<<filename<<" has a bad header or is truncated"<<endl;
+    munmap(addr, st.st_size);
+    return kFALSE;
+  }
+
+  fMapAddr = addr;
+  fMapSize = st.st_size;
+  SetGrid(header->fNZ, header->fNR, header->fZShift, header->fZStep, header->fRStep);
+  const char* base = static_cast<const char*>(addr);
+  Bz = reinterpret_cast<const Double_t*>(base + header->fBzOffset);
+  Br = reinterpret_cast<const Double_t*>(base + header->fBrOffset);
+  return kTRUE;
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldMap::LoadTextFieldMap(const char* filename)
+{
+  SoLIDFieldMapHeader grid;
+  if (!ReadTextFieldMap(filename, grid, fTable)) return kFALSE;
+
+  SetGrid(grid.fNZ, grid.fNR, grid.fZShift, grid.fZStep, grid.fRStep);
+  Bz = &fTable[0];
+  Br = &fTable[fNZ*fNR];
+  return kTRUE;
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldMap::FindGridAxis(vector<Double_t>& v, Double_t& vmin, Double_t& step, Int_t& n)
+{
+  sort(v.begin(), v.end());
+  vmin = v.front();
+  Double_t range = v.back() - v.front();
+  step = range;
+  for (size_t i=1; i<v.size(); i++){
+    Double_t d = v[i] - v[i-1];
+    if (d > 1e-6*range && d < step) step = d;
+  }
+  if (!(step > 0)) return kFALSE;
+  n = (Int_t)floor(range/step + 0.5) + 1;
+  return kTRUE;
+}
+//__________________________________________________________________
+Bool_t SoLIDFieldMap::ReadTextFieldMap(const char* filename, SoLIDFieldMapHeader& grid,
+                                       vector<Double_t>& table)
+{
+  ifstream infile;
+  infile.open(filename);
+  if (!infile.is_open()) return kFALSE;
+
+  //columns r, z (cm), Br, Bz (gauss), one line per grid point in any order.
+  //The grid is taken from the coordinates found in the file
+  vector<Double_t> data;
   double input[4];
-  while(1){
-    infile>>input[0]>>input[1]>>input[2]>>input[3];
-    if (infile.eof()) break;
-    
-    int z_pos = fabs( (int)(input[1] + ZSHIFT) );
-    int r_pos = fabs( (int)(input[0]) );
-    Bz[z_pos][r_pos] = input[3]/1000.;//convert from gauss to kgauss
-    Br[z_pos][r_pos] = input[2]/1000.;//convert from gauss to kgauss
-  }
-  
+  while (infile>>input[0]>>input[1]>>input[2]>>input[3]){
+    data.insert(data.end(), input, input + 4);
+  }
   infile.close();
-  
+
+  size_t nPoints = data.size()/4;
+  vector<Double_t> rs(nPoints), zs(nPoints);
+  for (size_t i=0; i<nPoints; i++){
+    rs[i] = data[4*i];
+    zs[i] = data[4*i + 1];
+  }
+  Double_t rMin, zMin, rStep, zStep;
+  Int_t nr, nz;
+  if (nPoints < 4 || !FindGridAxis(rs, rMin, rStep, nr) || !FindGridAxis(zs, zMin, zStep, nz) ||
+      nr < 2 || nz < 2){
+    cout<<"SoLIDFieldMap: "<<filename<<" is not a field map on an (r, z) grid"<<endl;
+    return kFALSE;
+  }
+  if (fabs(rMin) > 1e-6*rStep){
+    cout<<"SoLIDFieldMap: the r grid of "<<filename<<" does not start on the axis"<<endl;
+    return kFALSE;
+  }
+  if (nPoints < (size_t)nz*nr){
+    cout<<"SoLIDFieldMap: "<<filename<<" has "<<nPoints<<" of the "<<nz*nr
+        <<" grid points, the missing ones are set to zero"<<endl;
+  }
+
+  memset(&grid, 0, sizeof(grid));
+  grid.fNZ     = nz;
+  grid.fNR     = nr;
+  grid.fZShift = -zMin;
+  grid.fZStep  = zStep;
+  grid.fRStep  = rStep;
+
+  table.assign(2*nz*nr, 0.);
+  Double_t* bz = &table[0];
+  Double_t* br = &table[nz*nr];
+  for (size_t i=0; i<nPoints; i++){
+    int r_pos = (int)floor(data[4*i]/rStep + 0.5);
+    int z_pos = (int)floor((data[4*i + 1] - zMin)/zStep + 0.5);
+    bz[z_pos*nr + r_pos] = data[4*i + 3]/1000.;//convert from gauss to kgauss
+    br[z_pos*nr + r_pos] = data[4*i + 2]/1000.;//convert from gauss to kgauss
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+Int_t SoLIDFieldMap::ConvertTextToBinary(const char* textfile, const char* binfile)
+{
+  SoLIDFieldMapHeader header;
+  vector<Double_t> table;
+  if (!ReadTextFieldMap(textfile, header, table)){
+    cerr<<"SoLIDFieldMap: cannot read field map file "<<textfile<<endl;
+    return 1;
+  }
+
+  //tables start on page boundaries
+  const ULong64_t page = 4096;
+  const ULong64_t tableSize = sizeof(Double_t)*header.fNZ*header.fNR;
+  memcpy(header.fMagic, "SOLFMAP1", 8);
+  header.fEndianTag = kEndianTag;
+  header.fVersion   = kVersion;
+  header.fBzOffset  = page;
+  header.fBrOffset  = ((page + tableSize + page - 1)/page)*page;
+
+  FILE* out = fopen(binfile, "wb");
+  if (out == NULL){
+    cerr<<"SoLIDFieldMap: cannot create "<<binfile<<endl;
+    return 1;
+  }
+  vector<char> padding(page, 0);
+  Bool_t ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  ok = ok && fwrite(&padding[0], 1, header.fBzOffset - sizeof(header), out) == header.fBzOffset - sizeof(header);
+  ok = ok && fwrite(&table[0], 1, tableSize, out) == tableSize;
+  ok = ok && fwrite(&padding[0], 1, header.fBrOffset - header.fBzOffset - tableSize, out)
+             == header.fBrOffset - header.fBzOffset - tableSize;
+  ok = ok && fwrite(&table[header.fNZ*header.fNR], 1, tableSize, out) == tableSize;
+  ok = (fclose(out) == 0) && ok;
+  if (!ok){
+    cerr<<"SoLIDFieldMap: error writing "<<binfile<<endl;
+    return 1;
+  }
+  cout<<"SoLIDFieldMap: wrote "<<binfile<<", "<<header.fNZ<<" x "<<header.fNR<<" points, z from "
+      <<-header.fZShift<<" cm in steps of "<<header.fZStep<<" cm, r in steps of "
+      <<header.fRStep<<" cm"<<endl;
+  return 0;
+}
+//__________________________________________________________________
+void SoLIDFieldMap::SetStorage(Int_t storage)
+{
+  if (fField3D != NULL) return;
+  fSettingsId = ++fgNSettings;
+  if (storage == kInterleavedFloat){
+    if (fNode == NULL) BuildInterleavedTable();
+    fStorage = kInterleavedFloat;
+  }else{
+    fStorage = kSplitDouble;
+  }
+}
+//__________________________________________________________________
+void SoLIDFieldMap::BuildInterleavedTable()
+{
+  //the float table is built from the double tables, which stay in place
+  //(mapped or read from text) so the storage can be switched back
+  const size_t lineNodes = 64/sizeof(SoLIDFieldNode);
+  fNodeStorage.assign(fNZ*fNRPadded + lineNodes, SoLIDFieldNode());
+  size_t offset = (64 - ((size_t)&fNodeStorage[0] & 63)) % 64;
+  SoLIDFieldNode* node = reinterpret_cast<SoLIDFieldNode*>((char*)&fNodeStorage[0] + offset);
+
+  for (int iz = 0; iz < fNZ; iz++){
+    for (int ir = 0; ir < fNR; ir++){
+      node[iz*fNRPadded + ir].fBr = Br[iz*fNR + ir];
+      node[iz*fNRPadded + ir].fBz = Bz[iz*fNR + ir];
+    }
+  }
+  fNode = node;
+}
+//__________________________________________________________________
+void SoLIDFieldMap::SetInterpolation(Int_t interp)
+{
+  if (fField3D != NULL) return;
+  fSettingsId = ++fgNSettings;
+  if (interp == kHermite){
+    if (fHermite == NULL) BuildHermiteTable();
+    fInterpolation = kHermite;
+  }else if (interp == kChebyshev){
+    if (fChebyshev == NULL){
+      fChebyshev = new SoLIDFieldChebyshev();
+      //the coefficients must have been fitted to this map
+      if (!fChebyshev->ReadCoefficients(fChebyshevFile.c_str(), this)){
+        cout<<"SoLIDFieldMap: cannot use "<<fChebyshevFile<<" for "<<fFileName
+            <<" (run fieldchebfit -m "<<fFileName<<"), using bilinear interpolation"<<endl;
+        delete fChebyshev;
+        fChebyshev = NULL;
+        fInterpolation = kBilinear;
+        return;
+      }
+    }
+    fInterpolation = kChebyshev;
+  }else{
+    fInterpolation = kBilinear;
+  }
+}
+//__________________________________________________________________
+void SoLIDFieldMap::BuildHermiteTable()
+{
+  //derivatives by central differences, one-sided at the z ends and at the
+  //outer radius. At r = 0 the symmetry of the solenoid field is used:
+  //Bz is even and Br is odd in r. The table starts on a 64 byte boundary,
+  //so that every node is one cache line
+  fHermiteStorage.assign(fNZ*fNR + 1, SoLIDFieldHermiteNode());
+  size_t offset = (64 - ((size_t)&fHermiteStorage[0] & 63)) % 64;
+  SoLIDFieldHermiteNode* hermite =
+    reinterpret_cast<SoLIDFieldHermiteNode*>((char*)&fHermiteStorage[0] + offset);
+  const Double_t* tab[2] = { Bz, Br };
+  for (int c = 0; c < 2; c++){
+    const Double_t* f = tab[c];
+    const int nr = fNR;
+    Double_t parity = (c == 0) ? 1. : -1.;
+    for (int iz = 0; iz < fNZ; iz++){
+      int zl = (iz > 0) ? iz - 1 : iz;
+      int zh = (iz < fNZ - 1) ? iz + 1 : iz;
+      for (int ir = 0; ir < nr; ir++){
+        int rh = (ir < nr - 1) ? ir + 1 : ir;
+        int rl = (ir > 0) ? ir - 1 : ir;
+        //value at r - 1 for the r derivatives, mirrored through the axis at r = 0
+        Double_t lowZL = (ir > 0) ? f[zl*nr + rl] : parity*f[zl*nr + 1];
+        Double_t low   = (ir > 0) ? f[iz*nr + rl] : parity*f[iz*nr + 1];
+        Double_t lowZH = (ir > 0) ? f[zh*nr + rl] : parity*f[zh*nr + 1];
+        Double_t dr  = (ir > 0) ? rh - rl : 2;
+
+        Double_t* node = (c == 0) ? hermite[iz*nr + ir].fBz : hermite[iz*nr + ir].fBr;
+        node[0] = f[iz*nr + ir];
+        node[1] = (f[iz*nr + rh] - low)/dr;
+        node[2] = (f[zh*nr + ir] - f[zl*nr + ir])/(zh - zl);
+        node[3] = (f[zh*nr + rh] - lowZH - f[zl*nr + rh] + lowZL)/(dr*(zh - zl));
+      }
+    }
+  }
+  fHermite = hermite;
+}
+//___________________________________________________________________
+Double_t SoLIDFieldMap::GetZMin() const
+{
+  return (fField3D != NULL) ? fField3D->GetZMin() : -fZShift;
+}
+//___________________________________________________________________
+Double_t SoLIDFieldMap::GetZMax() const
+{
+  return (fField3D != NULL) ? fField3D->GetZMax() : (fNZ - 1)*fZStep - fZShift;
+}
+//___________________________________________________________________
+Double_t SoLIDFieldMap::GetRMax() const
+{
+  return (fField3D != NULL) ? fField3D->GetRMax() : (fNR - 1)*fRStep;
 }
 //___________________________________________________________________
 TVector3 & SoLIDFieldMap::GetBField(double x, double y, double z)
 {
-  //here use cm, other place use m
-  x = 100*x;
-  y = 100*y;
-  z = 100*z + ZSHIFT;
-  double r = sqrt(x*x + y*y);
-  if (r >= RSIZE || z <= 0 || z >= ZSIZE){
-    fField.Clear();
-    return fField;
-  }else{
-  
-    int z_max, z_min, r_max, r_min;
-    r_min = (int)r;
-    r_max = r_min + RSTEP;
-    z_min = (int)z;
-    z_max = z_min + ZSTEP;
+  //kept for existing callers, not reentrant since it returns the shared fField
+  Double_t b[3];
+  GetBField(x, y, z, b);
+  fField.SetXYZ(b[0], b[1], b[2]);
+  return fField;
+}
+//___________________________________________________________________
+void SoLIDFieldMap::GetBField(double x, double y, double z, double* b) const
+{
+  if (fField3D != NULL) fField3D->GetBField(x, y, z, b);
+  else if (fInterpolation == kChebyshev) GetBFieldChebyshev(x, y, z, b);
+  else if (fInterpolation == kHermite) GetBFieldHermite(x, y, z, b);
+  else if (fStorage == kInterleavedFloat) GetBFieldInterleaved(x, y, z, b);
+  else GetBFieldSplit(x, y, z, b);
+
+  if (fScale != 1.){
+    b[0] *= fScale;
+    b[1] *= fScale;
+    b[2] *= fScale;
+  }
+}
+//___________________________________________________________________
+void SoLIDFieldMap::GetBField(Int_t n, const double* x, const double* y, const double* z,
+                              double* bx, double* by, double* bz) const
+{
+  Int_t i = 0;
+#ifdef __AVX2__
+  if (fField3D == NULL && fStorage == kSplitDouble && fInterpolation == kBilinear){
+    i = n - n%4;
+    GetBFieldSplitAVX2(i, x, y, z, bx, by, bz);
+    if (fScale != 1.){
+      for (Int_t j=0; j<i; j++){
+        bx[j] *= fScale;
+        by[j] *= fScale;
+        bz[j] *= fScale;
+      }
+    }
+  }
+#endif
+  //scalar loop for the remainder and for the float table
+  Double_t b[3];
+  for (; i<n; i++){
+    GetBField(x[i], y[i], z[i], b);
+    bx[i] = b[0];
+    by[i] = b[1];
+    bz[i] = b[2];
+  }
+}
+#ifdef __AVX2__
+//___________________________________________________________________
+void SoLIDFieldMap::GetBFieldSplitAVX2(Int_t n, const double* x, const double* y, const double* z,
+                                       double* bx, double* by, double* bz) const
+{
+  //four points per iteration, n must be a multiple of 4. Points outside the
+  //map are not gathered and come out as zero
+  const double* bzTab = Bz;
+  const double* brTab = Br;
+  const __m256d cm    = _mm256_set1_pd(100.);
+  const __m256d shift = _mm256_set1_pd(fZShift);
+  const __m256d invRStep = _mm256_set1_pd(1./fRStep);
+  const __m256d invZStep = _mm256_set1_pd(1./fZStep);
+  const __m256d zero  = _mm256_setzero_pd();
+  const __m256d one   = _mm256_set1_pd(1.);
+  const __m256d rMax  = _mm256_set1_pd(fNR - 1);
+  const __m256d zMax  = _mm256_set1_pd(fNZ - 1);
+  const __m128i nr    = _mm_set1_epi32(fNR);
 
-    double f21_Bz =  Bz[z_max][r_min];
-    double f21_Br =  Br[z_max][r_min];
-    double f22_Bz =  Bz[z_max][r_max];
-    double f22_Br =  Br[z_max][r_max];
+  for (Int_t i=0; i<n; i+=4){
+    __m256d vx = _mm256_mul_pd(_mm256_loadu_pd(x + i), cm);
+    __m256d vy = _mm256_mul_pd(_mm256_loadu_pd(y + i), cm);
+    __m256d r  = _mm256_sqrt_pd(_mm256_fmadd_pd(vx, vx, _mm256_mul_pd(vy, vy)));
+    //grid coordinates in units of the steps
+    __m256d vr = _mm256_mul_pd(r, invRStep);
+    __m256d vz = _mm256_mul_pd(_mm256_fmadd_pd(_mm256_loadu_pd(z + i), cm, shift), invZStep);
 
-    double f11_Bz =  Bz[z_min][r_min];
-    double f11_Br =  Br[z_min][r_min];
-    double f12_Bz =  Bz[z_min][r_max];
-    double f12_Br =  Br[z_min][r_max];
-    
-    //linear interpolation
-    double Bzi = (1./((r_max - r_min)*(z_max - z_min)))*(f11_Bz*( z_max - z )*( r_max - r ) +
-                                                         f21_Bz*( z - z_min )*( r_max - r ) +
-                                                         f12_Bz*( z_max - z )*( r - r_min ) +
-                                                         f22_Bz*( z - z_min )*( r - r_min ) );
+    __m256d inside = _mm256_and_pd(_mm256_cmp_pd(vr, rMax, _CMP_LT_OQ),
+                     _mm256_and_pd(_mm256_cmp_pd(vz, zero, _CMP_GT_OQ),
+                                   _mm256_cmp_pd(vz, zMax, _CMP_LT_OQ)));
+    vr = _mm256_and_pd(vr, inside);
+    vz = _mm256_and_pd(vz, inside);
 
-    double Bri = (1./((r_max - r_min)*(z_max - z_min)))*(f11_Br*( z_max - z )*( r_max - r ) +
-                                                         f21_Br*( z - z_min )*( r_max - r ) +
-                                                         f12_Br*( z_max - z )*( r - r_min ) +
-                                                         f22_Br*( z - z_min )*( r - r_min ) );
+    __m256d rFloor = _mm256_floor_pd(vr);
+    __m256d zFloor = _mm256_floor_pd(vz);
+    __m256d dr = _mm256_sub_pd(vr, rFloor);
+    __m256d dz = _mm256_sub_pd(vz, zFloor);
+    __m128i lo = _mm_add_epi32(_mm_mullo_epi32(_mm256_cvttpd_epi32(zFloor), nr),
+                               _mm256_cvttpd_epi32(rFloor));
+    __m128i hi = _mm_add_epi32(lo, nr);
 
-   fField.SetXYZ(Bri*x/r, Bri*y/r, Bzi);
-   return fField;
-  }
+    __m256d wr0 = _mm256_sub_pd(one, dr);
+    __m256d wz0 = _mm256_sub_pd(one, dz);
+
+    //bilinear interpolation, rows z_min (lo) and z_max (hi)
+    __m256d bzLo = _mm256_fmadd_pd(dr, _mm256_mask_i32gather_pd(zero, bzTab + 1, lo, inside, 8),
+                                   _mm256_mul_pd(wr0, _mm256_mask_i32gather_pd(zero, bzTab, lo, inside, 8)));
+    __m256d bzHi = _mm256_fmadd_pd(dr, _mm256_mask_i32gather_pd(zero, bzTab + 1, hi, inside, 8),
+                                   _mm256_mul_pd(wr0, _mm256_mask_i32gather_pd(zero, bzTab, hi, inside, 8)));
+    __m256d brLo = _mm256_fmadd_pd(dr, _mm256_mask_i32gather_pd(zero, brTab + 1, lo, inside, 8),
+                                   _mm256_mul_pd(wr0, _mm256_mask_i32gather_pd(zero, brTab, lo, inside, 8)));
+    __m256d brHi = _mm256_fmadd_pd(dr, _mm256_mask_i32gather_pd(zero, brTab + 1, hi, inside, 8),
+                                   _mm256_mul_pd(wr0, _mm256_mask_i32gather_pd(zero, brTab, hi, inside, 8)));
+    __m256d vbz = _mm256_fmadd_pd(dz, bzHi, _mm256_mul_pd(wz0, bzLo));
+    __m256d vbr = _mm256_fmadd_pd(dz, brHi, _mm256_mul_pd(wz0, brLo));
+
+    //Br/r, zero on the axis and outside the map
+    __m256d onAxis = _mm256_cmp_pd(r, zero, _CMP_EQ_OQ);
+    __m256d brOverR = _mm256_div_pd(vbr, _mm256_blendv_pd(r, one, onAxis));
+    brOverR = _mm256_andnot_pd(onAxis, _mm256_and_pd(brOverR, inside));
 
+    _mm256_storeu_pd(bx + i, _mm256_mul_pd(brOverR, vx));
+    _mm256_storeu_pd(by + i, _mm256_mul_pd(brOverR, vy));
+    _mm256_storeu_pd(bz + i, _mm256_and_pd(vbz, inside));
+  }
 }
+#endif
+//___________________________________________________________________
+void SoLIDFieldMap::GetBFieldSplit(double x, double y, double z, double* b) const
+{
+  //here use cm, other place use m
+  x = 100*x;
+  y = 100*y;
+  double rho = sqrt(x*x + y*y);
+  //r, z below are grid coordinates, in units of the steps from the first node.
+  //The upper corner of the cell must still be inside the table, which may end
+  //together with the mapped file
+  double r = rho/fRStep;
+  z = (100*z + fZShift)/fZStep;
+  if (r >= fNR - 1 || z <= 0 || z >= fNZ - 1){
+    b[0] = 0.; b[1] = 0.; b[2] = 0.;
+    return;
+  }
 
+  int z_max, z_min, r_max, r_min;
+  r_min = (int)r;
+  r_max = r_min + 1;
+  z_min = (int)z;
+  z_max = z_min + 1;
 
+  double f21_Bz =  Bz[z_max*fNR + r_min];
+  double f21_Br =  Br[z_max*fNR + r_min];
+  double f22_Bz =  Bz[z_max*fNR + r_max];
+  double f22_Br =  Br[z_max*fNR + r_max];
 
+  double f11_Bz =  Bz[z_min*fNR + r_min];
+  double f11_Br =  Br[z_min*fNR + r_min];
+  double f12_Bz =  Bz[z_min*fNR + r_max];
+  double f12_Br =  Br[z_min*fNR + r_max];
 
+  //linear interpolation
+  double Bzi = (1./((r_max - r_min)*(z_max - z_min)))*(f11_Bz*( z_max - z )*( r_max - r ) +
+                                                       f21_Bz*( z - z_min )*( r_max - r ) +
+                                                       f12_Bz*( z_max - z )*( r - r_min ) +
+                                                       f22_Bz*( z - z_min )*( r - r_min ) );
 
+  double Bri = (1./((r_max - r_min)*(z_max - z_min)))*(f11_Br*( z_max - z )*( r_max - r ) +
+                                                       f21_Br*( z - z_min )*( r_max - r ) +
+                                                       f12_Br*( z_max - z )*( r - r_min ) +
+                                                       f22_Br*( z - z_min )*( r - r_min ) );
 
+  //Br vanishes on the axis, avoid 0/0 there
+  double cosphi = rho > 0 ? x/rho : 0.;
+  double sinphi = rho > 0 ? y/rho : 0.;
+  b[0] = Bri*cosphi;
+  b[1] = Bri*sinphi;
+  b[2] = Bzi;
+}
+//___________________________________________________________________
+void SoLIDFieldMap::GetBFieldInterleaved(double x, double y, double z, double* b) const
+{
+  //same lookup as GetBFieldSplit, on the interleaved float table
+  x = 100*x;
+  y = 100*y;
+  double rho = sqrt(x*x + y*y);
+  double r = rho/fRStep;
+  z = (100*z + fZShift)/fZStep;
+  if (r >= fNR - 1 || z <= 0 || z >= fNZ - 1){
+    b[0] = 0.; b[1] = 0.; b[2] = 0.;
+    return;
+  }
+
+  int r_min = (int)r;
+  int z_min = (int)z;
+  double dr = r - r_min;
+  double dz = z - z_min;
 
+  const SoLIDFieldNode* lo = &fNode[z_min*fNRPadded + r_min];
+  const SoLIDFieldNode* hi = lo + fNRPadded;
 
+  double Bzi = (1. - dz)*((1. - dr)*lo[0].fBz + dr*lo[1].fBz) +
+                     dz *((1. - dr)*hi[0].fBz + dr*hi[1].fBz);
+  double Bri = (1. - dz)*((1. - dr)*lo[0].fBr + dr*lo[1].fBr) +
+                     dz *((1. - dr)*hi[0].fBr + dr*hi[1].fBr);
 
+  double cosphi = rho > 0 ? x/rho : 0.;
+  double sinphi = rho > 0 ? y/rho : 0.;
+  b[0] = Bri*cosphi;
+  b[1] = Bri*sinphi;
+  b[2] = Bzi;
+}
+//___________________________________________________________________
+void SoLIDFieldMap::GetBFieldHermite(double x, double y, double z, double* b) const
+{
+  //bicubic Hermite interpolation within the cell, using the node values and
+  //derivatives. Derivatives are per grid step, so the local coordinates u, v
+  //run from 0 to 1
+  x = 100*x;
+  y = 100*y;
+  double rho = sqrt(x*x + y*y);
+  double r = rho/fRStep;
+  z = (100*z + fZShift)/fZStep;
+  if (r >= fNR - 1 || z <= 0 || z >= fNZ - 1){
+    b[0] = 0.; b[1] = 0.; b[2] = 0.;
+    return;
+  }
 
+  int r_min = (int)r;
+  int z_min = (int)z;
+  double u = r - r_min;
+  double v = z - z_min;
 
+  //Hermite basis: value weights h0 (at 0), h1 (at 1), slope weights g0, g1
+  double u2 = u*u, u3 = u2*u;
+  double v2 = v*v, v3 = v2*v;
+  double hu[2] = { 2*u3 - 3*u2 + 1, -2*u3 + 3*u2 };
+  double gu[2] = { u3 - 2*u2 + u,    u3 - u2 };
+  double hv[2] = { 2*v3 - 3*v2 + 1, -2*v3 + 3*v2 };
+  double gv[2] = { v3 - 2*v2 + v,    v3 - v2 };
 
+  double Bzi = 0., Bri = 0.;
+  for (int j = 0; j < 2; j++){
+    const SoLIDFieldHermiteNode* row = &fHermite[(z_min + j)*fNR + r_min];
+    for (int i = 0; i < 2; i++){
+      const SoLIDFieldHermiteNode& node = row[i];
+      double w[4] = { hu[i]*hv[j], gu[i]*hv[j], hu[i]*gv[j], gu[i]*gv[j] };
+      Bzi += w[0]*node.fBz[0] + w[1]*node.fBz[1] + w[2]*node.fBz[2] + w[3]*node.fBz[3];
+      Bri += w[0]*node.fBr[0] + w[1]*node.fBr[1] + w[2]*node.fBr[2] + w[3]*node.fBr[3];
+    }
+  }
 
+  double cosphi = rho > 0 ? x/rho : 0.;
+  double sinphi = rho > 0 ? y/rho : 0.;
+  b[0] = Bri*cosphi;
+  b[1] = Bri*sinphi;
+  b[2] = Bzi;
+}
+//___________________________________________________________________
+void SoLIDFieldMap::GetBFieldChebyshev(double x, double y, double z, double* b) const
+{
+  double r = 100*sqrt(x*x + y*y);
+  double br, bz;
+  if (!fChebyshev->EvalRZ(r, 100*z, br, bz)){
+    if (fStorage == kInterleavedFloat) GetBFieldInterleaved(x, y, z, b);
+    else GetBFieldSplit(x, y, z, b);
+    return;
+  }
 
+  double cosphi = r > 0 ? 100*x/r : 0.;
+  double sinphi = r > 0 ? 100*y/r : 0.;
+  b[0] = br*cosphi;
+  b[1] = br*sinphi;
+  b[2] = bz;
+}
@@ -4,40 +4,177 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <string>
 #include <cmath>
 //ROOT
 #include "TVector3.h"
 //SoLIDTracking
 #include "SoLIDUtility.h"
-
-#define ZSIZE 1201
-#define RSIZE 501
-#define ZSHIFT 600
-#define ZSTEP 1
-#define RSTEP 1
+class SoLIDFieldChebyshev;
+class SoLIDField3D;
 
 using namespace std;
 
+//header of the binary field map file, the Bz and Br tables follow at page
+//aligned offsets so that they can be mapped directly into memory
+struct SoLIDFieldMapHeader {
+  char      fMagic[8];   // "SOLFMAP1"
+  UInt_t    fEndianTag;  // kEndianTag as written by the converter
+  UInt_t    fVersion;
+  UInt_t    fNZ;         // number of grid points in z
+  UInt_t    fNR;         // number of grid points in r, the first one at r = 0
+  Double_t  fZShift;     // minus the z of the first grid point (cm)
+  Double_t  fZStep;      // cm
+  Double_t  fRStep;      // cm
+  ULong64_t fBzOffset;   // byte offset of the Bz[nz][nr] table (kG)
+  ULong64_t fBrOffset;   // byte offset of the Br[nz][nr] table (kG)
+};
+
+//one grid node of the interleaved single precision table
+struct SoLIDFieldNode {
+  Float_t fBr;  // kG
+  Float_t fBz;  // kG
+};
+
+//one grid node of the Hermite table: value and derivatives (per grid step)
+//of both components, one 64 byte cache line per node
+struct SoLIDFieldHermiteNode {
+  Double_t fBz[4];  // Bz, dBz/dr, dBz/dz, d2Bz/drdz (kG)
+  Double_t fBr[4];  // Br, dBr/dr, dBr/dz, d2Br/drdz (kG)
+};
+
 class SoLIDFieldMap
 {
-  public: 
-  ~SoLIDFieldMap() {;}
-  static SoLIDFieldMap * GetInstance() {
-    if (fInstance == NULL) fInstance = new SoLIDFieldMap();
-    return fInstance;
-  }
-  
+  public:
+  ~SoLIDFieldMap();
+  //the default map (kTextFile, or its binary version kBinaryFile) at nominal
+  //current, exits if it cannot be loaded
+  static SoLIDFieldMap * GetInstance();
+  //map from the given file (binary or text, a .dat file is looked for as .bin
+  //first, or a binary 3D map of SoLIDField3D) scaled by scale. Maps are kept
+  //by name, see MakeName, and loaded only once per job. Returns NULL if the
+  //file cannot be loaded
+  static SoLIDFieldMap * GetInstance(const char* filename, Double_t scale = 1.);
+  //a map that is already loaded, NULL otherwise
+  static SoLIDFieldMap * FindInstance(const char* name);
+  static string MakeName(const char* filename, Double_t scale);
+
   TVector3 & GetBField(double x, double y, double z);
-  
+  //reentrant evaluation, position in m, field (Bx, By, Bz) in kG written to b[3].
+  //Only reads the tables, so it can be called from several threads at once
+  void GetBField(double x, double y, double z, double* b) const;
+  //batched evaluation of n points, same units. Uses AVX2, four points at a
+  //time, when compiled with it, otherwise loops over the single point call
+  void GetBField(Int_t n, const double* x, const double* y, const double* z,
+                 double* bx, double* by, double* bz) const;
+
+  //storage used by GetBField: the two double tables as read from the map file,
+  //or (Br, Bz) float pairs interleaved per node, so that the four nodes of a
+  //bilinear lookup sit in two cache lines (one per z row)
+  enum EStorage { kSplitDouble = 0, kInterleavedFloat };
+  void     SetStorage(Int_t storage);
+  Int_t    GetStorage() const { return fStorage; }
+
+  //interpolation between the grid nodes: bilinear, or bicubic Hermite with
+  //derivatives precomputed at the nodes, which keeps the field and its first
+  //derivatives continuous across cell edges (64 bytes per node).
+  //kChebyshev evaluates the fitted parameterization of SoLIDFieldChebyshev
+  //instead of the grid (coefficients from fieldchebfit, fitted at unit
+  //scale), and falls back to bilinear outside the fitted range. The
+  //coefficient file is the map file with the .cheb extension by default,
+  //and is refused if it was fitted to another map
+  enum EInterpolation { kBilinear = 0, kHermite, kChebyshev };
+  void     SetInterpolation(Int_t interp);
+  Int_t    GetInterpolation() const { return fInterpolation; }
+  void     SetChebyshevFile(const char* filename) { fChebyshevFile = filename; }
+
+  //the field is multiplied by the scale factor, e.g. the ratio of the magnet
+  //current to the one the map was computed for
+  void     SetScale(Double_t scale) { fScale = scale; fSettingsId = ++fgNSettings; }
+  Double_t GetScale() const { return fScale; }
+
+  //changes with every setting that may change what GetBField returns (scale,
+  //storage, interpolation) and is never the same for two maps, so that a
+  //cache of field values (SoLIDFieldCursor, SoLKalStepperContext) can tell
+  //that it is out of date
+  UInt_t   GetSettingsId() const { return fSettingsId; }
+
+  const char* GetName()     const { return fName.c_str(); }
+  const char* GetFileName() const { return fFileName.c_str(); }
+  Int_t    GetNZ()     const { return fNZ; }
+  Int_t    GetNR()     const { return fNR; }
+  Double_t GetZShift() const { return fZShift; }
+  Double_t GetZStep()  const { return fZStep; }
+  Double_t GetRStep()  const { return fRStep; }
+  Double_t GetZMin()   const;   //cm
+  Double_t GetZMax()   const;   //cm
+  Double_t GetRMax()   const;   //cm, field known at every azimuth up to there
+
+  //3D Cartesian map, which replaces the (r, z) tables. Storage and
+  //interpolation settings do not apply to it
+  Bool_t   Is3D()      const { return fField3D != NULL; }
+  const SoLIDField3D* GetField3D() const { return fField3D; }
+
+  //one-time conversion of the CLEO text map into the binary format
+  static Int_t ConvertTextToBinary(const char* textfile, const char* binfile);
+  //smallest value, spacing and number of points of a regular grid axis, from
+  //all the coordinates found on that axis (v is sorted), for the map readers
+  static Bool_t FindGridAxis(vector<Double_t>& v, Double_t& vmin, Double_t& step, Int_t& n);
+
+  static const char* const kTextFile;
+  static const char* const kBinaryFile;
+  static const UInt_t kEndianTag = 0x01020304;
+  static const UInt_t kVersion   = 1;
+
   protected:
-  SoLIDFieldMap();
-  static SoLIDFieldMap *fInstance;
-  void LoadFieldMap();
-  
-  Double_t  Bz[ZSIZE][RSIZE]; //hard coded for now, array to store SoLID B field
-  Double_t  Br[ZSIZE][RSIZE]; //hard coded for now, array to store SoLID B field
-  TVector3  fField;
-  
-};  
+  friend class SoLIDFieldCursor;
+  SoLIDFieldMap(const char* name, const char* filename, Double_t scale);
+  static map<string, SoLIDFieldMap*> fInstances;
+  static UInt_t fgNSettings;   // last settings id given out
+  Bool_t LoadFieldMap();
+  Bool_t LoadBinaryFieldMap(const char* filename);
+  Bool_t LoadTextFieldMap(const char* filename);
+  static Bool_t ReadTextFieldMap(const char* filename, SoLIDFieldMapHeader& grid,
+                                 vector<Double_t>& table);
+  void SetGrid(Int_t nz, Int_t nr, Double_t zShift, Double_t zStep, Double_t rStep);
+  void BuildInterleavedTable();
+  void BuildHermiteTable();
+  void GetBFieldSplit(double x, double y, double z, double* b) const;
+  void GetBFieldInterleaved(double x, double y, double z, double* b) const;
+  void GetBFieldHermite(double x, double y, double z, double* b) const;
+  void GetBFieldChebyshev(double x, double y, double z, double* b) const;
+#ifdef __AVX2__
+  void GetBFieldSplitAVX2(Int_t n, const double* x, const double* y, const double* z,
+                          double* bx, double* by, double* bz) const;
+#endif
+
+  string    fName;
+  string    fFileName;
+  Double_t  fScale;
+  Int_t     fNZ;               // grid points in z
+  Int_t     fNR;               // grid points in r
+  Int_t     fNRPadded;         // fNR rounded up to whole 64 byte lines of SoLIDFieldNode
+  Double_t  fZShift;           // cm
+  Double_t  fZStep;            // cm
+  Double_t  fRStep;            // cm
+  const Double_t* Bz;          //! [fNZ][fNR], points either into fTable or into the mapped file
+  const Double_t* Br;          //! [fNZ][fNR], points either into fTable or into the mapped file
+  vector<Double_t> fTable;     //! storage when the map is read from the text file
+  void*     fMapAddr;          //! address of the mapped binary file, NULL if not mapped
+  size_t    fMapSize;
+  Int_t     fStorage;
+  vector<SoLIDFieldNode> fNodeStorage; //! backing store of fNode, with room for alignment
+  const SoLIDFieldNode* fNode; //! [fNZ][fNRPadded], 64 byte aligned interleaved table
+  Int_t     fInterpolation;
+  vector<SoLIDFieldHermiteNode> fHermiteStorage; //! backing store of fHermite, with room for alignment
+  const SoLIDFieldHermiteNode* fHermite; //! [fNZ][fNR], 64 byte aligned node values and derivatives
+  SoLIDFieldChebyshev* fChebyshev;        //! analytic parameterization, NULL until used
+  SoLIDField3D* fField3D;      //! 3D map, NULL for an (r, z) map
+  string    fChebyshevFile;
+  TVector3  fField;            //! returned by the non-reentrant GetBField
+  UInt_t    fSettingsId;       //! see GetSettingsId
+
+};
 
 #endif
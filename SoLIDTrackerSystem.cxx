@@ -28,8 +28,11 @@
 #include "SoLIDUtility.h"
 #include "SoLIDGEMHit.h"
 #include "SoLIDTrack.h"
+#include "SoLKalFieldStepper.h"
 #include "SIDISKalTrackFinder.h"
 #include "PVDISKalTrackFinder.h"
+#include "SoLKalTrackArena.h"
+#include "SoLKalTrackSite.h"
 
 using namespace std;
 using namespace Podd;
@@ -40,10 +43,26 @@ typedef string::size_type ssiz_t;
 typedef vector<vector<Int_t> >::iterator vviter_t;
 
 //typedef vector<Plane*>::size_type vrsiz_t;
+
+// The stepper and the field maps are shared by all tracker systems: the
+// settings of the stepper and the map settings of every system, with the
+// date of the database they were read for. Systems initialized for the same
+// date belong to one analysis and must agree (see CheckSharedSettings)
+namespace {
+  struct SharedSettings {
+    UInt_t fDate;
+    string fSettings;
+  };
+  map<const SoLIDTrackerSystem*, SharedSettings> gSharedSettings;
+}
+
 //_____________________________________________________________________________
 SoLIDTrackerSystem::SoLIDTrackerSystem( const char* name, const char* desc, THaApparatus* app)
   :THaTrackingDetector(name,desc,app), fSystemID(-1),
-   fPhi(0), fDetConf(0), fTracks(0), fCrateMap(0), fTrackFinder(0)
+   fPhi(0), fDetConf(0), fTracks(0), fCrateMap(0), fFieldMap(0), fMaxBranches(1), fTrackFinder(0),
+   fEvNTransport(0), fEvNRKStep(0), fEvNRejectStep(0), fEvNRetry(0), fEvNFieldCall(0),
+   fEvNStraightLine(0), fEvNSite(0), fEvNState(0), fEvNArenaAlloc(0), fEvNSingularFilter(0),
+   fRunNSingularFilter(0)
 #ifdef MCDATA
   , fMCDecoder(0), fChecked(false)
 #endif
@@ -53,8 +72,6 @@ SoLIDTrackerSystem::SoLIDTrackerSystem( const char* name, const char* desc, THaA
 #else
   fTracks = new TClonesArray("SoLIDTrack", 10);
 #endif
-
-  fFieldMap = SoLIDFieldMap::GetInstance();
 }
 
 //_____________________________________________________________________________
@@ -62,6 +79,7 @@ SoLIDTrackerSystem::~SoLIDTrackerSystem()
 {
   if( fIsSetup )
     RemoveVariables();
+  gSharedSettings.erase(this);
   DeleteContainer(fGEMTracker);
   delete fTracks;
   delete fECal;
@@ -99,8 +117,14 @@ Int_t SoLIDTrackerSystem::ReadDatabase(const TDatime& date)
   fNTracker    = -1;
   fChi2Cut     = -1;
   fNMaxMissHit = -1;
+  fMaxBranches = 1;
   fDetConf     = -1;
   Int_t do_rawdecode = -1, do_coarsetrack = -1, do_finetrack = -1, do_chi2 = -1;
+  Int_t field_float = 0, field_interp = 0, field_cursor = 0, rk_method = 0;
+  Int_t fast_transport = -1, material_table = 1, lump_air = 0, helix_step = 0;
+  TString field_map = SoLIDFieldMap::kTextFile;
+  TString transport_table, transfer_map;
+  Double_t field_scale = 1., seed_tolerance = -1.;
   assert( GetCrateMapDBcols() >= 5 );
   DBRequest request[] = {
     { "cratemap",          cmap,               kIntM,   GetCrateMapDBcols() },
@@ -114,7 +138,21 @@ Int_t SoLIDTrackerSystem::ReadDatabase(const TDatime& date)
     { "do_chi2",           &do_chi2,           kInt,    0, 1 },
     { "chi2_cut",          &fChi2Cut,          kDouble, 0, 1 },
     { "max_miss_hit",      &fNMaxMissHit,      kInt,    0, 1 },
+    { "max_branches",      &fMaxBranches,      kInt,    0, 1 },
     { "ntracker",          &fNTracker,         kInt,    0, 1 },
+    { "field_map",         &field_map,         kTString, 0, 1 },
+    { "field_scale",       &field_scale,       kDouble, 0, 1 },
+    { "field_float",       &field_float,       kInt,    0, 1 },
+    { "field_interp",      &field_interp,      kInt,    0, 1 },
+    { "field_cursor",      &field_cursor,      kInt,    0, 1 },
+    { "rk_method",         &rk_method,         kInt,    0, 1 },
+    { "transport_table",   &transport_table,   kTString, 0, 1 },
+    { "transfer_map",      &transfer_map,      kTString, 0, 1 },
+    { "fast_transport",    &fast_transport,    kInt,    0, 1 },
+    { "material_table",    &material_table,    kInt,    0, 1 },
+    { "lump_air",          &lump_air,          kInt,    0, 1 },
+    { "helix_step",        &helix_step,        kInt,    0, 1 },
+    { "seed_tolerance",    &seed_tolerance,    kDouble, 0, 1 },
     { 0 }
   };
 
@@ -164,6 +202,64 @@ Int_t SoLIDTrackerSystem::ReadDatabase(const TDatime& date)
   SetBit( kDoFine,        do_coarsetrack && do_finetrack );
   SetBit( kDoChi2,        do_chi2 );
 
+  // The keys below set the stepper and the field map, which all tracker
+  // systems share, and are refused if another system of this analysis set
+  // them differently. max_branches and the cuts above are per system
+  ostringstream shared;
+  shared << "field_map " << field_map << ", field_scale " << field_scale
+         << ", field_float " << field_float << ", field_interp " << field_interp
+         << ", field_cursor " << field_cursor << ", rk_method " << rk_method
+         << ", helix_step " << helix_step << ", material_table " << material_table
+         << ", lump_air " << lump_air << ", seed_tolerance " << seed_tolerance
+         << ", transport_table \"" << transport_table << "\", transfer_map \"" << transfer_map
+         << "\", fast_transport " << fast_transport;
+  if( !CheckSharedSettings( date, shared.str() ) )
+    return kInitError;
+
+  // field map file (binary or text) and current scale factor. Maps are shared
+  // by name, so runs at different settings can be processed in one job
+  fFieldMap = SoLIDFieldMap::GetInstance( field_map.Data(), field_scale );
+  if( !fFieldMap ) {
+    Error( Here(here), "Cannot load field map %s", field_map.Data() );
+    return kInitError;
+  }
+  SoLKalFieldStepper::GetInstance()->SetFieldMap( fFieldMap );
+  // field lookups through the last-cell cache of the stepper
+  SoLKalFieldStepper::GetInstance()->SetUseFieldCursor( field_cursor );
+  // Runge-Kutta scheme of the stepper, 0: RK4, 1: Dormand-Prince 5(4)
+  SoLKalFieldStepper::GetInstance()->SetRKMethod( rk_method );
+  // analytic helix steps where the field is uniform along the step
+  SoLKalFieldStepper::GetInstance()->SetUseHelix( helix_step );
+  // material effects from lookup tables (default) or the exact formulas, and
+  // the air once per plane gap instead of once per Runge-Kutta step
+  SoLKalFieldStepper::GetInstance()->SetUseMaterialTable( material_table );
+  SoLKalFieldStepper::GetInstance()->SetLumpAir( lump_air );
+  // accuracy (m) of the seed extrapolation to the ECal and the target, the
+  // stepper default if not given
+  if( seed_tolerance > 0 )
+    SoLKalFieldStepper::GetInstance()->SetSeedTolerance( seed_tolerance );
+  // plane to plane transport table and polynomial transfer maps for the hit
+  // predictions, optional. fast_transport selects one, 0: table, 1: transfer
+  // maps; by default the transfer maps if they are given
+  if( !transport_table.IsNull() &&
+      !SoLKalFieldStepper::GetInstance()->LoadTransportTable( transport_table.Data() ) )
+    Warning( Here(here), "Transport table %s not used, predictions with the stepper",
+             transport_table.Data() );
+  if( !transfer_map.IsNull() &&
+      !SoLKalFieldStepper::GetInstance()->LoadTransferMap( transfer_map.Data() ) )
+    Warning( Here(here), "Transfer map %s not used, predictions with the stepper",
+             transfer_map.Data() );
+  if( fast_transport < 0 )
+    fast_transport = transfer_map.IsNull() ? SoLKalFieldStepper::kFastTable
+                                           : SoLKalFieldStepper::kFastTransferMap;
+  SoLKalFieldStepper::GetInstance()->SetFastTransport( fast_transport );
+
+  // field map storage, interleaved single precision if field_float is set
+  fFieldMap->SetStorage( field_float ? SoLIDFieldMap::kInterleavedFloat
+                                     : SoLIDFieldMap::kSplitDouble );
+  // field interpolation, 0: bilinear, 1: bicubic Hermite, 2: Chebyshev fit
+  fFieldMap->SetInterpolation( field_interp );
+
   cout << endl;
   if( fDebug > 0 ) {
 #ifdef MCDATA
@@ -195,6 +291,8 @@ void SoLIDTrackerSystem::Clear(Option_t* opt)
     fTrackFinder->Clear(opt);
   }
   fTracks->Clear(opt);
+  fEvNTransport = fEvNRKStep = fEvNRejectStep = fEvNRetry = fEvNFieldCall = fEvNStraightLine = 0;
+  fEvNSite = fEvNState = fEvNArenaAlloc = fEvNSingularFilter = 0;
 }
 //_____________________________________________________________________________
 Int_t SoLIDTrackerSystem::Decode( const THaEvData& evdata)
@@ -263,6 +361,9 @@ THaAnalysisObject::EStatus SoLIDTrackerSystem::Init( const TDatime& date )
 
   fTrackFinder->SetGEMDetector(fGEMTracker);
   fTrackFinder->SetECalDetector(fECal);
+  // combinatorial track following, the number of branches of a candidate
+  // on several compatible hits of a tracker, 1 (default) for the closest hit
+  fTrackFinder->SetMaxBranches(fMaxBranches);
 
   return fStatus = kOK;
 }
@@ -316,7 +417,32 @@ Int_t SoLIDTrackerSystem::CoarseTrack( TClonesArray& /*tracks*/ )
 #endif
 
   //this is where the actual pattern recognition done
+  // the stepper and its counters are shared by all tracker systems, the
+  // difference around the track finding is the work of this system
+  SoLKalStepperContext& ctx = SoLKalFieldStepper::GetInstance()->GetDefaultContext();
+  SoLKalStepperCounts start(ctx);
+#ifdef TESTCODE
+  ULong64_t nSingularFilter = SoLKalTrackSite::GetNSingularFilter();
+#endif
   fTrackFinder->ProcessHits(fTracks);
+  SoLKalStepperCounts event(ctx);
+  event -= start;
+  fRunCounts += event;
+#ifdef TESTCODE
+  fEvNTransport    = event.fNTransport;
+  fEvNRKStep       = event.fNRKStep;
+  fEvNRejectStep   = event.fNRejectStep;
+  fEvNRetry        = event.fNRetry;
+  fEvNFieldCall    = event.fNFieldCall;
+  fEvNStraightLine = event.fNStraightLine;
+  fEvNSingularFilter = SoLKalTrackSite::GetNSingularFilter() - nSingularFilter;
+  fRunNSingularFilter += fEvNSingularFilter;
+  // each site and state was a new before the arena
+  SoLKalTrackArena* arena = fTrackFinder->GetArena();
+  fEvNSite       = arena->GetNSites();
+  fEvNState      = arena->GetNStates();
+  fEvNArenaAlloc = arena->GetNAlloc();
+#endif
   }
   return kOK;
 }
@@ -481,6 +607,24 @@ Int_t SoLIDTrackerSystem::DefineVariables( EMode mode )
     ret = DefineVarsFromList( mcvars, mode );
 #endif
   }
+#ifdef TESTCODE
+  if( ret != kOK ) return ret;
+  // cost of the propagation in the event, to correlate with the occupancy
+  RVarDef stepvars[] = {
+    { "stepper.ntransport", "calls of Transport",                       "fEvNTransport"    },
+    { "stepper.nstep",      "Runge-Kutta steps",                        "fEvNRKStep"       },
+    { "stepper.nreject",    "steps repeated for the precision",         "fEvNRejectStep"   },
+    { "stepper.nretry",     "steps repeated after passing the plane",   "fEvNRetry"        },
+    { "stepper.nfield",     "field lookups",                            "fEvNFieldCall"    },
+    { "stepper.nstraight",  "straight line fallbacks of Transport",     "fEvNStraightLine" },
+    { "filter.nsingular",   "filters refused for a singular residual covariance", "fEvNSingularFilter" },
+    { "arena.nsite",        "sites of the track finder",                "fEvNSite"         },
+    { "arena.nstate",       "states of the track finder",               "fEvNState"        },
+    { "arena.nalloc",       "sites and states newly allocated",         "fEvNArenaAlloc"   },
+    { 0 }
+  };
+  ret = DefineVarsFromList( stepvars, mode );
+#endif
   return ret;
 }
 //_____________________________________________________________________________
@@ -532,9 +676,82 @@ Int_t SoLIDTrackerSystem::Begin( THaRunBase* /*r*/)
 //_____________________________________________________________________________
 Int_t SoLIDTrackerSystem::End( THaRunBase* /*r*/ )
 {
+  // The stepper is shared by all tracker systems, each one reports the work
+  // of its own track finding, counted in CoarseTrack
+  const SoLKalStepperCounts& run = fRunCounts;
+  if( run.fNCursorHit + run.fNCursorMiss > 0 ) {
+    Info( Here("End"), "Field cursor: %llu lookups, cell hit rate %.3f",
+          run.fNCursorHit + run.fNCursorMiss,
+          Double_t(run.fNCursorHit)/(run.fNCursorHit + run.fNCursorMiss) );
+  }
+  // The arena belongs to the track finder of this system. The last event
+  // is not reset yet, its objects are added to the totals here
+  SoLKalTrackArena* arena = fTrackFinder ? fTrackFinder->GetArena() : 0;
+  if( arena ) arena->CountEvent();
+  if( arena && arena->GetNEvents() > 0 ) {
+    Info( Here("End"), "Track arena: %.1f sites and %.1f states per event, "
+          "%llu of the %llu objects newly allocated",
+          Double_t(arena->GetTotalSites())/arena->GetNEvents(),
+          Double_t(arena->GetTotalStates())/arena->GetNEvents(),
+          arena->GetTotalAlloc(), arena->GetTotalSites() + arena->GetTotalStates() );
+    arena->ResetCounters();
+  }
+  if( run.fNTransport > 0 ) {
+    Info( Here("End"), "Stepper: %llu transports, %.1f field lookups and %.1f helix steps per transport",
+          run.fNTransport, Double_t(run.fNFieldCall)/run.fNTransport,
+          Double_t(run.fNHelixStep)/run.fNTransport );
+#ifdef TESTCODE
+    Info( Here("End"), "Stepper: %llu Runge-Kutta steps, %llu rejected steps, "
+          "%llu overshoot retries, %llu straight line fallbacks, "
+          "%llu fixed step propagations past the plane",
+          run.fNRKStep, run.fNRejectStep, run.fNRetry, run.fNStraightLine, run.fNPassPlane );
+#endif
+  }
+#ifdef TESTCODE
+  if( fRunNSingularFilter > 0 ) {
+    Info( Here("End"), "Kalman filter: %llu hits refused for a singular residual covariance",
+          fRunNSingularFilter );
+  }
+#endif
+  if( run.fNTableHit + run.fNTableMiss > 0 ) {
+    Info( Here("End"), "%s: %llu predictions, %.3f from it",
+          SoLKalFieldStepper::GetInstance()->GetFastTransport() == SoLKalFieldStepper::kFastTransferMap
+          ? "Transfer map" : "Transport table",
+          run.fNTableHit + run.fNTableMiss,
+          Double_t(run.fNTableHit)/(run.fNTableHit + run.fNTableMiss) );
+  }
+  fRunCounts = SoLKalStepperCounts();
+  fRunNSingularFilter = 0;
   return 0;
 }
 //_____________________________________________________________________________
+Bool_t SoLIDTrackerSystem::CheckSharedSettings( const TDatime& date, const string& settings )
+{
+  // The stepper and field map settings of this system must be the same as
+  // those of the other systems read for the same date, otherwise the last
+  // one read would silently apply to all of them. Settings read for another
+  // date are from a previous run and are replaced when their system is
+  // initialized again
+
+  static const char* const here = "SoLIDTrackerSystem::ReadDatabase";
+  for( map<const SoLIDTrackerSystem*, SharedSettings>::const_iterator it = gSharedSettings.begin();
+       it != gSharedSettings.end(); ++it ) {
+    if( it->first == this || it->second.fDate != date.Get() ) continue;
+    if( it->second.fSettings != settings ) {
+      Error( Here(here), "Stepper and field map settings differ from those of %s, "
+             "they are shared by all tracker systems.\n  %s: %s\n  %s: %s",
+             it->first->GetName(), it->first->GetName(), it->second.fSettings.c_str(),
+             GetName(), settings.c_str() );
+      gSharedSettings.erase(this);
+      return kFALSE;
+    }
+  }
+  SharedSettings& mine = gSharedSettings[this];
+  mine.fDate     = date.Get();
+  mine.fSettings = settings;
+  return kTRUE;
+}
+//_____________________________________________________________________________
 const char* SoLIDTrackerSystem::GetDBFileName() const
 {
   // Return database file name prefix. For SoLID trackers, this is the detector
@@ -10,6 +10,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 //c++
 #include <vector>
+#include <string>
 #include <utility>
 #include <set>
 #include <list>
@@ -33,11 +34,12 @@
 #include "SoLIDECal.h"
 #include "SoLIDFieldMap.h"
 #include "SoLKalTrackFinder.h"
+#include "SoLKalFieldStepper.h"
 
 class SoLIDTrackerSystem : public THaTrackingDetector {
   public:
     SoLIDTrackerSystem( const char* name, const char* description = "", THaApparatus* app = 0 );
-    SoLIDTrackerSystem() : fECal(0), fTracks(0), fTrackFinder(0) {}
+    SoLIDTrackerSystem() : fECal(0), fFieldMap(0), fTracks(0), fTrackFinder(0) {}
     virtual ~SoLIDTrackerSystem();
 
     virtual Int_t   ReadDatabase( const TDatime& date );
@@ -94,6 +96,9 @@ class SoLIDTrackerSystem : public THaTrackingDetector {
     virtual void  MakePrefix();
     virtual Int_t ReadGeometry( FILE* file, const TDatime& date,
 				Bool_t required = kTRUE );
+    // the settings of the shared stepper and field maps agree with those of
+    // the other systems of the analysis
+    Bool_t        CheckSharedSettings( const TDatime& date, const std::string& settings );
 
     // Geometry
     Int_t          fSystemID;       // track system ID, 0 for SIDIS and J/Psi, 0~29 for PVDIS
@@ -114,9 +119,27 @@ class SoLIDTrackerSystem : public THaTrackingDetector {
     Int_t          fNTracker;       //total number of GEM detectors in this system SIDIS:6, PVDIS:5
     Double_t       fChi2Cut;        //chi2 cut after fitting the track
     Int_t          fNMaxMissHit;    //maximum number of hits that is allowed in the coarse tracking
+    Int_t          fMaxBranches;    //branches of a track candidate in the coarse tracking, 1 for the closest hit only
     
     
     SoLKalTrackFinder* fTrackFinder; 
+
+    // Stepper cost of the event (global variables), only filled with
+    // TESTCODE, but kept for binary compatibility
+    Int_t          fEvNTransport;   // calls of Transport
+    Int_t          fEvNRKStep;      // Runge-Kutta steps
+    Int_t          fEvNRejectStep;  // steps repeated shorter for the precision
+    Int_t          fEvNRetry;       // steps repeated after going past the plane
+    Int_t          fEvNFieldCall;   // field lookups
+    Int_t          fEvNStraightLine;// straight line fallbacks of Transport
+    Int_t          fEvNSite;        // sites taken from the arena of the track finder
+    Int_t          fEvNState;       // states taken from the arena
+    Int_t          fEvNArenaAlloc;  // new objects the arena had to allocate
+    Int_t          fEvNSingularFilter; // Kalman filters refused for a singular residual covariance
+    // Run totals of this system for End(): the stepper counters are shared
+    // by all systems, each adds the difference around its track finding
+    SoLKalStepperCounts fRunCounts;  //!
+    ULong64_t      fRunNSingularFilter; //! filters refused for a singular R (TESTCODE)
 #ifdef MCDATA
     const Podd::SimDecoder* fMCDecoder; //! MC data decoder (if kMCdata)
     Bool_t fChecked;
@@ -20,6 +20,9 @@
 #pragma link C++ class SoLIDGEMHit+;
 #pragma link C++ class SoLIDTrack+;
 #pragma link C++ class SoLIDFieldMap+;
+#pragma link C++ class SoLIDFieldChebyshev+;
+#pragma link C++ class SoLIDFieldCursor+;
+#pragma link C++ class SoLIDField3D+;
 #pragma link C++ class SoLKalTrackFinder+;
 #pragma link C++ class SIDISKalTrackFinder+;
 #pragma link C++ class PVDISKalTrackFinder+;
@@ -28,6 +31,10 @@
 #pragma link C++ class SoLKalTrackState+;
 #pragma link C++ class SoLKalTrackSite+;
 #pragma link C++ class SoLKalFieldStepper+;
+#pragma link C++ class SoLKalTransportTable+;
+#pragma link C++ class SoLKalTransferMap+;
+#pragma link C++ class SoLKalMaterialTable+;
+#pragma link C++ class SoLKalTrackArena+;
 #ifdef MCDATA
 #pragma link C++ class SoLIDMCRawHit+;
 #pragma link C++ class SoLIDMCGEMHit+;
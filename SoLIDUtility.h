@@ -14,6 +14,9 @@ enum ECType{kLAEC = 0, kFAEC};
 enum SoLKalIndex{ kIdxX0 = 0, kIdxY0, kIdxTX, kIdxTY, kIdxQP, kIdxZ0};
 enum SoLMatType{kAir = 0, kGEM};
 enum SeedType{kMidBack = 0, kFrontMid, kFrontBack, kTriplet};
+//what a propagation computes: the state only, the state and the propagator
+//(Jacobian), or the state, the propagator and the process noise
+enum SoLKalPropMode{kPropState = 0, kPropJacobian, kPropFull};
 enum SoLMatPropertyIdx{ kAtomicNum = 0, kProtonNum, kExcitEnergy, kDensity, kRadLength }; 
 static const double kElectronMass = 0.51099891;
 static const double kPimMass = 139.57018;
@@ -2,11 +2,14 @@
 #include <iostream>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 //ROOT
 #include "TMath.h"
 //SoLIDTracking
 #include "SoLKalFieldStepper.h"
 #include "SoLKalTrackSite.h"
+#include "SoLKalTransportTable.h"
+#include "SoLKalTransferMap.h"
 #include "SoLIDGEMHit.h"
 using namespace std;
 SoLKalFieldStepper * SoLKalFieldStepper::fSoLKalFieldStepper = NULL;
@@ -17,15 +20,41 @@ SoLKalFieldStepper::SoLKalFieldStepper()
   fIsMSOn = kTRUE;
   fIsDEDXOn = kTRUE;
   UseDefaultStep();
-  fMass = kElectronMass;
-  fCharge = -1.;
-  fIsElectron = kTRUE;
-  fFieldMap = SoLIDFieldMap::GetInstance();
+  fFieldMap = NULL; //set by SetFieldMap, the default map is loaded on first use otherwise
+  fUseCursor = kFALSE;
+  fRKMethod = kRK4;
+  fUseHelix = kFALSE;
+  fTransportTable = NULL;
+  fTransferMap = NULL;
+  fFastTransport = kFastTable;
+  fUseMatTable = kTRUE;
+  fLumpAir = kFALSE;
+  fSeedTolerance = 5.e-3; //m
   InitDetMaterial();
 }
 //_________________________________________________________________
 SoLKalFieldStepper::~SoLKalFieldStepper()
 {
+  delete fTransportTable;
+  delete fTransferMap;
+}
+//_________________________________________________________________
+void SoLKalFieldStepper::InitContext(SoLKalStepperContext &ctx)
+{
+  if (fFieldMap == NULL) SetFieldMap(SoLIDFieldMap::GetInstance());
+  if (ctx.fCursor.GetFieldMap() != fFieldMap || ctx.fMapSettingsId != fFieldMap->GetSettingsId()) {
+    ctx.fCursor.SetFieldMap(fFieldMap);
+    ctx.fHasLastB = kFALSE;
+    ctx.fMapSettingsId = fFieldMap->GetSettingsId();
+  }
+}
+//_________________________________________________________________
+void SoLKalFieldStepper::SetFieldMap(SoLIDFieldMap* map)
+{
+  fFieldMap = map;
+  fContext.fCursor.SetFieldMap(map);
+  fContext.fHasLastB = kFALSE;
+  fContext.fMapSettingsId = map ? map->GetSettingsId() : 0;
 }
 //_________________________________________________________________
 void SoLKalFieldStepper::UseDefaultStep()
@@ -40,6 +69,7 @@ void SoLKalFieldStepper::UseDefaultStep()
   maxNumSteps     = 1e3;
   maxDist         = 5.e-3;   //m
   minLengthCalcQ  = 1e-2;    //m
+  helixPrecision  = 1.e-5;   //m
 }
 //_________________________________________________________________
 void SoLKalFieldStepper::UseFineStep()
@@ -54,12 +84,22 @@ void SoLKalFieldStepper::UseFineStep()
   maxNumSteps     = 1e3;
   maxDist         = 1.e-3;   //m
   minLengthCalcQ  = 1e-3;    //m
+  helixPrecision  = 1.e-6;   //m
 }
 //__________________________________________________________________
 //a simple fixed step Runge-Kutta propagation method
 void SoLKalFieldStepper::PropagationClassicalRK4(TVector3 &inMom, TVector3 &inPos, 
                          Double_t &finalZ, Double_t &charge, 
                          Double_t &stepSize, TVector3 &fiMom, TVector3 &fiPos)
+{
+  InitContext(fContext);
+  PropagationClassicalRK4(fContext, inMom, inPos, finalZ, charge, stepSize, fiMom, fiPos);
+}
+//__________________________________________________________________
+void SoLKalFieldStepper::PropagationClassicalRK4(SoLKalStepperContext &ctx, 
+                         TVector3 &inMom, TVector3 &inPos, 
+                         Double_t &finalZ, Double_t &charge, 
+                         Double_t &stepSize, TVector3 &fiMom, TVector3 &fiPos) const
 {
   const Int_t nvar = 6;
   Double_t yt[nvar], yIn[nvar], yOut[nvar];
@@ -97,25 +137,25 @@ void SoLKalFieldStepper::PropagationClassicalRK4(TVector3 &inMom, TVector3 &inPo
       countStep++;
       //the classcial 4th order Runge-Kutta method happends here
       Int_t i;
-      RightHandSide(yIn, charge, inMom.Mag(), dydx);
+      RightHandSide(ctx, yIn, charge, inMom.Mag(), dydx);
       for(i=0;i<nvar;i++){
           yt[i] = yIn[i] + hh*dydx[i] ;             // 1st Step K1=h*dydx
       }
 
-      RightHandSide(yt,charge,inMom.Mag(), dydxt);
+      RightHandSide(ctx, yt,charge,inMom.Mag(), dydxt);
 
       for(i=0;i<nvar;i++){
           yt[i] = yIn[i] + hh*dydxt[i] ;
       }
 
-      RightHandSide(yt,charge,inMom.Mag(), dydxm);
+      RightHandSide(ctx, yt,charge,inMom.Mag(), dydxm);
 
       for(i=0;i<nvar;i++){
            yt[i]   = yIn[i] + h*dydxm[i] ;
            dydxm[i] += dydxt[i] ;                    // now dydxm=(K2+K3)/h
       }
 
-      RightHandSide(yt,charge,inMom.Mag(), dydxt) ;
+      RightHandSide(ctx, yt,charge,inMom.Mag(), dydxt) ;
       // Final RK4 output
       for(i=0;i<nvar;i++)    {
          yOut[i] = yIn[i]+h6*(dydx[i]+dydxt[i]+2.0*dydxm[i]); //+K1/6+K4/6+(K2+K3)/3
@@ -147,7 +187,10 @@ void SoLKalFieldStepper::PropagationClassicalRK4(TVector3 &inMom, TVector3 &inPo
            //stop the propagation
            do_loop = kFALSE;
       }else{
-           cout<<"SoLKalFieldStepper::PropagationClassicalRK4, propagation pass the target plane"<<endl;
+           //passed the target plane, the final straight line goes back to it
+#ifdef TESTCODE
+           ctx.fNPassPlane++;
+#endif
            do_loop = kFALSE;
       }
 
@@ -161,24 +204,433 @@ void SoLKalFieldStepper::PropagationClassicalRK4(TVector3 &inMom, TVector3 &inPo
     fiMom.SetXYZ(yOut[3], yOut[4], yOut[5]);
 }
 //________________________________________________________________________________________________
-void SoLKalFieldStepper::RightHandSide(const Double_t y[], const Double_t charge, 
-                                       const Double_t mom_mag, Double_t dydx[])
+void SoLKalFieldStepper::RightHandSide(SoLKalStepperContext &ctx, const Double_t y[], 
+                                       const Double_t charge, 
+                                       const Double_t mom_mag, Double_t dydx[]) const
 {
   Double_t momentum_mag_square = y[3]*y[3] + y[4]*y[4] + y[5]*y[5];
   Double_t inv_momentum_magnitude = 1.0 / std::sqrt( momentum_mag_square );
   Double_t cof = (charge*TMath::C()/1.e10)/sqrt(momentum_mag_square);
-  TVector3 B = fFieldMap->GetBField(y[0], y[1], y[2]);
+  Double_t B[3];
+  GetBField(ctx, y[0], y[1], y[2], B);
   
   dydx[0] = y[3]*inv_momentum_magnitude;       //  (d/ds)x = Vx/V
   dydx[1] = y[4]*inv_momentum_magnitude;       //  (d/ds)y = Vy/V
   dydx[2] = y[5]*inv_momentum_magnitude;       //  (d/ds)z = Vz/V
 
-  dydx[3] = cof*(y[4]*B.Z() - y[5]*B.Y()) ;   // Ax = a*(Vy*Bz - Vz*By)
-  dydx[4] = cof*(y[5]*B.X() - y[3]*B.Z()) ;   // Ay = a*(Vz*Bx - Vx*Bz)
-  dydx[5] = cof*(y[3]*B.Y() - y[4]*B.X()) ;   // Az = a*(Vx*By - Vy*Bx)
+  dydx[3] = cof*(y[4]*B[2] - y[5]*B[1]) ;   // Ax = a*(Vy*Bz - Vz*By)
+  dydx[4] = cof*(y[5]*B[0] - y[3]*B[2]) ;   // Ay = a*(Vz*Bx - Vx*Bz)
+  dydx[5] = cof*(y[3]*B[1] - y[4]*B[0]) ;   // Az = a*(Vx*By - Vy*Bx)
+}
+//__________________________________________________________________________________________________
+SoLKalStepperCounts::SoLKalStepperCounts()
+: fNCursorHit(0), fNCursorMiss(0), fNFieldCall(0), fNTransport(0), fNTableHit(0), fNTableMiss(0),
+  fNHelixStep(0), fNRKStep(0), fNRejectStep(0), fNRetry(0), fNStraightLine(0), fNPassPlane(0)
+{
+}
+//__________________________________________________________________________________________________
+SoLKalStepperCounts::SoLKalStepperCounts(const SoLKalStepperContext &ctx)
+: fNCursorHit(ctx.fCursor.GetNHit()), fNCursorMiss(ctx.fCursor.GetNMiss()),
+  fNFieldCall(ctx.fNFieldCall), fNTransport(ctx.fNTransport),
+  fNTableHit(ctx.fNTableHit), fNTableMiss(ctx.fNTableMiss), fNHelixStep(ctx.fNHelixStep),
+  fNRKStep(ctx.fNRKStep), fNRejectStep(ctx.fNRejectStep), fNRetry(ctx.fNRetry),
+  fNStraightLine(ctx.fNStraightLine), fNPassPlane(ctx.fNPassPlane)
+{
+}
+//__________________________________________________________________________________________________
+SoLKalStepperCounts& SoLKalStepperCounts::operator+=(const SoLKalStepperCounts &rhs)
+{
+  fNCursorHit    += rhs.fNCursorHit;
+  fNCursorMiss   += rhs.fNCursorMiss;
+  fNFieldCall    += rhs.fNFieldCall;
+  fNTransport    += rhs.fNTransport;
+  fNTableHit     += rhs.fNTableHit;
+  fNTableMiss    += rhs.fNTableMiss;
+  fNHelixStep    += rhs.fNHelixStep;
+  fNRKStep       += rhs.fNRKStep;
+  fNRejectStep   += rhs.fNRejectStep;
+  fNRetry        += rhs.fNRetry;
+  fNStraightLine += rhs.fNStraightLine;
+  fNPassPlane    += rhs.fNPassPlane;
+  return *this;
+}
+//__________________________________________________________________________________________________
+SoLKalStepperCounts& SoLKalStepperCounts::operator-=(const SoLKalStepperCounts &rhs)
+{
+  fNCursorHit    -= rhs.fNCursorHit;
+  fNCursorMiss   -= rhs.fNCursorMiss;
+  fNFieldCall    -= rhs.fNFieldCall;
+  fNTransport    -= rhs.fNTransport;
+  fNTableHit     -= rhs.fNTableHit;
+  fNTableMiss    -= rhs.fNTableMiss;
+  fNHelixStep    -= rhs.fNHelixStep;
+  fNRKStep       -= rhs.fNRKStep;
+  fNRejectStep   -= rhs.fNRejectStep;
+  fNRetry        -= rhs.fNRetry;
+  fNStraightLine -= rhs.fNStraightLine;
+  fNPassPlane    -= rhs.fNPassPlane;
+  return *this;
+}
+//__________________________________________________________________________________________________
+Int_t SoLKalSeedBatch::Add(const TVector3 &pos, const TVector3 &mom, Double_t charge)
+{
+  //the arrays only grow, a batch that is cleared and filled again reuses them
+  if ((Int_t)fCharge.size() <= fN){
+    for (Int_t i=0; i<6; i++){
+      fIn[i].push_back(0.);
+      fOut[i].push_back(0.);
+    }
+    fCharge.push_back(0.);
+  }
+  fIn[0][fN] = pos.X(); fIn[1][fN] = pos.Y(); fIn[2][fN] = pos.Z();
+  fIn[3][fN] = mom.X(); fIn[4][fN] = mom.Y(); fIn[5][fN] = mom.Z();
+  fCharge[fN] = charge;
+  return fN++;
+}
+//__________________________________________________________________________________________________
+void SoLKalSeedBatch::GetStart(Int_t lane, TVector3 &pos, TVector3 &mom) const
+{
+  pos.SetXYZ(fIn[0][lane], fIn[1][lane], fIn[2][lane]);
+  mom.SetXYZ(fIn[3][lane], fIn[4][lane], fIn[5][lane]);
+}
+//__________________________________________________________________________________________________
+void SoLKalSeedBatch::GetFinal(Int_t lane, TVector3 &pos, TVector3 &mom) const
+{
+  pos.SetXYZ(fOut[0][lane], fOut[1][lane], fOut[2][lane]);
+  mom.SetXYZ(fOut[3][lane], fOut[4][lane], fOut[5][lane]);
+}
+//__________________________________________________________________________________________________
+//RightHandSide for the lanes of a block, with the field of every lane. The
+//loops have the fixed length kLanes, so that they are vectorized
+static inline void RightHandSideLanes(const Double_t y[6][SoLKalSeedBatch::kLanes],
+                                      const Double_t charge[SoLKalSeedBatch::kLanes],
+                                      const Double_t B[3][SoLKalSeedBatch::kLanes],
+                                      Double_t dydx[6][SoLKalSeedBatch::kLanes])
+{
+  for (Int_t l=0; l<SoLKalSeedBatch::kLanes; l++){
+    Double_t momentum_mag_square = y[3][l]*y[3][l] + y[4][l]*y[4][l] + y[5][l]*y[5][l];
+    Double_t inv_momentum_magnitude = 1.0 / std::sqrt( momentum_mag_square );
+    Double_t cof = (charge[l]*TMath::C()/1.e10)/sqrt(momentum_mag_square);
+
+    dydx[0][l] = y[3][l]*inv_momentum_magnitude;
+    dydx[1][l] = y[4][l]*inv_momentum_magnitude;
+    dydx[2][l] = y[5][l]*inv_momentum_magnitude;
+
+    dydx[3][l] = cof*(y[4][l]*B[2][l] - y[5][l]*B[1][l]);
+    dydx[4][l] = cof*(y[5][l]*B[0][l] - y[3][l]*B[2][l]);
+    dydx[5][l] = cof*(y[3][l]*B[1][l] - y[4][l]*B[0][l]);
+  }
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::PropagationClassicalRK4(SoLKalSeedBatch &batch, Double_t finalZ,
+                                                 Double_t stepSize)
+{
+  InitContext(fContext);
+  PropagationClassicalRK4(fContext, batch, finalZ, stepSize);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::PropagationClassicalRK4(SoLKalStepperContext &ctx, SoLKalSeedBatch &batch,
+                                                 Double_t finalZ, Double_t stepSize) const
+{
+  //the single track method for kLanes lanes at a time: the steps, the step
+  //size control and the stop condition are the same for every lane, the
+  //field of all lanes is looked up in one call of the map (not through the
+  //cursor, the lanes are not close to each other)
+  const Int_t nl = SoLKalSeedBatch::kLanes;
+  const Int_t nvar = 6;
+  const Double_t distance2plane = 0.1;//(m) stop propagation when the particle is this close to the target plane
+  const Int_t maxStep = 1000;
+
+  for (Int_t first=0; first<batch.fN; first+=nl){
+    Double_t yIn[nvar][nl], yt[nvar][nl], yOut[nvar][nl];
+    Double_t dydx[nvar][nl], dydxt[nvar][nl], dydxm[nvar][nl];
+    Double_t B[3][nl], charge[nl];
+    Double_t h[nl], hh[nl], h6[nl], direction[nl], delta_z[nl];
+    Bool_t   active[nl];
+    Int_t    nActive = 0;
+
+    //lanes past the end of the batch repeat the first lane of the block and
+    //are masked from the start
+    for (Int_t l=0; l<nl; l++){
+      Int_t lane = (first + l < batch.fN) ? first + l : first;
+      active[l] = (first + l < batch.fN);
+      if (active[l]) nActive++;
+      for (Int_t i=0; i<nvar; i++) yIn[i][l] = batch.fIn[i][lane];
+      charge[l] = batch.fCharge[lane];
+
+      direction[l] = (yIn[2][l] >= finalZ) ? -1. : 1.;
+      delta_z[l]   = direction[l]*(finalZ - yIn[2][l]);
+      //make sure the initial step size is less than the distance between two planes
+      Double_t hl  = (delta_z[l] < stepSize) ? delta_z[l] : stepSize;
+      h[l]  = hl*direction[l];
+      hh[l] = (hl*0.5)*direction[l];
+      h6[l] = (hl/6.0)*direction[l];
+    }
+
+    Int_t countStep = 0;
+    while (nActive > 0 && countStep < maxStep){
+      countStep++;
+      //the classcial 4th order Runge-Kutta method, all lanes together; the
+      //masked ones repeat their last step
+      fFieldMap->GetBField(nl, yIn[0], yIn[1], yIn[2], B[0], B[1], B[2]);
+      RightHandSideLanes(yIn, charge, B, dydx);
+      for (Int_t i=0; i<nvar; i++)
+        for (Int_t l=0; l<nl; l++) yt[i][l] = yIn[i][l] + hh[l]*dydx[i][l];
+
+      fFieldMap->GetBField(nl, yt[0], yt[1], yt[2], B[0], B[1], B[2]);
+      RightHandSideLanes(yt, charge, B, dydxt);
+      for (Int_t i=0; i<nvar; i++)
+        for (Int_t l=0; l<nl; l++) yt[i][l] = yIn[i][l] + hh[l]*dydxt[i][l];
+
+      fFieldMap->GetBField(nl, yt[0], yt[1], yt[2], B[0], B[1], B[2]);
+      RightHandSideLanes(yt, charge, B, dydxm);
+      for (Int_t i=0; i<nvar; i++){
+        for (Int_t l=0; l<nl; l++){
+          yt[i][l]     = yIn[i][l] + h[l]*dydxm[i][l];
+          dydxm[i][l] += dydxt[i][l];
+        }
+      }
+
+      fFieldMap->GetBField(nl, yt[0], yt[1], yt[2], B[0], B[1], B[2]);
+      RightHandSideLanes(yt, charge, B, dydxt);
+      for (Int_t i=0; i<nvar; i++)
+        for (Int_t l=0; l<nl; l++)
+          yOut[i][l] = yIn[i][l] + h6[l]*(dydx[i][l] + dydxt[i][l] + 2.0*dydxm[i][l]);
+      ctx.fNFieldCall += 4*nl;
+
+      //decide for every lane if more propagation is needed and if the step
+      //size needs to be changed; a lane that stops leaves the block
+      for (Int_t l=0; l<nl; l++){
+        if (!active[l]) continue;
+        Bool_t stop = kFALSE;
+        delta_z[l] = direction[l]*(finalZ - yOut[2][l]);
+        if (delta_z[l] > direction[l]*h[l]){
+          //the particle is still far away from the target plane
+        }
+        else if (delta_z[l] < direction[l]*h[l] && delta_z[l] > distance2plane){
+          //the particle is approaching the target plane
+          h[l]  = direction[l]*delta_z[l];
+          hh[l] = h[l]*0.5;
+          h6[l] = h[l]/6.0;
+        }
+        else if (delta_z[l] < distance2plane && delta_z[l] > 0.){
+          stop = kTRUE;
+        }
+        else{
+#ifdef TESTCODE
+          ctx.fNPassPlane++;
+#endif
+          stop = kTRUE;
+        }
+        if (stop || countStep == maxStep){
+          active[l] = kFALSE;
+          nActive--;
+          //final output on the target plane
+          Int_t lane = first + l;
+          Double_t dz = finalZ - yOut[2][l];
+          batch.fOut[0][lane] = yOut[0][l] + dz*(yOut[3][l]/yOut[5][l]);
+          batch.fOut[1][lane] = yOut[1][l] + dz*(yOut[4][l]/yOut[5][l]);
+          batch.fOut[2][lane] = yOut[2][l] + dz;
+          for (Int_t i=3; i<nvar; i++) batch.fOut[i][lane] = yOut[i][l];
+        }
+        else{
+          for (Int_t i=0; i<nvar; i++) yIn[i][l] = yOut[i][l];
+        }
+      }
+    }
+  }
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::ExtrapolateSeeds(SoLKalSeedBatch &batch, Double_t finalZ)
+{
+  InitContext(fContext);
+  ExtrapolateSeeds(fContext, batch, finalZ);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::ExtrapolateSeeds(SoLKalStepperContext &ctx, SoLKalSeedBatch &batch,
+                                          Double_t finalZ) const
+{
+  const Int_t nl = SoLKalSeedBatch::kLanes;
+  const Double_t kappa = TMath::C() / 1.e10; // in GeV/(c * kG * m)
+
+  for (Int_t first=0; first<batch.fN; first+=nl){
+    Double_t t[4][nl], z[nl], a[nl], p[nl], sgn[nl];
+    Bool_t   active[nl];
+    //lanes past the end of the batch repeat the first lane of the block and
+    //are not moved
+    for (Int_t l=0; l<nl; l++){
+      Int_t lane = (first + l < batch.fN) ? first + l : first;
+      active[l] = (first + l < batch.fN);
+      Double_t pz = batch.fIn[5][lane];
+      p[l]    = sqrt(pow(batch.fIn[3][lane], 2) + pow(batch.fIn[4][lane], 2) + pz*pz);
+      sgn[l]  = (pz < 0.) ? -1. : 1.;
+      t[0][l] = batch.fIn[0][lane];
+      t[1][l] = batch.fIn[1][lane];
+      t[2][l] = batch.fIn[3][lane] / pz;
+      t[3][l] = batch.fIn[4][lane] / pz;
+      z[l]    = batch.fIn[2][lane];
+      a[l]    = kappa * batch.fCharge[lane] / p[l] * sgn[l];
+    }
+
+    ExtrapolateSeedLanes(ctx, t, z, a, active, finalZ);
+
+    for (Int_t l=0; l<nl && first+l<batch.fN; l++){
+      Int_t lane = first + l;
+      Double_t pz = sgn[l] * p[l] / sqrt(1. + t[2][l]*t[2][l] + t[3][l]*t[3][l]);
+      batch.fOut[0][lane] = t[0][l];
+      batch.fOut[1][lane] = t[1][l];
+      batch.fOut[2][lane] = z[l];
+      batch.fOut[3][lane] = t[2][l] * pz;
+      batch.fOut[4][lane] = t[3][l] * pz;
+      batch.fOut[5][lane] = pz;
+    }
+  }
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::ExtrapolateSeed(SoLKalStepperContext &ctx, const TVector3 &inPos,
+                                         const TVector3 &inMom, Double_t charge, Double_t finalZ,
+                                         TVector3 &fiPos, TVector3 &fiMom) const
+{
+  const Int_t nl = SoLKalSeedBatch::kLanes;
+  const Double_t kappa = TMath::C() / 1.e10; // in GeV/(c * kG * m)
+
+  Double_t t[4][nl], z[nl], a[nl];
+  Bool_t   active[nl];
+  Double_t p   = inMom.Mag();
+  Double_t sgn = (inMom.Z() < 0.) ? -1. : 1.;
+  for (Int_t l=0; l<nl; l++){
+    active[l] = (l == 0);
+    t[0][l] = inPos.X();
+    t[1][l] = inPos.Y();
+    t[2][l] = inMom.X() / inMom.Z();
+    t[3][l] = inMom.Y() / inMom.Z();
+    z[l]    = inPos.Z();
+    a[l]    = kappa * charge / p * sgn;
+  }
+
+  ExtrapolateSeedLanes(ctx, t, z, a, active, finalZ);
+
+  Double_t pz = sgn * p / sqrt(1. + t[2][0]*t[2][0] + t[3][0]*t[3][0]);
+  fiPos.SetXYZ(t[0][0], t[1][0], z[0]);
+  fiMom.SetXYZ(t[2][0] * pz, t[3][0] * pz, pz);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::ExtrapolateSeedLanes(SoLKalStepperContext &ctx,
+                                              Double_t t[4][SoLKalSeedBatch::kLanes],
+                                              Double_t z[SoLKalSeedBatch::kLanes],
+                                              const Double_t a[SoLKalSeedBatch::kLanes],
+                                              const Bool_t active[SoLKalSeedBatch::kLanes],
+                                              Double_t finalZ) const
+{
+  // Classical 4th order Runge-Kutta in z on (x, y, tx, ty), with
+  //   x'  = tx,  y' = ty
+  //   tx' = a * N * (tx * ty * Bx - (1 + tx^2) * By + ty * Bz)
+  //   ty' = a * N * ((1 + ty^2) * Bx - tx * ty * By - tx * Bz)
+  // and N = sqrt(1 + tx^2 + ty^2). Every lane has its own step size,
+  // controlled by the same error estimate as in RKPropagation, from the
+  // combination k1 + k4 - k2 - k3 of the stages. A lane whose step is
+  // rejected repeats it shorter while the others go on, the last step ends
+  // exactly on the plane.
+  const Int_t nl = SoLKalSeedBatch::kLanes;
+  const Int_t maxStep = 1000;
+  const Double_t seedInitialStep = 0.5;  //m
+  const Double_t seedMaxStep     = 2.;   //m
+  const Double_t seedMinStep     = 1.e-3;//m
+  //the estimate overstates the error of a 4th order step, with the solenoid
+  //map the position at the plane is good to about a tenth of the largest
+  //accepted estimate
+  const Double_t maxEst = 10. * fSeedTolerance;
+
+  Double_t h[nl], dir[nl];
+  Double_t x[3][nl], B[3][nl], tt[4][nl], k[4][4][nl];
+  Bool_t   moving[nl];
+  Int_t    nMoving = 0;
+  for (Int_t l=0; l<nl; l++){
+    Double_t length = fabs(finalZ - z[l]);
+    moving[l]  = active[l] && length > 0.;
+    if (moving[l]) nMoving++;
+    dir[l]     = (finalZ < z[l]) ? -1. : 1.;
+    h[l]       = dir[l] * TMath::Min(length, seedInitialStep);
+  }
+
+  Int_t countStep = 0;
+  while (nMoving > 0 && countStep < maxStep){
+    countStep++;
+    //the four stages, all lanes together; the lanes that do not move are
+    //evaluated as well and left unchanged
+    for (Int_t istep=0; istep<4; istep++){
+      Double_t f = (istep == 0) ? 0. : ((istep == 3) ? 1. : 0.5);
+      for (Int_t l=0; l<nl; l++){
+        Double_t hs = f * h[l];
+        if (istep == 0){
+          for (Int_t i=0; i<4; i++) tt[i][l] = t[i][l];
+        }
+        else{
+          for (Int_t i=0; i<4; i++) tt[i][l] = t[i][l] + hs * k[istep-1][i][l];
+        }
+        x[0][l] = tt[0][l];
+        x[1][l] = tt[1][l];
+        x[2][l] = z[l] + hs;
+      }
+      fFieldMap->GetBField(nl, x[0], x[1], x[2], B[0], B[1], B[2]);
+      for (Int_t l=0; l<nl; l++){
+        Double_t tx   = tt[2][l];
+        Double_t ty   = tt[3][l];
+        Double_t txty = tx * ty;
+        Double_t aN   = a[l] * sqrt(1. + tx*tx + ty*ty);
+        k[istep][0][l] = tx;
+        k[istep][1][l] = ty;
+        k[istep][2][l] = aN * (txty*B[0][l] - (1. + tx*tx)*B[1][l] + ty*B[2][l]);
+        k[istep][3][l] = aN * ((1. + ty*ty)*B[0][l] - txty*B[1][l] - tx*B[2][l]);
+      }
+    }
+    ctx.fNFieldCall += 4*nl;
+
+    for (Int_t l=0; l<nl; l++){
+      if (!moving[l]) continue;
+      Double_t ah     = fabs(h[l]);
+      Double_t remain = fabs(finalZ - z[l]) - ah;
+      Double_t est    = 0.;
+      for (Int_t i=0; i<4; i++)
+        est += fabs(k[0][i][l] + k[3][i][l] - k[1][i][l] - k[2][i][l]);
+      est *= 0.5 * ah;
+      Double_t fac = (est > 0.) ? 0.9 * cbrt(maxEst / est) : 4.;
+      fac = TMath::Min(4., TMath::Max(0.25, fac));
+
+      if (est > maxEst && ah > seedMinStep){
+        h[l] *= fac;
+#ifdef TESTCODE
+        ctx.fNRejectStep++;
+#endif
+        continue;
+      }
+#ifdef TESTCODE
+      ctx.fNRKStep++;
+#endif
+      for (Int_t i=0; i<4; i++)
+        t[i][l] += h[l] / 6. * (k[0][i][l] + 2.*k[1][i][l] + 2.*k[2][i][l] + k[3][i][l]);
+      if (remain < 1.e-9){
+        z[l]      = finalZ;
+        moving[l] = kFALSE;
+        nMoving--;
+        continue;
+      }
+      z[l] += h[l];
+      ah = TMath::Min(TMath::Min(ah * fac, seedMaxStep), remain);
+      h[l] = dir[l] * TMath::Max(ah, TMath::Min(seedMinStep, remain));
+    }
+  }
+  //a lane out of steps goes on the plane along its last direction
+  for (Int_t l=0; l<nl; l++){
+    if (!moving[l]) continue;
+    Double_t dz = finalZ - z[l];
+    t[0][l] += dz * t[2][l];
+    t[1][l] += dz * t[3][l];
+    z[l]     = finalZ;
+  }
 }
 //__________________________________________________________________________________________________
-Double_t SoLKalFieldStepper::Distance2Points(const TVector3 &vec1, const TVector3 &vec2)
+Double_t SoLKalFieldStepper::Distance2Points(const TVector3 &vec1, const TVector3 &vec2) const
 {
   // Calculates the distance between two points.
     TVector3 distV = vec1 - vec2;
@@ -187,10 +639,17 @@ Double_t SoLKalFieldStepper::Distance2Points(const TVector3 &vec1, const TVector
 //__________________________________________________________________________________________________
 void SoLKalFieldStepper::InitTrack(Double_t &mass, Double_t &charge, Bool_t &isElectron, Bool_t dir)
 {
-  fMass = mass;
-  fCharge = charge;
-  fIsElectron = isElectron;
-  fIsBackward = dir;
+  InitTrack(fContext, mass, charge, isElectron, dir);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::InitTrack(SoLKalStepperContext &ctx, Double_t mass, Double_t charge,
+                                   Bool_t isElectron, Bool_t dir) const
+{
+  ctx.fMass = mass;
+  ctx.fCharge = charge;
+  ctx.fIsElectron = isElectron;
+  ctx.fHypothesis = SoLKalMaterialTable::GetHypothesis(mass, isElectron);
+  ctx.fIsBackward = dir;
 }
 //__________________________________________________________________________________________________
 void SoLKalFieldStepper::Transport(const SoLKalTrackSite  &from, // site from
@@ -220,31 +679,78 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
                                    SoLKalMatrix       &F,    // propagator matrix
                                    SoLKalMatrix       &Q)   // process noise matrix
 {
-  trackPosAtZ    = sv_from.GetZ0();
-  trackLength    = 0.;
-  stepLength     = 0.;
-  jstep          = 0;
-  energyLoss     = 0.;
+  InitContext(fContext);
+  Transport(fContext, sv_from, finalZ, sv, F, Q);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::Transport(SoLKalStepperContext   &ctx,
+                                   const SoLKalTrackState  &sv_from, // site from
+                                   Double_t         &finalZ, // z position of the destination
+                                   SoLKalMatrix       &sv,   // state vector
+                                   SoLKalMatrix       &F,    // propagator matrix
+                                   SoLKalMatrix       &Q,    // process noise matrix
+                                   SoLKalPropMode   mode) const
+{
+  //the propagation works on the fixed size types, only the input and the
+  //results are converted
+  SoLKalStateVec sv_to;
+  SoLKalPropMat  F_to, Q_to;
+  Transport(ctx, SoLKalMatrix::ToStateVec(sv_from), sv_from.GetZ0(), finalZ, sv_to, F_to, Q_to, mode);
+  sv.SetFrom(sv_to);
+  F.SetFrom(F_to);
+  Q.SetFrom(Q_to);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::Transport(SoLKalStepperContext   &ctx,
+                                   const SoLKalTrackState  &sv_from, // site from
+                                   Double_t         &finalZ, // z position of the destination
+                                   SoLKalStateVec     &sv,   // state vector
+                                   SoLKalPropMat      &F,    // propagator matrix
+                                   SoLKalPropMat      &Q,    // process noise matrix
+                                   SoLKalPropMode   mode) const
+{
+  Transport(ctx, SoLKalMatrix::ToStateVec(sv_from), sv_from.GetZ0(), finalZ, sv, F, Q, mode);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::Transport(SoLKalStepperContext   &ctx,
+                                   const SoLKalStateVec  &sv_from, // state vector at z0
+                                   Double_t          z0,
+                                   Double_t         &finalZ, // z position of the destination
+                                   SoLKalStateVec     &sv,   // state vector
+                                   SoLKalPropMat      &F,    // propagator matrix
+                                   SoLKalPropMat      &Q,    // process noise matrix
+                                   SoLKalPropMode   mode) const
+{
+  ctx.fTrackPosAtZ  = z0;
+  ctx.fTrackLength  = 0.;
+  ctx.fStepLength   = 0.;
+  ctx.fStep         = 0;
+  ctx.fEnergyLoss   = 0.;
+  ctx.fFieldUniform = kTRUE;   // the first step tries a helix
+  ctx.fNTransport++;
   Double_t beta;
-  Bool_t bCalcJac = kTRUE;
+  Bool_t bCalcJac = (mode != kPropState);
+  Bool_t bCalcMS  = IsMSOn() && mode == kPropFull;
   
-  if (trackPosAtZ >= finalZ) fIsBackward = kTRUE;
-  else fIsBackward = kFALSE;
+  if (ctx.fTrackPosAtZ >= finalZ) ctx.fIsBackward = kTRUE;
+  else ctx.fIsBackward = kFALSE;
   
-  SoLKalMatrix sv_to(kSdim, 1);
-  SoLKalMatrix sv_PreStep(kSdim, 1);
-  SoLKalMatrix DF(kSdim, kSdim);                  // propagator matrix segment
-  for (Int_t i=0; i<kSdim; i++){
-      sv_to(i,0) = sv_from(i,0);
-  }
-  F.UnitMatrix(); // initialize F to unity
-  Q.Zero();       // initialize Q to zero
+  SoLKalStateVec sv_to = sv_from;
+  SoLKalStateVec sv_PreStep;
+  SoLKalPropMat  DF;                              // propagator matrix segment
+  F = ROOT::Math::SMatrixIdentity(); // initialize F to unity
+  Q = SoLKalPropMat();               // initialize Q to zero
+  // the energy loss also adds to the noise, which is dropped unless needed
+  SoLKalPropMat  QDrop;
+  SoLKalPropMat &QLoss = (mode == kPropFull) ? Q : QDrop;
   TVector3 posPreStep;
   TVector3 posAt; 
   
-  posAt.SetXYZ(sv_to(0,0), sv_to(1,0), trackPosAtZ);
+  posAt.SetXYZ(sv_to(0,0), sv_to(1,0), ctx.fTrackPosAtZ);
   
-  Double_t step = initialStepSize; 
+  // the embedded error estimate of Dormand-Prince adapts a long first step
+  // without wasted stages, RK4 starts short
+  Double_t step = (fRKMethod == kDormandPrince) ? maxStepSize : initialStepSize;
   Double_t nextStep = step;
   Double_t stepFac = 1.;
   Bool_t doNextStep = kTRUE;
@@ -268,10 +774,10 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
   
   //-----------------------begin Runge-Kutta stepping------------------//
   
-   while (d >= maxDist && doNextStep && jstep < maxNumSteps && step){
+   while (d >= maxDist && doNextStep && ctx.fStep < maxNumSteps && step){
 	   // Store some properties before stepping.
 	   
-	   posPreStep.SetXYZ(sv_to(kIdxX0, 0), sv_to(kIdxY0, 0), trackPosAtZ);
+	   posPreStep.SetXYZ(sv_to(kIdxX0, 0), sv_to(kIdxY0, 0), ctx.fTrackPosAtZ);
 	   sv_PreStep = sv_to;
 	   // Calculate step size in z-direction.
 	   TVector3 dirAt;
@@ -279,21 +785,28 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
 	   stepz = step * dirAt.z();
 	   
 	   
-	   stepFac = RKPropagation(sv_to, DF, stepz, bCalcJac, fIsBackward); // do one step
+	   if (fUseHelix && HelixStep(ctx, sv_to, DF, stepz, bCalcJac, stepFac)) {
+	     // closed form step in a uniform field
+	   }
+	   else if (fRKMethod == kDormandPrince) stepFac = RKPropagationDP(ctx, sv_to, DF, stepz, bCalcJac);
+	   else stepFac = RKPropagation(ctx, sv_to, DF, stepz, bCalcJac, ctx.fIsBackward); // do one step
 	   
 	   
-	   posAt.SetXYZ(sv_to(kIdxX0, 0), sv_to(kIdxY0, 0), trackPosAtZ);//update position vector after RK propagation
+	   posAt.SetXYZ(sv_to(kIdxX0, 0), sv_to(kIdxY0, 0), ctx.fTrackPosAtZ);//update position vector after RK propagation
        
-	   Double_t sd =  trackPosAtZ - finalZ;
+	   Double_t sd =  ctx.fTrackPosAtZ - finalZ;
 	   Double_t prec = 1.e-4;
-	   if(((sd > 0. + prec) && fIsBackward == kFALSE) || ((sd < 0. - prec) && fIsBackward == kTRUE)) {
+	   if(((sd > 0. + prec) && ctx.fIsBackward == kFALSE) || ((sd < 0. - prec) && ctx.fIsBackward == kTRUE)) {
 	     // Track went past target plane during propagtion. Repeating last step with reduced step size.
 	     step       *= stepSizeDec;
 	     nextStep   *= stepSizeDec;
 	     sv_to  = sv_PreStep;
-	     trackPosAtZ = posPreStep.Z();
+	     ctx.fTrackPosAtZ = posPreStep.Z();
 	     posAt.SetXYZ(posPreStep.X(), posPreStep.Y(), posPreStep.Z());
-	     trackLength -= stepLength;
+	     ctx.fTrackLength -= ctx.fStepLength;
+#ifdef TESTCODE
+	     ctx.fNRetry++;
+#endif
 	     continue;
 	   }
        
@@ -307,7 +820,7 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
 	   // C_n = F_n * ... * F_2 * F_1 * C_0 * F_1^T * F_2^T * ... * F_n^T
 	   //     =             F         * C_0 *         F^T 
        
-	   F = DF * F; // update propagator
+	   if (bCalcJac) F = DF * F; // update propagator
        
 
 	   //calculating process noice and energy loss 
@@ -315,19 +828,19 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
 	   //SoLKalMatrix Qms(kSdim, kSdim);
 	   //Qms.Zero();
 	   
-	   if ((IsMSOn() || IsDEDXOn()) && stepLength > minLengthCalcQ )
+	   if ((bCalcMS || IsDEDXOn()) && ctx.fStepLength > minLengthCalcQ && !fLumpAir)
 	     {
 	       // Track inclination = sqrt(1 + tx^2 + ty^2).
 	       Double_t trackIncl = TMath::Sqrt(1. + sv_PreStep(kIdxTX, 0)*sv_PreStep(kIdxTX, 0) 
 						+ sv_PreStep(kIdxTY, 0)*sv_PreStep(kIdxTY, 0));
 	       // Total step length = step length in z direction * track inclination.
 	       
-	       stepLength = stepz * trackIncl;
+	       ctx.fStepLength = stepz * trackIncl;
 	       
-	       beta = 1. / TMath::Sqrt(1. + (fMass*fMass*1e-6) * sv_PreStep(kIdxQP, 0)*sv_PreStep(kIdxQP, 0));
+	       beta = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * sv_PreStep(kIdxQP, 0)*sv_PreStep(kIdxQP, 0));
 	       
-	       if ( IsMSOn() )     /*Double_t cms2 = */CalcMultScat(Q, sv_PreStep, stepLength, beta);
-	       if ( IsDEDXOn() )   energyLoss += CalcEnergyLoss(Q, sv_to, stepLength, sv_PreStep(kIdxQP, 0), beta);
+	       if ( bCalcMS )      /*Double_t cms2 = */CalcMultScat(Q, sv_PreStep, ctx.fStepLength, beta);
+	       if ( IsDEDXOn() )   ctx.fEnergyLoss += CalcEnergyLoss(ctx, QLoss, sv_to, ctx.fStepLength, sv_PreStep(kIdxQP, 0), beta);
 	     }
        //end calculating process noice and energy loss
        
@@ -351,7 +864,7 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
 	   if (d > nextStep || d < maxDist) step = nextStep;
 	   else step = d;
      
-	   if(fIsBackward == kFALSE) {
+	   if(ctx.fIsBackward == kFALSE) {
 	     if(posAt.z() < pointIntersect.z()) { doNextStep = kTRUE; }
 	     else { doNextStep = kFALSE; }
 	   } else {
@@ -361,48 +874,221 @@ void SoLKalFieldStepper::Transport(const SoLKalTrackState  &sv_from, // site fro
      
 	 }
        //-----------------------end Runge-Kutta stepping--------------------//
+#ifdef TESTCODE
+   // out of steps, or the step size went to zero, before the plane was close
+   if (d >= maxDist) ctx.fNStraightLine++;
+#endif
   
    // To make sure the track position is on the target layer propagate to the target plane
    // using a straight line.
    sv_PreStep = sv_to;
-   posPreStep.SetXYZ(sv_PreStep(kIdxX0, 0), sv_PreStep(kIdxY0, 0), trackPosAtZ);
+   posPreStep.SetXYZ(sv_PreStep(kIdxX0, 0), sv_PreStep(kIdxY0, 0), ctx.fTrackPosAtZ);
    
-   if(!PropagateStraightLine(sv_to, DF, trackPosAtZ, finalZ, fIsBackward)) {
+   if(!PropagateStraightLine(ctx, sv_to, DF, ctx.fTrackPosAtZ, finalZ, ctx.fIsBackward)) {
 	   cout<<"TKalDetCradle::Transport: final propagation to target plane failed"<<endl;
    }
    
        //calculate the energy loss and multiple scattering for this straight line propagation
    
-   if ((IsMSOn() || IsDEDXOn()) && stepLength > minLengthCalcQ ){ 
+   if ((bCalcMS || IsDEDXOn()) && ctx.fStepLength > minLengthCalcQ && !fLumpAir){ 
 	   
-	   beta = 1. / TMath::Sqrt(1. + (fMass*fMass*1e-6) * sv_PreStep(kIdxQP, 0)*sv_PreStep(kIdxQP, 0));
+	   beta = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * sv_PreStep(kIdxQP, 0)*sv_PreStep(kIdxQP, 0));
 	   
-	   if ( IsMSOn() )     /*Double_t cms2 = */CalcMultScat(Q, sv_PreStep, stepLength, beta);
-	   if ( IsDEDXOn() )   energyLoss += CalcEnergyLoss(Q, sv_to, stepLength, sv_PreStep(kIdxQP, 0), beta);
+	   if ( bCalcMS )      /*Double_t cms2 = */CalcMultScat(Q, sv_PreStep, ctx.fStepLength, beta);
+	   if ( IsDEDXOn() )   ctx.fEnergyLoss += CalcEnergyLoss(ctx, QLoss, sv_to, ctx.fStepLength, sv_PreStep(kIdxQP, 0), beta);
 	   
 	 }
+   //or the air of the whole gap at once, with the start state as TransportFast
+   if ((bCalcMS || IsDEDXOn()) && ctx.fTrackLength > minLengthCalcQ && fLumpAir){
+     beta = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * sv_from(kIdxQP, 0)*sv_from(kIdxQP, 0));
+     if ( bCalcMS )      CalcMultScat(Q, sv_from, ctx.fTrackLength, beta);
+     if ( IsDEDXOn() )   ctx.fEnergyLoss += CalcEnergyLoss(ctx, QLoss, sv_to, ctx.fTrackLength, sv_from(kIdxQP, 0), beta);
+     sv_PreStep(kIdxQP, 0) = sv_to(kIdxQP, 0);
+   }
    //make a correction for the GEM detector for now
    //SoLKalMatrix DFt  = SoLKalMatrix(TMatrixD::kTransposed, DF);
 	 //SoLKalMatrix Qms(kSdim, kSdim);
 	 //Qms.Zero();
    
-   beta = 1. / TMath::Sqrt(1. + (fMass*fMass*1e-6) * sv_PreStep(kIdxQP, 0)*sv_PreStep(kIdxQP, 0));
+   beta = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * sv_PreStep(kIdxQP, 0)*sv_PreStep(kIdxQP, 0));
    
    Double_t theta = atan( sqrt(pow(sv_to(kIdxTX, 0), 2) + pow(sv_to(kIdxTY, 0), 2)) );
 	 Double_t distInGEM = 1.5525e-2 / cos(theta);
 	 
-	 if ( IsMSOn() )     CalcMultScat(Q, sv_PreStep, distInGEM, beta, kGEM);
-	 if ( IsDEDXOn() )   energyLoss += CalcEnergyLoss(Q, sv_to, distInGEM, sv_PreStep(kIdxQP, 0), beta, kGEM);
+	 if ( bCalcMS )      CalcMultScat(Q, sv_PreStep, distInGEM, beta, kGEM);
+	 if ( IsDEDXOn() )   ctx.fEnergyLoss += CalcEnergyLoss(ctx, QLoss, sv_to, distInGEM, sv_PreStep(kIdxQP, 0), beta, kGEM);
 	 
 	 //Q = DF * (Q + Qms) * DFt;
    
-   F = DF * F; // final propagator matrix
+   if (bCalcJac) F = DF * F; // final propagator matrix
    sv = sv_to;
    
 }
+//__________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::MatchesFieldMap(const char* filename, const char* mapName,
+                                           Double_t scale) const
+{
+  //a table or map holds transports through one field, it cannot be rescaled
+  if (fFieldMap->Is3D() || fabs(scale - fFieldMap->GetScale()) > 1.e-6) {
+    cout<<"SoLKalFieldStepper: "<<filename<<" was generated for "<<mapName<<" scaled by "
+        <<scale<<", not for "<<fFieldMap->GetFileName()<<" scaled by "<<fFieldMap->GetScale()<<endl;
+    return kFALSE;
+  }
+  return kTRUE;
+}
+//__________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::LoadTransportTable(const char* filename)
+{
+  if (fTransportTable != NULL && strcmp(fTransportTable->GetFileName(), filename) == 0) return kTRUE;
+  if (fFieldMap == NULL) SetFieldMap(SoLIDFieldMap::GetInstance());
+
+  SoLKalTransportTable *table = new SoLKalTransportTable();
+  if (!table->Load(filename) ||
+      !MatchesFieldMap(filename, table->GetFieldMapName(), table->GetFieldScale())) {
+    delete table;
+    return kFALSE;
+  }
+  delete fTransportTable;
+  fTransportTable = table;
+  return kTRUE;
+}
+//__________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::LoadTransferMap(const char* filename)
+{
+  if (fTransferMap != NULL && strcmp(fTransferMap->GetFileName(), filename) == 0) return kTRUE;
+  if (fFieldMap == NULL) SetFieldMap(SoLIDFieldMap::GetInstance());
+
+  SoLKalTransferMap *tmap = new SoLKalTransferMap();
+  if (!tmap->Load(filename) ||
+      !MatchesFieldMap(filename, tmap->GetFieldMapName(), tmap->GetFieldScale())) {
+    delete tmap;
+    return kFALSE;
+  }
+  delete fTransferMap;
+  fTransferMap = tmap;
+  return kTRUE;
+}
+//__________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::TransportFast(SoLKalStepperContext   &ctx,
+                                         const SoLKalStateVec  &sv_from, // state vector at z0
+                                         Double_t          z0,
+                                         Double_t          finalZ,
+                                         SoLKalStateVec     &sv,   // state vector
+                                         SoLKalPropMat      &F,    // propagator matrix
+                                         SoLKalPropMat      &Q,    // process noise matrix
+                                         SoLKalPropMode   mode) const
+{
+  // the segment in the selected backend
+  Bool_t useMap = (fFastTransport == kFastTransferMap);
+  if (useMap ? fTransferMap == NULL : fTransportTable == NULL) return kFALSE;
+  Int_t iseg = useMap ? fTransferMap->FindSegment(z0, finalZ)
+                      : fTransportTable->FindSegment(z0, finalZ);
+  if (iseg < 0) return kFALSE;
+
+  // the start agrees with the plane of the backend within its z tolerance,
+  // the rest is a straight line
+  Double_t zFrom = useMap ? fTransferMap->GetZFrom(iseg) : fTransportTable->GetZFrom(iseg);
+  Double_t zTo   = useMap ? fTransferMap->GetZTo(iseg)   : fTransportTable->GetZTo(iseg);
+  Double_t dz0   = zFrom - z0;
+  SoLKalStateVec sv_in = sv_from;
+  sv_in(kIdxX0, 0) += dz0 * sv_in(kIdxTX, 0);
+  sv_in(kIdxY0, 0) += dz0 * sv_in(kIdxTY, 0);
+
+  SoLKalStateVec sv_to;
+  Bool_t ok = useMap ? fTransferMap->Transport(iseg, sv_in, sv_to, F)
+                     : fTransportTable->Transport(iseg, sv_in, sv_to, F);
+  if (!ok) {
+    ctx.fNTableMiss++;
+    return kFALSE;
+  }
+  ctx.fNTableHit++;
+  for (Int_t i = 0; i < kIdxQP; i++) {
+    F(i, kIdxTX) += dz0 * F(i, kIdxX0);
+    F(i, kIdxTY) += dz0 * F(i, kIdxY0);
+  }
+  if (mode == kPropState) F = ROOT::Math::SMatrixIdentity();
+  Q = SoLKalPropMat();
+
+  ctx.fTrackPosAtZ = zTo;
+  ctx.fIsBackward  = (zTo < zFrom);
+  ctx.fStep        = 0;
+  ctx.fEnergyLoss  = 0.;
+  Double_t tx = 0.5 * (sv_in(kIdxTX, 0) + sv_to(kIdxTX, 0));
+  Double_t ty = 0.5 * (sv_in(kIdxTY, 0) + sv_to(kIdxTY, 0));
+  ctx.fStepLength  = fabs(zTo - z0) * TMath::Sqrt(1. + tx*tx + ty*ty);
+  ctx.fTrackLength = ctx.fStepLength;
+
+  // material of the whole segment with the start state, then the GEM at the
+  // destination as in Transport
+  Bool_t bCalcMS = IsMSOn() && mode == kPropFull;
+  SoLKalPropMat  QDrop;
+  SoLKalPropMat &QLoss = (mode == kPropFull) ? Q : QDrop;
+  Double_t qp_in = sv_in(kIdxQP, 0);
+  Double_t beta  = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * qp_in*qp_in);
+  if ((bCalcMS || IsDEDXOn()) && ctx.fStepLength > minLengthCalcQ) {
+    if ( bCalcMS )      CalcMultScat(Q, sv_in, ctx.fStepLength, beta);
+    if ( IsDEDXOn() )   ctx.fEnergyLoss += CalcEnergyLoss(ctx, QLoss, sv_to, ctx.fStepLength, qp_in, beta);
+  }
+  Double_t theta = atan( sqrt(pow(sv_to(kIdxTX, 0), 2) + pow(sv_to(kIdxTY, 0), 2)) );
+  Double_t distInGEM = 1.5525e-2 / cos(theta);
+  // with the transported state and the momentum after the loss in the air
+  qp_in = sv_to(kIdxQP, 0);
+  beta  = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * qp_in*qp_in);
+  if ( bCalcMS )      CalcMultScat(Q, sv_to, distInGEM, beta, kGEM);
+  if ( IsDEDXOn() )   ctx.fEnergyLoss += CalcEnergyLoss(ctx, QLoss, sv_to, distInGEM, qp_in, beta, kGEM);
+
+  sv = sv_to;
+  return kTRUE;
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::Predict(SoLKalStepperContext   &ctx,
+                                 const SoLKalTrackState  &sv_from, // site from
+                                 Double_t         &finalZ, // z position of the destination
+                                 SoLKalMatrix       &sv,   // state vector
+                                 SoLKalMatrix       &F,    // propagator matrix
+                                 SoLKalMatrix       &Q,    // process noise matrix
+                                 SoLKalPropMode   mode) const
+{
+  SoLKalStateVec sv_in = SoLKalMatrix::ToStateVec(sv_from);
+  SoLKalStateVec sv_to;
+  SoLKalPropMat  F_to, Q_to;
+  Predict(ctx, sv_in, sv_from.GetZ0(), finalZ, sv_to, F_to, Q_to, mode);
+  sv.SetFrom(sv_to);
+  F.SetFrom(F_to);
+  Q.SetFrom(Q_to);
+}
+//__________________________________________________________________________________________________
+void SoLKalFieldStepper::Predict(SoLKalStepperContext   &ctx,
+                                 const SoLKalStateVec   &sv_from, // state vector at z0
+                                 Double_t          z0,
+                                 Double_t         &finalZ, // z position of the destination
+                                 SoLKalStateVec     &sv,   // state vector
+                                 SoLKalPropMat      &F,    // propagator matrix
+                                 SoLKalPropMat      &Q,    // process noise matrix
+                                 SoLKalPropMode   mode) const
+{
+  if (!TransportFast(ctx, sv_from, z0, finalZ, sv, F, Q, mode))
+    Transport(ctx, sv_from, z0, finalZ, sv, F, Q, mode);
+}
 //___________________________________________________________________________________________________
 Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix &fPropStep, Double_t stepSize, 
                                            Bool_t bCalcJac, Bool_t dir)
+{
+  //adapter for the SoLKalMatrix interface. A propagator with a z row and
+  //column (6 x 6) gets them from the unit matrix
+  SoLKalStateVec sv = SoLKalMatrix::ToStateVec(stateVec);
+  SoLKalPropMat  prop;
+  InitContext(fContext);
+  Double_t stepFac = RKPropagation(fContext, sv, prop, stepSize, bCalcJac, dir);
+  stateVec.SetFrom(sv);
+  fPropStep.UnitMatrix();
+  fPropStep.SetFrom(prop);
+  return stepFac;
+}
+//___________________________________________________________________________________________________
+Double_t SoLKalFieldStepper::RKPropagation(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec, 
+                                           SoLKalPropMat &fPropStep, Double_t stepSize, 
+                                           Bool_t bCalcJac, Bool_t dir) const
 {
     // One step of track tracing from track state.
     //
@@ -433,9 +1119,9 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
     // fn+1 = fn + 1/6*k1 + 1/3*k2 + 1/3*k3 + 1/6*k4 + O(h^5)
 
     // Constants for RK stepping.
-    static Double_t a[numPars] = { 0.0    , 0.5    , 0.5    , 1.0     };
-    static Double_t b[numPars] = { 0.0    , 0.5    , 0.5    , 1.0     };
-    static Double_t c[numPars] = { 1.0/6.0, 1.0/3.0, 1.0/3.0, 1.0/6.0 };
+    static const Double_t a[numPars] = { 0.0    , 0.5    , 0.5    , 1.0     };
+    static const Double_t b[numPars] = { 0.0    , 0.5    , 0.5    , 1.0     };
+    static const Double_t c[numPars] = { 1.0/6.0, 1.0/3.0, 1.0/3.0, 1.0/6.0 };
     // for rk stepping
     //Int_t step4;
     const Int_t rksteps = 4; // The 4 points used in Runge-Kutta stepping: start, 2 mid points and end
@@ -450,23 +1136,23 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
 
     // for propagator matrix
     Double_t F_tx[numPars], F_ty[numPars], F_tx_tx[numPars], F_ty_tx[numPars], F_tx_ty[numPars], F_ty_ty[numPars];
-    Double_t F2_tx[numPars], F2_ty[numPars]; // @2tx/@z^2 and @2ty/@z^2
 
     //----------------------------------------------------------------
     Double_t est     = 0.; // error estimation
     Double_t stepFac = 1.;
 
-    TVector3 B;                  // B-field
+    Double_t B[3];               // B-field
+    Double_t BStart[3], BEnd[3]; // at the start and the end of the step
     Double_t h = stepSize;       // step size
-    if(fIsBackward == kTRUE) {
+    if(ctx.fIsBackward == kTRUE) {
         h *= -1;                 // stepping in negative z-direction
     }
     Double_t half    = h * 0.5;  // half step interval for fourth order RK
     
     Double_t qp_in   = stateVec(kIdxQP, 0);
-    TVector3 posFrom = TVector3(stateVec(kIdxX0, 0), stateVec(kIdxY0, 0), trackPosAtZ);
+    TVector3 posFrom = TVector3(stateVec(kIdxX0, 0), stateVec(kIdxY0, 0), ctx.fTrackPosAtZ);
     Double_t z_in    = posFrom.z();
-    trackPosAtZ      = z_in;
+    ctx.fTrackPosAtZ      = z_in;
     TVector3 posAt   = posFrom;
 
     Double_t hC      = h * kappa;
@@ -478,7 +1164,7 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
     sv_in[kIdxTX]   = stateVec(kIdxTX, 0);
     sv_in[kIdxTY] = stateVec(kIdxTY, 0);
 
-    fPropStep.UnitMatrix();
+    fPropStep = ROOT::Math::SMatrixIdentity();
 
     //------------------------------------------------------------------------
     //   Runge-Kutta step
@@ -496,12 +1182,18 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
                     sv_step[ipar] = sv_in[ipar] + b[istep] * k[istep-1][ipar];     // do step
                 }
             }
-            trackPosAtZ = z_in + a[istep] * h; // move z along with track
-            posAt.SetXYZ(sv_step[kIdxX0], sv_step[kIdxY0], trackPosAtZ ); // update z value for current position
+            ctx.fTrackPosAtZ = z_in + a[istep] * h; // move z along with track
+            posAt.SetXYZ(sv_step[kIdxX0], sv_step[kIdxY0], ctx.fTrackPosAtZ ); // update z value for current position
 
             
-            //get the magnatic field 
-	          B = fFieldMap->GetBField(posAt.X(), posAt.Y(), posAt.Z());
+            //get the magnatic field, at the start from the previous step if it ended here
+            if (istep == rkStart && ctx.fHasLastB && ctx.fLastBPos[0] == posAt.X()
+                && ctx.fLastBPos[1] == posAt.Y() && ctx.fLastBPos[2] == posAt.Z()) {
+                for (Int_t i = 0; i < 3; ++i) B[i] = ctx.fLastB[i];
+            }
+            else GetBField(ctx, posAt.X(), posAt.Y(), posAt.Z(), B);
+            if (istep == rkStart) for (Int_t i = 0; i < 3; ++i) BStart[i] = B[i];
+            if (istep == rkEnd)   for (Int_t i = 0; i < 3; ++i) BEnd[i]   = B[i];
 
             Double_t tx        = sv_step[kIdxTX];
             Double_t ty        = sv_step[kIdxTY];
@@ -516,15 +1208,15 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
             Double_t tx2ty2qp  = tx2ty2 * qp_in;
 
             // for state propagation
-            F_tx[istep] = ( txty        *B.x() - ( 1.0 + tx2 )*B.y() + ty*B.z()) * tx2ty2;    // h * @tx/@z / (qp) = h * tx' / (qp)
-            F_ty[istep] = (( 1.0 + ty2 )*B.x() - txty         *B.y() - tx*B.z()) * tx2ty2;    // h * @ty/@z / (qp) = h * ty' / (qp)
+            F_tx[istep] = ( txty        *B[0] - ( 1.0 + tx2 )*B[1] + ty*B[2]) * tx2ty2;    // h * @tx/@z / (qp) = h * tx' / (qp)
+            F_ty[istep] = (( 1.0 + ty2 )*B[0] - txty         *B[1] - tx*B[2]) * tx2ty2;    // h * @ty/@z / (qp) = h * ty' / (qp)
 
             //------------------------------------------------------------------------
             // for transport matrix
-            F_tx_tx[istep] = F_tx[istep]*tx*I_tx2ty21 + ( ty*B.x()-2.0*tx*B.y() ) * tx2ty2qp; // h * @tx'/@tx
-            F_tx_ty[istep] = F_tx[istep]*ty*I_tx2ty21 + ( tx*B.x()+B.z()        ) * tx2ty2qp; // h * @tx'/@ty
-            F_ty_tx[istep] = F_ty[istep]*tx*I_tx2ty21 + (-ty*B.y()-B.z()        ) * tx2ty2qp; // h * @ty'/@tx
-            F_ty_ty[istep] = F_ty[istep]*ty*I_tx2ty21 + ( 2.0*ty*B.x()-tx*B.y() ) * tx2ty2qp; // h * @ty'/@ty
+            F_tx_tx[istep] = F_tx[istep]*tx*I_tx2ty21 + ( ty*B[0]-2.0*tx*B[1] ) * tx2ty2qp; // h * @tx'/@tx
+            F_tx_ty[istep] = F_tx[istep]*ty*I_tx2ty21 + ( tx*B[0]+B[2]        ) * tx2ty2qp; // h * @tx'/@ty
+            F_ty_tx[istep] = F_ty[istep]*tx*I_tx2ty21 + (-ty*B[1]-B[2]        ) * tx2ty2qp; // h * @ty'/@tx
+            F_ty_ty[istep] = F_ty[istep]*ty*I_tx2ty21 + ( 2.0*ty*B[0]-tx*B[1] ) * tx2ty2qp; // h * @ty'/@ty
 
             // Change of track parameters in each step.
             k[istep][kIdxX0]       = tx * h;              // dx
@@ -532,21 +1224,6 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
             k[istep][kIdxTX]   = F_tx[istep] * qp_in; // dtx
             k[istep][kIdxTY] = F_ty[istep] * qp_in; // dty
 
-            // h * @tx'/@z = h * (@tx/@dz)/@dz
-            F2_tx[istep]   = qp_in *
-                (tx*k[istep][kIdxTX]/TMath::Sqrt(tx2ty21)*(txty*B.X() - (1. + tx2)*B.Y() + ty*B.Z())
-                  + TMath::Sqrt(tx2ty21) *
-                 (k[istep][kIdxTX]*ty*B.X() + tx*k[istep][kIdxTY]*B.X()
-                  - 2.*tx*k[istep][kIdxTX]*B.Y() + k[istep][kIdxTY]*B.Z())
-                );
-
-            // h * @ty'/@z = h * (@ty/@dz)/@dz
-            F2_ty[istep]   = qp_in *
-                (ty*k[istep][kIdxTY]/TMath::Sqrt(tx2ty21)*(( 1.0 + ty2 )*B.X() - txty*B.Y() - tx*B.Z())
-                  + TMath::Sqrt(tx2ty21) *
-                 (2.*ty*k[istep][kIdxTY]*B.X() - k[istep][kIdxTX]*ty*B.Y() - tx*k[istep][kIdxTY]*B.Y()
-                 - k[istep][kIdxTX]*B.Z()));
-
         }  // end of Runge-Kutta steps
         //------------------------------------------------------------------------
 
@@ -561,10 +1238,16 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
         //------------------------------------------------------------------------
         if (fabs(est) < minPrecision || fabs(h) <= minStepSize || stepFac <= minStepSize) {
             // we found a step size with good precision
-            jstep ++;
+            ctx.fStep ++;
+#ifdef TESTCODE
+            ctx.fNRKStep++;
+#endif
             break;
         } else {
             // precision not good enough. make smaller step
+#ifdef TESTCODE
+            ctx.fNRejectStep++;
+#endif
             stepFac *= stepSizeDec;
             h       *= stepSizeDec;
             hC       = h * kappa;
@@ -574,7 +1257,7 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
 #endif
         }
 
-    } while (jstep < maxNumSteps);
+    } while (ctx.fStep < maxNumSteps);
     
     if (est < maxPrecision && fabs(h) < maxStepSize) {
         stepFac *= stepSizeInc;
@@ -590,8 +1273,9 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
 
     //------------------------------------------------------------------------
     
-    stepLength = fabs(Distance2Points(posFrom, posAt));
-    trackLength += stepLength;  // calculate track length
+    ctx.fStepLength = fabs(Distance2Points(posFrom, posAt));
+    ctx.fTrackLength += ctx.fStepLength;  // calculate track length
+    if (fUseHelix) ctx.fFieldUniform = IsFieldUniform(BStart, BEnd, qp_in, ctx.fStepLength);
 
     if (est < maxPrecision && fabs(h) < maxStepSize) {
         stepFac *= stepSizeInc;
@@ -755,46 +1439,432 @@ Double_t SoLKalFieldStepper::RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix
     fPropStep(kIdxY0, kIdxY0) = 1.;
 
 
-    // Propagator has entry for z-coordinate as well.
+    return stepFac;
+}
+//___________________________________________________________________________________________________
+//derivatives of the track parameters (x, y, tx, ty) with respect to z in the
+//field B, the derivatives of tx' and ty' per unit qp, and the derivatives of
+//tx' and ty' with respect to tx and ty (tx'/tx, tx'/ty, ty'/tx, ty'/ty)
+static void DPStageDerivatives(const Double_t *sv, Double_t qp, const Double_t *B,
+                               Double_t *f, Double_t *f_qp, Double_t *f_t)
+{
+  const Double_t kappa = TMath::C() / 1.e10; // in GeV/(c * kG * m)
+  Double_t tx      = sv[kIdxTX];
+  Double_t ty      = sv[kIdxTY];
+  Double_t tx2     = tx * tx;
+  Double_t ty2     = ty * ty;
+  Double_t txty    = tx * ty;
+  Double_t tx2ty21 = 1.0 + tx2 + ty2;
+  Double_t norm    = sqrt(tx2ty21);
+  Double_t Ax      = txty        *B[0] - ( 1.0 + tx2 )*B[1] + ty*B[2];
+  Double_t Ay      = ( 1.0 + ty2 )*B[0] - txty        *B[1] - tx*B[2];
+
+  f_qp[0] = kappa * norm * Ax;
+  f_qp[1] = kappa * norm * Ay;
+
+  f[kIdxX0] = tx;
+  f[kIdxY0] = ty;
+  f[kIdxTX] = f_qp[0] * qp;
+  f[kIdxTY] = f_qp[1] * qp;
+
+  Double_t kqn = kappa * qp / norm;
+  f_t[0] = kqn * ( tx*Ax + tx2ty21 * (      ty*B[0] - 2.0*tx*B[1]) );
+  f_t[1] = kqn * ( ty*Ax + tx2ty21 * (      tx*B[0] + B[2]       ) );
+  f_t[2] = kqn * ( tx*Ay + tx2ty21 * (    - ty*B[1] - B[2]       ) );
+  f_t[3] = kqn * ( ty*Ay + tx2ty21 * ( 2.0*ty*B[0] - tx*B[1]     ) );
+}
+//___________________________________________________________________________________________________
+Double_t SoLKalFieldStepper::RKPropagationDP(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                                             SoLKalPropMat &fPropStep, Double_t stepSize,
+                                             Bool_t bCalcJac) const
+{
+    // One Dormand-Prince 5(4) step of track tracing from the track state, the
+    // alternative to the classical RK4 of RKPropagation with the same interface.
+    //
+    // The 5th order solution is the 7th stage point (first same as last), and
+    // the difference to the embedded 4th order solution is the error estimate,
+    // so no extra stages are needed for the precision check. The field of the
+    // 7th stage is kept in the context and is the first stage of the next step.
+    // A rejected step reuses the first stage and retries with a step size
+    // from the error estimate, an accepted one suggests the next step size.
+    //
+    // The Jacobian is integrated with the same stages from the derivatives of
+    // tx' and ty' with respect to tx, ty and qp; as in RKPropagation, the
+    // field gradient (derivatives with respect to x and y) is neglected.
+
+    const Int_t numPars = 4; // x, y, tx, ty
+    const Int_t nStages = 7;
+
+    // Butcher tableau, the last row of a is also the 5th order solution
+    static const Double_t c[nStages] = { 0., 1./5., 3./10., 4./5., 8./9., 1., 1. };
+    static const Double_t a[nStages][nStages-1] = {
+      { 0.,              0.,             0.,             0.,           0.,               0.       },
+      { 1./5.,           0.,             0.,             0.,           0.,               0.       },
+      { 3./40.,          9./40.,         0.,             0.,           0.,               0.       },
+      { 44./45.,        -56./15.,        32./9.,         0.,           0.,               0.       },
+      { 19372./6561.,   -25360./2187.,   64448./6561.,  -212./729.,    0.,               0.       },
+      { 9017./3168.,    -355./33.,       46732./5247.,   49./176.,    -5103./18656.,     0.       },
+      { 35./384.,        0.,             500./1113.,     125./192.,   -2187./6784.,      11./84.  } };
+    // difference of the 5th and 4th order weights
+    static const Double_t e[nStages] = { 71./57600., 0., -71./16695., 71./1920.,
+                                         -17253./339200., 22./525., -1./40. };
+    const Double_t *b = a[nStages-1];
+
+    // derivatives at each stage, see DPStageDerivatives
+    Double_t f[nStages][numPars], f_qp[nStages][2], f_t[nStages][4];
+
+    Double_t est     = 0.; // error estimation
+    Double_t stepFac = 1.;
 
-    if(fPropStep.GetNrows() == 6) {
-        Double_t x0z[numPars+1], xz[numPars+1];
+    Double_t B[3];               // B-field
+    Double_t h = stepSize;       // step size
+    if(ctx.fIsBackward == kTRUE) {
+        h *= -1;                 // stepping in negative z-direction
+    }
 
-        Double_t k1z[rksteps][numPars+1];
+    Double_t qp_in   = stateVec(kIdxQP, 0);
+    Double_t z_in    = ctx.fTrackPosAtZ;
+    Double_t sv_in[numPars], sv_step[numPars];
+    Int_t istep, jstep, ipar;
+    for (ipar = 0; ipar < numPars; ++ipar) sv_in[ipar] = stateVec(ipar, 0);
 
-        Int_t idxZ0 = 4;
-        x0z[kIdxX0] = 0.; x0z[kIdxY0] = 0.; x0z[kIdxTX] = 0.; x0z[kIdxTY] = 0.; x0z[idxZ0] = 1.;
+    // first stage, from the end of the previous step if it stopped here
+    if (ctx.fHasLastB && ctx.fLastBPos[0] == sv_in[kIdxX0] && ctx.fLastBPos[1] == sv_in[kIdxY0]
+        && ctx.fLastBPos[2] == z_in) {
+        for (Int_t i = 0; i < 3; ++i) B[i] = ctx.fLastB[i];
+    } else {
+        GetBField(ctx, sv_in[kIdxX0], sv_in[kIdxY0], z_in, B);
+    }
+    DPStageDerivatives(sv_in, qp_in, B, f[0], f_qp[0], f_t[0]);
+    Double_t BStart[3] = { B[0], B[1], B[2] };
 
-        for (istep = 0; istep < 4; ++ istep) {
-            for(ipar = 0; ipar < numPars+1; ++ipar) {
-                if(istep == 0) {
-                    xz[ipar] = x0z[ipar];
-                } else
-                    xz[ipar] = x0z[ipar] + b[istep] * k1z[istep-1][ipar];
+    do {
+        for (istep = 1; istep < nStages; ++istep) {
+            for (ipar = 0; ipar < numPars; ++ipar) {
+                Double_t sum = 0.;
+                for (jstep = 0; jstep < istep; ++jstep) sum += a[istep][jstep] * f[jstep][ipar];
+                sv_step[ipar] = sv_in[ipar] + h * sum;
             }
+            GetBField(ctx, sv_step[kIdxX0], sv_step[kIdxY0], z_in + c[istep] * h, B);
+            DPStageDerivatives(sv_step, qp_in, B, f[istep], f_qp[istep], f_t[istep]);
+        }
 
-            // @x'/@z = @tx/@z
-            k1z[istep][kIdxX0]       = xz[kIdxTX]   * h + F_tx[istep] * qp_in * xz[idxZ0];
-            k1z[istep][kIdxY0]       = xz[kIdxTY] * h + F_ty[istep] * qp_in * xz[idxZ0];
-            k1z[istep][kIdxTX]   = F_tx_ty[istep] * xz[kIdxTX] + F_tx_ty[istep] * xz[kIdxTY]
-                + F2_tx[istep] * xz[idxZ0];
-            k1z[istep][kIdxTY] = F_ty_tx[istep] * xz[kIdxTX] + F_ty_ty[istep] * xz[kIdxTY]
-                + F2_ty[istep] * xz[idxZ0];
-            k1z[istep][idxZ0]        = 0.;
+        // sv_step is now the 5th order solution, B the field there
+        est = 0.;
+        for (ipar = 0; ipar < numPars; ++ipar) {
+            Double_t err = 0.;
+            for (istep = 0; istep < nStages; ++istep) err += e[istep] * f[istep][ipar];
+            est += fabs(err * h);
         }
-        for (ipar = 0; ipar < numPars; ++ipar ) {
-            fPropStep(ipar, kIdxZ0) = x0z[ipar] + c[rkStart]*k1z[rkStart][ipar] + c[rkMid1]*k1z[rkMid1][ipar]
-                                                + c[rkMid2] *k1z[rkMid2][ipar]  + c[rkEnd] *k1z[rkEnd][ipar];
+
+        if (est < minPrecision || fabs(h) <= minStepSize || stepFac <= minStepSize) {
+            // we found a step size with good precision
+            ctx.fStep ++;
+#ifdef TESTCODE
+            ctx.fNRKStep++;
+#endif
+            break;
+        } else {
+            // precision not good enough, the error scales with h^5
+#ifdef TESTCODE
+            ctx.fNRejectStep++;
+#endif
+            Double_t fac = TMath::Max(0.2, 0.9 * pow(minPrecision / est, 0.2));
+            stepFac *= fac;
+            h       *= fac;
+        }
+
+    } while (ctx.fStep < maxNumSteps);
+
+    // suggested size of the next step
+    Double_t fac = est > 0. ? TMath::Min(5., 0.9 * pow(minPrecision / est, 0.2)) : 5.;
+    if (fabs(h) * fac > maxStepSize) fac = TMath::Max(1., maxStepSize / fabs(h));
+    stepFac *= fac;
+
+    //------------------------------------------------------------------------
+    // set output track parameters
+    for (ipar = 0; ipar < numPars; ++ipar) stateVec(ipar, 0) = sv_step[ipar];
+    ctx.fTrackPosAtZ = z_in + h;
+
+    ctx.fHasLastB    = kTRUE;
+    ctx.fLastBPos[0] = sv_step[kIdxX0];
+    ctx.fLastBPos[1] = sv_step[kIdxY0];
+    ctx.fLastBPos[2] = ctx.fTrackPosAtZ;
+    for (Int_t i = 0; i < 3; ++i) ctx.fLastB[i] = B[i];
+
+    Double_t dx = sv_step[kIdxX0] - sv_in[kIdxX0];
+    Double_t dy = sv_step[kIdxY0] - sv_in[kIdxY0];
+    ctx.fStepLength = sqrt(dx*dx + dy*dy + h*h);
+    ctx.fTrackLength += ctx.fStepLength;  // calculate track length
+    if (fUseHelix) ctx.fFieldUniform = IsFieldUniform(BStart, B, qp_in, ctx.fStepLength);
+
+    if(!bCalcJac) {
+        return stepFac;
+    }
+
+    //------------------------------------------------------------------------
+    //
+    //     Derivatives with respect to tx, ty and qp
+    //
+    // The columns of the Jacobian obey the variational equations
+    //   (dx/dp)'  = dtx/dp,  (dy/dp)' = dty/dp
+    //   (dtx/dp)' = @tx'/@tx * dtx/dp + @tx'/@ty * dty/dp (+ @tx'/@qp for p = qp)
+    // and similar for ty, integrated with the tableau of the track step.
+    // The last stage has no weight in the 5th order solution.
+
+    fPropStep = ROOT::Math::SMatrixIdentity();
+
+    Double_t x0[numPars], x[numPars];
+    Double_t k1[nStages-1][numPars];
+    const Int_t cols[3] = { kIdxTX, kIdxTY, kIdxQP };
+
+    for (Int_t icol = 0; icol < 3; ++icol) {
+        Int_t col = cols[icol];
+        for (ipar = 0; ipar < numPars; ++ipar) x0[ipar] = (ipar == col) ? 1. : 0.;
+        Double_t isQP = (col == kIdxQP) ? 1. : 0.;
+
+        for (istep = 0; istep < nStages - 1; ++istep) {
+            for (ipar = 0; ipar < numPars; ++ipar) {
+                Double_t sum = 0.;
+                for (jstep = 0; jstep < istep; ++jstep) sum += a[istep][jstep] * k1[jstep][ipar];
+                x[ipar] = x0[ipar] + h * sum;
+            }
+            k1[istep][kIdxX0] = x[kIdxTX];
+            k1[istep][kIdxY0] = x[kIdxTY];
+            k1[istep][kIdxTX] = isQP * f_qp[istep][0] + f_t[istep][0] * x[kIdxTX] + f_t[istep][1] * x[kIdxTY];
+            k1[istep][kIdxTY] = isQP * f_qp[istep][1] + f_t[istep][2] * x[kIdxTX] + f_t[istep][3] * x[kIdxTY];
         }
 
-        fPropStep(kIdxZ0, kIdxZ0) = 1.;
+        for (ipar = 0; ipar < numPars; ++ipar) {
+            Double_t sum = 0.;
+            for (istep = 0; istep < nStages - 1; ++istep) sum += b[istep] * k1[istep][ipar];
+            fPropStep(ipar, col) = x0[ipar] + h * sum;
+        }
     }
 
     return stepFac;
 }
 //_____________________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::IsFieldUniform(const Double_t *BStart, const Double_t *BEnd,
+                                          Double_t qp, Double_t length) const
+{
+  // the end point of a step of the given length moves by about
+  // kappa*|qp|*|dB|*length^2/4 if the field changes by dB along it, the
+  // same as the test of HelixStep
+  const Double_t kappa = TMath::C() / 1.e10; // in GeV/(c * kG * m)
+  Double_t dB = sqrt(pow(BEnd[0] - BStart[0], 2) + pow(BEnd[1] - BStart[1], 2)
+                     + pow(BEnd[2] - BStart[2], 2));
+  return kappa * fabs(qp) * dB * length * length / 4. < helixPrecision;
+}
+//_____________________________________________________________________________________________________________
+//point and direction after the path length s on the helix from r0 with the
+//direction u0 in a uniform field of direction n, with the signed curvature
+//omega = kappa * qp * |B|. With r0 = 0 it also gives the derivatives of both
+//with respect to a change du0 of the start direction (passed as u0)
+static void HelixPoint(const Double_t *r0, const Double_t *u0, const Double_t *n,
+                       Double_t omega, Double_t s, Double_t *r, Double_t *u)
+{
+  // the turning angle of a step is small, below 0.2 sin(th)/th and
+  // (1 - cos(th))/th are their series (to 1e-17)
+  Double_t th = omega * s, cs, sn, S, C;
+  if (fabs(th) < 0.2) {
+    Double_t th2 = th * th;
+    Double_t sinc = 1. - th2/6. * (1. - th2/20. * (1. - th2/42. * (1. - th2/72. * (1. - th2/110.))));
+    Double_t cosc = 0.5 * (1. - th2/12. * (1. - th2/30. * (1. - th2/56. * (1. - th2/90. * (1. - th2/132.)))));
+    sn = th * sinc;
+    cs = 1. - th * th * cosc;
+    S  = s * sinc;
+    C  = s * th * cosc;
+  } else {
+    cs = cos(th);
+    sn = sin(th);
+    S  = sn / omega;
+    C  = (1. - cs) / omega;
+  }
+  Double_t un = u0[0]*n[0] + u0[1]*n[1] + u0[2]*n[2];
+  Double_t w[3] = { u0[1]*n[2] - u0[2]*n[1], u0[2]*n[0] - u0[0]*n[2], u0[0]*n[1] - u0[1]*n[0] };
+  for (Int_t i = 0; i < 3; ++i) {
+    Double_t par  = un * n[i];
+    Double_t perp = u0[i] - par;
+    u[i] = par + cs * perp + sn * w[i];
+    r[i] = r0[i] + par * s + S * perp + C * w[i];
+  }
+}
+//_____________________________________________________________________________________________________________
+//helix to the plane z0 + h: the path length s (solved by Newton from the
+//straight line), point and direction there. The last Newton correction is
+//applied along the direction. kFALSE if the track turns away
+static Bool_t HelixToPlane(const Double_t *r0, const Double_t *u0, const Double_t *n,
+                           Double_t omega, Double_t h, Double_t &s, Double_t *r, Double_t *u)
+{
+  s = h / u0[2];
+  for (Int_t iter = 0; iter < 10; ++iter) {
+    HelixPoint(r0, u0, n, omega, s, r, u);
+    if (u[2] < 1.e-3) return kFALSE;
+    Double_t ds = (r0[2] + h - r[2]) / u[2];
+    s += ds;
+    if (fabs(ds) < 1.e-9) {
+      for (Int_t i = 0; i < 3; ++i) r[i] += u[i] * ds;
+      return kTRUE;
+    }
+  }
+  return kFALSE;
+}
+//_____________________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::HelixStep(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                                     SoLKalPropMat &fPropStep, Double_t stepSize,
+                                     Bool_t bCalcJac, Double_t &stepFac) const
+{
+    // One step on a helix, the closed form solution in a uniform field.
+    //
+    // Tried only if the previous step found the field uniform (see
+    // IsFieldUniform). The helix with the field at the start point gives the
+    // end point, where the field is looked up; the step is on the helix of
+    // the mean of the two fields. It is taken if its end point is less than
+    // helixPrecision from the one of the start field helix, which is about
+    // three times the error of the mean field helix in a field changing
+    // linearly along the step. The field at the end point of the step is
+    // looked up and kept in the context as the start field of the next step,
+    // so a helix step needs two field lookups. A rejected one leaves its
+    // start field to the Runge-Kutta step that replaces it, and no helix is
+    // tried until a step finds the field uniform again.
+    //
+    // The Jacobian (columns tx, ty, qp) is the derivative of the helix at
+    // fixed z; as in RKPropagation the field gradient is neglected.
+
+    if (!ctx.fFieldUniform) return kFALSE;
+
+    const Double_t kappa = TMath::C() / 1.e10; // in GeV/(c * kG * m)
+    Double_t h = stepSize;
+    if(ctx.fIsBackward == kTRUE) {
+        h *= -1;                 // stepping in negative z-direction
+    }
+    Double_t qp   = stateVec(kIdxQP, 0);
+    Double_t tx   = stateVec(kIdxTX, 0);
+    Double_t ty   = stateVec(kIdxTY, 0);
+    Double_t norm = sqrt(1. + tx*tx + ty*ty);
+    Double_t r0[3] = { stateVec(kIdxX0, 0), stateVec(kIdxY0, 0), ctx.fTrackPosAtZ };
+    Double_t u0[3] = { tx / norm, ty / norm, 1. / norm };
+
+    // field at the start, from the previous step if it ended here
+    Double_t B0[3], B1[3], Bm[3];
+    if (ctx.fHasLastB && ctx.fLastBPos[0] == r0[0] && ctx.fLastBPos[1] == r0[1]
+        && ctx.fLastBPos[2] == r0[2]) {
+        for (Int_t i = 0; i < 3; ++i) B0[i] = ctx.fLastB[i];
+    } else {
+        GetBField(ctx, r0[0], r0[1], r0[2], B0);
+        ctx.fHasLastB    = kTRUE;
+        for (Int_t i = 0; i < 3; ++i) {
+            ctx.fLastBPos[i] = r0[i];
+            ctx.fLastB[i]    = B0[i];
+        }
+    }
+
+    // helix of the start field, the field at its end point
+    Double_t n[3] = { 0., 0., 1. }, Bmag, omega, s, r[3], u[3], rB0[3];
+    Bmag = sqrt(B0[0]*B0[0] + B0[1]*B0[1] + B0[2]*B0[2]);
+    if (Bmag > 0.) for (Int_t i = 0; i < 3; ++i) n[i] = B0[i] / Bmag;
+    omega = kappa * qp * Bmag;
+    ctx.fFieldUniform = kFALSE;
+    if (!HelixToPlane(r0, u0, n, omega, h, s, rB0, u)) return kFALSE;
+    GetBField(ctx, rB0[0], rB0[1], rB0[2], B1);
+
+    // the step on the helix of the mean field
+    for (Int_t i = 0; i < 3; ++i) Bm[i] = 0.5 * (B0[i] + B1[i]);
+    n[0] = 0.; n[1] = 0.; n[2] = 1.;
+    Bmag = sqrt(Bm[0]*Bm[0] + Bm[1]*Bm[1] + Bm[2]*Bm[2]);
+    if (Bmag > 0.) for (Int_t i = 0; i < 3; ++i) n[i] = Bm[i] / Bmag;
+    omega = kappa * qp * Bmag;
+    if (!HelixToPlane(r0, u0, n, omega, h, s, r, u)) return kFALSE;
+    if (sqrt(pow(r[0] - rB0[0], 2) + pow(r[1] - rB0[1], 2)) > helixPrecision) return kFALSE;
+    ctx.fFieldUniform = kTRUE;
+
+    ctx.fStep ++;
+    ctx.fNHelixStep++;
+    stateVec(kIdxX0, 0) = r[0];
+    stateVec(kIdxY0, 0) = r[1];
+    stateVec(kIdxTX, 0) = u[0] / u[2];
+    stateVec(kIdxTY, 0) = u[1] / u[2];
+    ctx.fTrackPosAtZ = r0[2] + h;
+
+    // field at the end point for the next step (B1 is at the end point of
+    // the start field helix, up to helixPrecision away)
+    ctx.fHasLastB    = kTRUE;
+    ctx.fLastBPos[0] = stateVec(kIdxX0, 0);
+    ctx.fLastBPos[1] = stateVec(kIdxY0, 0);
+    ctx.fLastBPos[2] = ctx.fTrackPosAtZ;
+    GetBField(ctx, ctx.fLastBPos[0], ctx.fLastBPos[1], ctx.fLastBPos[2], ctx.fLastB);
+
+    ctx.fStepLength   = fabs(s);
+    ctx.fTrackLength += ctx.fStepLength;  // calculate track length
+    stepFac = (fabs(h) < maxStepSize) ? stepSizeInc : 1.;
+
+    if(!bCalcJac) {
+        return kTRUE;
+    }
+
+    //------------------------------------------------------------------------
+    //
+    //     Derivatives with respect to tx, ty and qp
+    //
+    // At fixed path length the helix is linear in the start direction, so a
+    // change of tx or ty moves point and direction by HelixPoint of du0; a
+    // change of qp changes omega. The path length to the plane changes by
+    // ds = -dz/u_z, which moves the point along u and turns the direction
+    // by omega * (u x n) * ds.
+
+    fPropStep = ROOT::Math::SMatrixIdentity();
+
+    const Double_t zero[3] = { 0., 0., 0. };
+    Double_t du0[3], dr[3], du[3];
+    Double_t turn[3] = { omega * (u[1]*n[2] - u[2]*n[1]),
+                         omega * (u[2]*n[0] - u[0]*n[2]),
+                         omega * (u[0]*n[1] - u[1]*n[0]) };
+    const Int_t cols[3] = { kIdxTX, kIdxTY, kIdxQP };
+    for (Int_t icol = 0; icol < 3; ++icol) {
+        Int_t col = cols[icol];
+        if (col != kIdxQP) {
+            // du0/dtx = (e_x - u0 * u0_x) / norm, and the same for ty
+            Double_t ut = (col == kIdxTX) ? u0[0] : u0[1];
+            for (Int_t i = 0; i < 3; ++i) du0[i] = -u0[i] * ut / norm;
+            du0[col == kIdxTX ? 0 : 1] += 1. / norm;
+            HelixPoint(zero, du0, n, omega, s, dr, du);
+        } else {
+            // d/domega at fixed s, times domega/dqp = kappa * |B|
+            Double_t th = omega * s, cs = cos(th), sn = sin(th), dS, dC;
+            if (fabs(th) < 1.e-2) {
+                Double_t th2 = th * th;
+                dS = s * s * th * (-1./3. + th2/30. * (1. - th2/28.));
+                dC = s * s * (0.5 - th2/8. * (1. - th2/18. * (1. - th2/40.)));
+            } else {
+                dS = s * s * (th * cs - sn) / (th * th);
+                dC = s * s * (th * sn - (1. - cs)) / (th * th);
+            }
+            Double_t dwdqp = kappa * Bmag;
+            Double_t u0n = u0[0]*n[0] + u0[1]*n[1] + u0[2]*n[2];
+            Double_t w[3] = { u0[1]*n[2] - u0[2]*n[1], u0[2]*n[0] - u0[0]*n[2], u0[0]*n[1] - u0[1]*n[0] };
+            for (Int_t i = 0; i < 3; ++i) {
+                Double_t perp = u0[i] - u0n * n[i];
+                du[i] = dwdqp * s * (-sn * perp + cs * w[i]);
+                dr[i] = dwdqp * (dS * perp + dC * w[i]);
+            }
+        }
+        Double_t ds = -dr[2] / u[2];
+        for (Int_t i = 0; i < 3; ++i) {
+            dr[i] += u[i] * ds;
+            du[i] += turn[i] * ds;
+        }
+        fPropStep(kIdxX0, col) = dr[0];
+        fPropStep(kIdxY0, col) = dr[1];
+        fPropStep(kIdxTX, col) = (du[0] - stateVec(kIdxTX, 0) * du[2]) / u[2];
+        fPropStep(kIdxTY, col) = (du[1] - stateVec(kIdxTY, 0) * du[2]) / u[2];
+    }
+
+    return kTRUE;
+}
+//_____________________________________________________________________________________________________________
 Bool_t SoLKalFieldStepper::FindTargetPlaneIntersection(TVector3 &intersection, 
-                                                       Double_t target_z, TVector3 &dir, TVector3 &pos)
+                                                       Double_t target_z, TVector3 &dir, TVector3 &pos) const
 {
   Double_t delta_z = target_z - pos.Z();
   Double_t cos_theta = TMath::Abs(dir.Z());
@@ -809,6 +1879,17 @@ Bool_t SoLKalFieldStepper::FindTargetPlaneIntersection(TVector3 &intersection,
 //______________________________________________________________________________________________________________
 void SoLKalFieldStepper::PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMatrix &fPropChange, 
                              Double_t &zPos, Double_t dz)
+{
+  SoLKalStateVec sv = SoLKalMatrix::ToStateVec(stateVec);
+  SoLKalPropMat  prop;
+  PropagateStraightLine(fContext, sv, prop, zPos, dz);
+  stateVec.SetFrom(sv);
+  fPropChange.UnitMatrix();
+  fPropChange.SetFrom(prop);
+}
+//______________________________________________________________________________________________________________
+void SoLKalFieldStepper::PropagateStraightLine(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec, 
+                             SoLKalPropMat &fPropChange, Double_t &zPos, Double_t dz) const
 {
   // Propagate the track state along a straight line in its current direction.
     // (x',y',z') = (x,y,z) + dz * (tx,ty,1)
@@ -830,25 +1911,38 @@ void SoLKalFieldStepper::PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMat
   stateVec(kIdxX0, 0) = stateVec(kIdxX0, 0) + dz * tx;
   stateVec(kIdxY0, 0) = stateVec(kIdxY0, 0) + dz * ty;
   zPos             = zPos             + dz;
-  trackPosAtZ      = zPos;
+  ctx.fTrackPosAtZ      = zPos;
 
   // Update propagator matrix.
-  fPropChange.UnitMatrix();
+  fPropChange = ROOT::Math::SMatrixIdentity();
 
   fPropChange(kIdxX0, kIdxTX)   = dz;
   fPropChange(kIdxY0, kIdxTY) = dz;
 
-  stepLength   = TMath::Abs(dz) * TMath::Sqrt(1. + tx*tx + ty*ty);
-  trackLength += stepLength;
+  ctx.fStepLength   = TMath::Abs(dz) * TMath::Sqrt(1. + tx*tx + ty*ty);
+  ctx.fTrackLength += ctx.fStepLength;
 }
 //______________________________________________________________________________________________________________
 Bool_t SoLKalFieldStepper::PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMatrix &fPropChange, 
                              Double_t &zPos, const Double_t target_z, Bool_t propDir)
+{
+  SoLKalStateVec sv = SoLKalMatrix::ToStateVec(stateVec);
+  SoLKalPropMat  prop;
+  Bool_t ok = PropagateStraightLine(fContext, sv, prop, zPos, target_z, propDir);
+  stateVec.SetFrom(sv);
+  fPropChange.UnitMatrix();
+  fPropChange.SetFrom(prop);
+  return ok;
+}
+//______________________________________________________________________________________________________________
+Bool_t SoLKalFieldStepper::PropagateStraightLine(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec, 
+                             SoLKalPropMat &fPropChange, Double_t &zPos, 
+                             const Double_t target_z, Bool_t propDir) const
 {
     // From the position and direction stored in the track state vector, propagate the track
     // to a target plane using a straight line. The track state and reference layer are updated
     // and the propagator matrix is calculated. The function returns the length of the straight line.
-    // The class variable trackPosAtZ must contain the current z-value of the track.
+    // The context variable fTrackPosAtZ must contain the current z-value of the track.
     //
     // Output:
     // fPropChange: Change in propagator matrix
@@ -861,7 +1955,7 @@ Bool_t SoLKalFieldStepper::PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalM
     // target_z:    z coordinate of the target plane
     // propDir:     Propagation direction.
 
-    stepLength = 0.;
+    ctx.fStepLength = 0.;
     TVector3 pos(stateVec(kIdxX0, 0), stateVec(kIdxY0, 0), zPos);
     TVector3 dir;
     SoLKalTrackState::CalcDir(dir, stateVec);
@@ -871,10 +1965,10 @@ Bool_t SoLKalFieldStepper::PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalM
     
 
     if((dz > 0. && propDir == kFALSE) || (dz < 0. && propDir == kTRUE)) {
-        PropagateStraightLine(stateVec, fPropChange, zPos, dz);
-        stepLength = (pos - pointIntersect).Mag();
+        PropagateStraightLine(ctx, stateVec, fPropChange, zPos, dz);
+        ctx.fStepLength = (pos - pointIntersect).Mag();
     } else {
-        fPropChange.UnitMatrix();
+        fPropChange = ROOT::Math::SMatrixIdentity();
         if(TMath::Abs(dz) > 0.001) {
           //if(bPrintWarn) {
           //    Warning("propagateStraightLine()", Form("Track already past target plane by dz = %f.", TMath::Abs(dz)));
@@ -902,10 +1996,49 @@ void SoLKalFieldStepper::InitDetMaterial()
   fDetMatProperties[kGEM][kDensity] = 0.1117433; //g/cm^3
   fDetMatProperties[kGEM][kRadLength] = 3.022; //m
   //fDetMatProperties[kGEM][kRadLength] = 2.5;
+
+  //lookup tables: path lengths up to a lumped plane gap in the air and a
+  //steep crossing of a GEM, |q/p| for 20 GeV down to 50 MeV (or the lower
+  //limit 0.1 of beta*gamma of Bethe-Bloch)
+  const Double_t maxLength[2] = { 4., 0.2 }; //m
+  const Double_t hypMass[SoLKalMaterialTable::kNHypothesis] = { kElectronMass, kPimMass, kProtonMass };
+  SoLKalStepperContext ctx;
+  ctx.fCharge = 1.;
+  for (Int_t type = kAir; type <= kGEM; type++){
+    const Double_t *prop = fDetMatProperties[type];
+    Double_t ZoverA = prop[kProtonNum]/prop[kAtomicNum];
+    SoLKalMaterialTable &table = fMatTable[type];
+    table.InitLength(prop[kRadLength], maxLength[type]);
+    for (Int_t hyp = 0; hyp < SoLKalMaterialTable::kNHypothesis; hyp++){
+      ctx.fMass = hypMass[hyp];
+      Double_t maxQP = 20.;
+      if (hyp != SoLKalMaterialTable::kHypElectron) maxQP = TMath::Min(maxQP, 0.99e4/hypMass[hyp]);
+      table.InitDEDX(hyp, 0.05, maxQP);
+      for (Int_t i = 0; i <= SoLKalMaterialTable::kNBin; i++){
+        Double_t aqp = table.GetQP(hyp, i);
+        if (hyp == SoLKalMaterialTable::kHypElectron){
+          table.SetDEDX(hyp, i, CalcDEDXIonLepton(aqp, ZoverA, prop[kDensity], prop[kExcitEnergy]));
+        }
+        else{
+          Double_t beta = 1. / TMath::Sqrt(1. + (ctx.fMass*ctx.fMass*1e-6) * aqp*aqp);
+          table.SetDEDX(hyp, i, CalcDEDXBetheBloch(ctx, beta, ZoverA, prop[kDensity], prop[kExcitEnergy]));
+        }
+      }
+    }
+  }
 }
 //_______________________________________________________________________________________________________________
 Double_t SoLKalFieldStepper::CalcMultScat(SoLKalMatrix &Q, SoLKalMatrix &sv_to, Double_t length, 
                                           Double_t beta, SoLMatType type )
+{
+  SoLKalPropMat Q5 = SoLKalMatrix::ToPropMat(Q);
+  Double_t cms2 = CalcMultScat(Q5, SoLKalMatrix::ToStateVec(sv_to), length, beta, type);
+  Q.SetFrom(Q5);
+  return cms2;
+}
+//_______________________________________________________________________________________________________________
+Double_t SoLKalFieldStepper::CalcMultScat(SoLKalPropMat &Q, const SoLKalStateVec &sv_to, Double_t length, 
+                                          Double_t beta, SoLMatType type ) const
 {
   // Add multiple scattering to the process noise covariance.
   //
@@ -926,14 +2059,18 @@ Double_t SoLKalFieldStepper::CalcMultScat(SoLKalMatrix &Q, SoLKalMatrix &sv_to,
   Double_t beta2Inv = 1. / (beta*beta);
 
   // 1/momentum^2
-  Double_t mom2Inv  = TMath::Power(sv_to(kIdxQP, 0), 2);
+  Double_t mom2Inv  = sv_to(kIdxQP, 0) * sv_to(kIdxQP, 0);
 
   // Squared scatter angle cms2.
   // cms = 13.6 MeV / (beta * c * p) * sqrt(l/X0) * (1 + 0.038 * ln(l/X0))
   // with l/X0 = length of particle track in units of radiation length.
   
-  Double_t lx0 = length / fDetMatProperties[type][kRadLength];
-  Double_t cms2 = (0.0136 * 0.0136 * beta2Inv * mom2Inv * lx0 * TMath::Power((1 + .038 * TMath::Log(lx0)),2));
+  Double_t highland;
+  if (!fUseMatTable || !fMatTable[type].GetHighland(length, highland)) {
+    Double_t lx0 = length / fDetMatProperties[type][kRadLength];
+    highland = lx0 * TMath::Power((1 + .038 * TMath::Log(lx0)),2);
+  }
+  Double_t cms2 = 0.0136 * 0.0136 * beta2Inv * mom2Inv * highland;
   
   // Update process noise.
   Q(kIdxTX, kIdxTX) += (1 + tx*tx) * t * cms2;
@@ -947,16 +2084,31 @@ Double_t SoLKalFieldStepper::CalcMultScat(SoLKalMatrix &Q, SoLKalMatrix &sv_to,
 //_____________________________________________________________________________________________________________
 Double_t SoLKalFieldStepper::CalcEnergyLoss(SoLKalMatrix &Q, SoLKalMatrix &sv_to, Double_t length, 
                                             Double_t qp, Double_t beta, SoLMatType type)
+{
+  SoLKalPropMat  Q5  = SoLKalMatrix::ToPropMat(Q);
+  SoLKalStateVec sv5 = SoLKalMatrix::ToStateVec(sv_to);
+  Double_t Eloss = CalcEnergyLoss(fContext, Q5, sv5, length, qp, beta, type);
+  Q.SetFrom(Q5);
+  sv_to.SetFrom(sv5);
+  return Eloss;
+}
+//_____________________________________________________________________________________________________________
+Double_t SoLKalFieldStepper::CalcEnergyLoss(const SoLKalStepperContext &ctx, SoLKalPropMat &Q, 
+                                            SoLKalStateVec &sv_to, Double_t length, 
+                                            Double_t qp, Double_t beta, SoLMatType type) const
 {
   Double_t ZoverA = fDetMatProperties[type][kProtonNum]/fDetMatProperties[type][kAtomicNum];
-  Double_t p    = fCharge / qp;
+  Double_t p    = ctx.fCharge / qp;
   Double_t ElossRad = 0.;
   Double_t ElossIon = 0.;
+  Double_t dedx, radFac;
+  const SoLKalMaterialTable *table = fUseMatTable ? &fMatTable[type] : NULL;
   
-   if(fIsElectron) {
+   if(ctx.fIsElectron) {
     // Radiation loss for electrons/positrons.
-      ElossRad = CalcRadLoss(Q, length, qp, fDetMatProperties[type][kRadLength]);
-      if(fIsBackward) {
+      if (table && table->GetRadLoss(length, radFac)) ElossRad = radFac / TMath::Abs(qp);
+      else ElossRad = CalcRadLoss(Q, length, qp, fDetMatProperties[type][kRadLength]);
+      if(ctx.fIsBackward) {
       ElossRad *= -1.;
     }
 
@@ -965,21 +2117,24 @@ Double_t SoLKalFieldStepper::CalcEnergyLoss(SoLKalMatrix &Q, SoLKalMatrix &sv_to
     // From "Passage of particles through matter", Particle Data Group, 2009
     
     
-    ElossIon = length * CalcDEDXIonLepton(qp, ZoverA, fDetMatProperties[type][kDensity], 
-                                          fDetMatProperties[type][kExcitEnergy]);
+    if (table && table->GetDEDX(ctx.fHypothesis, TMath::Abs(qp), dedx)) ElossIon = length * dedx;
+    else ElossIon = length * CalcDEDXIonLepton(qp, ZoverA, fDetMatProperties[type][kDensity], 
+                                               fDetMatProperties[type][kExcitEnergy]);
     
   } else { // Energy loss for heavy particles.
-    // Energy loss due to ionization.
-    ElossIon = length * CalcDEDXBetheBloch(beta, ZoverA, fDetMatProperties[type][kDensity],
-                                           fDetMatProperties[type][kExcitEnergy]);
+    // Energy loss due to ionization, the table is for unit charge
+    if (table && table->GetDEDX(ctx.fHypothesis, TMath::Abs(qp), dedx))
+      ElossIon = length * ctx.fCharge*ctx.fCharge * dedx;
+    else ElossIon = length * CalcDEDXBetheBloch(ctx, beta, ZoverA, fDetMatProperties[type][kDensity],
+                                                fDetMatProperties[type][kExcitEnergy]);
     
   }
-  if(fIsBackward == kTRUE) {
+  if(ctx.fIsBackward == kTRUE) {
     ElossIon *= -1.;
   }
   Double_t Eloss = ElossIon; // delta(E)
   
-  if (fIsElectron){
+  if (ctx.fIsElectron){
     // For electrons: E ~ p
     // p' = p * (1 + delta(E)/p)
     // Track state parameter change is:
@@ -993,16 +2148,24 @@ Double_t SoLKalFieldStepper::CalcEnergyLoss(SoLKalMatrix &Q, SoLKalMatrix &sv_to
     // p'^2 + m^2 = p^2 + m^2 + 2*E*delta(E) + delta(E)^2
     // p'^2 = p^2 + 2*E*delta(E) + delta(E)^2
     Double_t p2 = p * p;
-	  Double_t E = TMath::Sqrt(p2 + fMass*fMass*1e-6);
+	  Double_t E = TMath::Sqrt(p2 + ctx.fMass*ctx.fMass*1e-6);
     Double_t pnew = TMath::Sqrt(p2 + 2.*E*Eloss + Eloss*Eloss);
     if(pnew > 0.) {
-      sv_to(kIdxQP, 0) = fCharge / pnew;
+      sv_to(kIdxQP, 0) = ctx.fCharge / pnew;
     }
   }
   return Eloss;
 }
 //________________________________________________________________________________________________________________
 Double_t SoLKalFieldStepper::CalcRadLoss(SoLKalMatrix &Q, Double_t length, Double_t qp, Double_t radLength)
+{
+  SoLKalPropMat Q5 = SoLKalMatrix::ToPropMat(Q);
+  Double_t ElossRad = CalcRadLoss(Q5, length, qp, radLength);
+  Q.SetFrom(Q5);
+  return ElossRad;
+}
+//________________________________________________________________________________________________________________
+Double_t SoLKalFieldStepper::CalcRadLoss(SoLKalPropMat &Q, Double_t length, Double_t qp, Double_t radLength) const
 {
   // Calculates energy loss due to bremsstrahlung for electrons with Bethe-Heitler formula.
   // Sign will be negative if propagating in forward direction, i.e. particle looses energy.
@@ -1053,7 +2216,7 @@ Double_t SoLKalFieldStepper::CalcRadLoss(SoLKalMatrix &Q, Double_t length, Doubl
 
 }
 //______________________________________________________________________________________________________________
-Double_t SoLKalFieldStepper::CalcDEDXIonLepton(Double_t qp, Double_t ZoverA, Double_t density, Double_t I)
+Double_t SoLKalFieldStepper::CalcDEDXIonLepton(Double_t qp, Double_t ZoverA, Double_t density, Double_t I) const
 {
   // Calculates energy loss dE/dx in MeV/mm due to ionization for relativistic electrons/positrons.
   //
@@ -1086,7 +2249,8 @@ Double_t SoLKalFieldStepper::CalcDEDXIonLepton(Double_t qp, Double_t ZoverA, Dou
   return (- dedx);//convert from MeV/mm to GeV/m
 }
 //________________________________________________________________________________________________________________
-Double_t SoLKalFieldStepper::CalcDEDXBetheBloch(Double_t beta, Double_t ZoverA, Double_t density, Double_t I)
+Double_t SoLKalFieldStepper::CalcDEDXBetheBloch(const SoLKalStepperContext &ctx, Double_t beta, 
+                                                Double_t ZoverA, Double_t density, Double_t I) const
 {
   // Returns the ionization energy loss for thin materials with Bethe-Bloch formula.
   // - dE/dx = K/A * Z * z^2 / beta^2 * (0.5 * ln(2*me*beta^2*gamma^2*T_max/I^2) - beta^2)
@@ -1120,9 +2284,9 @@ Double_t SoLKalFieldStepper::CalcDEDXBetheBloch(Double_t beta, Double_t ZoverA,
     return 0.;
   }
   // Maximum kinetic energy that can be imparted on a free electron in a single collision.
-  Double_t tmax = (2. * me * betagamma2) / (1 + 2*gamma*me/(fMass) + (me*me)/(fMass*fMass));
+  Double_t tmax = (2. * me * betagamma2) / (1 + 2*gamma*me/(ctx.fMass) + (me*me)/(ctx.fMass*ctx.fMass));
 
-  return (-((Krho * fCharge*fCharge * ZoverA) / beta2)
+  return (-((Krho * ctx.fCharge*ctx.fCharge * ZoverA) / beta2)
           * (0.5 * TMath::Log((2. * me * betagamma2 * tmax)/(I*I)) - beta2))/10.;//convert from MeV/cm to GeV/m
 
 }
@@ -1,19 +1,134 @@
 #ifndef ROOT_SOL_KAL_FIELD_STEPPER
 #define ROOT_SOL_KAL_FIELD_STEPPER
 //c++
+#include <vector>
 //ROOT
 #include "TVector3.h"
 //SoLIDTracking
 #include "SoLIDUtility.h"
 #include "SoLIDFieldMap.h"
+#include "SoLIDFieldCursor.h"
 #include "SoLKalMatrix.h"
+#include "SoLKalMaterialTable.h"
 class SoLKalTrackSystem;
 class SoLKalTrackSite;
 class SoLKalTrackState;
+class SoLKalTransportTable;
+class SoLKalTransferMap;
+
+//state of one propagation: the particle hypothesis, the position and the
+//bookkeeping of the last Transport, and the field cursor. Every thread (or
+//track) that propagates owns one, set up by SoLKalFieldStepper::InitContext.
+//The stepper itself only keeps the settings shared by all tracks
+struct SoLKalStepperContext
+{
+  SoLKalStepperContext()
+  : fTrackPosAtZ(0.), fTrackLength(0.), fEnergyLoss(0.), fStepLength(0.), fStep(0),
+    fMass(kElectronMass), fCharge(-1.), fIsElectron(kTRUE),
+    fHypothesis(SoLKalMaterialTable::kHypElectron), fIsBackward(kFALSE),
+    fHasLastB(kFALSE), fFieldUniform(kFALSE), fMapSettingsId(0), fNFieldCall(0), fNTransport(0), fNTableHit(0), fNTableMiss(0),
+    fNHelixStep(0), fNRKStep(0), fNRejectStep(0), fNRetry(0), fNStraightLine(0), fNPassPlane(0) {}
+
+  Double_t  fTrackPosAtZ;    // z position of the track
+  Double_t  fTrackLength;    // total track length
+  Double_t  fEnergyLoss;     // total energy loss
+  Double_t  fStepLength;     // distance between the Runge-Kutta start and end points
+  Int_t     fStep;           // Runge-Kutta step number
+  Double_t  fMass;
+  Double_t  fCharge;
+  Bool_t    fIsElectron;
+  Int_t     fHypothesis;     // dE/dx table of the particle, see SoLKalMaterialTable
+  Bool_t    fIsBackward;     // kTRUE: backward propagation; kFALSE: forward propagation
+  SoLIDFieldCursor fCursor;  // cache of the last field map cell
+  //field at the end point of the last Dormand-Prince or helix step, reused
+  //as the first stage of the next step when it starts at the same point
+  Bool_t    fHasLastB;
+  //the fields at the start and the end of the last step were close enough
+  //for a helix step, the next step tries one
+  Bool_t    fFieldUniform;
+  Double_t  fLastBPos[3];
+  Double_t  fLastB[3];
+  //SoLIDFieldMap::GetSettingsId of the map when the cursor and fLastB were
+  //last cleared, they are cleared again when it changes
+  UInt_t    fMapSettingsId;
+  //statistics: field lookups and calls of Transport, predictions from the
+  //fast transport (table or transfer map) and those left to the stepper,
+  //helix steps taken
+  ULong64_t fNFieldCall;
+  ULong64_t fNTransport;
+  ULong64_t fNTableHit;
+  ULong64_t fNTableMiss;
+  ULong64_t fNHelixStep;
+  //only counted with TESTCODE: Runge-Kutta steps (of Transport and of the
+  //seed extrapolation), steps repeated shorter for the precision, steps of
+  //Transport repeated because they went past the destination,
+  //Transports that reached the plane with the final straight line from
+  //farther away than maxDist, and PropagationClassicalRK4 tracks that
+  //went past the destination plane
+  ULong64_t fNRKStep;
+  ULong64_t fNRejectStep;
+  ULong64_t fNRetry;
+  ULong64_t fNStraightLine;
+  ULong64_t fNPassPlane;
+};
+
+//snapshot of the statistics of a context and of its field cursor. The
+//difference of two snapshots is the work done in between, so a user of a
+//shared context can keep its own totals without resetting the context
+struct SoLKalStepperCounts
+{
+  SoLKalStepperCounts();
+  explicit SoLKalStepperCounts(const SoLKalStepperContext &ctx);
+  SoLKalStepperCounts& operator+=(const SoLKalStepperCounts &rhs);
+  SoLKalStepperCounts& operator-=(const SoLKalStepperCounts &rhs);
+
+  ULong64_t fNCursorHit;
+  ULong64_t fNCursorMiss;
+  ULong64_t fNFieldCall;
+  ULong64_t fNTransport;
+  ULong64_t fNTableHit;
+  ULong64_t fNTableMiss;
+  ULong64_t fNHelixStep;
+  ULong64_t fNRKStep;
+  ULong64_t fNRejectStep;
+  ULong64_t fNRetry;
+  ULong64_t fNStraightLine;
+  ULong64_t fNPassPlane;
+};
+
+//structure of arrays of track states propagated together by the batch
+//PropagationClassicalRK4 and by ExtrapolateSeeds: start position (m),
+//momentum (GeV) and charge of every lane, and the position at the
+//destination plane and the momentum there after the last propagation. The
+//lanes are advanced in blocks of kLanes in lockstep, a lane that reaches the
+//plane is masked out while the others of its block continue
+struct SoLKalSeedBatch
+{
+  static const Int_t kLanes = 4;
+
+  SoLKalSeedBatch() : fN(0) {}
+  //adds a lane with the start state, returns its index
+  Int_t Add(const TVector3 &pos, const TVector3 &mom, Double_t charge);
+  inline void  Clear() { fN = 0; }
+  inline Int_t GetN() const { return fN; }
+  //start state of a lane and the result of its last propagation
+  void GetStart(Int_t lane, TVector3 &pos, TVector3 &mom) const;
+  void GetFinal(Int_t lane, TVector3 &pos, TVector3 &mom) const;
+
+  Int_t fN;
+  vector<Double_t> fIn[6];  // x, y, z, px, py, pz at the start
+  vector<Double_t> fCharge;
+  vector<Double_t> fOut[6]; // x, y, z at the destination, px, py, pz
+};
 
 class SoLKalFieldStepper
 {
   public:
+  //integration scheme of RKPropagation
+  enum ERKMethod { kRK4 = 0, kDormandPrince = 1 };
+  //plane to plane backend of Predict
+  enum EFastTransport { kFastTable = 0, kFastTransferMap = 1 };
+
   ~SoLKalFieldStepper();
   static SoLKalFieldStepper * GetInstance() {
     if (fSoLKalFieldStepper == NULL) fSoLKalFieldStepper = new SoLKalFieldStepper();
@@ -23,19 +138,52 @@ class SoLKalFieldStepper
   void TurnOffMS()      { fIsMSOn = kFALSE; }
   void TurnOnDEDX ()    { fIsDEDXOn = kTRUE;  }
   void TurnOffDEDX ()   { fIsDEDXOn = kFALSE; }
-  
+
   inline Bool_t IsMSOn()   const { return fIsMSOn;     }
   inline Bool_t IsDEDXOn() const { return fIsDEDXOn;   }
-  inline Double_t GetEnergyLoss()  const { return energyLoss; }
-  inline Double_t GetTrackLength() const { return trackLength; }
-  inline Double_t GetTrackPosAtZ() const { return trackPosAtZ; }
-  
+  //results of the last propagation through the default context
+  inline Double_t GetEnergyLoss()  const { return fContext.fEnergyLoss; }
+  inline Double_t GetTrackLength() const { return fContext.fTrackLength; }
+  inline Double_t GetTrackPosAtZ() const { return fContext.fTrackPosAtZ; }
+  //field map used for the propagation, shared with the tracker system. The
+  //cached fields of the default context are cleared, those of the other
+  //contexts by their next InitContext
+  void SetFieldMap(SoLIDFieldMap* map);
+  inline SoLIDFieldMap* GetFieldMap() const { return fFieldMap; }
+  //field lookups through the cursor of the context
+  void SetUseFieldCursor(Bool_t use) { fUseCursor = use; }
+  inline Bool_t UseFieldCursor() const { return fUseCursor; }
+  inline SoLIDFieldCursor& GetFieldCursor() { return fContext.fCursor; }
+  //kRK4: classical Runge-Kutta with a step doubling style error estimate,
+  //kDormandPrince: embedded 5(4) pair, error estimate from the same stages
+  void SetRKMethod(Int_t method) { fRKMethod = (method == kDormandPrince) ? kDormandPrince : kRK4; }
+  inline Int_t GetRKMethod() const { return fRKMethod; }
+  //analytic helix steps where the field is uniform along the step, see
+  //HelixStep
+  void SetUseHelix(Bool_t use) { fUseHelix = use; }
+  inline Bool_t UseHelix() const { return fUseHelix; }
+  //material effects from the tables of InitDetMaterial instead of the
+  //exact formulas
+  void SetUseMaterialTable(Bool_t use) { fUseMatTable = use; }
+  inline Bool_t UseMaterialTable() const { return fUseMatTable; }
+  //multiple scattering and energy loss in the air once per Transport with
+  //the whole path length and the start state, instead of once per step
+  void SetLumpAir(Bool_t lump) { fLumpAir = lump; }
+  inline Bool_t LumpAir() const { return fLumpAir; }
+
+  //prepares a context for the propagation of a track (loads the default
+  //field map if none is set yet, and clears the cached fields if the map or
+  //its settings changed), and the default context used by the functions
+  //without a context argument, which are not thread safe
+  void InitContext(SoLKalStepperContext &ctx);
+  inline SoLKalStepperContext& GetDefaultContext() { return fContext; }
+
   void Transport(const SoLKalTrackSite  &from, // site from
                        SoLKalTrackSite   &to,   // sit to
                        SoLKalMatrix      &sv,   // state vector
                        SoLKalMatrix      &F,    // propagator matrix
                        SoLKalMatrix      &Q);   // process noise matrix
-                        
+
   void Transport(const SoLKalTrackSite  &from, // site from
                        Double_t         &finalZ, // z position of the destination
                        SoLKalMatrix       &sv,   // state vector
@@ -46,44 +194,190 @@ class SoLKalFieldStepper
                        SoLKalMatrix       &sv,   // state vector
                        SoLKalMatrix       &F,    // propagator matrix
                        SoLKalMatrix       &Q);   // process noise matrix
-                       
-  Double_t RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix &fPropStep, Double_t stepSize, 
+  //same with an explicit context, which also receives the z position,
+  //track length and energy loss of the propagation. The mode selects what
+  //is computed: kPropState skips the Jacobian and the process noise (F stays
+  //unity, Q zero), kPropJacobian skips the process noise. The mean energy
+  //loss is part of the state and applied in all modes
+  void Transport(SoLKalStepperContext   &ctx,
+                 const SoLKalTrackState &sv_from,
+                       Double_t         &finalZ, // z position of the destination
+                       SoLKalMatrix       &sv,   // state vector
+                       SoLKalMatrix       &F,    // propagator matrix
+                       SoLKalMatrix       &Q,    // process noise matrix
+                       SoLKalPropMode   mode = kPropFull) const;
+  //same with the fixed size types, nothing is allocated on the heap. The
+  //SoLKalMatrix versions above and below convert and call these
+  void Transport(SoLKalStepperContext   &ctx,
+                 const SoLKalTrackState &sv_from,
+                       Double_t         &finalZ, // z position of the destination
+                       SoLKalStateVec     &sv,   // state vector
+                       SoLKalPropMat      &F,    // propagator matrix
+                       SoLKalPropMat      &Q,    // process noise matrix
+                       SoLKalPropMode   mode = kPropFull) const;
+  void Transport(SoLKalStepperContext   &ctx,
+                 const SoLKalStateVec   &sv_from, // state vector at z0
+                       Double_t          z0,
+                       Double_t         &finalZ, // z position of the destination
+                       SoLKalStateVec     &sv,   // state vector
+                       SoLKalPropMat      &F,    // propagator matrix
+                       SoLKalPropMat      &Q,    // process noise matrix
+                       SoLKalPropMode   mode = kPropFull) const;
+
+  //plane to plane transport table and polynomial transfer maps used by
+  //Predict, owned by the stepper. kFALSE if the file cannot be loaded or
+  //does not match the field map
+  Bool_t LoadTransportTable(const char* filename);
+  Bool_t LoadTransferMap(const char* filename);
+  inline const SoLKalTransportTable* GetTransportTable() const { return fTransportTable; }
+  inline const SoLKalTransferMap* GetTransferMap() const { return fTransferMap; }
+  //backend of the fast transport, see EFastTransport
+  void SetFastTransport(Int_t backend) { fFastTransport = (backend == kFastTransferMap) ? kFastTransferMap : kFastTable; }
+  inline Int_t GetFastTransport() const { return fFastTransport; }
+  //transport through the selected backend if it has the segment from z0 to
+  //finalZ and the state is in its domain, kFALSE otherwise (nothing is
+  //changed then)
+  Bool_t TransportFast(SoLKalStepperContext   &ctx,
+                       const SoLKalStateVec   &sv_from, // state vector at z0
+                             Double_t          z0,
+                             Double_t          finalZ,
+                             SoLKalStateVec     &sv,   // state vector
+                             SoLKalPropMat      &F,    // propagator matrix
+                             SoLKalPropMat      &Q,    // process noise matrix
+                             SoLKalPropMode   mode = kPropFull) const;
+  //prediction for the hit search: through the fast transport when possible,
+  //with Transport otherwise
+  void Predict(SoLKalStepperContext   &ctx,
+               const SoLKalTrackState &sv_from,
+                     Double_t         &finalZ, // z position of the destination
+                     SoLKalMatrix       &sv,   // state vector
+                     SoLKalMatrix       &F,    // propagator matrix
+                     SoLKalMatrix       &Q,    // process noise matrix
+                     SoLKalPropMode   mode = kPropFull) const;
+  void Predict(SoLKalStepperContext   &ctx,
+               const SoLKalStateVec   &sv_from, // state vector at z0
+                     Double_t          z0,
+                     Double_t         &finalZ, // z position of the destination
+                     SoLKalStateVec     &sv,   // state vector
+                     SoLKalPropMat      &F,    // propagator matrix
+                     SoLKalPropMat      &Q,    // process noise matrix
+                     SoLKalPropMode   mode = kPropFull) const;
+
+  Double_t RKPropagation(SoLKalMatrix &stateVec, SoLKalMatrix &fPropStep, Double_t stepSize,
                          Bool_t bCalcJac, Bool_t dir);
-  void PropagationClassicalRK4(TVector3 &inMom, TVector3 &inPos, Double_t &finalZ, Double_t &charge, 
+  Double_t RKPropagation(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                         SoLKalPropMat &fPropStep, Double_t stepSize,
+                         Bool_t bCalcJac, Bool_t dir) const;
+  Double_t RKPropagationDP(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                           SoLKalPropMat &fPropStep, Double_t stepSize,
+                           Bool_t bCalcJac) const;
+  //one step on the helix of the mean field of the start and end points,
+  //taken only if the field difference between them moves the end point by
+  //less than helixPrecision; kFALSE (nothing changed) otherwise
+  Bool_t HelixStep(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                   SoLKalPropMat &fPropStep, Double_t stepSize,
+                   Bool_t bCalcJac, Double_t &stepFac) const;
+  //kTRUE if the field difference along a step allows a helix step
+  Bool_t IsFieldUniform(const Double_t *BStart, const Double_t *BEnd,
+                        Double_t qp, Double_t length) const;
+  void PropagationClassicalRK4(TVector3 &inMom, TVector3 &inPos, Double_t &finalZ, Double_t &charge,
                                Double_t &stepSize, TVector3 &fiMom, TVector3 &fiPos);
-  void RightHandSide(const Double_t y[], const Double_t charge, 
-                     const Double_t mom_mag, Double_t dydx[]);
-  Double_t Distance2Points(const TVector3 &vec1, const TVector3 &vec2);
-  Bool_t FindTargetPlaneIntersection(TVector3 &intersection, 
-                                     Double_t target_z, TVector3 &dir, TVector3 &pos);
-  void PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMatrix &fPropChange, 
+  void PropagationClassicalRK4(SoLKalStepperContext &ctx, TVector3 &inMom, TVector3 &inPos,
+                               Double_t &finalZ, Double_t &charge,
+                               Double_t &stepSize, TVector3 &fiMom, TVector3 &fiPos) const;
+  //the same for all lanes of a batch, to a common destination plane, with
+  //one field lookup per Runge-Kutta stage for kLanes lanes
+  void PropagationClassicalRK4(SoLKalSeedBatch &batch, Double_t finalZ, Double_t stepSize);
+  void PropagationClassicalRK4(SoLKalStepperContext &ctx, SoLKalSeedBatch &batch,
+                               Double_t finalZ, Double_t stepSize) const;
+  //seed extrapolator: the start state of every lane of the batch to the
+  //plane finalZ, with adaptive steps in z on (x, y, tx, ty) at fixed q/p.
+  //The step size follows the error estimate of the Runge-Kutta stages so
+  //that the position at the plane is good to about the seed tolerance.
+  //Nothing is allocated, the scalar version uses a block of one lane
+  void ExtrapolateSeeds(SoLKalSeedBatch &batch, Double_t finalZ);
+  void ExtrapolateSeeds(SoLKalStepperContext &ctx, SoLKalSeedBatch &batch,
+                        Double_t finalZ) const;
+  void ExtrapolateSeed(SoLKalStepperContext &ctx, const TVector3 &inPos, const TVector3 &inMom,
+                       Double_t charge, Double_t finalZ, TVector3 &fiPos, TVector3 &fiMom) const;
+  //position accuracy (m) of the seed extrapolator at the destination plane,
+  //a larger value takes fewer steps
+  void SetSeedTolerance(Double_t tol) { if (tol > 0.) fSeedTolerance = tol; }
+  inline Double_t GetSeedTolerance() const { return fSeedTolerance; }
+  void RightHandSide(SoLKalStepperContext &ctx, const Double_t y[], const Double_t charge,
+                     const Double_t mom_mag, Double_t dydx[]) const;
+  Double_t Distance2Points(const TVector3 &vec1, const TVector3 &vec2) const;
+  Bool_t FindTargetPlaneIntersection(TVector3 &intersection,
+                                     Double_t target_z, TVector3 &dir, TVector3 &pos) const;
+  void PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMatrix &fPropChange,
                              Double_t &zPos, Double_t dz);
-  Bool_t PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMatrix &fPropChange, 
+  Bool_t PropagateStraightLine(SoLKalMatrix &stateVec, SoLKalMatrix &fPropChange,
                                Double_t &zPos, const Double_t target_z, Bool_t propDir);
+  void PropagateStraightLine(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                             SoLKalPropMat &fPropChange, Double_t &zPos, Double_t dz) const;
+  Bool_t PropagateStraightLine(SoLKalStepperContext &ctx, SoLKalStateVec &stateVec,
+                               SoLKalPropMat &fPropChange, Double_t &zPos,
+                               const Double_t target_z, Bool_t propDir) const;
   void InitTrack(Double_t &mass, Double_t &charge, Bool_t &isElectron, Bool_t dir);
+  void InitTrack(SoLKalStepperContext &ctx, Double_t mass, Double_t charge,
+                 Bool_t isElectron, Bool_t dir) const;
   void UseDefaultStep();
   void UseFineStep();
-  
+
   //Process Noise calculation
-  Double_t CalcMultScat(SoLKalMatrix &Q, SoLKalMatrix &sv_to, Double_t length, 
+  Double_t CalcMultScat(SoLKalMatrix &Q, SoLKalMatrix &sv_to, Double_t length,
                         Double_t beta, SoLMatType type = kAir);
-  Double_t CalcEnergyLoss(SoLKalMatrix &Q, SoLKalMatrix &sv_to, Double_t length, 
+  Double_t CalcEnergyLoss(SoLKalMatrix &Q, SoLKalMatrix &sv_to, Double_t length,
                           Double_t qp, Double_t beta, SoLMatType type = kAir);
   Double_t CalcRadLoss(SoLKalMatrix &Q, Double_t length, Double_t qp, Double_t radLength);
-  Double_t CalcDEDXIonLepton(Double_t qp, Double_t ZoverA, Double_t density, Double_t I);
-  Double_t CalcDEDXBetheBloch(Double_t beta, Double_t ZoverA, Double_t density, Double_t I);
+  Double_t CalcMultScat(SoLKalPropMat &Q, const SoLKalStateVec &sv_to, Double_t length,
+                        Double_t beta, SoLMatType type = kAir) const;
+  Double_t CalcEnergyLoss(const SoLKalStepperContext &ctx, SoLKalPropMat &Q,
+                          SoLKalStateVec &sv_to, Double_t length,
+                          Double_t qp, Double_t beta, SoLMatType type = kAir) const;
+  Double_t CalcRadLoss(SoLKalPropMat &Q, Double_t length, Double_t qp, Double_t radLength) const;
+  Double_t CalcDEDXIonLepton(Double_t qp, Double_t ZoverA, Double_t density, Double_t I) const;
+  Double_t CalcDEDXBetheBloch(const SoLKalStepperContext &ctx, Double_t beta,
+                              Double_t ZoverA, Double_t density, Double_t I) const;
   protected:
   SoLKalFieldStepper();
-  
+
   void InitDetMaterial();
+  //kTRUE if a table or transfer map generated for the given field map and
+  //scale can be used with the field map of the stepper
+  Bool_t MatchesFieldMap(const char* filename, const char* mapName, Double_t scale) const;
+  //adaptive steps of the seed extrapolator for one block of lanes, t holds
+  //x, y, tx, ty at z and is replaced by the state at finalZ; a is
+  //kappa*q/p*sign(pz) of every lane. Lanes that are not active are not moved
+  void ExtrapolateSeedLanes(SoLKalStepperContext &ctx,
+                            Double_t t[4][SoLKalSeedBatch::kLanes],
+                            Double_t z[SoLKalSeedBatch::kLanes],
+                            const Double_t a[SoLKalSeedBatch::kLanes],
+                            const Bool_t active[SoLKalSeedBatch::kLanes],
+                            Double_t finalZ) const;
+  //field lookup through the cursor or the map, counted in the context
+  inline void GetBField(SoLKalStepperContext &ctx, Double_t x, Double_t y, Double_t z,
+                        Double_t *B) const {
+    ++ctx.fNFieldCall;
+    if (fUseCursor) ctx.fCursor.GetBField(x, y, z, B);
+    else fFieldMap->GetBField(x, y, z, B);
+  }
   SoLIDFieldMap* fFieldMap;
-  
+  Bool_t    fUseCursor;      //! look up the field through the cursor of the context
+  Int_t     fRKMethod;       //! integration scheme, see ERKMethod
+  Bool_t    fUseHelix;       //! helix steps in uniform field
+  SoLKalTransportTable* fTransportTable; //! plane to plane transport table, NULL if none
+  SoLKalTransferMap* fTransferMap; //! plane to plane transfer maps, NULL if none
+  Int_t     fFastTransport;  //! backend of Predict, see EFastTransport
+  Bool_t    fUseMatTable;    //! material effects from fMatTable
+  Bool_t    fLumpAir;        //! air once per Transport
+  Double_t  fSeedTolerance;  //! accuracy (m) of ExtrapolateSeeds at the destination plane
+  SoLKalStepperContext fContext; //! context of the functions without a context argument
+
   static SoLKalFieldStepper* fSoLKalFieldStepper;
-  
+
   Bool_t    fIsMSOn;         //! switch for multiple scattering
   Bool_t    fIsDEDXOn;       //! switch for energy loss
-  Bool_t    fIsBackward;     //kTRUE: backward propagation; kFALSE: forward propagation
-  Double_t  trackPosAtZ;  //z position of the track
   Double_t  minPrecision; // minimum precision for the Runge-Kutta method
   Double_t  maxPrecision; // maximum precision for the Runge-Kutta method
   Double_t  minStepSize;  //minimum step size for the Runge-Kutta method
@@ -91,20 +385,14 @@ class SoLKalFieldStepper
   Double_t  maxNumSteps;  //maximum number of steps for the Runge-Kutta method
   Double_t  stepSizeDec;  //step size reduction factor for the Runge-Kutta method
   Double_t  stepSizeInc;  //step size increasment factor for the Runge-Kutta method
-  Double_t  stepLength;   //distance between the Runge-Kutta start and end points
-  Double_t  trackLength;  //total track length
-  Double_t  energyLoss;   //total energy loss
   Double_t  maxDist;      //maximum distance for straight line approximation
-  Int_t     jstep;        //Runge-Kutta step number
   Double_t  initialStepSize; //initial step size for the Runge-Kutta method
   Double_t  minLengthCalcQ; //when the step size of propagation is larger than this value, process noise will be calculated
-  
-  Double_t  fMass;
-  Double_t  fCharge;
-  Bool_t    fIsElectron;
-  
+  Double_t  helixPrecision; //largest change (m) of the end point of a helix step by the field difference along it
+
   Double_t  fDetMatProperties[2][5];
-  
+  SoLKalMaterialTable fMatTable[2]; //! lookup tables of the materials
+
 };
 
 #endif
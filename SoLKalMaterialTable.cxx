@@ -0,0 +1,50 @@
+//c++
+#include <cmath>
+//ROOT
+#include "TMath.h"
+//SoLIDTracking
+#include "SoLKalMaterialTable.h"
+#include "SoLIDUtility.h"
+
+using namespace std;
+
+//__________________________________________________________________
+SoLKalMaterialTable::SoLKalMaterialTable()
+: fInvDL(0.)
+{
+  for (Int_t hyp=0; hyp<kNHypothesis; hyp++){
+    fMinQP[hyp]  = 0.;
+    fDQP[hyp]    = 0.;
+    fInvDQP[hyp] = 0.;
+  }
+}
+//__________________________________________________________________
+void SoLKalMaterialTable::InitLength(Double_t radLength, Double_t maxLength)
+{
+  Double_t dl = maxLength / kNBin;
+  fInvDL = 1. / dl;
+  fHighland.assign(kNBin+1, 0.);
+  fRadLoss.assign(kNBin+1, 0.);
+  //x ln(x) goes to 0 at the first point
+  for (Int_t i=1; i<=kNBin; i++){
+    Double_t lx0 = i * dl / radLength;
+    fHighland[i] = lx0 * TMath::Power(1 + .038 * TMath::Log(lx0), 2);
+    fRadLoss[i]  = TMath::Exp(-lx0) - 1.;
+  }
+}
+//__________________________________________________________________
+void SoLKalMaterialTable::InitDEDX(Int_t hyp, Double_t minQP, Double_t maxQP)
+{
+  fMinQP[hyp]  = minQP;
+  fDQP[hyp]    = (maxQP - minQP) / kNBin;
+  fInvDQP[hyp] = 1. / fDQP[hyp];
+  fDEDX[hyp].assign(kNBin+1, 0.);
+}
+//__________________________________________________________________
+Int_t SoLKalMaterialTable::GetHypothesis(Double_t mass, Bool_t isElectron)
+{
+  if (isElectron) return kHypElectron;
+  if (fabs(mass - kPimMass) < 1.e-3) return kHypPion;
+  if (fabs(mass - kProtonMass) < 1.e-3) return kHypProton;
+  return -1;
+}
@@ -0,0 +1,72 @@
+#ifndef ROOT_SOL_KAL_MATERIAL_TABLE
+#define ROOT_SOL_KAL_MATERIAL_TABLE
+//c++
+#include <vector>
+//ROOT
+#include "Rtypes.h"
+
+using namespace std;
+
+//lookup tables of the material effects of one detector material, filled
+//once by SoLKalFieldStepper::InitDetMaterial so that the process noise and
+//the energy loss of a Runge-Kutta step need no Log, Exp or Power: the
+//ionization dE/dx of every particle hypothesis on a grid in |q/p|, and the
+//Highland and Bethe-Heitler factors on a grid in the path length. Values
+//are interpolated linearly, arguments out of a grid are left to the exact
+//formulas of the stepper
+class SoLKalMaterialTable
+{
+  public:
+  //particle hypotheses with a dE/dx table
+  enum EHypothesis { kHypElectron = 0, kHypPion, kHypProton, kNHypothesis };
+
+  SoLKalMaterialTable();
+
+  //Highland and radiation loss grids from 0 to maxLength (m) for the
+  //radiation length radLength (m)
+  void InitLength(Double_t radLength, Double_t maxLength);
+  //dE/dx grid of a hypothesis from minQP to maxQP (1/GeV), its values are
+  //set with SetDEDX at the grid points GetQP
+  void InitDEDX(Int_t hyp, Double_t minQP, Double_t maxQP);
+  inline Double_t GetQP(Int_t hyp, Int_t i) const { return fMinQP[hyp] + i*fDQP[hyp]; }
+  inline void     SetDEDX(Int_t hyp, Int_t i, Double_t dedx) { fDEDX[hyp][i] = dedx; }
+
+  //hypothesis of a particle of the given mass (MeV), -1 if there is no table
+  static Int_t GetHypothesis(Double_t mass, Bool_t isElectron);
+
+  //dE/dx (GeV/m) of a hypothesis at |q/p| (1/GeV), for unit charge
+  inline Bool_t GetDEDX(Int_t hyp, Double_t aqp, Double_t &dedx) const {
+    if (hyp < 0) return kFALSE;
+    return Interpolate(fDEDX[hyp], (aqp - fMinQP[hyp]) * fInvDQP[hyp], dedx);
+  }
+  //l/X0 * (1 + 0.038 ln(l/X0))^2 of the Highland formula for a path length l (m)
+  inline Bool_t GetHighland(Double_t length, Double_t &h) const {
+    return Interpolate(fHighland, length * fInvDL, h);
+  }
+  //exp(-l/X0) - 1, the relative energy loss by bremsstrahlung
+  inline Bool_t GetRadLoss(Double_t length, Double_t &f) const {
+    return Interpolate(fRadLoss, length * fInvDL, f);
+  }
+
+  static const Int_t kNBin = 4096;
+
+  protected:
+  //linear interpolation at u in units of the bin size, kFALSE off the grid
+  static inline Bool_t Interpolate(const vector<Double_t> &v, Double_t u, Double_t &y) {
+    if (v.empty() || !(u >= 0.) || u >= kNBin) return kFALSE;
+    Int_t    i = (Int_t)u;
+    Double_t t = u - i;
+    y = v[i] + t * (v[i+1] - v[i]);
+    return kTRUE;
+  }
+
+  Double_t fInvDL;                      // 1/bin size of the length grids
+  vector<Double_t> fHighland;
+  vector<Double_t> fRadLoss;
+  Double_t fMinQP[kNHypothesis];
+  Double_t fDQP[kNHypothesis];
+  Double_t fInvDQP[kNHypothesis];
+  vector<Double_t> fDEDX[kNHypothesis];
+};
+
+#endif
@@ -123,3 +123,41 @@ TVector3 SoLKalMatrix::ToThreeVec(const TMatrixD &a)
 
 
 
+//___________________________________________________________
+SoLKalStateVec SoLKalMatrix::ToStateVec(const TMatrixD &a)
+{
+   assert(a.GetNrows() >= kSdim);
+   SoLKalStateVec sv;
+   const Double_t *p = a.GetMatrixArray();
+   Int_t ncols = a.GetNcols();
+   for (Int_t i=0; i<kSdim; i++) sv(i,0) = p[i*ncols];
+   return sv;
+}
+//___________________________________________________________
+SoLKalPropMat SoLKalMatrix::ToPropMat(const TMatrixD &a)
+{
+   assert(a.GetNrows() >= kSdim && a.GetNcols() >= kSdim);
+   SoLKalPropMat m;
+   const Double_t *p = a.GetMatrixArray();
+   Int_t ncols = a.GetNcols();
+   for (Int_t i=0; i<kSdim; i++)
+      for (Int_t j=0; j<kSdim; j++) m(i,j) = p[i*ncols + j];
+   return m;
+}
+//___________________________________________________________
+void SoLKalMatrix::SetFrom(const SoLKalStateVec &sv)
+{
+   assert(GetNrows() >= kSdim);
+   Double_t *p = GetMatrixArray();
+   Int_t ncols = GetNcols();
+   for (Int_t i=0; i<kSdim; i++) p[i*ncols] = sv(i,0);
+}
+//___________________________________________________________
+void SoLKalMatrix::SetFrom(const SoLKalPropMat &m)
+{
+   assert(GetNrows() >= kSdim && GetNcols() >= kSdim);
+   Double_t *p = GetMatrixArray();
+   Int_t ncols = GetNcols();
+   for (Int_t i=0; i<kSdim; i++)
+      for (Int_t j=0; j<kSdim; j++) p[i*ncols + j] = m(i,j);
+}
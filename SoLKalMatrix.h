@@ -3,6 +3,19 @@
 //ROOT
 #include "TMatrixD.h"
 #include "TVector3.h"
+#include "Math/SMatrix.h"
+//SoLIDTracking
+#include "SoLIDUtility.h"
+
+//fixed size state vector and propagator, kept on the stack by the stepper
+typedef ROOT::Math::SMatrix<Double_t, kSdim, 1>     SoLKalStateVec;
+typedef ROOT::Math::SMatrix<Double_t, kSdim, kSdim> SoLKalPropMat;
+//fixed size types of the measurement update: measurement vector and its
+//covariance, the projection H and the gain
+typedef ROOT::Math::SMatrix<Double_t, kMdim, 1>     SoLKalMeasVec;
+typedef ROOT::Math::SMatrix<Double_t, kMdim, kMdim> SoLKalMeasMat;
+typedef ROOT::Math::SMatrix<Double_t, kMdim, kSdim> SoLKalProjMat;
+typedef ROOT::Math::SMatrix<Double_t, kSdim, kMdim> SoLKalGainMat;
 
 class SoLKalMatrix : public TMatrixD {
 public:
@@ -32,6 +45,13 @@ public:
    static SoLKalMatrix ToKalMat  (const TVector3 &vec);
    static TVector3   ToThreeVec(const TMatrixD &mat);
 
+   //conversion to and from the fixed size types, the first kSdim rows and
+   //columns are copied, the matrix keeps its own size
+   static SoLKalStateVec ToStateVec(const TMatrixD &mat);
+   static SoLKalPropMat  ToPropMat (const TMatrixD &mat);
+   void SetFrom(const SoLKalStateVec &sv);
+   void SetFrom(const SoLKalPropMat  &m);
+
 private:
 
    ClassDef(SoLKalMatrix,1)      // Base class for Kalman matrix
@@ -0,0 +1,104 @@
+//ROOT
+#include "TClonesArray.h"
+//SoLIDTracking
+#include "SoLKalTrackArena.h"
+#include "SoLKalTrackSite.h"
+#include "SoLKalTrackState.h"
+#include "SoLIDUtility.h"
+
+//__________________________________________________________________
+SoLKalTrackArena::SoLKalTrackArena(Int_t nSite, Int_t nState)
+: fNSites(0), fNStates(0), fNSiteSlots(0), fNStateSlots(0),
+  fNSitesCounted(0), fNStatesCounted(0), fNAllocCounted(0),
+  fTotalSites(0), fTotalStates(0), fTotalAlloc(0), fNEvents(0)
+{
+  fSites  = new TClonesArray("SoLKalTrackSite", nSite);
+  fStates = new TClonesArray("SoLKalTrackState", nState);
+}
+//__________________________________________________________________
+SoLKalTrackArena::~SoLKalTrackArena()
+{
+  //the objects of the last event are destructed by the TClonesArray
+  delete fSites;
+  delete fStates;
+}
+//__________________________________________________________________
+SoLKalTrackSite * SoLKalTrackArena::NewSite(SoLIDGEMHit *hit, Double_t chi2)
+{
+  SoLKalTrackSite *site = new ((*fSites)[fNSites++]) SoLKalTrackSite(hit, kMdim, kSdim, chi2);
+  site->SetArena(this);
+  return site;
+}
+//__________________________________________________________________
+SoLKalTrackSite * SoLKalTrackArena::NewSite(Double_t chi2)
+{
+  SoLKalTrackSite *site = new ((*fSites)[fNSites++]) SoLKalTrackSite(kMdim, kSdim, chi2);
+  site->SetArena(this);
+  return site;
+}
+//__________________________________________________________________
+SoLKalTrackState * SoLKalTrackArena::NewState(const SoLKalMatrix &sv, Int_t type)
+{
+  SoLKalTrackState *state = new ((*fStates)[fNStates++]) SoLKalTrackState(sv, type, kSdim);
+  state->SetArena(this);
+  return state;
+}
+//__________________________________________________________________
+SoLKalTrackState * SoLKalTrackArena::NewState(const SoLKalMatrix &sv, const SoLKalTrackSite &site,
+                                              Int_t type)
+{
+  SoLKalTrackState *state = new ((*fStates)[fNStates++]) SoLKalTrackState(sv, site, type, kSdim);
+  state->SetArena(this);
+  return state;
+}
+//__________________________________________________________________
+SoLKalTrackState * SoLKalTrackArena::NewState(const SoLKalMatrix &sv, const SoLKalMatrix &c,
+                                              const SoLKalTrackSite &site, Int_t type)
+{
+  SoLKalTrackState *state = new ((*fStates)[fNStates++]) SoLKalTrackState(sv, c, site, type, kSdim);
+  state->SetArena(this);
+  return state;
+}
+//__________________________________________________________________
+SoLKalTrackSite * SoLKalTrackArena::CopySite(const SoLKalTrackSite &site)
+{
+  SoLKalTrackSite *copy = new ((*fSites)[fNSites++]) SoLKalTrackSite(site);
+  copy->SetArena(this);
+  for (Int_t i=0; i<site.GetEntriesFast(); i++){
+    const SoLKalTrackState *state = static_cast<const SoLKalTrackState*>(site.UncheckedAt(i));
+    SoLKalTrackState *stateCopy = new ((*fStates)[fNStates++]) SoLKalTrackState(*state);
+    stateCopy->SetArena(this);
+    copy->Add(stateCopy);
+  }
+  //the current state is the last one added, as in the site
+  return copy;
+}
+//__________________________________________________________________
+void SoLKalTrackArena::CountEvent()
+{
+  //only what was taken since the last call, so that the event is counted
+  //once whether or not its totals were already asked for
+  if (fNSitesCounted == 0 && fNStatesCounted == 0 && (fNSites > 0 || fNStates > 0)) fNEvents++;
+  fTotalSites  += fNSites - fNSitesCounted;
+  fTotalStates += fNStates - fNStatesCounted;
+  fTotalAlloc  += GetNAlloc() - fNAllocCounted;
+  fNSitesCounted  = fNSites;
+  fNStatesCounted = fNStates;
+  fNAllocCounted  = GetNAlloc();
+}
+//__________________________________________________________________
+void SoLKalTrackArena::Reset()
+{
+  //Clear without option keeps the objects in their slots, a slot is
+  //destructed only when it is taken again in a later event
+  CountEvent();
+  fNSiteSlots  = TMath::Max(fNSiteSlots, fNSites);
+  fNStateSlots = TMath::Max(fNStateSlots, fNStates);
+  fSites->Clear();
+  fStates->Clear();
+  fNSites  = 0;
+  fNStates = 0;
+  fNSitesCounted  = 0;
+  fNStatesCounted = 0;
+  fNAllocCounted  = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef ROOT_SOL_KAL_TRACK_ARENA
+#define ROOT_SOL_KAL_TRACK_ARENA
+//ROOT
+#include "Rtypes.h"
+#include "TMath.h"
+
+class TClonesArray;
+class SoLIDGEMHit;
+class SoLKalMatrix;
+class SoLKalTrackSite;
+class SoLKalTrackState;
+
+//per-event pool of the sites and states of the track finder. The objects
+//are constructed in the slots of two TClonesArray, which keep their memory
+//from one event to the next, and are all given back by Reset at the end of
+//the event. A site or state taken from the arena knows it (GetArena), the
+//states it creates are taken from the same arena, and neither the sites nor
+//the track systems delete them
+class SoLKalTrackArena
+{
+  public:
+  SoLKalTrackArena(Int_t nSite = 2000, Int_t nState = 8000);
+  ~SoLKalTrackArena();
+
+  SoLKalTrackSite  * NewSite(SoLIDGEMHit *hit, Double_t chi2);
+  SoLKalTrackSite  * NewSite(Double_t chi2);
+  SoLKalTrackState * NewState(const SoLKalMatrix &sv, Int_t type);
+  SoLKalTrackState * NewState(const SoLKalMatrix &sv, const SoLKalTrackSite &site,
+                              Int_t type);
+  SoLKalTrackState * NewState(const SoLKalMatrix &sv, const SoLKalMatrix &c,
+                              const SoLKalTrackSite &site, Int_t type);
+  //copy of a site with copies of its states
+  SoLKalTrackSite  * CopySite(const SoLKalTrackSite &site);
+
+  //give back all the objects of the event, the slots are reused by the next
+  void Reset();
+  //adds the objects taken in this event to the totals. Done by Reset, and
+  //to be done before the totals are reported at the end of a run, which
+  //comes after the last event but before its Reset
+  void CountEvent();
+
+  //objects taken in this event, each one was a new before the arena, and
+  //slots that had to be allocated for them
+  inline Int_t GetNSites()  const { return fNSites;  }
+  inline Int_t GetNStates() const { return fNStates; }
+  inline Int_t GetNAlloc()  const {
+    return TMath::Max(fNSites - fNSiteSlots, 0) + TMath::Max(fNStates - fNStateSlots, 0);
+  }
+  //totals since the last ResetCounters, over the events that took objects,
+  //up to the last CountEvent
+  inline ULong64_t GetTotalSites()  const { return fTotalSites;  }
+  inline ULong64_t GetTotalStates() const { return fTotalStates; }
+  inline ULong64_t GetTotalAlloc()  const { return fTotalAlloc;  }
+  inline Int_t     GetNEvents()     const { return fNEvents;     }
+  inline void ResetCounters() { fTotalSites = fTotalStates = fTotalAlloc = 0; fNEvents = 0; }
+
+  private:
+  TClonesArray* fSites;
+  TClonesArray* fStates;
+  Int_t         fNSites;      // sites taken in this event
+  Int_t         fNStates;     // states taken in this event
+  Int_t         fNSiteSlots;  // slots of fSites that hold an object
+  Int_t         fNStateSlots; // slots of fStates that hold an object
+  Int_t         fNSitesCounted;  // of this event, already in the totals
+  Int_t         fNStatesCounted;
+  Int_t         fNAllocCounted;
+  ULong64_t     fTotalSites;
+  ULong64_t     fTotalStates;
+  ULong64_t     fTotalAlloc;
+  Int_t         fNEvents;
+};
+
+#endif
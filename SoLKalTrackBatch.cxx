@@ -0,0 +1,231 @@
+//SoLIDTracking
+#include "SoLKalTrackBatch.h"
+#include "SoLKalTrackState.h"
+#include "SoLKalTrackSite.h"
+
+//__________________________________________________________________
+void SoLKalTrackBatch::Grow()
+{
+  //the arrays only grow, a batch that is cleared and filled again reuses them
+  if ((Int_t)fZ.size() > fN) return;
+  for (Int_t i=0; i<kSdim; i++){
+    fSV[i].push_back(0.);
+    fFilt[i].push_back(0.);
+  }
+  for (Int_t i=0; i<kNCov; i++){
+    fC[i].push_back(0.);
+    fQ[i].push_back(0.);
+    fFiltC[i].push_back(0.);
+  }
+  for (Int_t i=0; i<kSdim*kSdim; i++) fF[i].push_back(0.);
+  for (Int_t i=0; i<kMdim; i++) fM[i].push_back(0.);
+  for (Int_t i=0; i<3; i++) fV[i].push_back(0.);
+  fZ.push_back(0.);
+  fHasHit.push_back(0.);
+  fChi2.push_back(0.);
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::ResetMeasurement(Int_t lane)
+{
+  //a lane without measurement goes through Update with a unit noise
+  //matrix, which keeps its residual covariance regular, and is left as it is
+  fHasHit[lane] = 0.;
+  fM[0][lane] = 0.;
+  fM[1][lane] = 0.;
+  fV[0][lane] = 1.;
+  fV[1][lane] = 0.;
+  fV[2][lane] = 1.;
+}
+//__________________________________________________________________
+Int_t SoLKalTrackBatch::Add(const SoLKalTrackState &state)
+{
+  Grow();
+  const SoLKalMatrix &C = state.GetCovMat();
+  for (Int_t i=0; i<kSdim; i++){
+    fSV[i][fN] = state(i, 0);
+    for (Int_t j=i; j<kSdim; j++) fC[GetCovIndex(i, j)][fN] = C(i, j);
+  }
+  fZ[fN] = state.GetZ0();
+  fHasHit[fN] = 0.;
+  return fN++;
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::SetPrediction(Int_t lane, const SoLKalStateVec &sv, const SoLKalPropMat &F,
+                                     const SoLKalPropMat &Q, Double_t z)
+{
+  for (Int_t i=0; i<kSdim; i++){
+    fSV[i][lane] = sv(i, 0);
+    for (Int_t j=0; j<kSdim; j++) fF[i*kSdim + j][lane] = F(i, j);
+    for (Int_t j=i; j<kSdim; j++) fQ[GetCovIndex(i, j)][lane] = Q(i, j);
+  }
+  fZ[lane] = z;
+  ResetMeasurement(lane);
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::Predict()
+{
+  const Int_t nl = kLanes;
+
+  for (Int_t first=0; first<fN; first+=nl){
+    Double_t F[kSdim][kSdim][nl], C[kSdim][kSdim][nl], FC[kSdim][kSdim][nl];
+    Double_t Q[kNCov][nl];
+
+    //lanes past the end of the batch repeat the first lane of the block
+    for (Int_t l=0; l<nl; l++){
+      Int_t lane = (first + l < fN) ? first + l : first;
+      for (Int_t i=0; i<kSdim; i++){
+        for (Int_t j=0; j<kSdim; j++){
+          F[i][j][l] = fF[i*kSdim + j][lane];
+          C[i][j][l] = fC[GetCovIndex(i, j)][lane];
+        }
+      }
+      for (Int_t i=0; i<kNCov; i++) Q[i][l] = fQ[i][lane];
+    }
+
+    //F C, then (F C) F^T + Q for the upper triangle
+    for (Int_t i=0; i<kSdim; i++){
+      for (Int_t j=0; j<kSdim; j++){
+        for (Int_t l=0; l<nl; l++) FC[i][j][l] = 0.;
+        for (Int_t k=0; k<kSdim; k++)
+          for (Int_t l=0; l<nl; l++) FC[i][j][l] += F[i][k][l] * C[k][j][l];
+      }
+    }
+    for (Int_t i=0; i<kSdim; i++){
+      for (Int_t j=i; j<kSdim; j++){
+        Double_t s[nl];
+        for (Int_t l=0; l<nl; l++) s[l] = 0.;
+        for (Int_t k=0; k<kSdim; k++)
+          for (Int_t l=0; l<nl; l++) s[l] += FC[i][k][l] * F[j][k][l];
+        Int_t idx = GetCovIndex(i, j);
+        for (Int_t l=0; l<nl; l++) C[i][j][l] = s[l] + Q[idx][l];
+      }
+    }
+
+    for (Int_t l=0; l<nl && first + l < fN; l++){
+      for (Int_t i=0; i<kSdim; i++)
+        for (Int_t j=i; j<kSdim; j++) fC[GetCovIndex(i, j)][first + l] = C[i][j][l];
+    }
+  }
+}
+//__________________________________________________________________
+Int_t SoLKalTrackBatch::AddBranch(Int_t lane)
+{
+  Grow();
+  for (Int_t i=0; i<kSdim; i++) fSV[i][fN] = fSV[i][lane];
+  for (Int_t i=0; i<kNCov; i++) fC[i][fN] = fC[i][lane];
+  fZ[fN] = fZ[lane];
+  ResetMeasurement(fN);
+  return fN++;
+}
+//__________________________________________________________________
+Double_t SoLKalTrackBatch::GetPredictedChi2(Int_t lane, Double_t x, Double_t y,
+                                            Double_t vxx, Double_t vxy, Double_t vyy) const
+{
+  //as in Update, with R = V + H C H^T
+  Double_t r00 = vxx + fC[0][lane];
+  Double_t r01 = vxy + fC[1][lane];
+  Double_t r11 = vyy + fC[kSdim][lane];
+  Double_t det = r00*r11 - r01*r01;
+  if (SoLKalTrackSite::IsSingularResidual(det)) return kGiga;
+  Double_t p0 = x - fSV[0][lane];
+  Double_t p1 = y - fSV[1][lane];
+  return (p0*(r11*p0 - r01*p1) + p1*(r00*p1 - r01*p0))/det;
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::SetMeasurement(Int_t lane, const SoLKalMatrix &m, const SoLKalMatrix &V)
+{
+  fM[0][lane] = m(0, 0);
+  fM[1][lane] = m(1, 0);
+  fV[0][lane] = V(0, 0);
+  fV[1][lane] = V(0, 1);
+  fV[2][lane] = V(1, 1);
+  fHasHit[lane] = 1.;
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::Update()
+{
+  //  R  = V + H C H^T,     K = C H^T R^-1
+  //  a' = a + K (m - H a), C' = C - K H C, chi2 = (m - H a)^T R^-1 (m - H a)
+  //with H C H^T the upper left 2x2 block of C and C H^T its first two columns
+  const Int_t nl = kLanes;
+#ifdef TESTCODE
+  ULong64_t nSingular = 0;
+#endif
+
+  for (Int_t first=0; first<fN; first+=nl){
+    Double_t a[kSdim][nl], C[kNCov][nl], m[kMdim][nl], V[3][nl], hit[nl];
+
+    for (Int_t l=0; l<nl; l++){
+      Int_t lane = (first + l < fN) ? first + l : first;
+      for (Int_t i=0; i<kSdim; i++) a[i][l] = fSV[i][lane];
+      for (Int_t i=0; i<kNCov; i++) C[i][l] = fC[i][lane];
+      for (Int_t i=0; i<kMdim; i++) m[i][l] = fM[i][lane];
+      for (Int_t i=0; i<3; i++) V[i][l] = fV[i][lane];
+      hit[l] = fHasHit[lane];
+    }
+
+    Double_t i00[nl], i01[nl], i11[nl], p0[nl], p1[nl], chi2[nl], ok[nl];
+    for (Int_t l=0; l<nl; l++){
+      Double_t r00 = V[0][l] + C[0][l];
+      Double_t r01 = V[1][l] + C[1][l];
+      Double_t r11 = V[2][l] + C[kSdim][l];
+      Double_t det = r00*r11 - r01*r01;
+      //a singular residual covariance rejects the measurement
+      ok[l]  = SoLKalTrackSite::IsSingularResidual(det) ? 0. : 1.;
+      det = (ok[l] > 0.) ? det : 1.;
+      i00[l] =  r11 / det;
+      i01[l] = -r01 / det;
+      i11[l] =  r00 / det;
+      p0[l]  = m[0][l] - a[0][l];
+      p1[l]  = m[1][l] - a[1][l];
+      chi2[l] = hit[l] * ((ok[l] > 0.) ? p0[l]*(i00[l]*p0[l] + i01[l]*p1[l])
+                                      + p1[l]*(i01[l]*p0[l] + i11[l]*p1[l]) : kGiga);
+    }
+    //gain, zero for the lanes without measurement
+    Double_t CHt[kSdim][kMdim][nl], K[kSdim][kMdim][nl];
+    for (Int_t i=0; i<kSdim; i++){
+      Int_t i0 = GetCovIndex(i, 0);
+      Int_t i1 = GetCovIndex(i, 1);
+      for (Int_t l=0; l<nl; l++){
+        CHt[i][0][l] = C[i0][l];
+        CHt[i][1][l] = C[i1][l];
+        K[i][0][l] = hit[l] * (C[i0][l]*i00[l] + C[i1][l]*i01[l]);
+        K[i][1][l] = hit[l] * (C[i0][l]*i01[l] + C[i1][l]*i11[l]);
+        a[i][l] += K[i][0][l]*p0[l] + K[i][1][l]*p1[l];
+      }
+    }
+    for (Int_t i=0; i<kSdim; i++){
+      for (Int_t j=i; j<kSdim; j++){
+        Int_t idx = GetCovIndex(i, j);
+        for (Int_t l=0; l<nl; l++) C[idx][l] -= K[i][0][l]*CHt[j][0][l] + K[i][1][l]*CHt[j][1][l];
+      }
+    }
+    for (Int_t l=0; l<nl && first + l < fN; l++){
+      for (Int_t i=0; i<kSdim; i++) fFilt[i][first + l] = a[i][l];
+      for (Int_t i=0; i<kNCov; i++) fFiltC[i][first + l] = C[i][l];
+      fChi2[first + l] = chi2[l];
+#ifdef TESTCODE
+      if (hit[l] > 0. && ok[l] == 0.) nSingular++;
+#endif
+    }
+  }
+#ifdef TESTCODE
+  SoLKalTrackSite::AddNSingularFilter(nSingular);
+#endif
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::GetPredicted(Int_t lane, SoLKalMatrix &sv, SoLKalMatrix &C) const
+{
+  for (Int_t i=0; i<kSdim; i++){
+    sv(i, 0) = fSV[i][lane];
+    for (Int_t j=0; j<kSdim; j++) C(i, j) = fC[GetCovIndex(i, j)][lane];
+  }
+}
+//__________________________________________________________________
+void SoLKalTrackBatch::GetFiltered(Int_t lane, SoLKalStateVec &sv, SoLKalPropMat &C) const
+{
+  for (Int_t i=0; i<kSdim; i++){
+    sv(i, 0) = fFilt[i][lane];
+    for (Int_t j=0; j<kSdim; j++) C(i, j) = fFiltC[GetCovIndex(i, j)][lane];
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef ROOT_SOL_KAL_TRACK_BATCH
+#define ROOT_SOL_KAL_TRACK_BATCH
+//c++
+#include <vector>
+//ROOT
+#include "Rtypes.h"
+//SoLIDTracking
+#include "SoLKalMatrix.h"
+#include "SoLIDUtility.h"
+
+using namespace std;
+
+class SoLKalTrackState;
+
+//structure of arrays of the Kalman filter step of many candidate tracks
+//toward the same measurement plane, one lane per track. A lane starts from
+//the filtered state of its track; the stepper gives the predicted state,
+//propagator F and process noise Q (SetPrediction), Predict propagates the
+//covariances of all lanes, C = F C F^T + Q, and Update adds the measurement
+//of the lanes that have one (SetMeasurement) with the gain formalism of
+//SoLKalTrackSite::Filter. The measurement is the position, H = (1 0 0 0 0,
+//0 1 0 0 0), so only the 2x2 residual covariance is inverted. Covariances
+//are kept as the kNCov elements of the upper triangle (GetCovIndex). The
+//lanes are processed in blocks of kLanes with loops of fixed length and no
+//branches, so that they vectorize
+struct SoLKalTrackBatch
+{
+  static const Int_t kLanes = 4;
+  static const Int_t kNCov  = kSdim*(kSdim+1)/2;
+
+  SoLKalTrackBatch() : fN(0) {}
+  //adds a lane starting from a state (vector and covariance), returns its index
+  Int_t Add(const SoLKalTrackState &state);
+  inline void  Clear() { fN = 0; }
+  inline Int_t GetN() const { return fN; }
+  static inline Int_t GetCovIndex(Int_t i, Int_t j) {
+    return (i <= j) ? i*kSdim - i*(i-1)/2 + j - i : j*kSdim - j*(j-1)/2 + i - j;
+  }
+
+  //predicted state at z of a lane and the propagator and process noise of
+  //the step, the lane has no measurement until SetMeasurement
+  void SetPrediction(Int_t lane, const SoLKalStateVec &sv, const SoLKalPropMat &F,
+                     const SoLKalPropMat &Q, Double_t z);
+  void Predict();
+  //new lane with the predicted state of a lane (after Predict), for another
+  //measurement of the same track, returns its index
+  Int_t AddBranch(Int_t lane);
+  //chi2 increment that a measurement (x, y) with noise matrix (vxx, vxy, vyy)
+  //would give in a lane (after Predict), without changing the lane
+  Double_t GetPredictedChi2(Int_t lane, Double_t x, Double_t y,
+                            Double_t vxx, Double_t vxy, Double_t vyy) const;
+  //measurement vector and noise matrix of a lane
+  void SetMeasurement(Int_t lane, const SoLKalMatrix &m, const SoLKalMatrix &V);
+  void Update();
+
+  //predicted state of a lane (after Predict)
+  inline Double_t GetZ(Int_t lane) const { return fZ[lane]; }
+  inline Double_t GetState(Int_t lane, Int_t i) const { return fSV[i][lane]; }
+  inline Double_t GetCov(Int_t lane, Int_t i, Int_t j) const { return fC[GetCovIndex(i, j)][lane]; }
+  void GetPredicted(Int_t lane, SoLKalMatrix &sv, SoLKalMatrix &C) const;
+  //filtered state and chi2 increment of a lane with a measurement (after Update)
+  void GetFiltered(Int_t lane, SoLKalStateVec &sv, SoLKalPropMat &C) const;
+  inline Bool_t   HasMeasurement(Int_t lane) const { return fHasHit[lane] != 0.; }
+  inline Double_t GetDeltaChi2(Int_t lane) const { return fChi2[lane]; }
+
+  //room for one more lane, and a lane without measurement
+  void Grow();
+  void ResetMeasurement(Int_t lane);
+
+  Int_t fN;
+  vector<Double_t> fSV[kSdim];     // state vector, the predicted one after SetPrediction
+  vector<Double_t> fC[kNCov];      // its covariance, the predicted one after Predict
+  vector<Double_t> fF[kSdim*kSdim];// propagator by rows
+  vector<Double_t> fQ[kNCov];      // process noise
+  vector<Double_t> fZ;             // z of the prediction
+  vector<Double_t> fM[kMdim];      // measurement
+  vector<Double_t> fV[3];          // its noise matrix (00, 01, 11)
+  vector<Double_t> fHasHit;        // 1 for a lane with a measurement, 0 otherwise
+  vector<Double_t> fFilt[kSdim];   // filtered state vector
+  vector<Double_t> fFiltC[kNCov];  // and its covariance
+  vector<Double_t> fChi2;          // chi2 increment, 0 without measurement
+};
+
+#endif
@@ -1,17 +1,22 @@
+//c++
+#include <algorithm>
 //SoLIDTracking
 #include "SoLKalTrackFinder.h"
 #include "SoLKalFieldStepper.h"
 #include "SoLKalTrackSystem.h"
+#include "SoLKalTrackSite.h"
+#include "SoLKalTrackArena.h"
 #include "TVector2.h"
 
 #define MAXNTRACKS 1000
 ClassImp(SoLKalTrackFinder)
 SoLKalTrackFinder::SoLKalTrackFinder()
 : fGEMTracker(nullptr), fECal(nullptr), fNTrackers(0),fNSeeds(0), fEventNum(0),
-  fBPMX(0), fBPMY(0), fChi2PerNDFCut(30.)
+  fBPMX(0), fBPMY(0), fChi2PerNDFCut(30.), fNFollowLanes(0), fMaxBranches(1), fNHitsCovWindow(3)
 {
   fFieldStepper = SoLKalFieldStepper::GetInstance();
   fCoarseTracks = new TClonesArray("SoLKalTrackSystem", MAXNTRACKS, kTRUE);
+  fArena = new SoLKalTrackArena();
   vector<DoubletSeed> midBackSeed;
   midBackSeed.reserve(MAXNSEEDS);
   midBackSeed.clear();
@@ -25,6 +30,13 @@ SoLKalTrackFinder::SoLKalTrackFinder()
   fSeedPool[kMidBack] = midBackSeed;
   fSeedPool[kFrontMid] = frontMidSeed;
   fSeedPool[kFrontBack] = frontBackSeed;
+  fWindowHits.reserve(MAXWINDOWHIT);
+}
+//__________________________________________________________________________
+SoLKalTrackFinder::~SoLKalTrackFinder()
+{
+  //the derived classes have deleted their track systems by now
+  delete fArena;
 }
 //__________________________________________________________________________
 void SoLKalTrackFinder::SetGEMDetector(vector<SoLIDGEMTracker*> thetrackers)
@@ -69,3 +81,232 @@ void SoLKalTrackFinder::CalCircle(Double_t x1,Double_t y1,Double_t x2,Double_t y
     *R = 0;
   }
 }
+//__________________________________________________________________________
+void SoLKalTrackFinder::FollowTracks()
+{
+  Int_t nTracks = fCoarseTracks->GetLast()+1;
+  Int_t firstTracker = 0;
+  ResetFollow(nTracks);
+
+  for (Int_t i=0; i<nTracks; i++){
+    SoLKalTrackSystem* thisSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(i));
+    thisSystem->CheckTrackStatus();
+    if (!thisSystem->GetTrackStatus()) continue; //skip the bad tracks
+
+    thisSystem->SetCurInstancePtr(thisSystem);
+    Int_t currentTracker = ((thisSystem->GetCurSite()).GetHit())->GetTrackerID();
+
+    //seed from type kMidBack will skip the front seed plane. We assume for this type of seed, the hit on the
+    //front seed plane is missing, (otherwise the seed should be absorbed into the triplet seed)
+    if (thisSystem->GetSeedType() == kMidBack) currentTracker--;
+    fFollowStart[i] = currentTracker;
+    if (currentTracker > firstTracker) firstTracker = currentTracker;
+  }
+
+  for (Int_t currentTracker = firstTracker-1; currentTracker >= 0; currentTracker--){
+    for (Int_t i=0; i<(Int_t)fFollowStart.size(); i++){
+      if (fFollowStart[i] <= currentTracker) continue;
+      SoLKalTrackSystem* thisSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(i));
+      thisSystem->CheckTrackStatus();
+      if (!thisSystem->GetTrackStatus()) continue; //skip the bad tracks
+      AddToFollowBatch(i);
+    }
+
+    PredictFollowBatch(fGEMTracker[currentTracker]->GetZ());
+
+    //the branches started on this tracker are appended to the batch
+    Int_t nLanes = fFollowBatch.GetN();
+    for (Int_t lane=0; lane<nLanes; lane++){
+      SoLKalTrackSystem* thisSystem = fFollowSystems[lane];
+      double x = fFollowBatch.GetState(lane, kIdxX0);
+      double y = fFollowBatch.GetState(lane, kIdxY0);
+
+      bool flag = (thisSystem->GetNHits() >= fNHitsCovWindow);
+
+      int size = GetHitsInWindow(currentTracker, x, fFollowBatch.GetCov(lane, kIdxX0, kIdxX0),
+                                 y, fFollowBatch.GetCov(lane, kIdxY0, kIdxY0), flag);
+
+      if (size <= 0){
+        //when there are too many hits in a small window (usually should not happen), or
+        //when there is no hit found in the window, the track misses a hit
+        if (IsHitRequired(thisSystem, currentTracker)) thisSystem->AddMissingHits();
+      }
+      else{
+        //the cloest one if there are more than one, the others within the chi2 cut start new branches
+        //of the track if combinatorial following is on
+        SoLIDGEMHit *thisHit = (size == 1) ? fWindowHits.at(0) : FindCloestHitInWindow(x, y);
+        SetFollowHit(lane, *fArena->NewSite(thisHit, kMdim*fChi2PerNDFCut));
+        if (size > 1) BranchOnHits(lane, fWindowHits, thisHit);
+      }
+    }
+
+    UpdateFollowBatch();
+  }
+}
+//__________________________________________________________________________
+SoLIDGEMHit* SoLKalTrackFinder::FindCloestHitInWindow(double &x, double &y)
+{
+  double minD = kGiga;
+  SoLIDGEMHit *minHit = nullptr;
+  for (unsigned int i=0; i<fWindowHits.size(); i++){
+    double r = sqrt(pow(x - fWindowHits.at(i)->GetX(), 2) + pow(y - fWindowHits.at(i)->GetY(), 2));
+    if (r < minD) {
+      minHit = fWindowHits.at(i);
+      minD = r;
+    }
+  }
+  return minHit;
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::ResetFollow(Int_t nTracks)
+{
+  fFollowStart.assign(nTracks, -1);
+  fFollowRoot.resize(nTracks);
+  for (Int_t i=0; i<nTracks; i++) fFollowRoot[i] = i;
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::AddToFollowBatch(Int_t track)
+{
+  SoLKalTrackSystem* theSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(track));
+  fFollowBatch.Add((theSystem->GetCurSite()).GetCurState());
+  fFollowSystems.push_back(theSystem);
+  fFollowTracks.push_back(track);
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::PredictFollowBatch(Double_t z)
+{
+  //the stepper gives the predicted state, propagator and process noise of
+  //each lane from the filtered state of its track, the covariances are
+  //propagated together
+  SoLKalStepperContext &ctx = fFieldStepper->GetDefaultContext();
+  SoLKalStateVec sv;
+  SoLKalPropMat  F, Q;
+  for (Int_t lane=0; lane<fFollowBatch.GetN(); lane++){
+    const SoLKalTrackState &curState = (fFollowSystems[lane]->GetCurSite()).GetCurState();
+    Double_t finalZ = z;
+    fFieldStepper->InitContext(ctx);
+    fFieldStepper->Predict(ctx, SoLKalMatrix::ToStateVec(curState), curState.GetZ0(), finalZ, sv, F, Q);
+    fFollowBatch.SetPrediction(lane, sv, F, Q, ctx.fTrackPosAtZ);
+  }
+  fFollowBatch.Predict();
+  fFollowSites.assign(fFollowBatch.GetN(), nullptr);
+  fNFollowLanes = fFollowBatch.GetN();
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::SetFollowHit(Int_t lane, SoLKalTrackSite& theSite)
+{
+  fFollowSites[lane] = &theSite;
+  fFollowBatch.SetMeasurement(lane, theSite.GetMeasVec(), theSite.GetMeasNoiseMat());
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::UpdateFollowBatch()
+{
+  //a site that passes the chi2 cut is added to the track, otherwise the
+  //track misses the hit, or a new branch is dropped. The batch is cleared
+  //for the next tracker
+  fFollowBatch.Update();
+  SoLKalMatrix   sv(kSdim, 1), C(kSdim, kSdim);
+  SoLKalStateVec a;
+  SoLKalPropMat  Ca;
+  for (Int_t lane=0; lane<fFollowBatch.GetN(); lane++){
+    SoLKalTrackSite *thisSite = fFollowSites[lane];
+    if (thisSite == nullptr) continue;
+    SoLKalTrackSystem *thisSystem = fFollowSystems[lane];
+
+    fFollowBatch.GetPredicted(lane, sv, C);
+    SoLKalTrackState *predictState = fArena->NewState(sv, C, *thisSite, SoLKalTrackSite::kPredicted);
+    predictState->SetZ0(fFollowBatch.GetZ(lane));
+    thisSite->Add(predictState);
+
+    fFollowBatch.GetFiltered(lane, a, Ca);
+    if (thisSite->Filter(a, Ca, fFollowBatch.GetDeltaChi2(lane))){
+      thisSystem->Add(thisSite);
+      thisSystem->IncreaseChi2(thisSite->GetDeltaChi2());
+    }
+    else if (lane < fNFollowLanes){
+      thisSystem->AddMissingHits();
+    }
+    else{
+      thisSystem->SetTrackStatus(kFALSE);
+    }
+  }
+  fFollowBatch.Clear();
+  fFollowSystems.clear();
+  fFollowTracks.clear();
+  fFollowSites.clear();
+  if (fMaxBranches > 1) PruneBranches();
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::BranchOnHits(Int_t lane, const vector<SoLIDGEMHit*> &hits, SoLIDGEMHit* taken)
+{
+  if (fMaxBranches <= 1) return;
+  //only the hits that would pass the chi2 cut of the update, with the
+  //predicted covariance of the lane, start a branch
+  Double_t maxChi2 = kMdim*fChi2PerNDFCut;
+  Double_t vxx, vyy;
+  fBranchHits.clear();
+  for (UInt_t i=0; i<hits.size(); i++){
+    if (hits[i] == taken) continue;
+    SoLKalTrackSite::GetHitNoise(hits[i], vxx, vyy);
+    Double_t chi2 = fFollowBatch.GetPredictedChi2(lane, hits[i]->GetX(), hits[i]->GetY(), vxx, 0., vyy);
+    if (chi2 >= maxChi2) continue;
+    fBranchHits.push_back(pair<Double_t, SoLIDGEMHit*>(chi2, hits[i]));
+  }
+  sort(fBranchHits.begin(), fBranchHits.end());
+
+  //the branch is made before the update of its track, with the same sites
+  Int_t track = fFollowTracks[lane];
+  Int_t nBranch = TMath::Min((Int_t)fBranchHits.size(), fMaxBranches - 1);
+  for (Int_t i=0; i<nBranch; i++){
+    Int_t index = fCoarseTracks->GetLast()+1;
+    SoLKalTrackSystem *branch = new ((*fCoarseTracks)[index]) SoLKalTrackSystem(*fFollowSystems[lane]);
+    fFollowStart.push_back(fFollowStart[track]);
+    fFollowRoot.push_back(fFollowRoot[track]);
+
+    Int_t branchLane = fFollowBatch.AddBranch(lane);
+    fFollowSystems.push_back(branch);
+    fFollowTracks.push_back(index);
+    fFollowSites.push_back(nullptr);
+    SetFollowHit(branchLane, *fArena->NewSite(fBranchHits[i].second, kMdim*fChi2PerNDFCut));
+  }
+}
+//__________________________________________________________________________
+bool SoLKalTrackFinder::SortBranch(const pair<Int_t, SoLKalTrackSystem*> &a,
+                                   const pair<Int_t, SoLKalTrackSystem*> &b)
+{
+  //by track, then the branches with more hits and smaller chi2 per NDF first
+  if (a.first != b.first) return a.first < b.first;
+  if (a.second->GetNHits() != b.second->GetNHits()) return a.second->GetNHits() > b.second->GetNHits();
+  return a.second->GetChi2perNDF() < b.second->GetChi2perNDF();
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::PruneBranches()
+{
+  fBranchRank.clear();
+  for (UInt_t i=0; i<fFollowStart.size(); i++){
+    if (fFollowStart[i] < 0) continue;
+    SoLKalTrackSystem* thisSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(i));
+    if (!thisSystem->GetTrackStatus()) continue;
+    fBranchRank.push_back(pair<Int_t, SoLKalTrackSystem*>(fFollowRoot[i], thisSystem));
+  }
+  sort(fBranchRank.begin(), fBranchRank.end(), SortBranch);
+
+  Int_t nKept = 0;
+  for (UInt_t i=0; i<fBranchRank.size(); i++){
+    if (i == 0 || fBranchRank[i].first != fBranchRank[i-1].first) nKept = 0;
+    if (nKept < fMaxBranches) nKept++;
+    else fBranchRank[i].second->SetTrackStatus(kFALSE);
+  }
+  ReleaseBadTracks();
+}
+//__________________________________________________________________________
+void SoLKalTrackFinder::ReleaseBadTracks()
+{
+  //a dropped track holds on to the sites it shares with the others until
+  //it gives them back, and they would be copied when the others are smoothed
+  for (UInt_t i=0; i<fFollowStart.size(); i++){
+    SoLKalTrackSystem* thisSystem = (SoLKalTrackSystem*)(fCoarseTracks->At(i));
+    if (thisSystem->GetTrackStatus() || thisSystem->GetEntriesFast() == 0) continue;
+    thisSystem->ReleaseSites();
+  }
+}
@@ -23,25 +23,35 @@
 #include "SoLIDECal.h"
 #include "SoLIDUtility.h"
 #include "SoLIDGEMHit.h"
+#include "SoLKalTrackBatch.h"
 
 using namespace std;
 
 #define MAXWINDOWHIT 200
 #define MAXNSEEDS 2000
+#define SEEDBATCHSIZE 64 //seed candidates propagated together
 
 class SoLKalFieldStepper;
+class SoLKalTrackArena;
+class SoLKalTrackSystem;
+class SoLKalTrackSite;
 
 class SoLKalTrackFinder 
 {
 public:
   SoLKalTrackFinder();
-  virtual ~SoLKalTrackFinder() {;}
+  virtual ~SoLKalTrackFinder();
   
   virtual void SetGEMDetector(vector<SoLIDGEMTracker*> thetrackers);
   void SetECalDetector(SoLIDECal* theECal) { fECal = theECal; }
   void SetBPM(Double_t x, Double_t y);
   void SetTargetGeometry(Double_t& z, Double_t& center, Double_t& length);
   int  GetNSeeds() const { return fNSeeds; }
+  SoLKalTrackArena* GetArena() const { return fArena; }
+  //combinatorial track following: at most n branches of a track candidate,
+  //each with a different hit, 1 to take the closest hit only
+  void SetMaxBranches(Int_t n) { fMaxBranches = (n > 1) ? n : 1; }
+  Int_t GetMaxBranches() const { return fMaxBranches; }
   
   //pure virtual function to be implimented in derived classes
 #ifdef MCDATA
@@ -76,11 +86,53 @@ protected:
 
   void CalCircle(Double_t x1,Double_t y1,Double_t x2,Double_t y2,Double_t x3,
                  Double_t y3, Double_t* R,Double_t* Xc, Double_t* Yc);
+
+  //follows the good tracks of fCoarseTracks from the tracker of their last
+  //site down to tracker 0 (kMidBack seeds skip the front seed plane). All
+  //the tracks are followed together, one tracker at a time: the prediction
+  //and the filter step of the tracks on a tracker are done in one batch, the
+  //hit search is done track by track with GetHitsInWindow. Hits are not
+  //marked used here, so the tracks do not depend on each other
+  void FollowTracks();
+  //the hits of tracker plane in a window around (x, y) into fWindowHits,
+  //with the variances wx, wy of the prediction if flag is set and a fixed
+  //window otherwise, returns their number or -1 if there are too many
+  virtual int GetHitsInWindow(int plane, double x, double wx, double y, double wy,
+                              bool flag = false) = 0;
+  SoLIDGEMHit* FindCloestHitInWindow(double &x, double &y);
+  //a track without hit on the tracker counts a missing hit, unless the
+  //configuration does not need one there
+  virtual Bool_t IsHitRequired(SoLKalTrackSystem* /*theSystem*/, Int_t /*tracker*/) const { return kTRUE; }
+
+  //Kalman filter step of all the candidates followed to the same tracker:
+  //ResetFollow starts the following of the first nTracks tracks, a candidate
+  //is added to the batch with its current filtered state, PredictFollowBatch
+  //predicts them at z, the hit found for a lane is given with SetFollowHit,
+  //and UpdateFollowBatch filters and adds the sites of the lanes that have
+  //one to their track
+  void ResetFollow(Int_t nTracks);
+  void AddToFollowBatch(Int_t track);
+  void PredictFollowBatch(Double_t z);
+  void SetFollowHit(Int_t lane, SoLKalTrackSite& theSite);
+  void UpdateFollowBatch();
+  //with fMaxBranches > 1, the other hits of the window of a lane that pass
+  //the chi2 cut with the predicted state of the lane, smallest chi2 first,
+  //start new branches of its track (appended to fCoarseTracks) with lanes
+  //of their own. A branch whose hit fails the update is dropped, and after
+  //each tracker only the fMaxBranches best branches of a track are kept,
+  //the ones with more hits and then smaller chi2 per NDF. The dropped
+  //tracks give back their sites (ReleaseBadTracks)
+  void BranchOnHits(Int_t lane, const vector<SoLIDGEMHit*> &hits, SoLIDGEMHit* taken);
+  void PruneBranches();
+  void ReleaseBadTracks();
+  static bool SortBranch(const pair<Int_t, SoLKalTrackSystem*> &a,
+                         const pair<Int_t, SoLKalTrackSystem*> &b);
   
   SoLKalFieldStepper*                  fFieldStepper;
   std::vector<SoLIDGEMTracker*>        fGEMTracker;
   SoLIDECal*                           fECal;
   TClonesArray*                        fCoarseTracks;
+  SoLKalTrackArena*                    fArena;        //sites and states of the event
   Int_t                                fNTrackers;
   Int_t                                fNSeeds;
   Int_t                                fEventNum;
@@ -92,6 +144,24 @@ protected:
   Double_t                             fChi2PerNDFCut;
   vector<SoLIDCaloHit>*                fCaloHits;
   map< SeedType, vector<DoubletSeed> > fSeedPool;
+  //candidates followed to the same tracker, with the track, its index in
+  //fCoarseTracks and the site of the hit (NULL without) of each lane, the
+  //lanes before the branches of this tracker, and for each track the tracker
+  //it starts from (-1 if it is not followed) and the track it branched from
+  SoLKalTrackBatch                     fFollowBatch;
+  vector<SoLKalTrackSystem*>           fFollowSystems;
+  vector<Int_t>                        fFollowTracks;
+  vector<SoLKalTrackSite*>             fFollowSites;
+  Int_t                                fNFollowLanes;
+  vector<Int_t>                        fFollowStart;
+  vector<Int_t>                        fFollowRoot;
+  Int_t                                fMaxBranches;
+  //hits a track needs before its hit window is taken from its predicted
+  //covariance, and the hits found in the window of the last search
+  Int_t                                fNHitsCovWindow;
+  vector<SoLIDGEMHit*>                 fWindowHits;
+  vector< pair<Double_t, SoLIDGEMHit*> > fBranchHits;
+  vector< pair<Int_t, SoLKalTrackSystem*> > fBranchRank;
   
   ClassDef(SoLKalTrackFinder,0)
 };
@@ -5,34 +5,55 @@
 #include <cmath>
 //SoLIDTracking
 #include "SoLKalTrackSite.h"
+#include "SoLKalTrackArena.h"
 ClassImp(SoLKalTrackSite)
 
+ULong64_t SoLKalTrackSite::fgNSingularFilter = 0;
+
 SoLKalTrackSite::SoLKalTrackSite(Int_t m, Int_t p, Double_t chi2)
 :TObjArray(2), fCurStatePtr(0), fM(m,1), fV(m,m),
- fH(m,p), fHt(p,m), fResVec(m,1), fR(m,m), fDeltaChi2(0.), fMaxDeltaChi2(chi2)
+ fH(m,p), fHt(p,m), fResVec(m,1), fR(m,m), fDeltaChi2(0.), fMaxDeltaChi2(chi2),
+ fGEMHit(0), fArena(0), fNRef(0)
 {
 }
 //_________________________________________________________________________
 SoLKalTrackSite::SoLKalTrackSite(SoLIDGEMHit *ht, Int_t m, Int_t  p, Double_t chi2)
  : TObjArray(2), fCurStatePtr(0), fM(m,1), fV(m,m),
  fH(m,p), fHt(p,m), fResVec(m,1), fR(m,m), fDeltaChi2(0.), fMaxDeltaChi2(chi2),
- fGEMHit(ht) 
+ fGEMHit(ht), fArena(0), fNRef(0)
 {
   fM(kIdxX0, 0) = ht->GetX(); 
   fM(kIdxY0, 0) = ht->GetY();
+  GetHitNoise(ht, fV(kIdxX0, kIdxX0), fV(kIdxY0, kIdxY0));
+  fZ0 = ht->GetZ();
+}
+//_________________________________________________________________________
+void SoLKalTrackSite::GetHitNoise(const SoLIDGEMHit *ht, Double_t &vxx, Double_t &vyy)
+{
   Double_t phi = atan2(ht->GetY(), ht->GetX());
   Double_t dr = 5.e-4;
   Double_t drphi = 5.4e-5;
   
   Double_t dx = sqrt( pow( cos(phi)*dr, 2) + pow( sin(phi)*drphi, 2) );
   Double_t dy = sqrt( pow( sin(phi)*dr, 2) + pow( cos(phi)*drphi, 2) );
-  fV(kIdxX0, kIdxX0) = pow(dx, 2);
-  fV(kIdxY0, kIdxY0) = pow(dy, 2);
-  fZ0 = ht->GetZ();
+  vxx = pow(dx, 2);
+  vyy = pow(dy, 2);
+}
+//_________________________________________________________________________
+SoLKalTrackSite::SoLKalTrackSite(const SoLKalTrackSite &site)
+ : TObjArray(2), fCurStatePtr(0), fM(site.fM), fV(site.fV), fH(site.fH), fHt(site.fHt),
+ fResVec(site.fResVec), fR(site.fR), fDeltaChi2(site.fDeltaChi2), fMaxDeltaChi2(site.fMaxDeltaChi2),
+ fGEMHit(site.fGEMHit), fZ0(site.fZ0), fArena(0), fNRef(0)
+{
 }
 //_________________________________________________________________________
 SoLKalTrackSite::~SoLKalTrackSite()
 {
+  //the states of a site from an arena are given back with the arena
+  if (fArena){
+    SetOwner(kFALSE);
+    return;
+  }
   SetOwner(kTRUE);
   Delete();
 }
@@ -84,53 +105,96 @@ Bool_t SoLKalTrackSite::IsAccepted()
 Bool_t SoLKalTrackSite::Filter()
 {
    // prea and preC should be preset by SoLKalTrackState::Propagate()
+   //
+   // Gain formalism with the covariance R of the predicted residual, only
+   // the 2x2 matrix R is inverted:
+   //   R  = V + H C H^T,     K = C H^T R^-1
+   //   a' = a + K (m - h(a)), C' = C - K H C
+   // The chi2 increment (m - h(a))^T R^-1 (m - h(a)) is the same as the one
+   // of the weighted mean formalism, r'^T V^-1 r' + (a' - a)^T C^-1 (a' - a)
+   // with the filtered residual r' = m - h(a').
    SoLKalTrackState &prea = GetState(SoLKalTrackSite::kPredicted);
    SoLKalMatrix h = fM;
    
    if (!CalcExpectedMeasVec(prea,h)) return kFALSE;
-   
-   SoLKalMatrix pull  = fM - h;
-   
-   SoLKalMatrix preC  = GetState(SoLKalTrackSite::kPredicted).GetCovMat();
-   
    if (!CalcMeasVecDerivative(prea,fH)) return kFALSE;
    fHt = SoLKalMatrix(SoLKalMatrix::kTransposed, fH);
 
-   // Calculate covariance matrix of residual
-
-   SoLKalMatrix preR    = fV + fH * preC * fHt;
-   
-   SoLKalMatrix preRinv = SoLKalMatrix(SoLKalMatrix::kInverted, preR);
-   if (preR.Determinant() == 0) {cout<<"1"<<endl; preR.Print(); fV.Print(); fH.Print(); preC.Print(); }
-   // Calculate kalman gain matrix
-
-   SoLKalMatrix preCinv = SoLKalMatrix(SoLKalMatrix::kInverted, preC);
-   if (preC.Determinant() == 0) {cout<<"2"<<endl; preC.Print();}
-   SoLKalMatrix G       = SoLKalMatrix(SoLKalMatrix::kInverted, fV);
+   SoLKalStateVec a = SoLKalMatrix::ToStateVec(prea);
+   SoLKalPropMat  C = SoLKalMatrix::ToPropMat(prea.GetCovMat());
+   SoLKalProjMat  H;
+   SoLKalMeasVec  pull;
+   SoLKalMeasMat  V;
+   for (Int_t i=0; i<kMdim; i++){
+     pull(i, 0) = fM(i, 0) - h(i, 0);
+     for (Int_t j=0; j<kSdim; j++) H(i, j) = fH(i, j);
+     for (Int_t j=0; j<kMdim; j++) V(i, j) = fV(i, j);
+   }
 
-   // Calculate filtered state vector
+   // Calculate covariance matrix of residual and its inverse
+   SoLKalGainMat CHt = C * ROOT::Math::Transpose(H);
+   SoLKalMeasMat R   = V + H * CHt;
+   Double_t det = R(0, 0)*R(1, 1) - R(0, 1)*R(1, 0);
+   if (IsSingularResidual(det)) {
+#ifdef TESTCODE
+     fgNSingularFilter++;
+#endif
+     return kFALSE;
+   }
+   SoLKalMeasMat Rinv;
+   Rinv(0, 0) =  R(1, 1) / det;
+   Rinv(1, 1) =  R(0, 0) / det;
+   Rinv(0, 1) = -R(0, 1) / det;
+   Rinv(1, 0) = -R(1, 0) / det;
+
+   // Calculate kalman gain matrix, filtered state vector and covariance
+   // (H C is the transpose of C H^T, C is symmetric)
+   SoLKalGainMat K = CHt * Rinv;
+   a += K * pull;
+   C -= K * ROOT::Math::Transpose(CHt);
+
+   Double_t chi2 = 0.;
+   for (Int_t i=0; i<kMdim; i++)
+     for (Int_t j=0; j<kMdim; j++) chi2 += pull(i, 0) * Rinv(i, j) * pull(j, 0);
+
+   return Filter(a, C, chi2);
+}
+//______________________________________________________________________________
+Bool_t SoLKalTrackSite::Filter(const SoLKalStateVec &a, const SoLKalPropMat &C, Double_t chi2)
+{
+   // Stores the filtered state a and covariance C of the predicted state,
+   // with the chi2 increment chi2, as computed by Filter() or for many sites
+   // at once by SoLKalTrackBatch. Also the residual of the filtered state
+   // and its covariance matrix, R = V - H C H^T
+   SoLKalTrackState &prea = GetState(SoLKalTrackSite::kPredicted);
+   if (!CalcMeasVecDerivative(prea,fH)) return kFALSE;
+   fHt = SoLKalMatrix(SoLKalMatrix::kTransposed, fH);
 
-   SoLKalMatrix curCinv = preCinv + fHt * G * fH;
-   SoLKalMatrix curC    = SoLKalMatrix(SoLKalMatrix::kInverted, curCinv);
-   if (curC.Determinant() == 0) {cout<<"3"<<endl; curCinv.Print();}
-   SoLKalMatrix K       = curC * fHt * G;
+   SoLKalProjMat  H;
+   SoLKalMeasMat  V;
+   for (Int_t i=0; i<kMdim; i++){
+     for (Int_t j=0; j<kSdim; j++) H(i, j) = fH(i, j);
+     for (Int_t j=0; j<kMdim; j++) V(i, j) = fV(i, j);
+   }
 
-   SoLKalMatrix Kpull  = K * pull;
-   SoLKalMatrix Kpullt = SoLKalMatrix(SoLKalMatrix::kTransposed,Kpull);
-   SoLKalMatrix av     = prea + Kpull;
-   SoLKalTrackState &a     = CreateState(av,curC,SoLKalTrackSite::kFiltered);
-   SoLKalTrackState *aPtr  = &a;
+   SoLKalMatrix av(kSdim, 1);
+   SoLKalMatrix curC(kSdim, kSdim);
+   av.SetFrom(a);
+   curC.SetFrom(C);
+   SoLKalTrackState &as    = CreateState(av,curC,SoLKalTrackSite::kFiltered);
+   SoLKalTrackState *aPtr  = &as;
 
    Add(aPtr);
    SetOwner();
 
-   // Calculate chi2 increment
-
-   fR      = fV - fH * curC *fHt;
-   if (!CalcExpectedMeasVec(a,h)) return kFALSE;
-   fResVec = fM - h;
-   SoLKalMatrix curResVect = SoLKalMatrix(SoLKalMatrix::kTransposed, fResVec);
-   fDeltaChi2 = (curResVect * G * fResVec + Kpullt * preCinv * Kpull)(0,0);
+   SoLKalMeasMat curR = V - H * C * ROOT::Math::Transpose(H);
+   SoLKalMatrix h = fM;
+   if (!CalcExpectedMeasVec(as,h)) return kFALSE;
+   for (Int_t i=0; i<kMdim; i++){
+     fResVec(i, 0) = fM(i, 0) - h(i, 0);
+     for (Int_t j=0; j<kMdim; j++) fR(i, j) = curR(i, j);
+   }
+   fDeltaChi2 = chi2;
 
    if (IsAccepted()) return kTRUE;
    else              return kFALSE;
@@ -225,6 +289,7 @@ SoLKalTrackState & SoLKalTrackSite::GetState(SoLKalTrackSite::EStType t)
 //___________________________________________________________________________
 SoLKalTrackState & SoLKalTrackSite::CreateState(const SoLKalMatrix &sv, Int_t type)
 {
+   if (fArena) return *fArena->NewState(sv,*this,type);
    SetOwner();
    return *(new SoLKalTrackState(sv,*this,type));
 }
@@ -233,6 +298,7 @@ SoLKalTrackState & SoLKalTrackSite::CreateState(const SoLKalMatrix &sv,
                                                 const SoLKalMatrix &c,
                                                 Int_t       type)
 {
+   if (fArena) return *fArena->NewState(sv,c,*this,type);
    SetOwner();
    return *(new SoLKalTrackState(sv,c,*this,type));
 }
@@ -9,6 +9,7 @@
 #include "SoLIDUtility.h"
 #include "SoLIDGEMHit.h"
 class SoLKalTrackState;
+class SoLKalTrackArena;
 
 class SoLKalTrackSite : public TObjArray {
   friend class SoLKalTrackSystem;
@@ -21,6 +22,8 @@ class SoLKalTrackSite : public TObjArray {
                   
   SoLKalTrackSite(Int_t m = kMdim, Int_t p = kSdim, Double_t chi2 = 60.);
   SoLKalTrackSite(SoLIDGEMHit* ht, Int_t m = kMdim, Int_t p = kSdim , Double_t chi2 = 60.);
+  //measurement of the site only, the copy has no state yet
+  SoLKalTrackSite(const SoLKalTrackSite &site);
   ~SoLKalTrackSite();
   
   Int_t   CalcExpectedMeasVec  (const SoLKalTrackState &a,
@@ -28,6 +31,7 @@ class SoLKalTrackSite : public TObjArray {
   Int_t   CalcMeasVecDerivative(const SoLKalTrackState &a,
                                       SoLKalMatrix &H);
   Bool_t  Filter();
+  Bool_t  Filter(const SoLKalStateVec &a, const SoLKalPropMat &C, Double_t chi2);
   void    Smooth(SoLKalTrackSite &pre);
   void    InvFilter();
   void    Add(TObject *obj);
@@ -50,6 +54,22 @@ class SoLKalTrackSite : public TObjArray {
          
   inline const SoLIDGEMHit * GetHit    () const { return fGEMHit; }    
   SoLIDGEMHit * GetPredInfoHit();   
+  
+  inline SoLKalTrackArena * GetArena() const { return fArena; }
+  inline void SetArena(SoLKalTrackArena *arena) { fArena = arena; }
+  //track systems that hold the site, more than one for the common sites of
+  //the branches of a track (see SoLKalTrackSystem::CopySharedSites)
+  inline Int_t GetNRef() const { return fNRef; }
+  //measurement noise (diagonal) of a hit, from the resolution in r and phi
+  static void GetHitNoise(const SoLIDGEMHit *ht, Double_t &vxx, Double_t &vyy);
+  //the residual covariance R of a filter is taken as singular unless its
+  //determinant is positive, the test of Filter and SoLKalTrackBatch::Update
+  static Bool_t IsSingularResidual(Double_t det) { return !(det > 0.); }
+  //filters refused because the residual covariance was singular, counted
+  //with TESTCODE over all sites and batch lanes since the last reset
+  static ULong64_t GetNSingularFilter() { return fgNSingularFilter; }
+  static void AddNSingularFilter(ULong64_t n) { fgNSingularFilter += n; }
+  static void ResetNSingularFilter() { fgNSingularFilter = 0; }
   private:
    // Private utility methods
 
@@ -71,6 +91,9 @@ class SoLKalTrackSite : public TObjArray {
    Double_t           fMaxDeltaChi2;
    SoLIDGEMHit* fGEMHit;
    Double_t           fZ0;
+   SoLKalTrackArena*  fArena;       //! arena of the site and its states, 0 if on the heap
+   Int_t              fNRef;        //! track systems that hold the site
+   static ULong64_t   fgNSingularFilter; //! filters with a singular residual covariance
    ClassDef(SoLKalTrackSite,1)      // Base class for measurement vector objects
 
 };
@@ -5,13 +5,14 @@
 //SoLIDTracking
 #include "SoLKalTrackState.h"
 #include "SoLKalFieldStepper.h"
+#include "SoLKalTrackArena.h"
 
 ClassImp(SoLKalTrackState)
 
 //_________________________________________________________________
 SoLKalTrackState::SoLKalTrackState(Int_t type, Int_t p)
 : SoLKalMatrix(p,1), fType(type), fSitePtr(nullptr),
-  fF(p,p), fFt(p,p), fQ(p,p), fC(p,p), fAttemptState(nullptr)
+  fF(p,p), fFt(p,p), fQ(p,p), fC(p,p), fAttemptState(nullptr), fArena(nullptr)
 {
    fF.UnitMatrix();
    fFt.UnitMatrix();
@@ -22,7 +23,7 @@ SoLKalTrackState::SoLKalTrackState(Int_t type, Int_t p)
 SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv,
                        Int_t type, Int_t p)
 : SoLKalMatrix(sv), fType(type), fSitePtr(nullptr),
-  fF(p,p), fFt(p,p), fQ(p,p), fC(p,p), fAttemptState(nullptr)
+  fF(p,p), fFt(p,p), fQ(p,p), fC(p,p), fAttemptState(nullptr), fArena(nullptr)
 {
    fF.UnitMatrix();
    fFt.UnitMatrix();
@@ -33,7 +34,7 @@ SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv,
 SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv, const SoLKalMatrix &c,
                        Int_t type, Int_t p)
 : SoLKalMatrix(sv), fType(type), fSitePtr(nullptr), fF(p,p), fFt(p,p),
-  fQ(p,p), fC(c), fAttemptState(nullptr)
+  fQ(p,p), fC(c), fAttemptState(nullptr), fArena(nullptr)
 {
    fF.UnitMatrix();
    fFt.UnitMatrix();
@@ -44,7 +45,7 @@ SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv, const SoLKalMatrix &c
 SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv, const SoLKalTrackSite &site,
                        Int_t type, Int_t p)
 : SoLKalMatrix(sv), fType(type), fSitePtr((SoLKalTrackSite *)&site),
-  fF(p,p), fFt(p,p), fQ(p,p), fC(p,p), fAttemptState(nullptr)
+  fF(p,p), fFt(p,p), fQ(p,p), fC(p,p), fAttemptState(nullptr), fArena(nullptr)
 {
    fF.UnitMatrix();
    fFt.UnitMatrix();
@@ -56,7 +57,7 @@ SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv, const SoLKalTrackSite
 SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv, const SoLKalMatrix &c,
                        const SoLKalTrackSite &site, Int_t type, Int_t p)
 : SoLKalMatrix(sv), fType(type), fSitePtr((SoLKalTrackSite *)&site),
-  fF(p,p), fFt(p,p), fQ(p,p), fC(c), fAttemptState(nullptr)
+  fF(p,p), fFt(p,p), fQ(p,p), fC(c), fAttemptState(nullptr), fArena(nullptr)
 {
    fF.UnitMatrix();
    fFt.UnitMatrix();
@@ -66,7 +67,8 @@ SoLKalTrackState::SoLKalTrackState(const SoLKalMatrix &sv, const SoLKalMatrix &c
 //___________________________________________________________________
 SoLKalTrackState::~SoLKalTrackState()
 {
-  if (fAttemptState != nullptr && (&fAttemptState->GetSite()) == nullptr){
+  //an attempt state from the arena is given back with the arena
+  if (fArena == nullptr && fAttemptState != nullptr && (&fAttemptState->GetSite()) == nullptr){
     delete fAttemptState;
   }
 }
@@ -101,14 +103,22 @@ void SoLKalTrackState::Propagate(SoLKalTrackSite &to)
 //____________________________________________________________________
 SoLKalTrackState * SoLKalTrackState::MoveTo(SoLKalTrackSite  &to,
                                         SoLKalMatrix &F,
-                                        SoLKalMatrix *QPtr) const
+                                        SoLKalMatrix *QPtr,
+                                        SoLKalStepperContext *ctx) const
 {
    if (QPtr) {
       const SoLKalTrackSite &from   = static_cast<const SoLKalTrackSite &>(GetSite());
             SoLKalTrackSite &siteto = static_cast<SoLKalTrackSite &>(to);
+      assert(from.GetCurState().GetType() == SoLKalTrackSite::kFiltered);
 
+      SoLKalFieldStepper *stepper = SoLKalFieldStepper::GetInstance();
+      SoLKalStepperContext &context = ctx ? *ctx : stepper->GetDefaultContext();
+      stepper->InitContext(context);
       SoLKalMatrix sv(kSdim,1);
-      SoLKalFieldStepper::GetInstance()->Transport(from, to, sv, F, *QPtr);
+      Double_t z = siteto.GetZ();
+      stepper->Transport(context, from.GetCurState(), z, sv, F, *QPtr);
+      if (siteto.GetArena())
+        return siteto.GetArena()->NewState(sv, siteto, SoLKalTrackSite::kPredicted);
       return new SoLKalTrackState(sv, siteto, SoLKalTrackSite::kPredicted, kSdim);
    } else {
      return nullptr;
@@ -122,13 +132,13 @@ SoLKalTrackState & SoLKalTrackState::MoveTo(SoLKalTrackSite  &to,
    return *MoveTo(to, F, &Q);
 }
 //______________________________________________________________________
-SoLKalTrackState* SoLKalTrackState::PredictSVatZ(Double_t &z)
+SoLKalTrackState* SoLKalTrackState::PredictSVatZ(Double_t &z, SoLKalStepperContext *ctx)
 {
    //simply pass the current filtered state vector to the next detector
    //it is up to the track finder to decide whether we have a hit in the 
    //next measurement layer
    
-   SoLKalTrackState &prea    = MoveToZ(z,fF,fQ);
+   SoLKalTrackState &prea    = *MoveToZ(z,fF,&fQ,ctx);
    SoLKalTrackState *preaPtr = &prea;
 
    fFt = SoLKalMatrix(SoLKalMatrix::kTransposed, fF);
@@ -151,14 +161,16 @@ void SoLKalTrackState::InitPredictSV()
   if (fAttemptState == nullptr){
     SoLKalMatrix sv(kSdim,1);
     for (Int_t i=0; i<kSdim; i++) { sv(i, 0) = (*this)(i, 0); }
-    fAttemptState = new SoLKalTrackState(sv, SoLKalTrackSite::kPredicted, kSdim);
+    if (fArena) fAttemptState = fArena->NewState(sv, SoLKalTrackSite::kPredicted);
+    else        fAttemptState = new SoLKalTrackState(sv, SoLKalTrackSite::kPredicted, kSdim);
     fAttemptState->SetZ0(this->GetZ0());
   }else{
     return;
   }
 }
 //______________________________________________________________________
-SoLKalTrackState* SoLKalTrackState::PredictSVatNextZ(Double_t &z)
+SoLKalTrackState* SoLKalTrackState::PredictSVatNextZ(Double_t &z, SoLKalStepperContext *ctx,
+                                                     SoLKalPropMode mode)
 {
   //this function can be called only if the PredictSVatZ has been called
   //which is the first attempt to find hits on the next measurement site
@@ -167,9 +179,16 @@ SoLKalTrackState* SoLKalTrackState::PredictSVatNextZ(Double_t &z)
   SoLKalMatrix thisF (kSdim, kSdim);
   SoLKalMatrix thisQ (kSdim, kSdim);
   
-  SoLKalFieldStepper::GetInstance()->Transport(*fAttemptState, z, thisSV, thisF, thisQ);
+  SoLKalFieldStepper *stepper = SoLKalFieldStepper::GetInstance();
+  SoLKalStepperContext &context = ctx ? *ctx : stepper->GetDefaultContext();
+  stepper->InitContext(context);
+  stepper->Predict(context, *fAttemptState, z, thisSV, thisF, thisQ, mode);
   
   for (Int_t i=0; i<kSdim; i++) { (*fAttemptState)(i, 0) = thisSV(i, 0); }
+  if (mode == kPropState) {
+    fAttemptState->SetZ0(context.fTrackPosAtZ);
+    return fAttemptState;
+  }
   
   fF = thisF*fF;
   fFt = SoLKalMatrix(SoLKalMatrix::kTransposed, fF);
@@ -177,20 +196,26 @@ SoLKalTrackState* SoLKalTrackState::PredictSVatNextZ(Double_t &z)
   
   SoLKalMatrix preC = fF * fC * fFt + fQ;
   fAttemptState->SetCovMat(preC);
-  fAttemptState->SetZ0(SoLKalFieldStepper::GetInstance()->GetTrackPosAtZ());
+  fAttemptState->SetZ0(context.fTrackPosAtZ);
   return fAttemptState;
 }
 //______________________________________________________________________
 SoLKalTrackState * SoLKalTrackState::MoveToZ(Double_t z,
                                         SoLKalMatrix &F,
-                                        SoLKalMatrix *QPtr) const
+                                        SoLKalMatrix *QPtr,
+                                        SoLKalStepperContext *ctx) const
 {
    if (QPtr) {
      const SoLKalTrackSite &from   = static_cast<const SoLKalTrackSite &>(GetSite());
+     assert(from.GetCurState().GetType() == SoLKalTrackSite::kFiltered);
+     SoLKalFieldStepper *stepper = SoLKalFieldStepper::GetInstance();
+     SoLKalStepperContext &context = ctx ? *ctx : stepper->GetDefaultContext();
+     stepper->InitContext(context);
      SoLKalMatrix sv(kSdim,1); 
-     SoLKalFieldStepper::GetInstance()->Transport(from, z, sv, F, *QPtr);
-     SoLKalTrackState* thisState =  new SoLKalTrackState(sv, SoLKalTrackSite::kPredicted, kSdim);
-     thisState->SetZ0(SoLKalFieldStepper::GetInstance()->GetTrackPosAtZ());
+     stepper->Transport(context, from.GetCurState(), z, sv, F, *QPtr);
+     SoLKalTrackState* thisState = fArena ? fArena->NewState(sv, SoLKalTrackSite::kPredicted)
+                                          : new SoLKalTrackState(sv, SoLKalTrackSite::kPredicted, kSdim);
+     thisState->SetZ0(context.fTrackPosAtZ);
      return thisState;
    } else {
      return nullptr;
@@ -226,6 +251,19 @@ void SoLKalTrackState::CalcDir(TVector3 &dir, const SoLKalMatrix &sv) {
     dir.SetY(tany * dir.Z());
     dir = dir.Unit();
 }
+//______________________________________________________________________
+void SoLKalTrackState::CalcDir(TVector3 &dir, const SoLKalStateVec &sv) {
+    // Same as above for the fixed size state vector of the stepper.
+
+  Double_t tanx = sv(2,0);
+  Double_t tany = sv(3,0);
+  Double_t qp   = sv(4,0);
+
+    dir.SetZ( 1./(TMath::Abs(qp) * TMath::Sqrt(tanx*tanx + tany*tany + 1. )) );
+    dir.SetX(tanx * dir.Z());
+    dir.SetY(tany * dir.Z());
+    dir = dir.Unit();
+}
 //________________________________________________________________________
 void SoLKalTrackState::CalcMomVec(TVector3 &dir) const {
     // Calculates the momentum vector from this state.
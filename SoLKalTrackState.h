@@ -6,6 +6,8 @@
 #include "SoLKalTrackSite.h"
 class SoLKalTrackSite;
 class SoLKalFieldStepper;
+struct SoLKalStepperContext;
+class SoLKalTrackArena;
 
 class SoLKalTrackState : public SoLKalMatrix {
   public:
@@ -20,19 +22,28 @@ class SoLKalTrackState : public SoLKalMatrix {
               const SoLKalTrackSite &site, Int_t type = 0, Int_t p = kSdim);
   ~SoLKalTrackState();
 
+  //the propagation uses the given stepper context, or the default context
+  //of the stepper if none is given (not thread safe)
   virtual SoLKalTrackState * MoveTo(SoLKalTrackSite  &to,
                                SoLKalMatrix &F,
-                               SoLKalMatrix *QPtr = 0) const;
+                               SoLKalMatrix *QPtr = 0,
+                               SoLKalStepperContext *ctx = 0) const;
   virtual SoLKalTrackState & MoveTo(SoLKalTrackSite  &to,
                               SoLKalMatrix &F,
                               SoLKalMatrix &Q) const;
   virtual SoLKalTrackState * MoveToZ(Double_t z, SoLKalMatrix &F,
-                                     SoLKalMatrix *QPtr = 0) const;
+                                     SoLKalMatrix *QPtr = 0,
+                                     SoLKalStepperContext *ctx = 0) const;
   virtual SoLKalTrackState & MoveToZ(Double_t z, SoLKalMatrix &F,
                                      SoLKalMatrix &Q) const;
   virtual void         Propagate(SoLKalTrackSite &to);
-  virtual SoLKalTrackState * PredictSVatZ(Double_t &z);
-  virtual SoLKalTrackState * PredictSVatNextZ(Double_t &z);
+  virtual SoLKalTrackState * PredictSVatZ(Double_t &z, SoLKalStepperContext *ctx = 0);
+  //goes through the transport table of the stepper when it covers the step,
+  //see SoLKalFieldStepper::Predict. With kPropState only the state vector of
+  //the attempt state is moved, its covariance and the propagator and noise
+  //of this state are left as they are
+  virtual SoLKalTrackState * PredictSVatNextZ(Double_t &z, SoLKalStepperContext *ctx = 0,
+                                              SoLKalPropMode mode = kPropFull);
   virtual void InitPredictSV();
 
   inline void  ClearAttemptSV() { fAttemptState = nullptr; }
@@ -43,15 +54,18 @@ class SoLKalTrackState : public SoLKalMatrix {
   inline const SoLKalMatrix & GetPropMat     (const Char_t *t = "") const { return (t[0] == 'T' ? fFt : fF); }
   inline const Int_t & GetType() const { return fType; }
   inline const Double_t & GetZ0() const { return fZ0; }
+  inline SoLKalTrackArena * GetArena() const { return fArena; }
 
   inline void SetStateVec    (const SoLKalMatrix &c) { TMatrixD::operator=(c); }
   inline void SetCovMat      (const SoLKalMatrix &c) { fC       = c; }
   inline void SetProcNoiseMat(const SoLKalMatrix &q) { fQ       = q; }
   inline void SetSitePtr     (SoLKalTrackSite  *s)   { fSitePtr = s; }
   inline void SetZ0          (Double_t z)            { fZ0 = z; }
+  inline void SetArena       (SoLKalTrackArena *a)   { fArena = a; }
   
   virtual void   CalcDir (TVector3 &dir) const;
   static  void   CalcDir (TVector3 &dir, const SoLKalMatrix &sv);
+  static  void   CalcDir (TVector3 &dir, const SoLKalStateVec &sv);
   virtual void   CalcMomVec (TVector3 &dir) const;
   static  void   CalcMomVec (TVector3 &dir, const SoLKalMatrix &sv);
   
@@ -69,6 +83,7 @@ class SoLKalTrackState : public SoLKalMatrix {
                                     //for finding hits on the next detector
                                     
    Double_t         fZ0;
+   SoLKalTrackArena *fArena;  //! arena of the state and of the states it creates, 0 for the heap
    
    //SoLKalFieldStepper* fFieldStepper;
    ClassDef(SoLKalTrackState,1)      // Base class for state vector objects
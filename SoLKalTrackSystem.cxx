@@ -1,5 +1,8 @@
+//c++
+#include <cassert>
 //SoLIDTracking
 #include "SoLKalTrackSystem.h"
+#include "SoLKalTrackArena.h"
 
 ClassImp(SoLKalTrackSystem)
 
@@ -12,12 +15,46 @@ SoLKalTrackSystem::SoLKalTrackSystem(Int_t n)
              fNHits(-1), fNDF(0), fSeedType(kTriplet)
 {
 }
+//__________________________________________________________________
+SoLKalTrackSystem::SoLKalTrackSystem(const SoLKalTrackSystem &track)
+            :TObjArray(track.GetEntriesFast()+1),
+             fDeltaECX(track.fDeltaECX), fDeltaECY(track.fDeltaECY), fDeltaECE(track.fDeltaECE),
+             fCurSitePtr(track.fCurSitePtr),
+             fChi2(track.fChi2), fMass(track.fMass), fCharge(track.fCharge),
+             fIsElectron(track.fIsElectron), fIsGood(track.fIsGood), fAngleFlag(track.fAngleFlag),
+             fNMissingHits(track.fNMissingHits), fNHits(track.fNHits), fNDF(track.fNDF),
+             fMomentum(track.fMomentum), fTheta(track.fTheta), fPhi(track.fPhi),
+             fVertexZ(track.fVertexZ), fSeedType(track.fSeedType)
+{
+   for (Int_t isite=0; isite<track.GetEntriesFast(); isite++) {
+       SoLKalTrackSite *site = static_cast<SoLKalTrackSite *>(track.UncheckedAt(isite));
+       assert(site == 0 || site->GetArena());
+       TObjArray::Add(site);
+       if (site) site->fNRef++;
+   }
+}
 //___________________________________________________________________
 SoLKalTrackSystem::~SoLKalTrackSystem()
 {
    if (this == fgCurInstancePtr) fgCurInstancePtr = 0;
-   SetOwner(kTRUE);
-   Delete();
+   ReleaseSites();
+   SetOwner(kFALSE);
+}
+//___________________________________________________________________
+void SoLKalTrackSystem::ReleaseSites()
+{
+   //sites from an arena are given back with the arena
+   for (Int_t isite=0; isite<GetEntriesFast(); isite++) {
+       SoLKalTrackSite *site = static_cast<SoLKalTrackSite *>(UncheckedAt(isite));
+       if (site && !site->GetArena()) delete site;
+       else if (site) site->fNRef--;
+   }
+   //the sites are not deleted by Clear, also for an owning track
+   Bool_t owner = IsOwner();
+   SetOwner(kFALSE);
+   TObjArray::Clear();
+   SetOwner(owner);
+   fCurSitePtr = 0;
 }
 //___________________________________________________________________
 Bool_t SoLKalTrackSystem::AddAndFilter(SoLKalTrackSite &next)
@@ -62,6 +99,8 @@ Int_t SoLKalTrackSystem::GetNDF(Bool_t self) const
 //_____________________________________________________________________
 void SoLKalTrackSystem::SmoothBackTo(Int_t k)
 {
+   CopySharedSites();
+
    TIter previous(this,kIterBackward);
    TIter cur     (this,kIterBackward);
 
@@ -107,14 +146,33 @@ void SoLKalTrackSystem::InvFilter(Int_t k)
    //
    // Inverse filter site k
    //
+   CopySharedSites();
+   curPtr = static_cast<SoLKalTrackSite *>(At(k));
    fCurSitePtr = curPtr;
    curPtr->InvFilter();
 }
 //_____________________________________________________________________
+void SoLKalTrackSystem::CopySharedSites()
+{
+   //copy on write: a site that other branches of the track also hold is
+   //replaced by a copy from its arena, the last branch that holds a site
+   //changes it in place
+   for (Int_t isite=0; isite<GetEntriesFast(); isite++) {
+       SoLKalTrackSite *site = static_cast<SoLKalTrackSite *>(UncheckedAt(isite));
+       if (!site || site->fNRef <= 1) continue;
+       SoLKalTrackSite *copy = site->GetArena()->CopySite(*site);
+       site->fNRef--;
+       copy->fNRef = 1;
+       AddAt(copy, isite);
+       if (fCurSitePtr == site) fCurSitePtr = copy;
+   }
+}
+//_____________________________________________________________________
 inline void SoLKalTrackSystem::Add(TObject *obj)
 {
    TObjArray::Add(obj);
    fCurSitePtr = static_cast<SoLKalTrackSite *>(obj);
+   fCurSitePtr->fNRef++;
    fNHits++;
    fNDF = fNHits*kMdim - kSdim;
 }
@@ -15,6 +15,10 @@ class SoLKalTrackSystem : public TObjArray {
   
   public:
   SoLKalTrackSystem(Int_t n = 1);
+  //branch of a track: starts with the sites of the track, which are shared
+  //and copied only when one of the two changes them (CopySharedSites). The
+  //sites must be from an arena
+  SoLKalTrackSystem(const SoLKalTrackSystem &track);
   ~SoLKalTrackSystem();
   
   Bool_t AddAndFilter(SoLKalTrackSite &next);
@@ -23,6 +27,10 @@ class SoLKalTrackSystem : public TObjArray {
   void   InvFilter(Int_t k);
 
   void   Add(TObject *obj);
+  //gives back the sites of a track that is dropped, so that the ones it
+  //shared with its branches are no longer copied on write. The track has no
+  //site afterwards
+  void   ReleaseSites();
   inline SoLKalTrackSite  & GetCurSite() { return *fCurSitePtr; }
   inline SoLKalTrackState & GetState(SoLKalTrackSite::EStType t)
                             { return fCurSitePtr->GetState(t); }
@@ -72,6 +80,10 @@ class SoLKalTrackSystem : public TObjArray {
   Double_t     fDeltaECE;
 
   private:
+  //replaces the sites shared with other branches by copies, before the
+  //smoother changes them
+  void             CopySharedSites();
+
   SoLKalTrackSite   *fCurSitePtr;  // pointer to current site
   
   Double_t     fChi2;        // current total chi2
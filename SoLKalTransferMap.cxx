@@ -0,0 +1,414 @@
+//c++
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+//unix
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//ROOT
+#include "TMath.h"
+//SoLIDTracking
+#include "SoLKalTransferMap.h"
+#include "SoLKalTransportTable.h"
+#include "SoLKalFieldStepper.h"
+#include "SoLIDFieldMap.h"
+
+using namespace std;
+
+//__________________________________________________________________
+SoLKalTransferMap::SoLKalTransferMap()
+: fMapAddr(NULL), fMapSize(0), fFieldScale(0.), fNSegment(0), fSegments(NULL),
+  fDegree(0), fNTerm(0), fTerms(NULL), fMaxPosError(2.e-5), fMaxSlopeError(2.e-5)
+{
+  for (Int_t a=0; a<4; a++){
+    fNReg[a]      = 0;
+    fMin[a]       = 0.;
+    fMax[a]       = 0.;
+    fInvRegion[a] = 1.;
+  }
+}
+//__________________________________________________________________
+SoLKalTransferMap::~SoLKalTransferMap()
+{
+  if (fMapAddr != NULL) munmap(fMapAddr, fMapSize);
+}
+//__________________________________________________________________
+static Int_t NumberOfTerms(Int_t degree)
+{
+  //monomials in 4 variables of total degree <= degree
+  return (degree + 1)*(degree + 2)*(degree + 3)*(degree + 4)/24;
+}
+//__________________________________________________________________
+void SoLKalTransferMap::SetDomain(const UInt_t *nReg, const Double_t *min, const Double_t *max,
+                                  Int_t degree)
+{
+  fDegree = degree;
+  fNTerm  = NumberOfTerms(degree);
+  for (Int_t a=0; a<4; a++){
+    fNReg[a]      = nReg[a];
+    fMin[a]       = min[a];
+    fMax[a]       = max[a];
+    fInvRegion[a] = nReg[a]/(max[a] - min[a]);
+  }
+}
+//__________________________________________________________________
+Bool_t SoLKalTransferMap::Load(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0){
+    cout<<"SoLKalTransferMap: cannot open "<<filename<<endl;
+    return kFALSE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SoLKalTransferMapHeader)){
+    close(fd);
+    return kFALSE;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return kFALSE;
+
+  const SoLKalTransferMapHeader* header = static_cast<const SoLKalTransferMapHeader*>(addr);
+  Bool_t ok = strncmp(header->fMagic, "SOLKTMAP", 8) == 0 &&
+              header->fEndianTag == SoLIDFieldMap::kEndianTag &&
+              header->fVersion == SoLIDFieldMap::kVersion &&
+              header->fDegree <= (UInt_t)kMaxDegree &&
+              header->fNTerm == (UInt_t)NumberOfTerms(header->fDegree) &&
+              header->fSegmentOffset + header->fNSegment*sizeof(SoLKalTransferMapSegment) <= (size_t)st.st_size &&
+              header->fTermOffset + header->fNTerm*4 <= (size_t)st.st_size;
+  size_t nRegion = 1;
+  for (Int_t a=0; a<4 && ok; a++){
+    ok = header->fNReg[a] >= 1 && header->fMax[a] > header->fMin[a];
+    nRegion *= header->fNReg[a];
+  }
+  const SoLKalTransferMapSegment* segments = NULL;
+  const UChar_t* terms = NULL;
+  if (ok){
+    segments = reinterpret_cast<const SoLKalTransferMapSegment*>(
+                 static_cast<const char*>(addr) + header->fSegmentOffset);
+    terms = reinterpret_cast<const UChar_t*>(static_cast<const char*>(addr) + header->fTermOffset);
+    for (UInt_t i=0; i<header->fNSegment && ok; i++){
+      ok = segments[i].fCoefOffset + nRegion*header->fNTerm*kNOutput*sizeof(Double_t) <= (size_t)st.st_size &&
+           segments[i].fErrorOffset + nRegion*2*sizeof(Float_t) <= (size_t)st.st_size;
+    }
+    for (UInt_t t=0; t<header->fNTerm && ok; t++){
+      ok = terms[4*t] + terms[4*t+1] + terms[4*t+2] + terms[4*t+3] <= (Int_t)header->fDegree;
+    }
+  }
+  if (!ok){
+    cout<<"SoLKalTransferMap: "<<filename<<" has a bad header or is truncated"<<endl;
+    munmap(addr, st.st_size);
+    return kFALSE;
+  }
+
+  if (fMapAddr != NULL) munmap(fMapAddr, fMapSize);
+  fMapAddr      = addr;
+  fMapSize      = st.st_size;
+  fFileName     = filename;
+  fFieldMapName = string(header->fFieldMap, strnlen(header->fFieldMap, sizeof(header->fFieldMap)));
+  fFieldScale   = header->fFieldScale;
+  fNSegment     = header->fNSegment;
+  fSegments     = segments;
+  fTerms        = terms;
+  SetDomain(header->fNReg, header->fMin, header->fMax, header->fDegree);
+  return kTRUE;
+}
+//__________________________________________________________________
+Int_t SoLKalTransferMap::FindSegment(Double_t zFrom, Double_t zTo) const
+{
+  for (Int_t i=0; i<fNSegment; i++){
+    if (fabs(fSegments[i].fZFrom - zFrom) < SoLKalTransportTable::kZTolerance &&
+        fabs(fSegments[i].fZTo - zTo) < SoLKalTransportTable::kZTolerance) return i;
+  }
+  return -1;
+}
+//__________________________________________________________________
+Int_t SoLKalTransferMap::FindRegion(const Double_t *v, Double_t *u) const
+{
+  Int_t region = 0;
+  for (Int_t a=0; a<4; a++){
+    Double_t x = (v[a] - fMin[a])*fInvRegion[a];
+    if (!(x >= 0. && x <= fNReg[a])) return -1;
+    Int_t i = (Int_t)x;
+    if (i > fNReg[a] - 1) i = fNReg[a] - 1;
+    u[a]   = 2.*(x - i) - 1.;
+    region = region*fNReg[a] + i;
+  }
+  return region;
+}
+//__________________________________________________________________
+void SoLKalTransferMap::Evaluate(const Double_t *coef, const Double_t *u, Double_t *d) const
+{
+  //Chebyshev polynomials of every variable and their derivatives, by the
+  //recurrences T_k = 2u T_k-1 - T_k-2 and T'_k = 2 T_k-1 + 2u T'_k-1 - T'_k-2
+  Double_t T[4][kMaxDegree + 1], dT[4][kMaxDegree + 1];
+  for (Int_t a=0; a<4; a++){
+    T[a][0]  = 1.;
+    dT[a][0] = 0.;
+    if (fDegree == 0) continue;
+    T[a][1]  = u[a];
+    dT[a][1] = 1.;
+    for (Int_t k=2; k<=fDegree; k++){
+      T[a][k]  = 2.*u[a]*T[a][k-1] - T[a][k-2];
+      dT[a][k] = 2.*T[a][k-1] + 2.*u[a]*dT[a][k-1] - dT[a][k-2];
+    }
+  }
+
+  //value and derivatives in tr, tphi, qp of the 4 outputs. A term is a
+  //product of 4 polynomials, its derivatives replace one factor
+  Double_t val[kNOutput] = { 0. }, gtr[kNOutput] = { 0. }, gtp[kNOutput] = { 0. }, gqp[kNOutput] = { 0. };
+  for (Int_t t=0; t<fNTerm; t++){
+    const UChar_t *e = fTerms + 4*t;
+    const Double_t *c = coef + kNOutput*t;
+    Double_t ab = T[0][e[0]]*T[1][e[1]];
+    Double_t cd = T[2][e[2]]*T[3][e[3]];
+    Double_t w0 = ab*cd;
+    Double_t w1 = T[0][e[0]]*dT[1][e[1]]*cd;
+    Double_t w2 = ab*dT[2][e[2]]*T[3][e[3]];
+    Double_t w3 = ab*T[2][e[2]]*dT[3][e[3]];
+    for (Int_t o=0; o<kNOutput; o++){
+      val[o] += w0*c[o];
+      gtr[o] += w1*c[o];
+      gtp[o] += w2*c[o];
+      gqp[o] += w3*c[o];
+    }
+  }
+
+  //du/dv = 2/(region size)
+  Double_t str = 2.*fInvRegion[1], stp = 2.*fInvRegion[2], sqp = 2.*fInvRegion[3];
+  for (Int_t o=0; o<kNOutput; o++){
+    d[o]      = val[o];
+    d[4 + o]  = gtr[o]*str;
+    d[8 + o]  = gtp[o]*stp;
+    d[12 + o] = gqp[o]*sqp;
+  }
+}
+//__________________________________________________________________
+Bool_t SoLKalTransferMap::Transport(Int_t iseg, const SoLKalStateVec &from, SoLKalStateVec &to,
+                                    SoLKalPropMat &F) const
+{
+  Double_t v[4], u[4], c, s;
+  SoLKalTransportTable::ToLocal(from, v, c, s);
+  Int_t region = FindRegion(v, u);
+  if (region < 0) return kFALSE;
+
+  const SoLKalTransferMapSegment &seg = fSegments[iseg];
+  const char* base = static_cast<const char*>(fMapAddr);
+  const Float_t *errors = reinterpret_cast<const Float_t*>(base + seg.fErrorOffset);
+  if (errors[2*region] > fMaxPosError || errors[2*region+1] > fMaxSlopeError) return kFALSE;
+
+  const Double_t *coef = reinterpret_cast<const Double_t*>(base + seg.fCoefOffset)
+                         + (size_t)region*fNTerm*kNOutput;
+  Double_t d[SoLKalTransportTable::kNodeValues];
+  Evaluate(coef, u, d);
+  SoLKalTransportTable::FromLocal(v, d, seg.fZTo - seg.fZFrom, c, s, to, F);
+  return kTRUE;
+}
+//__________________________________________________________________
+//radical inverse of i in the given base, the Halton sequence for the
+//validation states
+static Double_t RadicalInverse(Int_t i, Int_t base)
+{
+  Double_t inv = 1./base, f = inv, x = 0.;
+  while (i > 0){
+    x += f*(i % base);
+    i /= base;
+    f *= inv;
+  }
+  return x;
+}
+//__________________________________________________________________
+Int_t SoLKalTransferMap::Generate(const char* filename, const vector<Double_t> &planes,
+                                  const Double_t *min, const Double_t *max, const Int_t *nReg,
+                                  Int_t degree)
+{
+  SoLKalFieldStepper *stepper = SoLKalFieldStepper::GetInstance();
+  SoLKalStepperContext ctx;
+  stepper->InitContext(ctx);
+  SoLIDFieldMap *map = stepper->GetFieldMap();
+  if (map->Is3D()){
+    cerr<<"SoLKalTransferMap: the maps need an axially symmetric (r, z) field map"<<endl;
+    return 1;
+  }
+  if (planes.size() < 2){
+    cerr<<"SoLKalTransferMap: at least two planes are needed"<<endl;
+    return 1;
+  }
+  if (degree < 1 || degree > kMaxDegree){
+    cerr<<"SoLKalTransferMap: the degree must be between 1 and "<<kMaxDegree<<endl;
+    return 1;
+  }
+
+  //the maps hold the field transport only, with the fine steps
+  Bool_t isMSOn = stepper->IsMSOn(), isDEDXOn = stepper->IsDEDXOn();
+  stepper->TurnOffMS();
+  stepper->TurnOffDEDX();
+  stepper->UseFineStep();
+
+  const ULong64_t page = 4096;
+  SoLKalTransferMapHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.fMagic, "SOLKTMAP", 8);
+  header.fEndianTag  = SoLIDFieldMap::kEndianTag;
+  header.fVersion    = SoLIDFieldMap::kVersion;
+  header.fNSegment   = 2*(planes.size() - 1);
+  header.fDegree     = degree;
+  header.fNTerm      = NumberOfTerms(degree);
+  header.fFieldScale = map->GetScale();
+  strncpy(header.fFieldMap, map->GetFileName(), sizeof(header.fFieldMap) - 1);
+  size_t nRegion = 1;
+  for (Int_t a=0; a<4; a++){
+    header.fNReg[a] = nReg[a];
+    header.fMin[a]  = min[a];
+    header.fMax[a]  = max[a];
+    nRegion *= nReg[a];
+  }
+  header.fSegmentOffset = (sizeof(header) + 63)/64*64;
+  header.fTermOffset    = (header.fSegmentOffset + header.fNSegment*sizeof(SoLKalTransferMapSegment)
+                           + 63)/64*64;
+
+  //exponents of the terms, the first variable varies slowest
+  vector<UChar_t> terms;
+  for (Int_t i0=0; i0<=degree; i0++)
+    for (Int_t i1=0; i0+i1<=degree; i1++)
+      for (Int_t i2=0; i0+i1+i2<=degree; i2++)
+        for (Int_t i3=0; i0+i1+i2+i3<=degree; i3++){
+          terms.push_back(i0);
+          terms.push_back(i1);
+          terms.push_back(i2);
+          terms.push_back(i3);
+        }
+
+  //every block starts on a page
+  ULong64_t coefBytes  = (nRegion*header.fNTerm*kNOutput*sizeof(Double_t) + page - 1)/page*page;
+  ULong64_t errorBytes = (nRegion*2*sizeof(Float_t) + page - 1)/page*page;
+  ULong64_t offset     = (header.fTermOffset + terms.size() + page - 1)/page*page;
+  vector<SoLKalTransferMapSegment> segments(header.fNSegment);
+  for (UInt_t i=0; i<header.fNSegment; i++){
+    Int_t ip = i/2;
+    segments[i].fZFrom       = (i%2 == 0) ? planes[ip] : planes[ip + 1];
+    segments[i].fZTo         = (i%2 == 0) ? planes[ip + 1] : planes[ip];
+    segments[i].fCoefOffset  = offset;
+    segments[i].fErrorOffset = offset + coefBytes;
+    offset += coefBytes + errorBytes;
+  }
+
+  FILE* out = fopen(filename, "wb");
+  if (out == NULL){
+    cerr<<"SoLKalTransferMap: cannot create "<<filename<<endl;
+    return 1;
+  }
+  vector<char> buffer(segments[0].fCoefOffset, 0);
+  memcpy(&buffer[0], &header, sizeof(header));
+  memcpy(&buffer[header.fSegmentOffset], &segments[0],
+         header.fNSegment*sizeof(SoLKalTransferMapSegment));
+  memcpy(&buffer[header.fTermOffset], &terms[0], terms.size());
+  Bool_t ok = fwrite(&buffer[0], 1, buffer.size(), out) == buffer.size();
+
+  //a map object on the coefficients in memory, for the validation
+  SoLKalTransferMap tmap;
+  tmap.SetDomain(header.fNReg, min, max, degree);
+  tmap.fTerms = &terms[0];
+
+  //Chebyshev nodes of the first kind and the polynomials evaluated on them
+  Int_t n = degree + 1, nNodes = n*n*n*n;
+  vector<Double_t> node(n), T(n*n);
+  for (Int_t k=0; k<n; k++){
+    node[k] = cos(TMath::Pi()*(k + 0.5)/n);
+    for (Int_t i=0; i<n; i++) T[i*n + k] = cos(i*TMath::Pi()*(k + 0.5)/n);
+  }
+
+  const Int_t nValidate = 16 + 256;
+  const Int_t nd = SoLKalTransportTable::kNodeValues;
+  vector<Double_t> coef(coefBytes/sizeof(Double_t), 0.);
+  vector<Float_t>  errors(errorBytes/sizeof(Float_t), 0.);
+  vector<Double_t> f(nNodes*kNOutput);
+  for (UInt_t iseg=0; iseg<header.fNSegment && ok; iseg++){
+    Double_t zFrom = segments[iseg].fZFrom, zTo = segments[iseg].fZTo;
+    Double_t maxPos = 0., maxSlope = 0., maxJac = 0., sumPos2 = 0.;
+    Int_t nAbove = 0;
+    for (size_t ireg=0; ireg<nRegion; ireg++){
+      Double_t lo[4], size[4], v[4], u[4], d[nd], dp[nd];
+      size_t rest = ireg;
+      for (Int_t a=3; a>=0; a--){
+        size[a] = (max[a] - min[a])/nReg[a];
+        lo[a]   = min[a] + (rest % nReg[a])*size[a];
+        rest   /= nReg[a];
+      }
+
+      //the stepper at the nodes of this region
+      for (Int_t k=0; k<nNodes; k++){
+        Int_t kr = k;
+        for (Int_t a=3; a>=0; a--){
+          v[a] = lo[a] + 0.5*(node[kr % n] + 1.)*size[a];
+          kr  /= n;
+        }
+        SoLKalTransportTable::GenerateNode(stepper, ctx, zFrom, zTo, v, d);
+        for (Int_t o=0; o<kNOutput; o++) f[k*kNOutput + o] = d[o];
+      }
+
+      //discrete Chebyshev transform, truncated to the total degree
+      Double_t *c = &coef[ireg*header.fNTerm*kNOutput];
+      for (UInt_t t=0; t<header.fNTerm; t++){
+        const UChar_t *e = &terms[4*t];
+        Double_t s[kNOutput] = { 0. };
+        for (Int_t k=0; k<nNodes; k++){
+          Int_t k3 = k % n, k2 = (k/n) % n, k1 = (k/(n*n)) % n, k0 = k/(n*n*n);
+          Double_t w = T[e[0]*n + k0]*T[e[1]*n + k1]*T[e[2]*n + k2]*T[e[3]*n + k3];
+          for (Int_t o=0; o<kNOutput; o++) s[o] += w*f[k*kNOutput + o];
+        }
+        Double_t norm = 1.;
+        for (Int_t a=0; a<4; a++) norm *= (e[a] == 0 ? 1. : 2.)/n;
+        for (Int_t o=0; o<kNOutput; o++) c[t*kNOutput + o] = norm*s[o];
+      }
+
+      //error bound of the region: the largest residual on its corners,
+      //where the polynomials are least accurate, and on quasi-random
+      //states inside it
+      Double_t errPos = 0., errSlope = 0.;
+      for (Int_t i=0; i<nValidate; i++){
+        const Int_t prime[4] = { 2, 3, 5, 7 };
+        for (Int_t a=0; a<4; a++){
+          u[a] = (i < 16) ? ((i & (8 >> a)) ? 1. : -1.) : 2.*RadicalInverse(i - 15, prime[a]) - 1.;
+          v[a] = lo[a] + 0.5*(u[a] + 1.)*size[a];
+        }
+        SoLKalTransportTable::GenerateNode(stepper, ctx, zFrom, zTo, v, d);
+        tmap.Evaluate(c, u, dp);
+        Double_t ePos = TMath::Max(fabs(dp[0] - d[0]), fabs(dp[1] - d[1]));
+        errPos   = TMath::Max(errPos, ePos);
+        errSlope = TMath::Max(errSlope, TMath::Max(fabs(dp[2] - d[2]), fabs(dp[3] - d[3])));
+        for (Int_t k=4; k<nd; k++) maxJac = TMath::Max(maxJac, fabs(dp[k] - d[k]));
+        sumPos2 += ePos*ePos;
+      }
+      errors[2*ireg]     = errPos;
+      errors[2*ireg + 1] = errSlope;
+      maxPos   = TMath::Max(maxPos, errPos);
+      maxSlope = TMath::Max(maxSlope, errSlope);
+      if (errPos > tmap.fMaxPosError || errSlope > tmap.fMaxSlopeError) nAbove++;
+    }
+    cout<<"segment z = "<<zFrom<<" -> "<<zTo<<" m: largest residual "
+        <<maxPos*1e6<<" um (rms "<<sqrt(sumPos2/(nRegion*nValidate))*1e6<<"), "
+        <<maxSlope*1e6<<" urad, Jacobian "<<maxJac<<"; "<<nAbove<<" of "<<nRegion
+        <<" regions above the default tolerance"<<endl;
+
+    ok = fwrite(&coef[0], 1, coefBytes, out) == coefBytes &&
+         fwrite(&errors[0], 1, errorBytes, out) == errorBytes;
+  }
+  ok = (fclose(out) == 0) && ok;
+
+  stepper->UseDefaultStep();
+  if (isMSOn) stepper->TurnOnMS();
+  if (isDEDXOn) stepper->TurnOnDEDX();
+
+  if (!ok){
+    cerr<<"SoLKalTransferMap: error writing "<<filename<<endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef ROOT_SOL_KAL_TRANSFER_MAP
+#define ROOT_SOL_KAL_TRANSFER_MAP
+//c++
+#include <cstddef>
+#include <string>
+#include <vector>
+//ROOT
+#include "Rtypes.h"
+//SoLIDTracking
+#include "SoLKalMatrix.h"
+
+using namespace std;
+
+//header of the binary transfer map file, the segment list follows at
+//fSegmentOffset and the exponents of the terms at fTermOffset
+struct SoLKalTransferMapHeader {
+  char      fMagic[8];      // "SOLKTMAP"
+  UInt_t    fEndianTag;     // SoLIDFieldMap::kEndianTag as written by the generator
+  UInt_t    fVersion;
+  UInt_t    fNSegment;
+  UInt_t    fDegree;        // total degree of the polynomials
+  UInt_t    fNTerm;         // terms of total degree <= fDegree
+  UInt_t    fNReg[4];       // regions in r, tr, tphi, qp
+  Double_t  fMin[4];        // domain (m, slope, slope, 1/GeV)
+  Double_t  fMax[4];
+  Double_t  fFieldScale;    // scale of the field map the map was fitted to
+  char      fFieldMap[256]; // file name of that field map
+  ULong64_t fSegmentOffset; // byte offset of the segment list
+  ULong64_t fTermOffset;    // byte offset of the exponents, 4 UChar_t per term
+};
+
+//one plane to plane transfer map
+struct SoLKalTransferMapSegment {
+  Double_t  fZFrom;         // m
+  Double_t  fZTo;
+  ULong64_t fCoefOffset;    // byte offset of the coefficients, fNTerm*kNOutput doubles per region
+  ULong64_t fErrorOffset;   // byte offset of the region error bounds, 2 floats each
+};
+
+//polynomial transfer maps between fixed z planes, the second fast transport
+//backend next to SoLKalTransportTable and in the same rotated frame: the
+//deviations of x, y, tr, tphi from the straight line at the second plane
+//are polynomials of total degree fDegree in (r, tr, tphi, qp) at the first
+//one. The domain is cut into a grid of regions, each with its own
+//coefficients in a product basis of Chebyshev polynomials, fitted offline
+//by a discrete Chebyshev transform of Runge-Kutta transports at the
+//Chebyshev nodes of the region (as SoLIDFieldChebyshev does for the field).
+//The Jacobian (columns tx, ty, qp) is the analytic derivative of the
+//polynomials, the x, y columns are unity as in the stepper.
+//Every region has an error bound, the largest residual against the stepper
+//on validation states inside it; states out of the domain or in a region
+//whose bound is above the tolerance are left to the stepper.
+//The bounds only cover stepper transports of quasi-random states of the
+//domain; the maps are not yet validated against the Runge-Kutta residuals
+//of reconstructed or MC tracks
+class SoLKalTransferMap
+{
+  public:
+  SoLKalTransferMap();
+  ~SoLKalTransferMap();
+
+  //maps a binary transfer map file, returns kFALSE if it cannot be used
+  Bool_t Load(const char* filename);
+  inline Bool_t IsLoaded() const { return fMapAddr != NULL; }
+  inline const char* GetFileName() const { return fFileName.c_str(); }
+  inline Double_t GetFieldScale() const { return fFieldScale; }
+  inline const char* GetFieldMapName() const { return fFieldMapName.c_str(); }
+  inline Int_t GetDegree() const { return fDegree; }
+
+  //index of the segment from zFrom to zTo (within kZTolerance of the
+  //table), -1 if none
+  Int_t    FindSegment(Double_t zFrom, Double_t zTo) const;
+  inline Int_t    GetNSegment() const { return fNSegment; }
+  inline Double_t GetZFrom(Int_t iseg) const { return fSegments[iseg].fZFrom; }
+  inline Double_t GetZTo(Int_t iseg) const { return fSegments[iseg].fZTo; }
+
+  //state at the first plane of the segment to the state at the second one
+  //and the propagator. kFALSE if the state is out of the domain or the
+  //error bound of its region is above the tolerance
+  Bool_t   Transport(Int_t iseg, const SoLKalStateVec &from, SoLKalStateVec &to,
+                     SoLKalPropMat &F) const;
+
+  //tolerances on the position (m) and slope errors of a region
+  void     SetMaxError(Double_t pos, Double_t slope) { fMaxPosError = pos; fMaxSlopeError = slope; }
+
+  //fits maps for the transports between consecutive planes, in both
+  //directions, with the stepper and its field map. min and max are the
+  //domain of r, tr, tphi and qp, nReg the numbers of regions
+  static Int_t Generate(const char* filename, const vector<Double_t> &planes,
+                        const Double_t *min, const Double_t *max, const Int_t *nReg,
+                        Int_t degree);
+
+  //polynomials per region: deviations of x, y, tr, tphi
+  static const Int_t kNOutput   = 4;
+  static const Int_t kMaxDegree = 12;
+
+  protected:
+  //local state v to the region index and the Chebyshev variables u in [-1, 1]
+  Int_t    FindRegion(const Double_t *v, Double_t *u) const;
+  //the kNodeValues deviations of SoLKalTransportTable (state and Jacobian
+  //columns tr, tphi, qp) from the coefficients of a region
+  void     Evaluate(const Double_t *coef, const Double_t *u, Double_t *d) const;
+  void     SetDomain(const UInt_t *nReg, const Double_t *min, const Double_t *max, Int_t degree);
+
+  void*     fMapAddr;    // mapped file, NULL if not loaded
+  size_t    fMapSize;
+  string    fFileName;
+  string    fFieldMapName;
+  Double_t  fFieldScale;
+  Int_t     fNSegment;
+  const SoLKalTransferMapSegment* fSegments;
+  Int_t     fDegree;
+  Int_t     fNTerm;
+  const UChar_t* fTerms; // exponents of r, tr, tphi, qp per term
+  Int_t     fNReg[4];
+  Double_t  fMin[4];
+  Double_t  fMax[4];
+  Double_t  fInvRegion[4]; // 1/region size
+  Double_t  fMaxPosError;
+  Double_t  fMaxSlopeError;
+};
+
+#endif
@@ -0,0 +1,406 @@
+//c++
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+//unix
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//ROOT
+#include "TMath.h"
+//SoLIDTracking
+#include "SoLKalTransportTable.h"
+#include "SoLKalFieldStepper.h"
+#include "SoLIDFieldMap.h"
+
+using namespace std;
+
+const Double_t SoLKalTransportTable::kZTolerance = 1.e-4; // m
+
+//__________________________________________________________________
+SoLKalTransportTable::SoLKalTransportTable()
+: fMapAddr(NULL), fMapSize(0), fFieldScale(0.), fNSegment(0), fSegments(NULL),
+  fMaxPosError(2.e-5), fMaxSlopeError(2.e-5)
+{
+  for (Int_t a=0; a<4; a++){
+    fN[a]       = 0;
+    fMin[a]     = 0.;
+    fStep[a]    = 1.;
+    fInvStep[a] = 1.;
+    fStride[a]  = 0;
+  }
+}
+//__________________________________________________________________
+SoLKalTransportTable::~SoLKalTransportTable()
+{
+  if (fMapAddr != NULL) munmap(fMapAddr, fMapSize);
+}
+//__________________________________________________________________
+Bool_t SoLKalTransportTable::Load(const char* filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0){
+    cout<<"SoLKalTransportTable: cannot open "<<filename<<endl;
+    return kFALSE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SoLKalTransportTableHeader)){
+    close(fd);
+    return kFALSE;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return kFALSE;
+
+  const SoLKalTransportTableHeader* header = static_cast<const SoLKalTransportTableHeader*>(addr);
+  Bool_t ok = strncmp(header->fMagic, "SOLKTTAB", 8) == 0 &&
+              header->fEndianTag == SoLIDFieldMap::kEndianTag &&
+              header->fVersion == SoLIDFieldMap::kVersion &&
+              header->fSegmentOffset + header->fNSegment*sizeof(SoLKalTransportSegment) <= (size_t)st.st_size;
+  size_t nNodes = 1, nCells = 1;
+  for (Int_t a=0; a<4 && ok; a++){
+    ok = header->fN[a] >= 2 && header->fStep[a] > 0;
+    nNodes *= header->fN[a];
+    nCells *= header->fN[a] - 1;
+  }
+  const SoLKalTransportSegment* segments = NULL;
+  if (ok){
+    segments = reinterpret_cast<const SoLKalTransportSegment*>(
+                 static_cast<const char*>(addr) + header->fSegmentOffset);
+    for (UInt_t i=0; i<header->fNSegment && ok; i++){
+      ok = segments[i].fNodeOffset + nNodes*kNodeValues*sizeof(Float_t) <= (size_t)st.st_size &&
+           segments[i].fErrorOffset + nCells*2*sizeof(Float_t) <= (size_t)st.st_size;
+    }
+  }
+  if (!ok){
+    cout<<"SoLKalTransportTable: "<<filename<<" has a bad header or is truncated"<<endl;
+    munmap(addr, st.st_size);
+    return kFALSE;
+  }
+
+  if (fMapAddr != NULL) munmap(fMapAddr, fMapSize);
+  fMapAddr      = addr;
+  fMapSize      = st.st_size;
+  fFileName     = filename;
+  fFieldMapName = string(header->fFieldMap, strnlen(header->fFieldMap, sizeof(header->fFieldMap)));
+  fFieldScale   = header->fFieldScale;
+  fNSegment     = header->fNSegment;
+  fSegments     = segments;
+  for (Int_t a=0; a<4; a++){
+    fN[a]       = header->fN[a];
+    fMin[a]     = header->fMin[a];
+    fStep[a]    = header->fStep[a];
+    fInvStep[a] = 1./header->fStep[a];
+  }
+  fStride[3] = 1;
+  for (Int_t a=2; a>=0; a--) fStride[a] = fStride[a+1]*fN[a+1];
+  return kTRUE;
+}
+//__________________________________________________________________
+Int_t SoLKalTransportTable::FindSegment(Double_t zFrom, Double_t zTo) const
+{
+  for (Int_t i=0; i<fNSegment; i++){
+    if (fabs(fSegments[i].fZFrom - zFrom) < kZTolerance &&
+        fabs(fSegments[i].fZTo - zTo) < kZTolerance) return i;
+  }
+  return -1;
+}
+//__________________________________________________________________
+void SoLKalTransportTable::ToLocal(const SoLKalStateVec &sv, Double_t *v,
+                                   Double_t &cosPhi, Double_t &sinPhi)
+{
+  //rotation around z that brings the position onto the positive x axis
+  Double_t x = sv(kIdxX0, 0);
+  Double_t y = sv(kIdxY0, 0);
+  Double_t r = sqrt(x*x + y*y);
+  cosPhi = (r > 0.) ? x/r : 1.;
+  sinPhi = (r > 0.) ? y/r : 0.;
+  v[0] = r;
+  v[1] =  cosPhi*sv(kIdxTX, 0) + sinPhi*sv(kIdxTY, 0);
+  v[2] = -sinPhi*sv(kIdxTX, 0) + cosPhi*sv(kIdxTY, 0);
+  v[3] = sv(kIdxQP, 0);
+}
+//__________________________________________________________________
+Bool_t SoLKalTransportTable::FindCell(const Double_t *v, Int_t *cell, Double_t *frac) const
+{
+  for (Int_t a=0; a<4; a++){
+    Double_t u = (v[a] - fMin[a])*fInvStep[a];
+    if (!(u >= 0. && u <= fN[a] - 1)) return kFALSE;
+    Int_t i = (Int_t)u;
+    if (i > fN[a] - 2) i = fN[a] - 2;
+    cell[a] = i;
+    frac[a] = u - i;
+  }
+  return kTRUE;
+}
+//__________________________________________________________________
+void SoLKalTransportTable::Interpolate(const Float_t *nodes, const Int_t *cell,
+                                       const Double_t *frac, Double_t *values) const
+{
+  //multilinear interpolation over the 16 corners of the cell. The corners
+  //are far apart in a large table, their lines are requested together so
+  //that the cache misses overlap
+  size_t base = 0;
+  for (Int_t a=0; a<4; a++) base += (size_t)cell[a]*fStride[a];
+  const Float_t *corner[16];
+  Double_t w[16];
+  for (Int_t c=0; c<16; c++){
+    size_t node = base;
+    w[c] = 1.;
+    for (Int_t a=0; a<4; a++){
+      if (c & (8 >> a)){
+        w[c] *= frac[a];
+        node += fStride[a];
+      } else {
+        w[c] *= 1. - frac[a];
+      }
+    }
+    corner[c] = nodes + node*kNodeValues;
+    __builtin_prefetch(corner[c]);
+  }
+  for (Int_t k=0; k<kNodeValues; k++) values[k] = 0.;
+  for (Int_t c=0; c<16; c++){
+    for (Int_t k=0; k<kNodeValues; k++) values[k] += w[c]*corner[c][k];
+  }
+}
+//__________________________________________________________________
+Bool_t SoLKalTransportTable::Transport(Int_t iseg, const SoLKalStateVec &from, SoLKalStateVec &to,
+                                       SoLKalPropMat &F) const
+{
+  Double_t v[4], c, s;
+  ToLocal(from, v, c, s);
+  Int_t cell[4];
+  Double_t frac[4];
+  if (!FindCell(v, cell, frac)) return kFALSE;
+
+  const SoLKalTransportSegment &seg = fSegments[iseg];
+  const char* base = static_cast<const char*>(fMapAddr);
+  const Float_t *errors = reinterpret_cast<const Float_t*>(base + seg.fErrorOffset);
+  size_t icell = cell[0];
+  for (Int_t a=1; a<4; a++) icell = icell*(fN[a] - 1) + cell[a];
+  __builtin_prefetch(errors + 2*icell);
+
+  //the error bound is checked after the interpolation, its cache miss
+  //overlaps with those of the nodes
+  Double_t d[kNodeValues];
+  Interpolate(reinterpret_cast<const Float_t*>(base + seg.fNodeOffset), cell, frac, d);
+  if (errors[2*icell] > fMaxPosError || errors[2*icell+1] > fMaxSlopeError) return kFALSE;
+  FromLocal(v, d, seg.fZTo - seg.fZFrom, c, s, to, F);
+  return kTRUE;
+}
+//__________________________________________________________________
+void SoLKalTransportTable::FromLocal(const Double_t *v, const Double_t *d, Double_t dz,
+                                     Double_t c, Double_t s, SoLKalStateVec &to, SoLKalPropMat &F)
+{
+  //state at the end in the rotated frame, then rotated back
+  Double_t xl  = v[0] + v[1]*dz + d[0];
+  Double_t yl  = v[2]*dz + d[1];
+  Double_t trl = v[1] + d[2];
+  Double_t tpl = v[2] + d[3];
+  to(kIdxX0, 0) = c*xl  - s*yl;
+  to(kIdxY0, 0) = s*xl  + c*yl;
+  to(kIdxTX, 0) = c*trl - s*tpl;
+  to(kIdxTY, 0) = s*trl + c*tpl;
+  to(kIdxQP, 0) = v[3];
+
+  //Jacobian: the 2 x 2 blocks of the rows (x, y) and (tx, ty) with the
+  //columns (tr, tphi) become R * J * R^T, the qp column R * J
+  Double_t J[2][2][2] = { { { dz + d[4], d[8]      }, { d[5],     dz + d[9] } },
+                          { { 1. + d[6], d[10]     }, { d[7],     1. + d[11] } } };
+  F = ROOT::Math::SMatrixIdentity();
+  for (Int_t b=0; b<2; b++){
+    Double_t RJ[2][2];
+    for (Int_t j=0; j<2; j++){
+      RJ[0][j] = c*J[b][0][j] - s*J[b][1][j];
+      RJ[1][j] = s*J[b][0][j] + c*J[b][1][j];
+    }
+    for (Int_t i=0; i<2; i++){
+      F(2*b + i, kIdxTX) = RJ[i][0]*c - RJ[i][1]*s;
+      F(2*b + i, kIdxTY) = RJ[i][0]*s + RJ[i][1]*c;
+    }
+    F(2*b,     kIdxQP) = c*d[12 + 2*b] - s*d[13 + 2*b];
+    F(2*b + 1, kIdxQP) = s*d[12 + 2*b] + c*d[13 + 2*b];
+  }
+}
+//__________________________________________________________________
+void SoLKalTransportTable::GenerateNode(SoLKalFieldStepper *stepper, SoLKalStepperContext &ctx,
+                                       Double_t zFrom, Double_t zTo, const Double_t *v, Double_t *d)
+{
+  //transport of the state (r, 0, tr, tphi, qp) with the stepper. The
+  //direction is not defined for qp = 0, the node is the mean of two close
+  //ones, the deviations are smooth (nearly linear) in qp there
+  if (fabs(v[3]) < 1.e-6){
+    const Double_t eps = 1.e-4;
+    Double_t vp[4] = { v[0], v[1], v[2], eps }, vm[4] = { v[0], v[1], v[2], -eps };
+    Double_t dm[kNodeValues];
+    GenerateNode(stepper, ctx, zFrom, zTo, vp, d);
+    GenerateNode(stepper, ctx, zFrom, zTo, vm, dm);
+    for (Int_t k=0; k<kNodeValues; k++) d[k] = 0.5*(d[k] + dm[k]);
+    return;
+  }
+  SoLKalStateVec sv, out;
+  SoLKalPropMat  F, Q;
+  sv(kIdxX0, 0) = v[0];
+  sv(kIdxY0, 0) = 0.;
+  sv(kIdxTX, 0) = v[1];
+  sv(kIdxTY, 0) = v[2];
+  sv(kIdxQP, 0) = v[3];
+  Double_t z  = zTo;
+  Double_t dz = zTo - zFrom;
+  stepper->Transport(ctx, sv, zFrom, z, out, F, Q, kPropJacobian);
+
+  d[0]  = out(kIdxX0, 0) - (v[0] + v[1]*dz);
+  d[1]  = out(kIdxY0, 0) - v[2]*dz;
+  d[2]  = out(kIdxTX, 0) - v[1];
+  d[3]  = out(kIdxTY, 0) - v[2];
+  d[4]  = F(kIdxX0, kIdxTX) - dz;
+  d[5]  = F(kIdxY0, kIdxTX);
+  d[6]  = F(kIdxTX, kIdxTX) - 1.;
+  d[7]  = F(kIdxTY, kIdxTX);
+  d[8]  = F(kIdxX0, kIdxTY);
+  d[9]  = F(kIdxY0, kIdxTY) - dz;
+  d[10] = F(kIdxTX, kIdxTY);
+  d[11] = F(kIdxTY, kIdxTY) - 1.;
+  for (Int_t i=0; i<4; i++) d[12 + i] = F(i, kIdxQP);
+}
+//__________________________________________________________________
+Int_t SoLKalTransportTable::Generate(const char* filename, const vector<Double_t> &planes,
+                                     const Double_t *min, const Double_t *max, const Int_t *n)
+{
+  SoLKalFieldStepper *stepper = SoLKalFieldStepper::GetInstance();
+  SoLKalStepperContext ctx;
+  stepper->InitContext(ctx);
+  SoLIDFieldMap *map = stepper->GetFieldMap();
+  if (map->Is3D()){
+    cerr<<"SoLKalTransportTable: the table needs an axially symmetric (r, z) field map"<<endl;
+    return 1;
+  }
+  if (planes.size() < 2){
+    cerr<<"SoLKalTransportTable: at least two planes are needed"<<endl;
+    return 1;
+  }
+
+  //the table holds the field transport only, with the fine steps
+  Bool_t isMSOn = stepper->IsMSOn(), isDEDXOn = stepper->IsDEDXOn();
+  stepper->TurnOffMS();
+  stepper->TurnOffDEDX();
+  stepper->UseFineStep();
+
+  const ULong64_t page = 4096;
+  SoLKalTransportTableHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.fMagic, "SOLKTTAB", 8);
+  header.fEndianTag  = SoLIDFieldMap::kEndianTag;
+  header.fVersion    = SoLIDFieldMap::kVersion;
+  header.fNSegment   = 2*(planes.size() - 1);
+  header.fFieldScale = map->GetScale();
+  strncpy(header.fFieldMap, map->GetFileName(), sizeof(header.fFieldMap) - 1);
+  header.fSegmentOffset = (sizeof(header) + 63)/64*64;
+  size_t nNodes = 1, nCells = 1;
+  for (Int_t a=0; a<4; a++){
+    header.fN[a]    = n[a];
+    header.fMin[a]  = min[a];
+    header.fStep[a] = (max[a] - min[a])/(n[a] - 1);
+    nNodes *= n[a];
+    nCells *= n[a] - 1;
+  }
+
+  //every block starts on a page
+  ULong64_t nodeBytes  = (nNodes*kNodeValues*sizeof(Float_t) + page - 1)/page*page;
+  ULong64_t errorBytes = (nCells*2*sizeof(Float_t) + page - 1)/page*page;
+  ULong64_t offset     = (header.fSegmentOffset + header.fNSegment*sizeof(SoLKalTransportSegment)
+                          + page - 1)/page*page;
+  vector<SoLKalTransportSegment> segments(header.fNSegment);
+  for (UInt_t i=0; i<header.fNSegment; i++){
+    Int_t ip = i/2;
+    segments[i].fZFrom       = (i%2 == 0) ? planes[ip] : planes[ip + 1];
+    segments[i].fZTo         = (i%2 == 0) ? planes[ip + 1] : planes[ip];
+    segments[i].fNodeOffset  = offset;
+    segments[i].fErrorOffset = offset + nodeBytes;
+    offset += nodeBytes + errorBytes;
+  }
+
+  FILE* out = fopen(filename, "wb");
+  if (out == NULL){
+    cerr<<"SoLKalTransportTable: cannot create "<<filename<<endl;
+    return 1;
+  }
+  vector<char> buffer(segments[0].fNodeOffset, 0);
+  memcpy(&buffer[0], &header, sizeof(header));
+  memcpy(&buffer[header.fSegmentOffset], &segments[0],
+         header.fNSegment*sizeof(SoLKalTransportSegment));
+  Bool_t ok = fwrite(&buffer[0], 1, buffer.size(), out) == buffer.size();
+
+  //a table object on the nodes in memory, for the interpolation at the
+  //cell centres
+  SoLKalTransportTable table;
+  for (Int_t a=0; a<4; a++){
+    table.fN[a]       = n[a];
+    table.fMin[a]     = min[a];
+    table.fStep[a]    = header.fStep[a];
+    table.fInvStep[a] = 1./header.fStep[a];
+  }
+  table.fStride[3] = 1;
+  for (Int_t a=2; a>=0; a--) table.fStride[a] = table.fStride[a+1]*n[a+1];
+
+  vector<Float_t> nodes(nodeBytes/sizeof(Float_t), 0.);
+  vector<Float_t> errors(errorBytes/sizeof(Float_t), 0.);
+  for (UInt_t iseg=0; iseg<header.fNSegment && ok; iseg++){
+    Double_t zFrom = segments[iseg].fZFrom, zTo = segments[iseg].fZTo;
+    Int_t idx[4];
+    Double_t v[4], d[kNodeValues];
+    for (size_t node=0; node<nNodes; node++){
+      size_t rest = node;
+      for (Int_t a=3; a>=0; a--){
+        idx[a] = rest % n[a];
+        rest  /= n[a];
+        v[a]   = min[a] + idx[a]*header.fStep[a];
+      }
+      GenerateNode(stepper, ctx, zFrom, zTo, v, d);
+      for (Int_t k=0; k<kNodeValues; k++) nodes[node*kNodeValues + k] = d[k];
+    }
+
+    //error bound of every cell: the interpolation at its centre against the
+    //stepper
+    Double_t maxPos = 0., maxSlope = 0.;
+    Double_t frac[4] = { 0.5, 0.5, 0.5, 0.5 };
+    Double_t di[kNodeValues];
+    for (size_t icell=0; icell<nCells; icell++){
+      size_t rest = icell;
+      for (Int_t a=3; a>=0; a--){
+        idx[a] = rest % (n[a] - 1);
+        rest  /= n[a] - 1;
+        v[a]   = min[a] + (idx[a] + 0.5)*header.fStep[a];
+      }
+      GenerateNode(stepper, ctx, zFrom, zTo, v, d);
+      table.Interpolate(&nodes[0], idx, frac, di);
+      Double_t errPos   = TMath::Max(fabs(di[0] - d[0]), fabs(di[1] - d[1]));
+      Double_t errSlope = TMath::Max(fabs(di[2] - d[2]), fabs(di[3] - d[3]));
+      errors[2*icell]     = errPos;
+      errors[2*icell + 1] = errSlope;
+      maxPos   = TMath::Max(maxPos, errPos);
+      maxSlope = TMath::Max(maxSlope, errSlope);
+    }
+    cout<<"segment z = "<<zFrom<<" -> "<<zTo<<" m: largest cell error "
+        <<maxPos*1e6<<" um, "<<maxSlope*1e6<<" urad"<<endl;
+
+    ok = fwrite(&nodes[0], 1, nodeBytes, out) == nodeBytes &&
+         fwrite(&errors[0], 1, errorBytes, out) == errorBytes;
+  }
+  ok = (fclose(out) == 0) && ok;
+
+  stepper->UseDefaultStep();
+  if (isMSOn) stepper->TurnOnMS();
+  if (isDEDXOn) stepper->TurnOnDEDX();
+
+  if (!ok){
+    cerr<<"SoLKalTransportTable: error writing "<<filename<<endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,126 @@
+#ifndef ROOT_SOL_KAL_TRANSPORT_TABLE
+#define ROOT_SOL_KAL_TRANSPORT_TABLE
+//c++
+#include <cstddef>
+#include <string>
+#include <vector>
+//ROOT
+#include "Rtypes.h"
+//SoLIDTracking
+#include "SoLKalMatrix.h"
+class SoLKalFieldStepper;
+struct SoLKalStepperContext;
+
+using namespace std;
+
+//header of the binary transport table file, the segment list follows at
+//fSegmentOffset
+struct SoLKalTransportTableHeader {
+  char      fMagic[8];      // "SOLKTTAB"
+  UInt_t    fEndianTag;     // SoLIDFieldMap::kEndianTag as written by the generator
+  UInt_t    fVersion;
+  UInt_t    fNSegment;
+  UInt_t    fN[4];          // nodes in r, tr, tphi, qp
+  Double_t  fMin[4];        // first node (m, slope, slope, 1/GeV)
+  Double_t  fStep[4];
+  Double_t  fFieldScale;    // scale of the field map the table was generated with
+  char      fFieldMap[256]; // file name of that field map
+  ULong64_t fSegmentOffset; // byte offset of the segment list
+};
+
+//one plane to plane transport of the table
+struct SoLKalTransportSegment {
+  Double_t  fZFrom;         // m
+  Double_t  fZTo;
+  ULong64_t fNodeOffset;    // byte offset of the nodes, kNodeValues floats each
+  ULong64_t fErrorOffset;   // byte offset of the cell error bounds, 2 floats each
+};
+
+//transport of the track state between fixed z planes (the GEM trackers),
+//generated offline with the Runge-Kutta stepper and interpolated at run time.
+//The field is axially symmetric, so a state is rotated around the z axis
+//onto the x axis and the table is indexed by r, the radial and azimuthal
+//slopes tr, tphi and qp. A node keeps the deviation of the transported state
+//from the straight line and of the Jacobian (columns tx, ty, qp; as in the
+//stepper the field gradient is neglected) from the straight line one, which
+//are smooth and interpolated linearly in all four variables.
+//Every cell has an error bound, the difference between the interpolation
+//and the stepper at its centre; a state out of the grid or in a cell whose
+//bound is above the tolerance is left to the stepper; the bounds are not
+//yet validated on reconstructed or MC tracks. Energy loss and
+//multiple scattering are not in the table, see
+//SoLKalFieldStepper::TransportFast
+class SoLKalTransportTable
+{
+  public:
+  SoLKalTransportTable();
+  ~SoLKalTransportTable();
+
+  //maps a binary table file, returns kFALSE if it cannot be used
+  Bool_t Load(const char* filename);
+  inline Bool_t IsLoaded() const { return fMapAddr != NULL; }
+  inline const char* GetFileName() const { return fFileName.c_str(); }
+  inline Double_t GetFieldScale() const { return fFieldScale; }
+  inline const char* GetFieldMapName() const { return fFieldMapName.c_str(); }
+
+  //index of the segment from zFrom to zTo (within kZTolerance), -1 if none
+  Int_t    FindSegment(Double_t zFrom, Double_t zTo) const;
+  inline Int_t    GetNSegment() const { return fNSegment; }
+  inline Double_t GetZFrom(Int_t iseg) const { return fSegments[iseg].fZFrom; }
+  inline Double_t GetZTo(Int_t iseg) const { return fSegments[iseg].fZTo; }
+
+  //state at the first plane of the segment to the state at the second one
+  //and the propagator (x, y and qp columns and the qp row from the unit
+  //matrix). kFALSE if the state is out of the grid or the error bound of
+  //its cell is above the tolerance
+  Bool_t   Transport(Int_t iseg, const SoLKalStateVec &from, SoLKalStateVec &to,
+                     SoLKalPropMat &F) const;
+
+  //tolerances on the position (m) and slope errors of a cell
+  void     SetMaxError(Double_t pos, Double_t slope) { fMaxPosError = pos; fMaxSlopeError = slope; }
+
+  //generates a table for the transports between consecutive planes, in
+  //both directions, with the stepper and its field map. min, max and n are
+  //the ranges and node numbers of r, tr, tphi and qp
+  static Int_t Generate(const char* filename, const vector<Double_t> &planes,
+                        const Double_t *min, const Double_t *max, const Int_t *n);
+
+  //floats per node: deviation of x, y, tx, ty, then of the Jacobian columns
+  //tx, ty, qp, each with the rows x, y, tx, ty
+  static const Int_t    kNodeValues = 16;
+  static const Double_t kZTolerance;
+
+  //rotated frame shared with SoLKalTransferMap: v = (r, tr, tphi, qp) of the
+  //state and the rotation angle
+  static void ToLocal(const SoLKalStateVec &sv, Double_t *v, Double_t &cosPhi, Double_t &sinPhi);
+  //state and propagator over dz from the local start v and the kNodeValues
+  //deviations d, rotated back
+  static void FromLocal(const Double_t *v, const Double_t *d, Double_t dz,
+                        Double_t cosPhi, Double_t sinPhi, SoLKalStateVec &to, SoLKalPropMat &F);
+  //deviations of the local state v transported from zFrom to zTo with the
+  //stepper (its settings, no material), as stored in a node
+  static void GenerateNode(SoLKalFieldStepper *stepper, SoLKalStepperContext &ctx,
+                           Double_t zFrom, Double_t zTo, const Double_t *v, Double_t *d);
+
+  protected:
+  Bool_t   FindCell(const Double_t *v, Int_t *cell, Double_t *frac) const;
+  void     Interpolate(const Float_t *nodes, const Int_t *cell, const Double_t *frac,
+                       Double_t *values) const;
+
+  void*     fMapAddr;    // mapped file, NULL if not loaded
+  size_t    fMapSize;
+  string    fFileName;
+  string    fFieldMapName;
+  Double_t  fFieldScale;
+  Int_t     fNSegment;
+  const SoLKalTransportSegment* fSegments;
+  Int_t     fN[4];
+  Double_t  fMin[4];
+  Double_t  fStep[4];
+  Double_t  fInvStep[4];
+  Int_t     fStride[4];  // nodes between neighbours in each variable
+  Double_t  fMaxPosError;
+  Double_t  fMaxSlopeError;
+};
+
+#endif
@@ -0,0 +1,112 @@
+//*************************************************//
+//fits the Chebyshev parameterization of the       //
+//solenoid field (SoLIDFieldChebyshev) to the      //
+//field map, writes the coefficient file and a     //
+//residual report against the grid nodes           //
+//                                                 //
+//usage: fieldchebfit [options] [nregr nregz       //
+//                     degree rmin rmax zmin zmax] //
+//       -m map     field map (default kTextFile)  //
+//       -o file    coefficient file (default the  //
+//                  map file with .cheb extension) //
+//       ranges in cm, default is the tracking     //
+//       volume inside the coil, where the field   //
+//       is smooth. Outside the fitted range       //
+//       SoLIDFieldMap falls back to the grid. The //
+//       fit is done at unit scale, the file       //
+//       records the map it was fitted to          //
+//*************************************************//
+//c++
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <string>
+//SoLIDTracking
+#include "SoLIDFieldMap.h"
+#include "SoLIDFieldChebyshev.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  const char* mapfile = SoLIDFieldMap::kTextFile;
+  string output;
+  vector<Double_t> arg;
+  for (Int_t i=1; i<argc; i++){
+    const char* opt = argv[i];
+    if (strcmp(opt, "-m") == 0 && i+1 < argc) mapfile = argv[++i];
+    else if (strcmp(opt, "-o") == 0 && i+1 < argc) output = argv[++i];
+    else if (opt[0] == '-' && (opt[1] < '0' || opt[1] > '9') && opt[1] != '.'){
+      cerr<<"usage: "<<argv[0]<<" [-m map] [-o file] [nregr nregz degree rmin rmax zmin zmax]"<<endl;
+      return 1;
+    }
+    else arg.push_back(atof(opt));
+  }
+  if (output.empty()) output = SoLIDFieldChebyshev::MakeCoefFileName(mapfile);
+  Int_t    nRegR = (arg.size() > 0) ? (Int_t)arg[0] : 14;
+  Int_t    nRegZ = (arg.size() > 1) ? (Int_t)arg[1] : 80;
+  Int_t    deg   = (arg.size() > 2) ? (Int_t)arg[2] : 5;
+  Double_t rMin  = (arg.size() > 3) ? arg[3] : 0.;
+  Double_t rMax  = (arg.size() > 4) ? arg[4] : 140.;
+  Double_t zMin  = (arg.size() > 5) ? arg[5] : -350.;
+  Double_t zMax  = (arg.size() > 6) ? arg[6] : 450.;
+
+  SoLIDFieldMap* map = SoLIDFieldMap::GetInstance(mapfile, 1.);
+  if (map == NULL){
+    cerr<<"cannot load field map "<<mapfile<<endl;
+    return 1;
+  }
+  if (map->Is3D()){
+    cerr<<mapfile<<" is a 3D map, the Chebyshev fit is for (r, z) maps"<<endl;
+    return 1;
+  }
+
+  //sample the smooth Hermite interpolant of the grid at the Chebyshev nodes
+  map->SetInterpolation(SoLIDFieldMap::kHermite);
+
+  SoLIDFieldChebyshev cheb;
+  cheb.Fit(*map, nRegR, nRegZ, deg, rMin, rMax, zMin, zMax);
+  if (cheb.WriteCoefficients(output.c_str()) != 0) return 1;
+  cout<<"wrote "<<output<<" for "<<mapfile<<": "<<nRegR<<" x "<<nRegZ
+      <<" regions of degree "<<deg<<endl;
+
+  //residuals at every grid node, the bilinear lookup on a node returns the
+  //tabulated value exactly
+  map->SetInterpolation(SoLIDFieldMap::kBilinear);
+  Double_t regR = (rMax - rMin)/nRegR;
+  Double_t regZ = (zMax - zMin)/nRegZ;
+  Double_t rStep = map->GetRStep(), zStep = map->GetZStep(), zShift = map->GetZShift();
+  Double_t sum2 = 0., maxAll = 0.;
+  Long64_t nAll = 0;
+  Double_t b[3];
+  printf("%8s %8s %8s %8s %12s %12s\n", "r_lo", "r_hi", "z_lo", "z_hi", "max|dBz|", "max|dBr|");
+  for (Int_t iz=0; iz<nRegZ; iz++){
+    for (Int_t ir=0; ir<nRegR; ir++){
+      Double_t r0 = rMin + ir*regR, z0 = zMin + iz*regZ;
+      Double_t maxZ = 0., maxR = 0.;
+      for (Int_t i = (Int_t)ceil(r0/rStep); i*rStep < r0 + regR; i++){
+        Double_t r = i*rStep;
+        for (Int_t k = (Int_t)ceil((z0 + zShift)/zStep); k*zStep - zShift < z0 + regZ; k++){
+          Double_t z = k*zStep - zShift;
+          Double_t br, bz;
+          if (!cheb.EvalRZ(r, z, br, bz)) continue;
+          map->GetBField(r/100., 0., z/100., b);
+          Double_t dz = fabs(bz - b[2]), dr = fabs(br - b[0]);
+          if (dz > maxZ) maxZ = dz;
+          if (dr > maxR) maxR = dr;
+          sum2 += dz*dz + dr*dr;
+          nAll++;
+        }
+      }
+      if (maxZ > maxAll) maxAll = maxZ;
+      if (maxR > maxAll) maxAll = maxR;
+      printf("%8.1f %8.1f %8.1f %8.1f %12.3e %12.3e\n", r0, r0 + regR, z0, z0 + regZ, maxZ, maxR);
+    }
+  }
+  printf("residuals over %lld grid nodes: rms %.3e kG, max %.3e kG\n",
+         nAll, nAll > 0 ? sqrt(sum2/(2*nAll)) : 0., maxAll);
+  return 0;
+}
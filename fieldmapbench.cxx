@@ -0,0 +1,293 @@
+//*************************************************//
+//microbenchmark and accuracy check of the field   //
+//map lookups. Points are taken along SIDIS and    //
+//PVDIS trajectories, traced through the map with  //
+//the Runge-Kutta stages of a 2 cm step, so that   //
+//the access pattern is the one of the tracking.   //
+//Every backend is timed (ns per GetBField call)   //
+//and compared to a reference: the given reference //
+//map, e.g. a finer grid, with bicubic Hermite     //
+//interpolation. Results go to stdout and to a     //
+//JSON file for regression tracking                //
+//                                                 //
+//usage: fieldmapbench [map [reference map         //
+//                     [output json]]]             //
+//       default map kTextFile, default reference  //
+//       the map itself (then only the differences //
+//       between the interpolations are measured)  //
+//       a 3D map can be compared to an (r, z) one //
+//*************************************************//
+//c++
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+//unix
+#include <time.h>
+//ROOT
+#include "TMath.h"
+//SoLIDTracking
+#include "SoLIDFieldMap.h"
+#include "SoLIDFieldCursor.h"
+
+using namespace std;
+
+//one set of sample points, in the order in which they are looked up
+struct BenchPoints {
+  string name;
+  vector<Double_t> x, y, z;  // m
+};
+
+//one measurement
+struct BenchResult {
+  string   backend;
+  string   points;
+  Double_t nsPerCall;
+  Double_t rms;   // rms of |B - B_ref| (kG)
+  Double_t max;   // max of |B - B_ref| (kG)
+};
+
+static const Int_t    kNTracks  = 400;   // tracks per configuration
+static const Int_t    kNRepeat  = 5;     // timing repetitions, the best one is kept
+static const Double_t kStep     = 0.02;  // m, Runge-Kutta step of the sampling
+static const Double_t kRStop    = 1.4;   // m, tracks end at the inner radius of the coil
+
+//__________________________________________________________________
+static Double_t Now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+//__________________________________________________________________
+//uniform in [0, 1), fixed sequence so that runs are comparable
+static Double_t Uniform(UInt_t& seed)
+{
+  seed = seed*1664525u + 1013904223u;
+  return (seed >> 8)*(1./16777216.);
+}
+//__________________________________________________________________
+//dp/ds for momentum p (GeV) at position pos (m), charge q
+static void Force(const SoLIDFieldMap* map, const Double_t* pos, const Double_t* p,
+                  Double_t q, Double_t* dp)
+{
+  const Double_t kappa = TMath::C()/1.e10; // GeV/(c kG m)
+  Double_t b[3];
+  map->GetBField(pos[0], pos[1], pos[2], b);
+  Double_t c = q*kappa/sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+  dp[0] = c*(p[1]*b[2] - p[2]*b[1]);
+  dp[1] = c*(p[2]*b[0] - p[0]*b[2]);
+  dp[2] = c*(p[0]*b[1] - p[1]*b[0]);
+}
+//__________________________________________________________________
+//trace tracks from the target to zEnd, or to the coil, and keep the four RK4
+//stage positions of every step, which are the points the stepper looks up
+static void MakeTrackPoints(const SoLIDFieldMap* map, BenchPoints& pts, UInt_t seed,
+                            Double_t zTarget, Double_t targetLength,
+                            Double_t thetaMin, Double_t thetaMax,
+                            Double_t pMin, Double_t pMax, Double_t zEnd)
+{
+  Double_t rMax = TMath::Min(kRStop, map->GetRMax()/100.);
+  for (Int_t it=0; it<kNTracks; it++){
+    Double_t theta = thetaMin + (thetaMax - thetaMin)*Uniform(seed);
+    Double_t phi   = TMath::TwoPi()*Uniform(seed);
+    Double_t mom   = pMin + (pMax - pMin)*Uniform(seed);
+    Double_t q     = (Uniform(seed) < 0.5) ? -1. : 1.;
+    Double_t pos[3] = { 0., 0., zTarget + targetLength*(Uniform(seed) - 0.5) };
+    Double_t p[3]   = { mom*sin(theta)*cos(phi), mom*sin(theta)*sin(phi), mom*cos(theta) };
+
+    while (pos[2] < zEnd && sqrt(pos[0]*pos[0] + pos[1]*pos[1]) < rMax && p[2] > 0){
+      Double_t k[4][6], y[6], dy[6];
+      for (Int_t s=0; s<4; s++){
+        Double_t f = (s == 0) ? 0. : ((s == 3) ? 1. : 0.5);
+        for (Int_t i=0; i<3; i++){
+          y[i]     = pos[i] + (s == 0 ? 0. : f*k[s-1][i]);
+          y[i + 3] = p[i]   + (s == 0 ? 0. : f*k[s-1][i + 3]);
+        }
+        pts.x.push_back(y[0]);
+        pts.y.push_back(y[1]);
+        pts.z.push_back(y[2]);
+
+        Double_t pmag = sqrt(y[3]*y[3] + y[4]*y[4] + y[5]*y[5]);
+        Force(map, y, y + 3, q, dy + 3);
+        for (Int_t i=0; i<3; i++){
+          k[s][i]     = kStep*y[i + 3]/pmag;
+          k[s][i + 3] = kStep*dy[i + 3];
+        }
+      }
+      for (Int_t i=0; i<6; i++){
+        Double_t d = (k[0][i] + 2*k[1][i] + 2*k[2][i] + k[3][i])/6.;
+        if (i < 3) pos[i] += d;
+        else p[i - 3] += d;
+      }
+    }
+  }
+}
+//__________________________________________________________________
+//the same points in random order, as seen by unrelated lookups
+static void Shuffle(const BenchPoints& in, BenchPoints& out, UInt_t seed)
+{
+  out = in;
+  out.name = in.name + "_shuffled";
+  for (size_t i=out.x.size(); i>1; i--){
+    size_t j = (size_t)(Uniform(seed)*i);
+    swap(out.x[i-1], out.x[j]);
+    swap(out.y[i-1], out.y[j]);
+    swap(out.z[i-1], out.z[j]);
+  }
+}
+//__________________________________________________________________
+static void Evaluate(const SoLIDFieldMap* map, const BenchPoints& pts, vector<Double_t>& b)
+{
+  size_t n = pts.x.size();
+  b.resize(3*n);
+  for (size_t i=0; i<n; i++) map->GetBField(pts.x[i], pts.y[i], pts.z[i], &b[3*i]);
+}
+//__________________________________________________________________
+//backends: 0 map, 1 cursor, 2 batched call
+static BenchResult Measure(const string& backend, Int_t mode, SoLIDFieldMap* map,
+                           const BenchPoints& pts, const vector<Double_t>& ref)
+{
+  size_t n = pts.x.size();
+  vector<Double_t> b(3*n), bx(n), by(n), bz(n);
+  SoLIDFieldCursor cursor(map);
+  Double_t best = 1e30;
+  for (Int_t rep=0; rep<kNRepeat; rep++){
+    Double_t t0 = Now();
+    if (mode == 2){
+      map->GetBField((Int_t)n, &pts.x[0], &pts.y[0], &pts.z[0], &bx[0], &by[0], &bz[0]);
+    }else if (mode == 1){
+      for (size_t i=0; i<n; i++) cursor.GetBField(pts.x[i], pts.y[i], pts.z[i], &b[3*i]);
+    }else{
+      for (size_t i=0; i<n; i++) map->GetBField(pts.x[i], pts.y[i], pts.z[i], &b[3*i]);
+    }
+    Double_t dt = (Now() - t0)/n;
+    if (dt < best) best = dt;
+  }
+  if (mode == 2){
+    for (size_t i=0; i<n; i++){
+      b[3*i] = bx[i];
+      b[3*i + 1] = by[i];
+      b[3*i + 2] = bz[i];
+    }
+  }
+
+  BenchResult res;
+  res.backend   = backend;
+  res.points    = pts.name;
+  res.nsPerCall = best;
+  Double_t sum2 = 0.;
+  res.max = 0.;
+  for (size_t i=0; i<n; i++){
+    Double_t d2 = 0.;
+    for (Int_t c=0; c<3; c++) d2 += (b[3*i + c] - ref[3*i + c])*(b[3*i + c] - ref[3*i + c]);
+    sum2 += d2;
+    if (sqrt(d2) > res.max) res.max = sqrt(d2);
+  }
+  res.rms = (n > 0) ? sqrt(sum2/n) : 0.;
+  return res;
+}
+//__________________________________________________________________
+int main(int argc, char** argv)
+{
+  const char* mapfile  = (argc > 1) ? argv[1] : SoLIDFieldMap::kTextFile;
+  const char* reffile  = (argc > 2) ? argv[2] : mapfile;
+  const char* jsonfile = (argc > 3) ? argv[3] : "fieldmapbench.json";
+
+  SoLIDFieldMap* map = SoLIDFieldMap::GetInstance(mapfile, 1.);
+  SoLIDFieldMap* ref = SoLIDFieldMap::GetInstance(reffile, 1.);
+  if (map == NULL || ref == NULL) return 1;
+
+  //sample points, traced with the bilinear field of the map
+  map->SetStorage(SoLIDFieldMap::kSplitDouble);
+  map->SetInterpolation(SoLIDFieldMap::kBilinear);
+  vector<BenchPoints> sets(4);
+  sets[0].name = "sidis";
+  MakeTrackPoints(map, sets[0], 12345, -3.5, 0.4, 0.1, 0.5, 1., 7., 1.0);
+  sets[1].name = "pvdis";
+  MakeTrackPoints(map, sets[1], 54321, 0.1, 0.4, 0.35, 0.6, 2., 6., 3.2);
+  Shuffle(sets[0], sets[2], 777);
+  Shuffle(sets[1], sets[3], 778);
+
+  //reference values, computed first since ref may be the same map object
+  ref->SetInterpolation(SoLIDFieldMap::kHermite);
+  vector< vector<Double_t> > refB(sets.size());
+  for (size_t s=0; s<sets.size(); s++) Evaluate(ref, sets[s], refB[s]);
+  ref->SetInterpolation(SoLIDFieldMap::kBilinear);
+
+  //the Chebyshev backend only if its coefficient file is there
+  map->SetInterpolation(SoLIDFieldMap::kChebyshev);
+  Bool_t hasChebyshev = (map->GetInterpolation() == SoLIDFieldMap::kChebyshev);
+  map->SetInterpolation(SoLIDFieldMap::kBilinear);
+
+  vector<BenchResult> results;
+  for (size_t s=0; s<sets.size(); s++){
+    const BenchPoints& pts = sets[s];
+    //a 3D map has a single (trilinear) interpolation
+    if (map->Is3D()){
+      results.push_back(Measure("trilinear_3d", 0, map, pts, refB[s]));
+      results.push_back(Measure("trilinear_3d_batched", 2, map, pts, refB[s]));
+      continue;
+    }
+    map->SetStorage(SoLIDFieldMap::kSplitDouble);
+    map->SetInterpolation(SoLIDFieldMap::kBilinear);
+    results.push_back(Measure("bilinear_double", 0, map, pts, refB[s]));
+    results.push_back(Measure("bilinear_double_cursor", 1, map, pts, refB[s]));
+    results.push_back(Measure("bilinear_double_batched", 2, map, pts, refB[s]));
+    map->SetStorage(SoLIDFieldMap::kInterleavedFloat);
+    results.push_back(Measure("bilinear_float", 0, map, pts, refB[s]));
+    map->SetStorage(SoLIDFieldMap::kSplitDouble);
+    map->SetInterpolation(SoLIDFieldMap::kHermite);
+    results.push_back(Measure("hermite", 0, map, pts, refB[s]));
+    if (hasChebyshev){
+      map->SetInterpolation(SoLIDFieldMap::kChebyshev);
+      results.push_back(Measure("chebyshev", 0, map, pts, refB[s]));
+    }
+    map->SetInterpolation(SoLIDFieldMap::kBilinear);
+  }
+
+  printf("%-26s %-16s %10s %12s %12s\n", "backend", "points", "ns/call", "rms dB (kG)", "max dB (kG)");
+  for (size_t i=0; i<results.size(); i++){
+    const BenchResult& r = results[i];
+    printf("%-26s %-16s %10.2f %12.3e %12.3e\n", r.backend.c_str(), r.points.c_str(),
+           r.nsPerCall, r.rms, r.max);
+  }
+
+  ofstream out(jsonfile);
+  if (!out.is_open()){
+    cerr<<"fieldmapbench: cannot create "<<jsonfile<<endl;
+    return 1;
+  }
+  char line[512];
+  out<<"{\n";
+  out<<"  \"map\": \""<<map->GetName()<<"\",\n";
+  snprintf(line, sizeof(line), "  \"grid\": { \"nz\": %d, \"nr\": %d, \"zmin_cm\": %g, \"zstep_cm\": %g, \"rstep_cm\": %g },\n",
+           map->GetNZ(), map->GetNR(), map->GetZMin(), map->GetZStep(), map->GetRStep());
+  out<<line;
+  out<<"  \"reference\": \"hermite:"<<ref->GetName()<<"\",\n";
+#ifdef __AVX2__
+  out<<"  \"avx2\": true,\n";
+#else
+  out<<"  \"avx2\": false,\n";
+#endif
+  out<<"  \"points\": {";
+  for (size_t s=0; s<sets.size(); s++)
+    out<<(s ? ", " : " ")<<"\""<<sets[s].name<<"\": "<<sets[s].x.size();
+  out<<" },\n";
+  out<<"  \"results\": [\n";
+  for (size_t i=0; i<results.size(); i++){
+    const BenchResult& r = results[i];
+    snprintf(line, sizeof(line),
+             "    { \"backend\": \"%s\", \"points\": \"%s\", \"ns_per_call\": %.3f, \"rms_dB_kG\": %.4e, \"max_dB_kG\": %.4e }%s\n",
+             r.backend.c_str(), r.points.c_str(), r.nsPerCall, r.rms, r.max,
+             (i + 1 < results.size()) ? "," : "");
+    out<<line;
+  }
+  out<<"  ]\n}\n";
+  out.close();
+  cout<<"results written to "<<jsonfile<<endl;
+  return 0;
+}
@@ -0,0 +1,35 @@
+//*************************************************//
+//one-time converter from the CLEO text field map  //
+//to the binary format that SoLIDFieldMap maps     //
+//directly into memory                             //
+//                                                 //
+//usage: fieldmapconvert [text map] [binary map]   //
+//   or: fieldmapconvert -3d symmetry text binary  //
+//       for a 3D Cartesian map, see SoLIDField3D  //
+//*************************************************//
+//c++
+#include <iostream>
+#include <cstring>
+//SoLIDTracking
+#include "SoLIDFieldMap.h"
+#include "SoLIDField3D.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  if (argc > 1 && strcmp(argv[1], "-3d") == 0){
+    if (argc < 5){
+      cerr<<"usage: "<<argv[0]<<" -3d symmetry textmap binarymap"<<endl;
+      return 1;
+    }
+    cout<<"converting 3D map "<<argv[3]<<" to "<<argv[4]<<", symmetry "<<argv[2]<<endl;
+    return SoLIDField3D::ConvertTextToBinary(argv[3], argv[4], argv[2]);
+  }
+
+  const char* textfile = (argc > 1) ? argv[1] : SoLIDFieldMap::kTextFile;
+  const char* binfile  = (argc > 2) ? argv[2] : SoLIDFieldMap::kBinaryFile;
+
+  cout<<"converting "<<textfile<<" to "<<binfile<<endl;
+  return SoLIDFieldMap::ConvertTextToBinary(textfile, binfile);
+}
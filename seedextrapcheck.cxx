@@ -0,0 +1,139 @@
+//*************************************************//
+//regression check of the seed extrapolator        //
+//(SoLKalFieldStepper::ExtrapolateSeeds). Seeds    //
+//like the SIDIS ones, from the last GEM planes    //
+//over the momentum and angle range of the         //
+//acceptance, are extrapolated to every plane and  //
+//compared to PropagationClassicalRK4 with a 1 cm  //
+//step. The check fails (exit code 1) if the       //
+//largest distance at a plane exceeds twice the    //
+//seed tolerance, or if the scalar and the batch   //
+//versions do not agree                            //
+//                                                 //
+//usage: seedextrapcheck [options] [z1 z2 ...]     //
+//       -m map     field map (default kTextFile)  //
+//       -s scale   field scale factor (1)         //
+//       -t tol     seed tolerance in m (stepper   //
+//                  default)                       //
+//       -n seeds   number of seeds (2000)         //
+//       planes in m, default the forward ECal     //
+//       (4.15) and the target center (-3.5)       //
+//*************************************************//
+//c++
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+//ROOT
+#include "TVector3.h"
+#include "TRandom3.h"
+//SoLIDTracking
+#include "SoLIDFieldMap.h"
+#include "SoLKalFieldStepper.h"
+
+using namespace std;
+
+static const Double_t kStepRef   = 0.01;   // m, step of the reference propagation
+static const Double_t kMaxFactor = 2.;     // largest distance allowed, in seed tolerances
+static const Double_t kScalarTol = 1.e-9;  // m, scalar against batch
+
+int main(int argc, char** argv)
+{
+  const char* mapfile = SoLIDFieldMap::kTextFile;
+  Double_t scale = 1., tol = -1.;
+  Int_t    nSeed = 2000;
+  vector<Double_t> planes;
+
+  for (Int_t i=1; i<argc; i++){
+    const char* opt = argv[i];
+    if (strcmp(opt, "-m") == 0 && i+1 < argc) mapfile = argv[++i];
+    else if (strcmp(opt, "-s") == 0 && i+1 < argc) scale = atof(argv[++i]);
+    else if (strcmp(opt, "-t") == 0 && i+1 < argc) tol = atof(argv[++i]);
+    else if (strcmp(opt, "-n") == 0 && i+1 < argc) nSeed = atoi(argv[++i]);
+    else if (opt[0] == '-' && (opt[1] < '0' || opt[1] > '9') && opt[1] != '.'){
+      cerr<<"usage: "<<argv[0]<<" [-m map] [-s scale] [-t tol] [-n seeds] [z1 z2 ...]"<<endl;
+      return 1;
+    }
+    else planes.push_back(atof(opt));
+  }
+  if (planes.empty()){
+    planes.push_back(4.15);
+    planes.push_back(-3.5);
+  }
+  if (nSeed <= 0){
+    cerr<<"no seeds to check"<<endl;
+    return 1;
+  }
+
+  SoLIDFieldMap* map = SoLIDFieldMap::GetInstance(mapfile, scale);
+  if (map == NULL){
+    cerr<<"cannot load field map "<<mapfile<<endl;
+    return 1;
+  }
+  SoLKalFieldStepper* stepper = SoLKalFieldStepper::GetInstance();
+  stepper->SetFieldMap(map);
+  if (tol > 0.) stepper->SetSeedTolerance(tol);
+  tol = stepper->GetSeedTolerance();
+
+  //seeds at the last GEM planes: radius, azimuth, polar angle and momentum
+  //of the SIDIS acceptance, both charges. Fixed random seed, so that every
+  //run checks the same tracks
+  TRandom3 rnd(4357);
+  vector<TVector3> pos(nSeed), mom(nSeed);
+  vector<Double_t> charge(nSeed);
+  SoLKalSeedBatch batch;
+  for (Int_t i=0; i<nSeed; i++){
+    Double_t r     = rnd.Uniform(0.5, 1.1);
+    Double_t phi   = rnd.Uniform(0., 2.*TMath::Pi());
+    Double_t theta = rnd.Uniform(0.1, 0.3);
+    Double_t p     = rnd.Uniform(0.8, 6.8);
+    Double_t phiP  = phi + rnd.Uniform(-0.15, 0.15);
+    pos[i].SetXYZ(r*cos(phi), r*sin(phi), rnd.Uniform(1.6, 1.9));
+    mom[i].SetXYZ(p*sin(theta)*cos(phiP), p*sin(theta)*sin(phiP), p*cos(theta));
+    charge[i] = (rnd.Uniform() < 0.5) ? -1. : 1.;
+    batch.Add(pos[i], mom[i], charge[i]);
+  }
+
+  SoLKalStepperContext ctx;
+  stepper->InitContext(ctx);
+  Bool_t ok = kTRUE;
+  printf("seed tolerance %.2e m, %d seeds, failing above %.2e m\n", tol, nSeed, kMaxFactor*tol);
+  printf("%8s %12s %12s %12s %12s\n", "z (m)", "mean (m)", "max (m)", "scalar (m)", "lookups");
+  for (UInt_t k=0; k<planes.size(); k++){
+    Double_t toZ = planes[k];
+    ctx.fNFieldCall = 0;
+    stepper->ExtrapolateSeeds(ctx, batch, toZ);
+    Double_t lookups = (Double_t)ctx.fNFieldCall/nSeed;
+
+    Double_t sum = 0., dMax = 0., sMax = 0.;
+    for (Int_t i=0; i<nSeed; i++){
+      TVector3 finalPos, finalMom, refPos, refMom, scalarPos, scalarMom;
+      batch.GetFinal(i, finalPos, finalMom);
+
+      Double_t z = toZ, step = kStepRef;
+      stepper->PropagationClassicalRK4(ctx, mom[i], pos[i], z, charge[i], step, refMom, refPos);
+      Double_t d = (finalPos - refPos).Perp();
+      sum += d;
+      if (d > dMax) dMax = d;
+
+      stepper->ExtrapolateSeed(ctx, pos[i], mom[i], charge[i], toZ, scalarPos, scalarMom);
+      Double_t s = (scalarPos - finalPos).Mag();
+      if (s > sMax) sMax = s;
+    }
+    printf("%8.3f %12.3e %12.3e %12.3e %12.1f\n", toZ, sum/nSeed, dMax, sMax, lookups);
+
+    if (dMax > kMaxFactor*tol){
+      cerr<<"FAILED: seeds to z = "<<toZ<<" m are off by up to "<<dMax<<" m"<<endl;
+      ok = kFALSE;
+    }
+    if (sMax > kScalarTol){
+      cerr<<"FAILED: scalar and batch extrapolation to z = "<<toZ<<" m differ by up to "
+          <<sMax<<" m"<<endl;
+      ok = kFALSE;
+    }
+  }
+  cout<<(ok ? "seed extrapolation check passed" : "seed extrapolation check FAILED")<<endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+//*************************************************//
+//offline generation of the plane to plane         //
+//transport table, see SoLKalTransportTable. The   //
+//transports between consecutive planes (both      //
+//directions) are computed with the fine step      //
+//Runge-Kutta stepper through the given field map  //
+//on a grid of r (m), radial and azimuthal slope   //
+//and q/p (1/GeV); the largest cell error of every //
+//segment is printed                               //
+//                                                 //
+//usage: transporttablegen [options] table z1 z2.. //
+//       -m map     field map (default kTextFile)  //
+//       -s scale   field scale factor (1)         //
+//       -r min max n   r grid (0.2 1.4 25)        //
+//       -t min max n   radial slope (0 1 21)      //
+//       -p min max n   azimuthal slope (-0.4 0.4  //
+//                      17)                        //
+//       -q max n   q/p grid -max..max (1.5 31)    //
+//       -dp        Dormand-Prince steps           //
+//*************************************************//
+//c++
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+//SoLIDTracking
+#include "SoLIDFieldMap.h"
+#include "SoLKalFieldStepper.h"
+#include "SoLKalTransportTable.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  const char* mapfile = SoLIDFieldMap::kTextFile;
+  Double_t scale  = 1.;
+  Double_t min[4] = { 0.2, 0.0, -0.4, -1.5 };
+  Double_t max[4] = { 1.4, 1.0,  0.4,  1.5 };
+  Int_t    n[4]   = { 25,  21,   17,   31  };
+  Bool_t   dp     = kFALSE;
+  const char* table = NULL;
+  vector<Double_t> planes;
+
+  for (Int_t i=1; i<argc; i++){
+    const char* axes = "rtp";
+    const char* opt  = argv[i];
+    if (strcmp(opt, "-m") == 0 && i+1 < argc) mapfile = argv[++i];
+    else if (strcmp(opt, "-s") == 0 && i+1 < argc) scale = atof(argv[++i]);
+    else if (strcmp(opt, "-dp") == 0) dp = kTRUE;
+    else if (strcmp(opt, "-q") == 0 && i+2 < argc){
+      max[3] = atof(argv[++i]);
+      min[3] = -max[3];
+      n[3]   = atoi(argv[++i]);
+    }
+    else if (opt[0] == '-' && opt[1] != '\0' && opt[2] == '\0' && strchr(axes, opt[1]) && i+3 < argc){
+      Int_t a = strchr(axes, opt[1]) - axes;
+      min[a] = atof(argv[++i]);
+      max[a] = atof(argv[++i]);
+      n[a]   = atoi(argv[++i]);
+    }
+    else if (table == NULL) table = opt;
+    else planes.push_back(atof(opt));
+  }
+  Bool_t ok = table != NULL && planes.size() >= 2;
+  for (Int_t a=0; a<4; a++) ok = ok && n[a] >= 2 && max[a] > min[a];
+  if (!ok){
+    cerr<<"usage: "<<argv[0]<<" [-m map] [-s scale] [-r|-t|-p min max n] [-q max n] [-dp]"
+        <<" table z1 z2 ..."<<endl;
+    return 1;
+  }
+
+  SoLIDFieldMap* map = SoLIDFieldMap::GetInstance(mapfile, scale);
+  if (map == NULL){
+    cerr<<"cannot load field map "<<mapfile<<endl;
+    return 1;
+  }
+  SoLKalFieldStepper* stepper = SoLKalFieldStepper::GetInstance();
+  stepper->SetFieldMap(map);
+  if (dp) stepper->SetRKMethod(SoLKalFieldStepper::kDormandPrince);
+
+  cout<<"generating "<<table<<" for "<<planes.size()<<" planes, "
+      <<n[0]*n[1]*n[2]*n[3]<<" nodes per segment"<<endl;
+  return SoLKalTransportTable::Generate(table, planes, min, max, n);
+}